@@ -64,7 +64,7 @@
 #define configTICK_RATE_HZ                       ((TickType_t)1000)
 #define configMAX_PRIORITIES                     ( 56 )
 #define configMINIMAL_STACK_SIZE                 ((uint16_t)128)
-#define configTOTAL_HEAP_SIZE                    ((size_t)30720)
+#define configTOTAL_HEAP_SIZE                    ((size_t)65536)  /* 任务栈约26KB(含Main_Task),加上TCB、队列、定时器,留出余量 */
 #define configMAX_TASK_NAME_LEN                  ( 16 )
 #define configUSE_TRACE_FACILITY                 1
 #define configUSE_16_BIT_TICKS                   0
@@ -153,6 +153,13 @@ standard names. */
 
 /* USER CODE BEGIN Defines */
 /* Section where parameter definitions can be added (for instance, to override default ones in FreeRTOS.h) */
+/* 任务运行时间统计,调试shell的ps命令使用,计数器为日志模块的微秒时间戳(TIM6),约71分钟回绕 */
+#define configGENERATE_RUN_TIME_STATS            1
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()         LOG_GetTimeUs()
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+  extern uint32_t LOG_GetTimeUs(void);
+#endif
 /* USER CODE END Defines */
 
 /* Time is measured in 'ticks' - which is the number of times the tick interrupt
@@ -34,11 +34,19 @@
 #include "ov2640.h"
 #include "beep.h"
 #include "sg90.h"
+#include "auth.h"
+#include "audit.h"
+#include "bio.h"
 #include "nfc.h"
 #include "delay.h"
 #include "ble.h"
 #include "sdcard.h"
 #include "fatfs.h"
+#include "log.h"
+#include "rtc.h"
+#include "fstore.h"
+#include "cred.h"
+#include "shell.h"
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
@@ -93,6 +101,10 @@ int main(void)
 static void Main_Task(void *argument)
 {
     UART_Init();
+    LOG_Init();
+    RTC_Init();//备份寄存器,保存了各模块协商好的波特率等
+    SG90_RestoreState();//门锁状态在备份寄存器中,复位后最先恢复,不转动舵机
+    SHELL_Init();//调试shell,USART1接收命令
     printf("System starting, performing initialization in Main_Task...\r\n");
     
     /* 初始化基本延时函数 */
@@ -103,7 +115,9 @@ static void Main_Task(void *argument)
     LCD_Init();
     LCD_SHOW();
     
-    KEY_Init();//锁密码也在里面读出
+    FSTORE_Init();//Flash记录存储,凭据库保存在这里
+    CRED_Init();//凭据库:用户、密码、NFC卡、指纹/人脸ID
+    KEY_Init();
     BEEP_Init();
     SG90_Init();
     FP_Init();
@@ -133,6 +147,15 @@ static void Main_Task(void *argument)
 
     LedTask_Create();
 
+    /* 创建审计日志任务,在授权任务之前 */
+    AUDIT_CreateTask();
+
+    /* 创建开锁授权任务,在各开锁方式的任务之前 */
+    AUTH_CreateTask();
+
+    /* 人脸和指纹识别协调,在指纹、人脸任务之前 */
+    BIO_Init();
+
     /* 创建蓝牙任务 */
     BLE_CreateTask();
     /* 创建键盘任务 */
@@ -152,6 +175,9 @@ static void Main_Task(void *argument)
 
     /* 创建人脸识别任务 */
     FACE_CreateTask();
+
+    /* 创建调试shell任务 */
+    SHELL_CreateTask();
     
     printf("All initializations and task creations completed.\r\n");
     
@@ -25,6 +25,7 @@
 #include "fingerprint.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "log.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -88,6 +89,9 @@ void print_fault_info(void)
   // 获取当前堆栈指针(MSP或PSP)
   uint32_t current_sp;
 
+  // 停止日志DMA并发完缓冲区中的记录,之后printf改为轮询发送
+  LOG_Panic();
+
   if(__get_CONTROL() & 0x02) {
     current_sp = __get_PSP();  // 如果使用PSP
     printf("\r\n=== Using PSP: 0x%08X ===\r\n", current_sp);
@@ -19,6 +19,7 @@
 #include "fatfs.h"
 #include "string.h"
 #include "stdio.h"
+#include "rtc.h"
 
 /* 私有变量 */
 FATFS SDFatFS;             /* 文件系统对象 */
@@ -280,7 +281,17 @@ FRESULT FATFS_GetDiskInfo(void)
 DWORD get_fattime(void)
 {
   /* USER CODE BEGIN get_fattime */
-  return 0;
+  RTC_DateTime_t dt;
+  uint32_t now = RTC_GetTime();
+
+  /* 日历没有设置时返回0,文件不带时间 */
+  if (now == 0)
+  {
+    return 0;
+  }
+  RTC_UnixToDate(now, &dt);
+  return ((DWORD)(dt.year - 1980) << 25) | ((DWORD)dt.month << 21) | ((DWORD)dt.day << 16) |
+         ((DWORD)dt.hour << 11) | ((DWORD)dt.minute << 5) | ((DWORD)dt.second >> 1);
   /* USER CODE END get_fattime */
 }
 
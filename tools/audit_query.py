@@ -0,0 +1,290 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+audit_query.py - 解码和查询SD卡上的开锁审计日志(对应 user/audit.c)
+
+用法:
+    python tools/audit_query.py E:/AUDIT                          列出全部记录
+    python tools/audit_query.py E:/AUDIT --day yesterday          昨天的记录(本地时间)
+    python tools/audit_query.py E:/AUDIT --since "2024-05-01 08:00" --until "2024-05-01 18:00"
+    python tools/audit_query.py E:/AUDIT --since 1714521600 --source nfc --event fail
+    python tools/audit_query.py E:/AUDIT --verify                 全部扫描,检查CRC、序号、索引
+
+目录是SD卡上的AUDIT目录(或拷贝)。记录文件Annnnnnn.LOG每个扇区16条32字节记录,
+Annnnnnn.IDX每个LOG扇区一项(扇区第一条记录的单调时间、序号),格式见 user/audit.h。
+按时间查询时先对各分段的第一项、再对分段内的索引二分查找,只读需要的扇区。
+时间是设备RTC的UTC时间,输入输出按本地时间,加 --utc 按UTC。
+"""
+import argparse
+import bisect
+import datetime
+import os
+import re
+import struct
+import sys
+import time
+import zlib
+
+SECTOR = 512
+REC = struct.Struct('<IIIIIBBhII')
+IDX = struct.Struct('<II')
+REC_PER_SECTOR = SECTOR // REC.size
+EMPTY = 0xFFFFFFFF
+SOURCES = ['key', 'ble', 'nfc', 'fp', 'face', 'phone']
+EVENTS = ['unlock', 'fail', 'lockout', 'denied', 'mfa']
+NAME_RE = re.compile(r'^A(\d{7})\.LOG$', re.I)
+
+
+class Record(object):
+    __slots__ = ('seq', 'time', 'uptime_ms', 'snapshot', 'latency_us', 'source', 'result', 'user', 'crc_ok')
+
+    def __init__(self, raw):
+        (self.seq, self.time, self.uptime_ms, self.snapshot, self.latency_us,
+         self.source, self.result, self.user, _, crc) = REC.unpack(raw)
+        self.crc_ok = self.seq != EMPTY and crc == zlib.crc32(raw[:REC.size - 4]) & 0xFFFFFFFF
+
+
+class Segment(object):
+    """一个分段:LOG文件和对应的时间索引"""
+
+    def __init__(self, directory, number, name):
+        self.number = number
+        self.log_path = os.path.join(directory, name)
+        self.idx_path = os.path.join(directory, name[:-4] + ('.IDX' if name.endswith('.LOG') else '.idx'))
+        self.sectors = os.path.getsize(self.log_path) // SECTOR
+        self._index = None
+        self.sectors_read = 0
+
+    def index(self):
+        """(单调时间, 序号)列表,每个LOG扇区一项,索引文件缺失或该项为空时为None"""
+        if self._index is None:
+            data = b''
+            if os.path.exists(self.idx_path):
+                with open(self.idx_path, 'rb') as f:
+                    data = f.read(self.sectors * IDX.size)
+            self._index = []
+            for i in range(self.sectors):
+                if (i + 1) * IDX.size <= len(data):
+                    t, seq = IDX.unpack_from(data, i * IDX.size)
+                    self._index.append(None if seq == EMPTY else (t, seq))
+                else:
+                    self._index.append(None)
+        return self._index
+
+    def first_time(self):
+        """分段第一个扇区的单调时间,只读索引文件开头"""
+        if self._index is None and os.path.exists(self.idx_path):
+            with open(self.idx_path, 'rb') as f:
+                head = f.read(IDX.size)
+            if len(head) == IDX.size:
+                t, seq = IDX.unpack(head)
+                return None if seq == EMPTY else t
+        entries = self.index()
+        return entries[0][0] if entries and entries[0] else None
+
+    def read_sectors(self, first, count):
+        """读连续的扇区,返回记录列表(跳过空槽)"""
+        with open(self.log_path, 'rb') as f:
+            f.seek(first * SECTOR)
+            data = f.read(count * SECTOR)
+        self.sectors_read += len(data) // SECTOR
+        records = []
+        for off in range(0, len(data) - REC.size + 1, REC.size):
+            raw = data[off:off + REC.size]
+            if raw == b'\xff' * REC.size:
+                continue
+            records.append(Record(raw))
+        return records
+
+    def time_range(self, since, until):
+        """按索引找出可能包含[since, until]的扇区范围[first, last)
+
+        扇区i中记录的单调时间在[t[i], t[i+1]]之间,没有索引项的扇区保守地包含进来。
+        """
+        entries = self.index()
+        n = len(entries)
+        if n == 0:
+            return 0, 0
+        times = []
+        last = 0
+        for e in entries:
+            # 缺失的索引项用前一项代替,保持单调
+            last = e[0] if e else last
+            times.append(last)
+        first = 0
+        if since is not None:
+            first = max(0, bisect.bisect_left(times, since, 1) - 1)
+        end = n
+        if until is not None:
+            end = bisect.bisect_right(times, until)
+        return first, max(first, end)
+
+
+def load_segments(directory):
+    segs = []
+    for name in os.listdir(directory):
+        m = NAME_RE.match(name)
+        if m:
+            segs.append(Segment(directory, int(m.group(1)), name))
+    segs.sort(key=lambda s: s.number)
+    return segs
+
+
+def parse_time(text, utc):
+    """Unix秒、"YYYY-MM-DD[ HH:MM[:SS]]"、today、yesterday"""
+    text = text.strip()
+    if text.isdigit():
+        return int(text)
+    if text in ('today', 'yesterday'):
+        day = datetime.date.today()
+        if text == 'yesterday':
+            day -= datetime.timedelta(days=1)
+        text = day.isoformat()
+    for fmt in ('%Y-%m-%d %H:%M:%S', '%Y-%m-%d %H:%M', '%Y-%m-%dT%H:%M:%S', '%Y-%m-%d'):
+        try:
+            dt = datetime.datetime.strptime(text, fmt)
+        except ValueError:
+            continue
+        if utc:
+            return int((dt - datetime.datetime(1970, 1, 1)).total_seconds())
+        return int(time.mktime(dt.timetuple()))
+    raise argparse.ArgumentTypeError('bad time: %s' % text)
+
+
+def format_time(t, utc):
+    if t == 0:
+        return '-' * 19     # RTC没有设置
+    if utc:
+        return datetime.datetime.utcfromtimestamp(t).strftime('%Y-%m-%d %H:%M:%S')
+    return datetime.datetime.fromtimestamp(t).strftime('%Y-%m-%d %H:%M:%S')
+
+
+def format_record(r, utc):
+    source = SOURCES[r.source] if r.source < len(SOURCES) else str(r.source)
+    event = EVENTS[r.result] if r.result < len(EVENTS) else str(r.result)
+    user = '-' if r.user < 0 else str(r.user)
+    line = '%10u  %s  %10.3f  %-5s %-8s user %-5s %9u us' % (
+        r.seq, format_time(r.time, utc), r.uptime_ms / 1000.0, source, event, user, r.latency_us)
+    if r.snapshot:
+        line += '  snapshot %u' % r.snapshot
+    return line
+
+
+def query(segs, since, until):
+    """按时间范围返回记录,先二分查找分段,再在分段内二分查找扇区"""
+    firsts = [s.first_time() for s in segs]
+    start = 0
+    if since is not None:
+        # 下一个分段的第一项还早于since时,这个分段的记录都更早
+        known = [t if t is not None else 0 for t in firsts]
+        start = max(0, bisect.bisect_left(known, since, 1) - 1)
+    for k in range(start, len(segs)):
+        if until is not None and firsts[k] is not None and firsts[k] > until:
+            break
+        first, end = segs[k].time_range(since, until)
+        if end > first:
+            for r in segs[k].read_sectors(first, end - first):
+                if not r.crc_ok:
+                    continue
+                if since is not None and r.time < since:
+                    continue
+                if until is not None and r.time > until:
+                    continue
+                yield r
+
+
+def verify(segs):
+    """全部扫描:CRC、序号连续、索引项和扇区第一条记录一致、单调时间不减"""
+    errors = 0
+    prev_seq = None
+    mono = 0
+    total = 0
+
+    def report(msg):
+        print('ERROR: ' + msg)
+        return 1
+
+    for k, seg in enumerate(segs):
+        if k and seg.number != segs[k - 1].number + 1:
+            errors += report('segment %d missing before %d' % (segs[k - 1].number + 1, seg.number))
+        entries = seg.index()
+        for i in range(seg.sectors):
+            records = seg.read_sectors(i, 1)
+            e = entries[i]
+            if e is None:
+                errors += report('segment %d sector %d has no index entry' % (seg.number, i))
+            elif records and records[0].crc_ok:
+                if k == 0 and i == 0:
+                    mono = e[0]     # 更早的分段已经删除,单调时间从第一项开始
+                if e[1] != records[0].seq:
+                    errors += report('segment %d sector %d index seq %u, record seq %u'
+                                     % (seg.number, i, e[1], records[0].seq))
+                if e[0] < mono:
+                    errors += report('segment %d sector %d index time goes back' % (seg.number, i))
+                if e[0] != max(mono, records[0].time):
+                    errors += report('segment %d sector %d index time %u, expect %u'
+                                     % (seg.number, i, e[0], max(mono, records[0].time)))
+            last_in_file = k == len(segs) - 1 and i == seg.sectors - 1
+            if len(records) != REC_PER_SECTOR and not last_in_file:
+                errors += report('segment %d sector %d has %d records' % (seg.number, i, len(records)))
+            for r in records:
+                if not r.crc_ok:
+                    errors += report('segment %d sector %d seq %u bad crc' % (seg.number, i, r.seq))
+                    continue
+                if prev_seq is not None and r.seq != prev_seq + 1:
+                    errors += report('seq %u follows %u' % (r.seq, prev_seq))
+                prev_seq = r.seq
+                mono = max(mono, r.time)
+                total += 1
+    print('%d segments, %d records, %d errors' % (len(segs), total, errors))
+    return errors
+
+
+def main():
+    ap = argparse.ArgumentParser(description='decode / query the lock audit log')
+    ap.add_argument('dir', help='AUDIT directory on the SD card (or a copy)')
+    ap.add_argument('--since', help='start time: unix seconds, "YYYY-MM-DD[ HH:MM[:SS]]", today, yesterday')
+    ap.add_argument('--until', help='end time (inclusive), same formats')
+    ap.add_argument('--day', help='one whole day: YYYY-MM-DD, today, yesterday')
+    ap.add_argument('--source', choices=SOURCES)
+    ap.add_argument('--event', choices=EVENTS)
+    ap.add_argument('--user', type=int, help='user id, -1 for failed credentials')
+    ap.add_argument('--utc', action='store_true', help='input/output times in UTC instead of local time')
+    ap.add_argument('--verify', action='store_true', help='full scan: crc, sequence, index')
+    ap.add_argument('--stats', action='store_true', help='print how many sectors were read')
+    args = ap.parse_args()
+
+    segs = load_segments(args.dir)
+    if not segs:
+        sys.exit('no audit segments in %s' % args.dir)
+    if args.verify:
+        sys.exit(1 if verify(segs) else 0)
+
+    since = parse_time(args.since, args.utc) if args.since else None
+    until = parse_time(args.until, args.utc) if args.until else None
+    if args.day:
+        since = parse_time(args.day, args.utc)
+        until = parse_time((datetime.datetime.utcfromtimestamp(since) + datetime.timedelta(days=1)).strftime('%Y-%m-%d')
+                           if args.utc else
+                           (datetime.datetime.fromtimestamp(since) + datetime.timedelta(days=1)).strftime('%Y-%m-%d'),
+                           args.utc) - 1
+
+    count = 0
+    for r in query(segs, since, until):
+        if args.source is not None and r.source != SOURCES.index(args.source):
+            continue
+        if args.event is not None and r.result != EVENTS.index(args.event):
+            continue
+        if args.user is not None and r.user != args.user:
+            continue
+        print(format_record(r, args.utc))
+        count += 1
+    if args.stats:
+        total = sum(s.sectors for s in segs)
+        read = sum(s.sectors_read for s in segs)
+        print('%d records, read %d of %d sectors in %d segments' % (count, read, total, len(segs)),
+              file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+ble_key.py - 手机钥匙模拟器,生成蓝牙透传要发的命令(协议见 user/ble.h),
+用手机上的BLE调试App(如nRF Connect)连上门锁后,把输出的命令行发过去。
+
+    python tools/ble_key.py keygen -k phone.key     生成私钥,输出ENROLL命令
+                                                    (先在调试shell执行 cred phone <用户>)
+    python tools/ble_key.py enroll -k phone.key     再次输出ENROLL命令和钥匙ID
+    python tools/ble_key.py sign -k phone.key NONCE 对门锁回的 NONCE <32位十六进制> 签名,输出SIG命令
+
+私钥以十六进制保存在文件中,只用于测试。签名是ECDSA P-256/SHA-256,随机数k用secrets生成,
+纯Python实现,不依赖第三方库;每次签名后用公钥验证一遍。
+"""
+import argparse
+import hashlib
+import secrets
+import sys
+
+DOMAIN = b'SLKEY1'      # 与 ble.h 中 BLE_KEY_DOMAIN 一致
+NONCE_SIZE = 16         # BLE_KEY_NONCE_SIZE
+KEY_ID_SIZE = 8         # CRED_PHONE_ID_SIZE
+
+P = 0xFFFFFFFF00000001000000000000000000000000FFFFFFFFFFFFFFFFFFFFFFFF
+N = 0xFFFFFFFF00000000FFFFFFFFFFFFFFFFBCE6FAADA7179E84F3B9CAC2FC632551
+A = P - 3
+G = (0x6B17D1F2E12C4247F8BCE6E563A440F277037D812DEB33A0F4A13945D898C296,
+     0x4FE342E2FE1A7F9B8EE7EB4A7C0F9E162BCE33576B315ECECBB6406837BF51F5)
+
+
+def point_add(p1, p2):
+    """仿射坐标点加,None为无穷远点"""
+    if p1 is None:
+        return p2
+    if p2 is None:
+        return p1
+    (x1, y1), (x2, y2) = p1, p2
+    if x1 == x2:
+        if (y1 + y2) % P == 0:
+            return None
+        lam = (3 * x1 * x1 + A) * pow(2 * y1, -1, P) % P
+    else:
+        lam = (y2 - y1) * pow(x2 - x1, -1, P) % P
+    x3 = (lam * lam - x1 - x2) % P
+    return x3, (lam * (x1 - x3) - y1) % P
+
+
+def point_mul(k, pt):
+    r = None
+    while k:
+        if k & 1:
+            r = point_add(r, pt)
+        pt = point_add(pt, pt)
+        k >>= 1
+    return r
+
+
+def public_bytes(d):
+    x, y = point_mul(d, G)
+    return x.to_bytes(32, 'big') + y.to_bytes(32, 'big')
+
+
+def key_id(pub):
+    """与 CRED_PhoneId 相同:SHA-256(X|Y)的前8字节"""
+    return hashlib.sha256(pub).digest()[:KEY_ID_SIZE]
+
+
+def sign(d, digest):
+    e = int.from_bytes(digest, 'big')
+    while True:
+        k = secrets.randbelow(N - 1) + 1
+        r = point_mul(k, G)[0] % N
+        s = pow(k, -1, N) * (e + r * d) % N
+        if r and s:
+            return r, s
+
+
+def verify(pub, digest, r, s):
+    q = (int.from_bytes(pub[:32], 'big'), int.from_bytes(pub[32:], 'big'))
+    if not (0 < r < N and 0 < s < N):
+        return False
+    w = pow(s, -1, N)
+    e = int.from_bytes(digest, 'big')
+    pt = point_add(point_mul(e * w % N, G), point_mul(r * w % N, q))
+    return pt is not None and pt[0] % N == r
+
+
+def load_key(path):
+    with open(path) as f:
+        d = int(f.read().strip(), 16)
+    if not 0 < d < N:
+        sys.exit('%s: bad private key' % path)
+    return d
+
+
+def print_enroll(d):
+    pub = public_bytes(d)
+    print('ENROLL %s' % pub.hex().upper())
+    print('key id %s' % key_id(pub).hex().upper(), file=sys.stderr)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='BLE phone key simulator')
+    ap.add_argument('cmd', choices=['keygen', 'enroll', 'sign'])
+    ap.add_argument('nonce', nargs='?', help='NONCE from the lock (32 hex chars), for sign')
+    ap.add_argument('-k', '--key', required=True, help='private key file (hex)')
+    args = ap.parse_intermixed_args()
+
+    if args.cmd == 'keygen':
+        d = secrets.randbelow(N - 1) + 1
+        with open(args.key, 'w') as f:
+            f.write('%064x\n' % d)
+        print_enroll(d)
+        return 0
+    d = load_key(args.key)
+    if args.cmd == 'enroll':
+        print_enroll(d)
+        return 0
+
+    nonce = bytes.fromhex(args.nonce or '')
+    if len(nonce) != NONCE_SIZE:
+        sys.exit('nonce must be %d hex chars' % (2 * NONCE_SIZE))
+    pub = public_bytes(d)
+    digest = hashlib.sha256(DOMAIN + nonce).digest()
+    r, s = sign(d, digest)
+    if not verify(pub, digest, r, s):
+        sys.exit('self check failed')
+    print('SIG %s %064X%064X' % (key_id(pub).hex().upper(), r, s))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
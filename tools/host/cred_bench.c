@@ -0,0 +1,555 @@
+/**
+  ******************************************************************************
+  * @file    cred_bench.c
+  * @author  cyytx
+  * @brief   凭据库(user/cred.c)的主机测试和查找基准
+  *          1.建立n个用户,每个用户一个密码、一张NFC卡(UID+令牌)、一个指纹模板ID、一个人脸ID,
+  *            默认2500个用户共10000个凭据;
+  *          2.检查每种开锁方式都能查到正确的用户,错误的密码/UID/令牌/ID查不到;
+  *          3.删除一半用户再重新添加,检查索引回填后查找仍然正确;
+  *          4.统计各类型查找的平均耗时和索引的探测长度;
+  *          5.SHA-256压缩和PBKDF2每次迭代的耗时(-O2),以及CRED_PIN_BUDGET_MS内能做的迭代次数,
+  *            设备上第一次启动时按同样的方法标定(shell的cred命令查看);
+  *          6.一次性密码:RFC 6238的测试向量,默认500个用户各一个TOTP密钥,检查时间窗口、
+  *            同一个码不能用两次,统计验证一个码(扫描所有密钥)的耗时,设备上用shell的bench totp;
+  *          7.手机钥匙:OpenSSL对挑战消息签名的向量,篡改摘要、签名、公钥后必须验证失败,
+  *            登记、重复登记、删除后的查找,统计P-256验签耗时,设备上用shell的bench ecc。
+  *
+  * 用法: cred_bench [-u 用户数] [-r 计时轮数] [-t TOTP密钥数]
+  * 主机编译时凭据库容量放大(见Makefile),设备上为CRED_MAX_USERS/CRED_MAX_ENTRIES的默认值。
+  ******************************************************************************
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include "cred.h"
+#include "sha256.h"
+#include "sha1.h"
+#include "p256.h"
+#include "ble.h"
+
+#define BENCH_USERS         2500
+#define BENCH_ROUNDS        20
+#define BENCH_PER_USER      4       /* 每个用户的凭据数 */
+#define BENCH_TOTP          500     /* TOTP密钥数 */
+#define BENCH_TOTP_NOW      1700000000U     /* 验证时的时间(Unix秒) */
+
+static uint32_t users = BENCH_USERS;
+static uint32_t rounds = BENCH_ROUNDS;
+static uint32_t totp_secrets = BENCH_TOTP;
+static int failures = 0;
+static volatile int sink;           /* 防止查找结果被优化掉 */
+
+#define CHECK(cond, ...) do { if (!(cond)) { failures++; if (failures <= 10) { printf("FAIL: " __VA_ARGS__); printf("\n"); } } } while (0)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* 用户u的8位密码,各用户不同 */
+static void make_pin(uint32_t u, uint8_t *pin)
+{
+    uint32_t v = u * 7919U + 10000000U;
+    int i;
+
+    for (i = 7; i >= 0; i--)
+    {
+        pin[i] = (uint8_t)(v % 10);
+        v /= 10;
+    }
+}
+
+/* 用户u的4字节卡UID,打乱顺序模拟真实卡号 */
+static void make_uid(uint32_t u, uint8_t *uid)
+{
+    uint32_t v = (u + 1) * 2654435761U;
+
+    uid[0] = (uint8_t)(v >> 24);
+    uid[1] = (uint8_t)(v >> 16);
+    uid[2] = (uint8_t)(v >> 8);
+    uid[3] = (uint8_t)v;
+}
+
+static void make_token(uint32_t u, uint8_t *token)
+{
+    int i;
+
+    for (i = 0; i < CRED_TOKEN_SIZE; i++)
+    {
+        token[i] = (uint8_t)(u * 31 + i * 17 + 5);
+    }
+}
+
+static void add_user(uint32_t u)
+{
+    uint8_t pin[8], uid[4], token[CRED_TOKEN_SIZE];
+    char name[CRED_NAME_SIZE];
+
+    make_pin(u, pin);
+    make_uid(u, uid);
+    make_token(u, token);
+    snprintf(name, sizeof(name), "user%u", u);
+    CHECK(CRED_AddUser((uint16_t)u, name, 0) == 0, "add user %u", u);
+    CHECK(CRED_SetPin((uint16_t)u, pin, sizeof(pin)) == 0, "set pin %u", u);
+    CHECK(CRED_Add(CRED_TYPE_NFC_UID, (uint16_t)u, uid, sizeof(uid), token) == 0, "add nfc %u", u);
+    CHECK(CRED_AddId(CRED_TYPE_FP, (uint16_t)u, (uint16_t)(u + 1)) == 0, "add fp %u", u);
+    CHECK(CRED_AddId(CRED_TYPE_FACE, (uint16_t)u, (uint16_t)(u + 1000)) == 0, "add face %u", u);
+}
+
+/* 检查用户u的所有凭据,present为0时应该都查不到 */
+static void verify_user(uint32_t u, int present)
+{
+    uint8_t pin[8], uid[4], token[CRED_TOKEN_SIZE];
+    int expect = present ? (int)u : CRED_NONE;
+
+    make_pin(u, pin);
+    make_uid(u, uid);
+    make_token(u, token);
+    CHECK(CRED_MatchPin(pin, sizeof(pin)) == expect, "pin of user %u", u);
+    CHECK(CRED_MatchNfc(uid, sizeof(uid), token) == expect, "nfc of user %u", u);
+    CHECK(CRED_Find(CRED_TYPE_FP, (const uint8_t[]){(uint8_t)((u + 1) >> 8), (uint8_t)(u + 1)}, 2, NULL) == expect,
+          "fp of user %u", u);
+    CHECK(CRED_Find(CRED_TYPE_FACE, (const uint8_t[]){(uint8_t)((u + 1000) >> 8), (uint8_t)(u + 1000)}, 2, NULL) == expect,
+          "face of user %u", u);
+    if (present)
+    {
+        // 令牌不对的卡不能开锁
+        token[0] ^= 0x01;
+        CHECK(CRED_MatchNfc(uid, sizeof(uid), token) == CRED_NONE, "bad token of user %u", u);
+    }
+}
+
+static void report_stats(const char *label)
+{
+    CRED_Stats_t st;
+
+    CRED_GetStats(&st);
+    printf("%-10s users %u entries %u (pin %u nfc %u fp %u face %u) load %.2f probe avg %.2f max %u\n",
+           label, st.users, st.entries, st.by_type[CRED_TYPE_PIN], st.by_type[CRED_TYPE_NFC_UID],
+           st.by_type[CRED_TYPE_FP], st.by_type[CRED_TYPE_FACE], (double)st.entries / CRED_INDEX_SIZE,
+           st.entries ? (double)st.total_probe / st.entries : 0.0, st.max_probe);
+}
+
+/* 每种查找计时rounds轮,每轮查所有用户 */
+static void bench(void)
+{
+    static const char *const names[] = {"pin", "nfc", "fp", "face", "miss", "nfckey"};
+    uint8_t pin[8], uid[4], token[CRED_TOKEN_SIZE], key[CRED_NFC_KEY_SIZE];
+    CRED_Entry_t e;
+    uint64_t t0, ns;
+    uint32_t r, u;
+    int kind, acc = 0;
+
+    printf("%-6s %10s %10s\n", "lookup", "count", "ns/lookup");
+    for (kind = 0; kind < 6; kind++)
+    {
+        t0 = now_ns();
+        for (r = 0; r < rounds; r++)
+        {
+            for (u = 0; u < users; u++)
+            {
+                switch (kind)
+                {
+                    case 0:
+                        make_pin(u, pin);
+                        acc += CRED_MatchPin(pin, sizeof(pin));
+                        break;
+                    case 1:
+                        make_uid(u, uid);
+                        make_token(u, token);
+                        acc += CRED_MatchNfc(uid, sizeof(uid), token);
+                        break;
+                    case 2:
+                        acc += CRED_MatchId(CRED_TYPE_FP, (uint16_t)(u + 1));
+                        break;
+                    case 3:
+                        acc += CRED_MatchId(CRED_TYPE_FACE, (uint16_t)(u + 1000));
+                        break;
+                    case 5:
+                        // NFC任务射频认证前的部分:按UID查凭据,计算该卡的扇区密钥
+                        make_uid(u, uid);
+                        acc += CRED_Find(CRED_TYPE_NFC_UID, uid, sizeof(uid), &e);
+                        CRED_NfcKey(uid, sizeof(uid), 1, key);
+                        acc += key[0];
+                        break;
+                    default:
+                        // 没登记的卡:先查UID再查令牌,两次都不命中
+                        make_uid(u + users, uid);
+                        make_token(u + users, token);
+                        acc += CRED_MatchNfc(uid, sizeof(uid), token);
+                        break;
+                }
+            }
+        }
+        ns = now_ns() - t0;
+        printf("%-6s %10u %10.1f\n", names[kind], rounds * users, (double)ns / ((double)rounds * users));
+    }
+    sink = acc;
+}
+
+/* 密码派生的计算量:单块SHA-256,PBKDF2每次迭代 */
+static void bench_kdf(void)
+{
+    static const uint8_t pin[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint8_t salt[CRED_PIN_SALT_SIZE] = {0};
+    uint8_t dk[CRED_PIN_DK_SIZE];
+    uint64_t t0, block_ns, iter_ns;
+    uint32_t i, n = 20000;
+
+    t0 = now_ns();
+    for (i = 0; i < n; i++)
+    {
+        SHA256(dk, 55, dk);     // 55字节补位后正好一块
+    }
+    block_ns = (now_ns() - t0) / n;
+    t0 = now_ns();
+    PBKDF2_SHA256(pin, sizeof(pin), salt, sizeof(salt), n, dk, sizeof(dk));
+    iter_ns = (now_ns() - t0) / n;
+    sink = dk[0];
+    printf("sha256 block %llu ns, pbkdf2 %llu ns/iteration, %llu iterations in %u ms\n",
+           (unsigned long long)block_ns, (unsigned long long)iter_ns,
+           (unsigned long long)(CRED_PIN_BUDGET_MS * 1000000ULL / (iter_ns ? iter_ns : 1)), CRED_PIN_BUDGET_MS);
+}
+
+/* 用户u的TOTP密钥,各用户不同 */
+static void make_secret(uint32_t u, uint8_t *secret)
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+
+    SHA256(&u, sizeof(u), digest);
+    memcpy(secret, digest, CRED_TOTP_SECRET_SIZE);
+}
+
+/* 用户u在时间步step的6位码 */
+static uint32_t totp_code(uint32_t u, uint32_t step)
+{
+    HMAC_SHA1_Key_t hk;
+    uint8_t secret[CRED_TOTP_SECRET_SIZE];
+
+    make_secret(u, secret);
+    HMAC_SHA1_Init(&hk, secret, sizeof(secret));
+    return HOTP_Value(&hk, step) % 1000000U;
+}
+
+static void totp_digits(uint32_t code, uint8_t *digits)
+{
+    int i;
+
+    for (i = CRED_TOTP_DIGITS - 1; i >= 0; i--)
+    {
+        digits[i] = (uint8_t)(code % 10);
+        code /= 10;
+    }
+}
+
+/* 其他用户在step前后的时间步中有没有同样的码,有的话凭据库会拒绝(不知道是谁) */
+static int totp_ambiguous(uint32_t u, uint32_t code, uint32_t step)
+{
+    uint32_t v, s;
+
+    for (v = 0; v < totp_secrets; v++)
+    {
+        for (s = step - CRED_TOTP_WINDOW; v != u && s <= step + CRED_TOTP_WINDOW; s++)
+        {
+            if (totp_code(v, s) == code)
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* 一次性密码:测试向量、时间窗口、防重放和扫描所有密钥的耗时 */
+static void bench_totp(void)
+{
+    /* RFC 6238附录B,SHA1,8位 */
+    static const struct { uint64_t t; uint32_t code; } vec[] = {
+        {59, 94287082}, {1111111109, 7081804}, {1111111111, 14050471},
+        {1234567890, 89005924}, {2000000000, 69279037}, {20000000000ULL, 65353130},
+    };
+    HMAC_SHA1_Key_t hk;
+    uint8_t secret[CRED_TOTP_SECRET_SIZE], digits[CRED_TOTP_DIGITS];
+    uint32_t step = BENCH_TOTP_NOW / CRED_TOTP_STEP, u, i, code, ambiguous = 0, n = 20000;
+    uint64_t t0, block_ns, hit_ns, miss_ns;
+    int acc = 0;
+
+    HMAC_SHA1_Init(&hk, "12345678901234567890", 20);
+    for (i = 0; i < sizeof(vec) / sizeof(vec[0]); i++)
+    {
+        CHECK(HOTP_Value(&hk, vec[i].t / 30) % 100000000U == vec[i].code, "rfc6238 vector t=%llu",
+              (unsigned long long)vec[i].t);
+    }
+
+    CRED_Reset();
+    for (u = 0; u < totp_secrets; u++)
+    {
+        make_secret(u, secret);
+        CHECK(CRED_AddUser((uint16_t)u, NULL, 0) == 0, "add user %u", u);
+        CHECK(CRED_SetTotp((uint16_t)u, secret) == 0, "set totp %u", u);
+    }
+    for (u = 0; u < totp_secrets; u++)
+    {
+        // 前一个时间步的码在窗口内,再用一次不行;当前的码还能用,窗口外的码不行
+        code = totp_code(u, step - 1);
+        totp_digits(code, digits);
+        if (totp_ambiguous(u, code, step) || totp_ambiguous(u, totp_code(u, step), step))
+        {
+            ambiguous++;
+            continue;
+        }
+        CHECK(CRED_MatchTotp(digits, sizeof(digits), BENCH_TOTP_NOW) == (int)u, "totp step-1 of user %u", u);
+        CHECK(CRED_MatchTotp(digits, sizeof(digits), BENCH_TOTP_NOW) == CRED_NONE, "totp replay of user %u", u);
+        totp_digits(totp_code(u, step), digits);
+        CHECK(CRED_MatchTotp(digits, sizeof(digits), BENCH_TOTP_NOW) == (int)u, "totp step of user %u", u);
+        code = totp_code(u, step + 2);
+        totp_digits(code, digits);
+        if (!totp_ambiguous(u, code, step))
+        {
+            CHECK(CRED_MatchTotp(digits, sizeof(digits), BENCH_TOTP_NOW) == CRED_NONE, "totp step+2 of user %u", u);
+        }
+    }
+    CHECK(CRED_MatchTotp(digits, sizeof(digits), 0) == CRED_NONE, "totp without rtc");
+
+    t0 = now_ns();
+    for (i = 0; i < n; i++)
+    {
+        HMAC_SHA1_Init(&hk, &i, sizeof(i));     // 两次压缩
+    }
+    block_ns = (now_ns() - t0) / (2U * n);
+    // 命中:每轮换一个新的时间步,码都没用过
+    t0 = now_ns();
+    for (i = 0; i < rounds; i++)
+    {
+        totp_digits(totp_code(i % totp_secrets, step + 100 + i), digits);
+        acc += CRED_MatchTotp(digits, sizeof(digits), (step + 100 + i) * CRED_TOTP_STEP);
+    }
+    hit_ns = (now_ns() - t0) / rounds;
+    t0 = now_ns();
+    for (i = 0; i < rounds; i++)
+    {
+        totp_digits(i, digits);
+        acc += CRED_MatchTotp(digits, sizeof(digits), BENCH_TOTP_NOW);
+    }
+    miss_ns = (now_ns() - t0) / rounds;
+    sink = acc;
+    printf("totp %u secrets (%u ambiguous skipped): sha1 block %llu ns, check hit %.1f us miss %.1f us, "
+           "%u blocks per check\n", totp_secrets, ambiguous, (unsigned long long)block_ns, hit_ns / 1e3,
+           miss_ns / 1e3, totp_secrets * (2U + 2U * (2U * CRED_TOTP_WINDOW + 1U)));
+}
+
+/* OpenSSL(prime256v1,SHA-256)对BLE_KEY_DOMAIN|随机数的签名,3个密钥各2个 */
+static const struct { const char *pub, *nonce, *sig; } phone_vec[] = {
+    {"2460b1798eb68ad05eb698fab8bab3431cbfcd6d16cd3575b3bd3c9b577d37f06144fa4e6c03e12f2d76f7665ac199902e083796a940cb017539afb813112075",
+     "5f418820733cc23c4dd01f9d0be05d8e",
+     "81188df1b3439f2ef3d42f75c5836784c58b65eac521f12471fabdac33ece49a39af59d462032c43875a718638799b4b093e5b43cd88df3f532bbfe29556e272"},
+    {"2460b1798eb68ad05eb698fab8bab3431cbfcd6d16cd3575b3bd3c9b577d37f06144fa4e6c03e12f2d76f7665ac199902e083796a940cb017539afb813112075",
+     "d88fa561b3b1fd0219e15e1f56cab416",
+     "2df6dc036f17cc19f6341bb8024428b9289ea755c18dd551dc9d4749e49a9ceaafe7d8fc3b92cd3ca5b5a90450cbbc5a8a34f9c9ae7ad1570d05f2681ed5273a"},
+    {"0294248dff0e063c51f211706bae7c1d93bb719254e0d66586c5579d1d227b6ea4c3380709e1f424d4aa76aab410f0f483786ea3271b4346969a62c9e6a497dc",
+     "126cbed2a554d59d45e69d6bc83528fb",
+     "cddb9695a523a25792a0b605a65eed165b509bce84daa474cc1a0f01a55839d97b7bfff9cc10846631590247f7270dd3ca1ef583b0b4f2e48445d65ba5816ffb"},
+    {"0294248dff0e063c51f211706bae7c1d93bb719254e0d66586c5579d1d227b6ea4c3380709e1f424d4aa76aab410f0f483786ea3271b4346969a62c9e6a497dc",
+     "b291c1c4f3ce69a0ae50d290a556bb5b",
+     "0af29de4b960b54f4efe781d7aa64a8b3bcd251ab8c15bce6d33775f8df65ec475e4dc615886cb66108290a833f1f89d5203feab4f23b18b9d73547a10cc4065"},
+    {"be6e19f9754b7c6aea5b9fa036331dd777f7483a76090f6360b6ef92de3a0a1f38483118a8b5ff9da0954e8547bfbd8dcf8de4503897ae25f548a1bc9dfeef81",
+     "4b4a89d69cbf329404d3485d4c0b5fe6",
+     "42f3a533c76ab9b9e54b008b58beac331c063ea51ac4fed25261497adbec0acda711f593efd7c60e066a54d6c9659f5e2a51eac09db9c3b1ca32e963a5b1fdf2"},
+    {"be6e19f9754b7c6aea5b9fa036331dd777f7483a76090f6360b6ef92de3a0a1f38483118a8b5ff9da0954e8547bfbd8dcf8de4503897ae25f548a1bc9dfeef81",
+     "1db7ec313bf72a5effc360d10d6c6fde",
+     "52f070c708f02035422ac098308f9b667839c38050c38277b7e92bbe0fa2a4c4969f5eb98da5878d6a37ed062df81b6508f043d735b88648bb7fe0a6e0f28731"},
+};
+#define PHONE_VEC_NUM       (sizeof(phone_vec) / sizeof(phone_vec[0]))
+
+static void unhex(const char *hex, uint8_t *out, uint32_t len)
+{
+    uint32_t i;
+    unsigned v;
+
+    for (i = 0; i < len; i++)
+    {
+        sscanf(hex + 2 * i, "%2x", &v);
+        out[i] = (uint8_t)v;
+    }
+}
+
+/* 挑战消息的摘要,和ble.c中BLE_KeySign相同 */
+static void phone_hash(const uint8_t *nonce, uint8_t *hash)
+{
+    SHA256_Ctx_t ctx;
+
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, BLE_KEY_DOMAIN, sizeof(BLE_KEY_DOMAIN) - 1);
+    SHA256_Update(&ctx, nonce, BLE_KEY_NONCE_SIZE);
+    SHA256_Final(&ctx, hash);
+}
+
+/* 手机钥匙:验签向量、篡改、登记/删除,P-256验签耗时 */
+static void bench_phone(void)
+{
+    uint8_t pub[P256_PUB_SIZE], sig[P256_SIG_SIZE], hash[SHA256_DIGEST_SIZE], bad[P256_PUB_SIZE];
+    uint8_t nonce[BLE_KEY_NONCE_SIZE], key_id[CRED_PHONE_ID_SIZE];
+    uint32_t i, b;
+    uint64_t t0, verify_ns;
+    int acc = 0;
+
+    for (i = 0; i < PHONE_VEC_NUM; i++)
+    {
+        unhex(phone_vec[i].pub, pub, sizeof(pub));
+        unhex(phone_vec[i].nonce, nonce, sizeof(nonce));
+        unhex(phone_vec[i].sig, sig, sizeof(sig));
+        phone_hash(nonce, hash);
+        CHECK(P256_CheckPublic(pub) == 0, "p256 public key %u", i);
+        CHECK(P256_Verify(pub, hash, sig) == 0, "p256 vector %u", i);
+        // 摘要、r、s、公钥各翻转一位
+        for (b = 0; b < 4; b++)
+        {
+            uint8_t *p = b == 0 ? hash : (b == 3 ? pub : sig + (b - 1) * P256_BYTES);
+
+            p[i % P256_BYTES] ^= 0x01;
+            CHECK(P256_Verify(pub, hash, sig) != 0, "p256 vector %u tampered %u", i, b);
+            p[i % P256_BYTES] ^= 0x01;
+        }
+    }
+    memset(bad, 0, sizeof(bad));
+    CHECK(P256_CheckPublic(bad) != 0, "p256 point at origin");
+    unhex(phone_vec[0].pub, bad, sizeof(bad));
+    bad[P256_PUB_SIZE - 1] ^= 0x01;
+    CHECK(P256_CheckPublic(bad) != 0, "p256 point off curve");
+    memset(sig, 0, sizeof(sig));
+    CHECK(P256_Verify(pub, hash, sig) != 0, "p256 zero signature");
+
+    // 凭据库:用户i登记第i个密钥,同一个密钥登记给另一个用户时改变归属,不占新的槽
+    CRED_Reset();
+    for (i = 0; i < 4; i++)
+    {
+        CHECK(CRED_AddUser((uint16_t)i, NULL, 0) == 0, "add user %u", i);
+    }
+    for (i = 0; i < PHONE_VEC_NUM; i += 2)
+    {
+        unhex(phone_vec[i].pub, pub, sizeof(pub));
+        CHECK(CRED_AddPhone((uint16_t)(i / 2), pub) == 0, "add phone %u", i);
+    }
+    CHECK(CRED_AddPhone(0, bad) != 0, "add phone off curve");
+    CHECK(CRED_AddPhone(CRED_MAX_USERS - 1, pub) != 0, "add phone to missing user");
+    CHECK(CRED_AddPhone(3, pub) == 0 && CRED_Count(CRED_TYPE_PHONE) == PHONE_VEC_NUM / 2, "re-add phone");
+    for (i = 0; i < PHONE_VEC_NUM; i++)
+    {
+        unhex(phone_vec[i].pub, pub, sizeof(pub));
+        unhex(phone_vec[i].nonce, nonce, sizeof(nonce));
+        unhex(phone_vec[i].sig, sig, sizeof(sig));
+        phone_hash(nonce, hash);
+        CRED_PhoneId(pub, key_id);
+        CHECK(CRED_MatchPhone(key_id, hash, sig) == (i / 2 == 2 ? 3 : (int)(i / 2)), "match phone %u", i);
+        nonce[0] ^= 0x80;
+        phone_hash(nonce, hash);
+        CHECK(CRED_MatchPhone(key_id, hash, sig) == CRED_NONE, "phone %u other nonce", i);
+        key_id[0] ^= 0x80;
+        CHECK(CRED_MatchPhone(key_id, hash, sig) == CRED_NONE, "phone %u unknown key", i);
+    }
+    // 删除后查不到,空出的槽给下一个密钥
+    unhex(phone_vec[0].pub, pub, sizeof(pub));
+    unhex(phone_vec[0].nonce, nonce, sizeof(nonce));
+    unhex(phone_vec[0].sig, sig, sizeof(sig));
+    phone_hash(nonce, hash);
+    CRED_PhoneId(pub, key_id);
+    CHECK(CRED_Remove(CRED_TYPE_PHONE, key_id, sizeof(key_id)) == 0, "remove phone");
+    CHECK(CRED_MatchPhone(key_id, hash, sig) == CRED_NONE, "removed phone");
+    CHECK(CRED_AddPhone(1, pub) == 0 && CRED_MatchPhone(key_id, hash, sig) == 1, "phone slot reuse");
+
+    t0 = now_ns();
+    for (i = 0; i < rounds; i++)
+    {
+        acc += P256_Verify(pub, hash, sig);
+    }
+    verify_ns = (now_ns() - t0) / rounds;
+    sink = acc;
+    printf("phone key: %u vectors, p256 verify %.1f us\n", (unsigned)PHONE_VEC_NUM, verify_ns / 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t u;
+    uint64_t t0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "u:r:t:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'u': users = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'r': rounds = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 't': totp_secrets = (uint32_t)strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: cred_bench [-u users] [-r rounds] [-t totp secrets]\n");
+                return 2;
+        }
+    }
+    if (users == 0 || users > CRED_MAX_USERS || users * BENCH_PER_USER > CRED_MAX_ENTRIES)
+    {
+        fprintf(stderr, "users must be 1..%u\n", CRED_MAX_ENTRIES / BENCH_PER_USER);
+        return 2;
+    }
+    if (totp_secrets == 0 || totp_secrets > CRED_MAX_USERS || rounds == 0)
+    {
+        fprintf(stderr, "totp secrets must be 1..%u, rounds at least 1\n", CRED_MAX_USERS);
+        return 2;
+    }
+
+    CRED_Reset();
+    // 空库里没有登记的指纹/人脸ID不能对应到任何用户
+    CHECK(CRED_MatchId(CRED_TYPE_FP, 1) == CRED_NONE, "unmapped fp id");
+    CHECK(CRED_MatchId(CRED_TYPE_FACE, 1000) == CRED_NONE, "unmapped face id");
+    t0 = now_ns();
+    for (u = 0; u < users; u++)
+    {
+        add_user(u);
+    }
+    printf("load %u entries: %.2f ms\n", users * BENCH_PER_USER, (now_ns() - t0) / 1e6);
+    report_stats("loaded");
+    for (u = 0; u < users; u++)
+    {
+        verify_user(u, 1);
+    }
+    // 不存在的用户凭据
+    verify_user(users, 0);
+
+    // 删除偶数用户,检查删除后的回填没有破坏其他凭据
+    for (u = 0; u < users; u += 2)
+    {
+        CHECK(CRED_DelUser((uint16_t)u) == 0, "del user %u", u);
+    }
+    report_stats("deleted");
+    for (u = 0; u < users; u++)
+    {
+        verify_user(u, u & 1);
+    }
+    for (u = 0; u < users; u += 2)
+    {
+        add_user(u);
+    }
+    report_stats("re-added");
+    for (u = 0; u < users; u++)
+    {
+        verify_user(u, 1);
+    }
+
+    bench();
+    bench_kdf();
+    bench_totp();
+    bench_phone();
+
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
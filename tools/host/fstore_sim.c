@@ -0,0 +1,185 @@
+/**
+  ******************************************************************************
+  * @file    fstore_sim.c
+  * @author  cyytx
+  * @brief   Flash记录存储(user/fstore.c)的掉电仿真
+  *          1.Flash用host_flash.c仿真,扇区只用8KB(见Makefile),几十次写入就整理一次;
+  *          2.随机写入/删除一组键,在随机的一次擦写中掉电(编程写一半、擦除擦一半),
+  *            然后重新FSTORE_Init,相当于设备重启;
+  *          3.重启后检查每个键:掉电前写成功的值都在,掉电时正在写的键是旧值或新值,
+  *            遍历的记录数和键数一致,从来没有对没擦除的字编程。
+  *
+  * 用法: fstore_sim [-n 掉电次数] [-m 每次最多擦写次数] [-s 随机种子]
+  ******************************************************************************
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "fstore.h"
+#include "host.h"
+
+#define SIM_KEYS            48          /* 键数,小于FSTORE_MAX_KEYS */
+#define SIM_KEY_BASE        0x0100
+#define SIM_LEN_MAX         96
+#define SIM_CUTS            5000
+#define SIM_MAX_OPS         3000
+
+static uint32_t versions[SIM_KEYS];     /* 每个键当前的值,0表示不存在 */
+static uint32_t next_version = 1;
+static int pending = -1;                /* 掉电时正在写的键 */
+static uint32_t pending_version;
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { failures++; if (failures <= 10) { printf("FAIL: " __VA_ARGS__); printf("\n"); } } } while (0)
+
+/* 版本v的值,长度和内容都由版本决定 */
+static uint16_t make_value(uint32_t v, uint8_t *buf)
+{
+    uint16_t len = (uint16_t)(1 + (v * 2654435761U >> 16) % SIM_LEN_MAX);
+    uint16_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        // 数据中有一部分0xFF,覆盖记录末尾是0xFF的情况
+        buf[i] = (i % 7 == 3) ? 0xFF : (uint8_t)(v * 31 + i * 13);
+    }
+    return len;
+}
+
+static int value_is(uint32_t v, const uint8_t *data, int len)
+{
+    uint8_t expect[SIM_LEN_MAX];
+
+    if (v == 0)
+    {
+        return len < 0;
+    }
+    return len == make_value(v, expect) && memcmp(data, expect, (size_t)len) == 0;
+}
+
+static int count_cb(uint16_t key, const uint8_t *data, uint16_t len, void *arg)
+{
+    (*(int *)arg)++;
+    return 0;
+}
+
+/* 一直随机写入/删除,直到掉电 */
+static void run_until_cut(volatile uint32_t *ops)
+{
+    uint8_t buf[SIM_LEN_MAX];
+    uint16_t len;
+    int k, ret;
+
+    for (;;)
+    {
+        k = rand() % SIM_KEYS;
+        pending = k;
+        if (rand() % 4 == 0)
+        {
+            pending_version = 0;
+            ret = FSTORE_Delete((uint16_t)(SIM_KEY_BASE + k));
+        }
+        else
+        {
+            pending_version = next_version++;
+            len = make_value(pending_version, buf);
+            ret = FSTORE_Write((uint16_t)(SIM_KEY_BASE + k), buf, len);
+        }
+        if (ret != 0)
+        {
+            CHECK(0, "op on key %d failed", k);
+            return;
+        }
+        versions[k] = pending_version;
+        pending = -1;
+        (*ops)++;
+    }
+}
+
+/* 重启后检查所有键,掉电时正在写的键接受旧值或新值 */
+static void verify(void)
+{
+    uint8_t buf[FSTORE_DATA_MAX];
+    int k, len, present = 0, n = 0;
+
+    for (k = 0; k < SIM_KEYS; k++)
+    {
+        len = FSTORE_Read((uint16_t)(SIM_KEY_BASE + k), buf, sizeof(buf));
+        if (k == pending && value_is(pending_version, buf, len))
+        {
+            versions[k] = pending_version;
+        }
+        CHECK(value_is(versions[k], buf, len), "key %d expect version %u, read len %d", k, versions[k], len);
+        present += versions[k] != 0;
+    }
+    FSTORE_Foreach(0, FSTORE_KEY_INVALID - 1, count_cb, &n);
+    CHECK(n == present, "foreach %d records, expect %d", n, present);
+    pending = -1;
+}
+
+int main(int argc, char *argv[])
+{
+    /* 掉电用longjmp回到setjmp,循环中修改的局部变量必须是volatile */
+    volatile uint32_t cuts = SIM_CUTS, max_ops = SIM_MAX_OPS, c;
+    volatile uint32_t ops = 0, gcs = 0, skipped = 0, writes = 0;
+    uint32_t seed = 1;
+    FSTORE_Stats_t st;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:s:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': cuts = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'm': max_ops = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 's': seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: fstore_sim [-n cuts] [-m max_ops] [-s seed]\n");
+                return 2;
+        }
+    }
+    if (max_ops == 0)
+    {
+        max_ops = 1;
+    }
+    srand(seed);
+    host_flash_init();
+    FSTORE_Init();
+
+    for (c = 0; c < cuts; c++)
+    {
+        host_flash_budget = 1 + rand() % max_ops;
+        if (setjmp(host_flash_jmp) == 0)
+        {
+            run_until_cut(&ops);
+        }
+        FSTORE_GetStats(&st);
+        gcs += st.gcs;
+        writes += st.writes;
+
+        host_flash_budget = -1;
+        FSTORE_Init();
+        FSTORE_GetStats(&st);
+        skipped += st.skipped;
+        verify();
+        if (failures > 10)
+        {
+            break;
+        }
+    }
+    FSTORE_GetStats(&st);
+    CHECK(host_flash_errors == 0, "%u programs over non-erased words", host_flash_errors);
+
+    printf("power cuts %u, ops %u, records written %u, gc %u\n", c, ops, writes, gcs);
+    printf("erases sector0 %u sector1 %u, words programmed %u, torn bytes skipped %u\n",
+           host_flash_erases[0], host_flash_erases[1], host_flash_programs, skipped);
+    printf("final: sector %u seq %u used %u live %u keys %u\n", st.active, st.seq, st.used, st.live, st.keys);
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,104 @@
+/**
+  ******************************************************************************
+  * @file    host.h
+  * @author  cyytx
+  * @brief   主机工具的公共定义,replay.c、fstore_sim.c和host_stub.c、host_flash.c共用
+  ******************************************************************************
+  */
+#ifndef __HOST_H
+#define __HOST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <setjmp.h>
+
+extern uint32_t host_time_us;   /* 回放的虚拟时间,LOG_GetTimeUs和xTaskGetTickCount返回它 */
+extern int host_quiet;          /* 1: 重复运行只为计时,不写日志、不记录开锁 */
+extern int host_lock_cmd;       /* 本帧处理中发出的开关锁命令,-1表示没有 */
+extern FILE *host_log;          /* 日志记录输出,格式和设备相同,可用tools/log_decode.py解码 */
+
+void host_delay_ns(uint64_t ns);        /* 推进虚拟时间,vTaskDelay、delay_us和RC522仿真使用 */
+uint64_t host_now_ns(void);
+
+/* Flash仿真,见host_flash.c */
+extern jmp_buf host_flash_jmp;          /* 掉电时跳回这里 */
+extern long host_flash_budget;          /* 剩余可执行的擦写次数,用完即掉电,-1表示不掉电 */
+extern uint32_t host_flash_errors;      /* 对没擦除的字编程的次数,应为0 */
+extern uint32_t host_flash_programs;    /* 编程的字数 */
+extern uint32_t host_flash_erases[2];   /* 每个扇区的擦除次数 */
+
+void host_flash_init(void);
+
+/* RC522和ISO14443A卡片仿真,见host_rc522.c */
+#define HOST_CARD_MAX           4
+#define HOST_CARD_MEM           1024    /* Classic 1K:64块;NTAG216:231页 */
+#define HOST_APDU_MAX           272
+
+typedef enum {
+    HOST_CARD_CLASSIC = 0,              /* MIFARE Classic 1K */
+    HOST_CARD_NTAG213,
+    HOST_CARD_NTAG215,
+    HOST_CARD_NTAG216,
+    HOST_CARD_ISO4                      /* ISO14443-4:DESFire、手机模拟卡 */
+} host_card_type_t;
+
+typedef struct {
+    /* 配置,host_card_add之后可以修改 */
+    host_card_type_t type;
+    uint8_t  uid[10];
+    uint8_t  uid_len;                   /* 4/7/10 */
+    uint8_t  atqa[2];
+    uint8_t  sak;
+    uint8_t  present;                   /* 在天线场中,用host_card_move修改 */
+    uint32_t powerup_us;                /* 上电后多久才能应答 */
+    uint32_t delay_us;                  /* 每条命令在FDT之外的处理时间 */
+    uint8_t  mem[HOST_CARD_MEM];        /* Classic按块,NTAG按页 */
+    uint16_t pages;                     /* NTAG总页数 */
+    uint8_t  cfg;                       /* NTAG配置页CFG0的页号 */
+    uint8_t  random_uid;                /* 每次上电换一个随机UID(手机) */
+    uint8_t  fsci;                      /* ATS中的FSCI */
+    uint8_t  fwi;                       /* ATS中的FWI */
+    uint8_t  chain;                     /* 应答分块的INF长度,0表示一帧发完 */
+    uint32_t wtx_us;                    /* READ BINARY的处理时间,非0时先回S(WTX) */
+    uint8_t  fci_token;                 /* SELECT的应答直接返回令牌(手机应用) */
+    uint8_t  has_app;                   /* 有门锁应用 */
+    uint8_t  token[16];                 /* 应用文件中的令牌 */
+    /* 运行状态 */
+    uint8_t  state;
+    uint8_t  level;                     /* 防冲突级别 */
+    uint8_t  from_halt;
+    uint8_t  auth_sector;               /* Classic已认证的扇区,0xFF表示没有 */
+    int16_t  write_block;               /* Classic WRITE第二步要写的块,-1表示没有 */
+    uint8_t  ntag_auth;
+    uint8_t  selected;                  /* ISO14443-4应用已选择 */
+    uint8_t  iso_block;
+    uint8_t  wtx_pending;
+    uint8_t  apdu[HOST_APDU_MAX];
+    uint16_t apdu_len;
+    uint8_t  resp[HOST_APDU_MAX];
+    uint16_t resp_len, resp_off;
+    uint32_t powered_at;
+} host_card_t;
+
+typedef struct {
+    uint32_t reg_reads;                 /* 单个寄存器读 */
+    uint32_t reg_writes;                /* 单个寄存器写 */
+    uint32_t fifo_bursts;               /* FIFO连续读写次数 */
+    uint32_t fifo_bytes;                /* FIFO连续读写的字节数 */
+    uint32_t spi_frames;                /* 片选次数 */
+    uint64_t spi_ns;                    /* SPI总线时间 */
+    uint32_t rf_frames;                 /* 发给卡片的帧数,认证算两帧 */
+    uint32_t rf_timeouts;               /* 定时器超时(没有应答)次数 */
+    uint64_t rf_ns;                     /* 射频收发时间(发送、等待、接收) */
+} host_rc522_stats_t;
+
+extern host_card_t host_cards[HOST_CARD_MAX];
+extern int host_card_num;
+extern host_rc522_stats_t host_rc522;
+extern int host_auth_user;              /* 最近一次开锁请求的用户,CRED_NONE表示验证失败 */
+
+void host_rc522_init(void);
+host_card_t *host_card_add(host_card_type_t type, const uint8_t *uid, uint8_t uid_len);
+void host_card_move(host_card_t *card, int present);
+
+#endif /* __HOST_H */
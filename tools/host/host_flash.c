@@ -0,0 +1,139 @@
+/**
+  ******************************************************************************
+  * @file    host_flash.c
+  * @author  cyytx
+  * @brief   主机上的Flash仿真,让user/fstore.c不改动地在PC上运行
+  *          1.在设备的地址上映射内存:扇区6、7(0x08080000起512KB)、FLASH寄存器页、SCB页,
+  *            固件按设备地址直接读Flash、写FLASH->SR、读SCB->CCR都落在这些内存上;
+  *          2.HAL_FLASH_Program按Flash的规律只能把1写成0,对没擦除的字写入不同的值记为错误;
+  *          3.掉电注入:host_flash_budget为剩余可执行的擦写次数,用完时这次操作只做一半
+  *            (编程只写入部分位,擦除把扇区写成随机内容),然后longjmp到host_flash_jmp。
+  ******************************************************************************
+  */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "stm32f7xx_hal.h"
+#include "fstore.h"
+#include "host.h"
+
+#define HOST_FLASH_BASE     FSTORE_SECTOR0_ADDR
+#define HOST_FLASH_SIZE     0x80000     /* 扇区6、7各256KB */
+#define HOST_SECTOR_SIZE    0x40000
+#define HOST_PAGE           0x1000U
+
+jmp_buf host_flash_jmp;
+long host_flash_budget = -1;
+uint32_t host_flash_errors = 0;
+uint32_t host_flash_programs = 0;
+uint32_t host_flash_erases[2] = {0, 0};
+
+static int host_flash_mapped = 0;
+
+static void *host_map(uint32_t addr, uint32_t size)
+{
+    void *p = mmap((void *)(uintptr_t)addr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    if (p != (void *)(uintptr_t)addr)
+    {
+        fprintf(stderr, "host_flash: cannot map 0x%08x\n", addr);
+        exit(1);
+    }
+    return p;
+}
+
+/* 映射Flash和用到的寄存器,Flash为擦除状态,寄存器全0(D-Cache关闭) */
+void host_flash_init(void)
+{
+    if (!host_flash_mapped)
+    {
+        host_map(HOST_FLASH_BASE, HOST_FLASH_SIZE);
+        host_map(FLASH_R_BASE & ~(HOST_PAGE - 1U), HOST_PAGE);
+        host_map(SCS_BASE & ~(HOST_PAGE - 1U), HOST_PAGE);
+        host_flash_mapped = 1;
+    }
+    memset((void *)(uintptr_t)HOST_FLASH_BASE, 0xFF, HOST_FLASH_SIZE);
+}
+
+/* 消耗一次擦写,返回0表示这次操作时掉电 */
+static int host_flash_power(void)
+{
+    if (host_flash_budget < 0)
+    {
+        return 1;
+    }
+    if (host_flash_budget == 0)
+    {
+        return 0;
+    }
+    host_flash_budget--;
+    return 1;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+    return host_flash_mapped ? HAL_OK : HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+    volatile uint32_t *p = (volatile uint32_t *)(uintptr_t)Address;
+    uint32_t v = (uint32_t)Data;
+
+    if (!host_flash_mapped || TypeProgram != FLASH_TYPEPROGRAM_WORD || (Address & 3U) != 0 ||
+        Address < HOST_FLASH_BASE || Address >= HOST_FLASH_BASE + HOST_FLASH_SIZE)
+    {
+        return HAL_ERROR;
+    }
+    if (!host_flash_power())
+    {
+        // 只有一部分0位写进去了
+        *p &= v | (uint32_t)rand();
+        longjmp(host_flash_jmp, 1);
+    }
+    if ((*p & v) != v)
+    {
+        host_flash_errors++;
+    }
+    *p &= v;
+    host_flash_programs++;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError)
+{
+    uint32_t s = pEraseInit->Sector - FSTORE_SECTOR0, i;
+    uint32_t *p;
+
+    if (!host_flash_mapped || pEraseInit->TypeErase != FLASH_TYPEERASE_SECTORS ||
+        pEraseInit->NbSectors != 1 || s > 1)
+    {
+        *SectorError = pEraseInit->Sector;
+        return HAL_ERROR;
+    }
+    p = (uint32_t *)(uintptr_t)(HOST_FLASH_BASE + s * HOST_SECTOR_SIZE);
+    if (!host_flash_power())
+    {
+        // 擦到一半:每个字可能保持原值、已擦除或是不确定的值
+        for (i = 0; i < HOST_SECTOR_SIZE / 4U; i++)
+        {
+            switch (rand() % 3)
+            {
+                case 0: break;
+                case 1: p[i] = 0xFFFFFFFFU; break;
+                default: p[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand(); break;
+            }
+        }
+        longjmp(host_flash_jmp, 1);
+    }
+    memset(p, 0xFF, HOST_SECTOR_SIZE);
+    host_flash_erases[s]++;
+    *SectorError = 0xFFFFFFFFU;
+    return HAL_OK;
+}
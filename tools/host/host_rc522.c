@@ -0,0 +1,1153 @@
+/**
+  ******************************************************************************
+  * @file    host_rc522.c
+  * @author  cyytx
+  * @brief   RC522和ISO14443A卡片的寄存器级仿真,代替rc522_spi.c,和nfc.c、iso14443.c一起在主机上编译
+  *          1.寄存器:FIFO(64字节,溢出置BufferOvfl)、ComIrqReg/DivIrqReg(Set1写法)、ErrorReg、
+  *            ControlReg的RxLastBits、BitFramingReg(TxLastBits/RxAlign/StartSend)、CollReg、
+  *            TxModeReg/RxModeReg的硬件CRC、TxControlReg的天线开关、定时器(TPrescaler/TReload/TAuto),
+  *            命令CalcCRC、Transceive、MFAuthent、SoftReset;
+  *          2.时间:SPI按RC522_SPI_HZ计(HAL方式按HOST_SPI_HAL_NS每字节),射频按106kbps每位128/fc,
+  *            加上帧延迟FDT和卡片处理时间。命令完成前读ComIrqReg看不到完成标志,
+  *            固件查询寄存器和vTaskDelay都推进虚拟时间,等待时间和设备上一样计算;
+  *          3.卡片:MIFARE Classic 1K(认证只比较扇区密钥,不仿真Crypto1,但MFCrypto1On和
+  *            卡片的认证状态不一致时卡片不应答)、NTAG213/215/216(PWD_AUTH保护)、
+  *            ISO14443-4卡(RATS、双向链接、WTX,门锁应用中存令牌),4/7/10字节UID;
+  *            多张卡同时应答时按位合并,第一个不同的位记入CollReg;
+  *          4.统计寄存器访问、FIFO连续读写、片选次数、射频帧数和时间,nfc_sim.c按操作输出。
+  ******************************************************************************
+  */
+#include <stdlib.h>
+#include <string.h>
+#include "nfc.h"
+#include "iso14443.h"
+#include "rc522_spi.h"
+#include "cred.h"
+#include "host.h"
+
+#define HOST_RF_BIT_NS          9440U       /* 106kbps一位:128/fc */
+#define HOST_FDT_NS             91150U      /* 帧延迟时间FDT,最后一位为1时1236/fc */
+#define HOST_FC_KHZ             13560U
+#define HOST_SPI_CS_NS          200U        /* 每次片选的函数调用和片选开销 */
+#define HOST_SPI_HAL_NS         8000U       /* HAL方式每字节:每位三次HAL_GPIO_WritePin */
+#define HOST_CLASSIC_WRITE_US   2500U       /* Classic写块(第二步)的时间 */
+#define HOST_NTAG_WRITE_US      4100U       /* NTAG写页的时间 */
+#define HOST_RESP_MAX           (HOST_APDU_MAX + 8)
+
+/* 卡片状态(ISO14443-3) */
+#define CARD_OFF                0
+#define CARD_IDLE               1
+#define CARD_READY              2
+#define CARD_ACTIVE             3
+#define CARD_HALT               4
+#define CARD_PROTOCOL           5           /* ISO14443-4,RATS之后 */
+
+/* 卡片应答:按位存放(第i位在data[i/8]的第i%8位),含CRC */
+typedef struct {
+    uint8_t  data[HOST_RESP_MAX];
+    uint16_t bits;
+    uint32_t delay_us;                      /* FDT之外的处理时间 */
+} host_resp_t;
+
+host_card_t host_cards[HOST_CARD_MAX];
+int host_card_num = 0;
+host_rc522_stats_t host_rc522;
+
+static uint8_t rc_reg[64];
+static uint8_t rc_fifo[DEF_FIFO_LENGTH];
+static uint8_t rc_fifo_len;
+static uint8_t rc_field;
+static RC522_SpiMode_t rc_mode = RC522_SPI_FAST;
+
+/* 正在执行的命令,rc_done_ns时把结果写入寄存器 */
+static int rc_busy;
+static uint64_t rc_done_ns;
+static uint8_t rc_done_irq;                 /* ComIrqReg中置位的位 */
+static uint8_t rc_done_err;                 /* ErrorReg */
+static uint8_t rc_done_coll;                /* CollReg低7位 */
+static uint8_t rc_done_crypto;              /* 认证成功,置位MFCrypto1On */
+static uint8_t rc_done_fifo[HOST_RESP_MAX];
+static uint16_t rc_done_len;
+static uint8_t rc_done_lastbits;
+
+static const uint8_t host_sel[3] = {PICC_ANTICOLL1, PICC_ANTICOLL2, PICC_ANTICOLL3};
+static const uint8_t host_app_aid[NFC_APP_AID_SIZE] = {NFC_APP_AID};
+
+/*************************************** 工具函数 ***************************************/
+
+static uint16_t crc_a(const uint8_t *data, uint16_t len)
+{
+    uint16_t crc = 0x6363;
+    uint8_t b;
+
+    while (len--)
+    {
+        b = *data++;
+        b ^= (uint8_t)crc;
+        b ^= (uint8_t)(b << 4);
+        crc = (uint16_t)((crc >> 8) ^ ((uint16_t)b << 8) ^ ((uint16_t)b << 3) ^ (b >> 4));
+    }
+    return crc;
+}
+
+static int crc_ok(const uint8_t *data, uint16_t len)
+{
+    uint16_t crc;
+
+    if (len < 3)
+    {
+        return 0;
+    }
+    crc = crc_a(data, len - 2);
+    return data[len - 2] == (uint8_t)crc && data[len - 1] == (uint8_t)(crc >> 8);
+}
+
+static int get_bit(const uint8_t *data, uint16_t i)
+{
+    return (data[i / 8] >> (i % 8)) & 1;
+}
+
+static void put_bit(uint8_t *data, uint16_t i, int v)
+{
+    if (v)
+    {
+        data[i / 8] |= (uint8_t)(1U << (i % 8));
+    }
+    else
+    {
+        data[i / 8] &= (uint8_t)~(1U << (i % 8));
+    }
+}
+
+/* 字节应答,附加CRC */
+static void resp_bytes(host_resp_t *r, const uint8_t *data, uint16_t len, int crc)
+{
+    uint16_t c;
+
+    memcpy(r->data, data, len);
+    if (crc)
+    {
+        c = crc_a(data, len);
+        r->data[len++] = (uint8_t)c;
+        r->data[len++] = (uint8_t)(c >> 8);
+    }
+    r->bits = (uint16_t)(len * 8U);
+}
+
+/* 4位ACK/NAK */
+static void resp_nibble(host_resp_t *r, uint8_t v)
+{
+    r->data[0] = v & 0x0F;
+    r->bits = 4;
+}
+
+/* 帧的空中时间:每字节8位加奇偶校验位,再加SOF和EOF */
+static uint64_t rf_ns(uint16_t bits)
+{
+    return (uint64_t)(bits + bits / 8U + 2U) * HOST_RF_BIT_NS;
+}
+
+/* 定时器超时时间:(TReload+1)个计数,每个计数(2*TPrescaler+1)/fc */
+static uint64_t timer_ns(void)
+{
+    uint32_t presc = ((uint32_t)(rc_reg[TModeReg] & 0x0F) << 8) | rc_reg[TPrescalerReg];
+    uint32_t reload = ((uint32_t)rc_reg[TReloadRegH] << 8) | rc_reg[TReloadRegL];
+
+    return (uint64_t)(reload + 1U) * (2U * presc + 1U) * 1000000U / HOST_FC_KHZ;
+}
+
+/*************************************** 卡片 ***************************************/
+
+static uint8_t card_levels(const host_card_t *c)
+{
+    return c->uid_len == 4 ? 1 : (c->uid_len == 7 ? 2 : 3);
+}
+
+/* 第level级的CLn(4字节)和BCC */
+static void card_cl(const host_card_t *c, uint8_t level, uint8_t *cl)
+{
+    uint8_t last = (uint8_t)(level + 1 == card_levels(c));
+
+    if (last)
+    {
+        memcpy(cl, c->uid + level * 3, 4);
+    }
+    else
+    {
+        cl[0] = ISO14443_CASCADE_TAG;
+        memcpy(cl + 1, c->uid + level * 3, 3);
+    }
+    cl[4] = cl[0] ^ cl[1] ^ cl[2] ^ cl[3];
+}
+
+static int card_is_ntag(const host_card_t *c)
+{
+    return c->type == HOST_CARD_NTAG213 || c->type == HOST_CARD_NTAG215 || c->type == HOST_CARD_NTAG216;
+}
+
+/* 上电:回到IDLE,清除认证状态 */
+static void card_power_on(host_card_t *c)
+{
+    uint8_t i;
+
+    c->state = CARD_IDLE;
+    c->level = 0;
+    c->from_halt = 0;
+    c->auth_sector = 0xFF;
+    c->write_block = -1;
+    c->ntag_auth = 0;
+    c->selected = 0;
+    c->wtx_pending = 0;
+    c->apdu_len = 0;
+    c->resp_len = c->resp_off = 0;
+    c->powered_at = host_time_us;
+    if (c->random_uid)
+    {
+        c->uid[0] = 0x08;               // 随机UID的第一个字节
+        for (i = 1; i < c->uid_len; i++)
+        {
+            c->uid[i] = (uint8_t)rand();
+        }
+    }
+}
+
+static void card_to_idle(host_card_t *c)
+{
+    c->state = c->from_halt ? CARD_HALT : CARD_IDLE;
+    c->auth_sector = 0xFF;
+    c->write_block = -1;
+    c->ntag_auth = 0;
+}
+
+static int card_can_answer(const host_card_t *c)
+{
+    return c->present && rc_field && c->state != CARD_OFF &&
+           host_time_us - c->powered_at >= c->powerup_us;
+}
+
+static uint8_t *ntag_page(host_card_t *c, uint16_t page)
+{
+    return &c->mem[page * 4U];
+}
+
+static int ntag_protected(host_card_t *c, uint16_t page, int write)
+{
+    uint8_t auth0 = ntag_page(c, c->cfg)[NTAG_AUTH0_OFFSET];
+    uint8_t prot = ntag_page(c, c->cfg + 1)[0] & NTAG_ACCESS_PROT;
+
+    return page >= auth0 && !c->ntag_auth && (write || prot);
+}
+
+/* NTAG读页:PWD、PACK读出为0 */
+static int ntag_read(host_card_t *c, uint16_t start, uint16_t end, uint8_t *out)
+{
+    uint16_t p;
+
+    for (p = start; p <= end; p++)
+    {
+        if (p >= c->pages || ntag_protected(c, p, 0))
+        {
+            return -1;
+        }
+        if (p == c->cfg + 2 || p == c->cfg + 3)
+        {
+            memset(out, 0, 4);
+        }
+        else
+        {
+            memcpy(out, ntag_page(c, p), 4);
+        }
+        out += 4;
+    }
+    return 0;
+}
+
+static int ntag_rx(host_card_t *c, const uint8_t *d, uint16_t len, host_resp_t *r)
+{
+    uint8_t buf[64];
+
+    if (!crc_ok(d, len))
+    {
+        return 0;
+    }
+    len -= 2;
+    if (d[0] == NTAG_CMD_GET_VERSION && len == 1)
+    {
+        buf[0] = 0x00;
+        buf[1] = 0x04;
+        buf[2] = 0x04;                  // NTAG
+        buf[3] = 0x02;
+        buf[4] = 0x01;
+        buf[5] = 0x00;
+        buf[6] = c->type == HOST_CARD_NTAG213 ? 0x0F : (c->type == HOST_CARD_NTAG215 ? 0x11 : 0x13);
+        buf[7] = 0x03;
+        resp_bytes(r, buf, 8, 1);
+        return 1;
+    }
+    if (d[0] == NTAG_CMD_READ && len == 2)
+    {
+        if (d[1] + 3U < c->pages && ntag_read(c, d[1], d[1] + 3U, buf) == 0)
+        {
+            resp_bytes(r, buf, 16, 1);
+            return 1;
+        }
+    }
+    else if (d[0] == NTAG_CMD_FAST_READ && len == 3)
+    {
+        if (d[1] <= d[2] && ntag_read(c, d[1], d[2], buf) == 0 && (d[2] - d[1] + 1U) * 4U <= sizeof(buf))
+        {
+            resp_bytes(r, buf, (uint16_t)((d[2] - d[1] + 1U) * 4U), 1);
+            return 1;
+        }
+    }
+    else if (d[0] == NTAG_CMD_WRITE && len == 6)
+    {
+        if (d[1] >= 2 && d[1] < c->pages && !ntag_protected(c, d[1], 1))
+        {
+            memcpy(ntag_page(c, d[1]), d + 2, 4);
+            resp_nibble(r, NTAG_ACK);
+            r->delay_us += HOST_NTAG_WRITE_US;
+            return 1;
+        }
+    }
+    else if (d[0] == NTAG_CMD_PWD_AUTH && len == 5)
+    {
+        if (memcmp(d + 1, ntag_page(c, c->cfg + 2), NTAG_PWD_SIZE) == 0)
+        {
+            c->ntag_auth = 1;
+            resp_bytes(r, ntag_page(c, c->cfg + 3), NTAG_PACK_SIZE, 1);
+            return 1;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+    // NAK之后卡片回到IDLE
+    resp_nibble(r, 0x0);
+    card_to_idle(c);
+    return 1;
+}
+
+static int classic_rx(host_card_t *c, const uint8_t *d, uint16_t len, host_resp_t *r)
+{
+    uint8_t buf[16];
+
+    if (!crc_ok(d, len))
+    {
+        return 0;
+    }
+    len -= 2;
+    if (c->write_block >= 0)
+    {
+        // WRITE第二步:16字节数据
+        if (len != 16)
+        {
+            card_to_idle(c);
+            return 0;
+        }
+        memcpy(&c->mem[c->write_block * 16], d, 16);
+        c->write_block = -1;
+        resp_nibble(r, 0x0A);
+        r->delay_us += HOST_CLASSIC_WRITE_US;
+        return 1;
+    }
+    if ((d[0] == PICC_READ || d[0] == PICC_WRITE) && len == 2 && d[1] < 64 && c->auth_sector == d[1] / 4)
+    {
+        if (d[0] == PICC_READ)
+        {
+            memcpy(buf, &c->mem[d[1] * 16], 16);
+            if (d[1] % 4 == 3)
+            {
+                memset(buf, 0, CRED_NFC_KEY_SIZE);   // 密钥A读出为0
+            }
+            resp_bytes(r, buf, 16, 1);
+            return 1;
+        }
+        if (d[1] != 0)
+        {
+            c->write_block = d[1];
+            resp_nibble(r, 0x0A);
+            return 1;
+        }
+    }
+    resp_nibble(r, 0x04);               // NAK
+    card_to_idle(c);
+    return 1;
+}
+
+/* 处理一条APDU,应答放到resp */
+static void iso4_apdu(host_card_t *c)
+{
+    const uint8_t *a = c->apdu;
+    uint16_t n = 0;
+
+    if (c->apdu_len >= 5 && a[0] == 0x00 && a[1] == 0xA4 && a[2] == 0x04 && a[4] + 5U <= c->apdu_len)
+    {
+        c->selected = c->has_app && a[4] == NFC_APP_AID_SIZE && memcmp(a + 5, host_app_aid, NFC_APP_AID_SIZE) == 0;
+        if (c->selected && c->fci_token)
+        {
+            memcpy(c->resp, c->token, sizeof(c->token));
+            n = sizeof(c->token);
+        }
+        c->resp[n++] = c->selected ? 0x90 : 0x6A;
+        c->resp[n++] = c->selected ? 0x00 : 0x82;
+    }
+    else if (c->apdu_len == 5 && a[0] == 0x00 && a[1] == 0xB0)
+    {
+        if (c->selected && a[2] == (0x80 | NFC_APP_TOKEN_SFI) && a[3] == 0 && a[4] <= sizeof(c->token))
+        {
+            memcpy(c->resp, c->token, a[4]);
+            n = a[4];
+            c->resp[n++] = 0x90;
+            c->resp[n++] = 0x00;
+        }
+        else
+        {
+            c->resp[n++] = 0x6A;
+            c->resp[n++] = 0x82;
+        }
+    }
+    else
+    {
+        c->resp[n++] = 0x6D;
+        c->resp[n++] = 0x00;
+    }
+    c->resp_len = n;
+    c->resp_off = 0;
+}
+
+/* 发送应答的下一块,超过chain时链接 */
+static void iso4_send_chunk(host_card_t *c, host_resp_t *r)
+{
+    uint8_t buf[DEF_FIFO_LENGTH];
+    uint16_t n = c->resp_len - c->resp_off;
+    uint16_t max = c->chain ? c->chain : (uint16_t)(DEF_FIFO_LENGTH - 3);
+
+    if (n > max)
+    {
+        n = max;
+    }
+    buf[0] = (uint8_t)(0x02 | c->iso_block | (c->resp_off + n < c->resp_len ? 0x10 : 0x00));
+    memcpy(buf + 1, c->resp + c->resp_off, n);
+    c->resp_off += n;
+    resp_bytes(r, buf, (uint16_t)(n + 1), 1);
+    r->delay_us += c->delay_us;
+}
+
+static int iso4_rx(host_card_t *c, const uint8_t *d, uint16_t len, host_resp_t *r)
+{
+    uint8_t buf[8];
+    uint8_t pcb;
+    uint32_t fwt_us;
+
+    if (!crc_ok(d, len))
+    {
+        return 0;
+    }
+    len -= 2;
+    pcb = d[0];
+    if (c->state == CARD_ACTIVE)
+    {
+        if (pcb != 0xE0 || len != 2)
+        {
+            card_to_idle(c);
+            return 0;
+        }
+        buf[0] = 3;                     // TL
+        buf[1] = (uint8_t)(0x20 | c->fsci);   // T0:只有TB(1)
+        buf[2] = (uint8_t)(c->fwi << 4);      // TB(1):FWI,SFGI=0
+        resp_bytes(r, buf, 3, 1);
+        c->state = CARD_PROTOCOL;
+        c->iso_block = 1;
+        return 1;
+    }
+    if ((pcb & 0xF7) == 0xC2)           // S(DESELECT)
+    {
+        resp_bytes(r, &pcb, 1, 1);
+        c->state = CARD_HALT;
+        c->from_halt = 1;
+        return 1;
+    }
+    if ((pcb & 0xF7) == 0xF2 && c->wtx_pending)     // 读卡器回应的S(WTX)
+    {
+        c->wtx_pending = 0;
+        iso4_send_chunk(c, r);
+        r->delay_us += c->wtx_us;
+        return 1;
+    }
+    if ((pcb & 0xE2) == 0x02)           // I块
+    {
+        c->iso_block = pcb & 0x01;
+        if (c->apdu_len + len - 1U > sizeof(c->apdu))
+        {
+            return 0;
+        }
+        memcpy(c->apdu + c->apdu_len, d + 1, len - 1U);
+        c->apdu_len += len - 1U;
+        if (pcb & 0x10)
+        {
+            buf[0] = (uint8_t)(0xA2 | c->iso_block);    // R(ACK)
+            resp_bytes(r, buf, 1, 1);
+            return 1;
+        }
+        iso4_apdu(c);
+        if (c->wtx_us && c->apdu[1] == 0xB0)
+        {
+            fwt_us = 302U << c->fwi;
+            buf[0] = 0xF2;
+            buf[1] = (uint8_t)(c->wtx_us / fwt_us + 1U);
+            resp_bytes(r, buf, 2, 1);
+            c->wtx_pending = 1;
+        }
+        else
+        {
+            iso4_send_chunk(c, r);
+        }
+        c->apdu_len = 0;
+        return 1;
+    }
+    if ((pcb & 0xF6) == 0xA2 && c->resp_off < c->resp_len)     // R(ACK),发下一块
+    {
+        c->iso_block = pcb & 0x01;
+        iso4_send_chunk(c, r);
+        return 1;
+    }
+    return 0;
+}
+
+/* ISO14443-3:寻卡、防冲突、选卡、HLTA,之后按卡片类型处理 */
+static int card_rx(host_card_t *c, const uint8_t *d, uint16_t bits, int crypto, host_resp_t *r)
+{
+    uint8_t cl[5];
+    uint8_t buf[3];
+    uint16_t len = bits / 8U, known, i;
+    uint8_t nvb;
+
+    r->bits = 0;
+    r->delay_us = 0;
+    if (bits == 7)
+    {
+        if ((d[0] == PICC_REQIDL && c->state == CARD_IDLE) ||
+            (d[0] == PICC_REQALL && (c->state == CARD_IDLE || c->state == CARD_HALT)))
+        {
+            c->from_halt = c->state == CARD_HALT;
+            c->state = CARD_READY;
+            c->level = 0;
+            resp_bytes(r, c->atqa, 2, 0);
+            return 1;
+        }
+        if (c->state != CARD_IDLE && c->state != CARD_HALT)
+        {
+            card_to_idle(c);
+        }
+        return 0;
+    }
+    if (c->state == CARD_IDLE || c->state == CARD_HALT || (bits % 8U != 0 && c->state != CARD_READY))
+    {
+        return 0;
+    }
+    // 认证之后的通讯是加密的,读卡器和卡片的加密状态不一致时卡片收到的是乱码
+    if (crypto != (c->type == HOST_CARD_CLASSIC && c->auth_sector != 0xFF))
+    {
+        card_to_idle(c);
+        return 0;
+    }
+    if (c->state == CARD_READY)
+    {
+        if (len < 2 && bits < 16)
+        {
+            card_to_idle(c);
+            return 0;
+        }
+        if (d[0] != host_sel[c->level])
+        {
+            card_to_idle(c);
+            return 0;
+        }
+        card_cl(c, c->level, cl);
+        nvb = d[1];
+        if (nvb == 0x70)
+        {
+            if (bits != 72 || !crc_ok(d, 9) || memcmp(d + 2, cl, 5) != 0)
+            {
+                return 0;               // 选的不是这张卡,保持READY
+            }
+            if (c->level + 1 < card_levels(c))
+            {
+                c->level++;
+                buf[0] = ISO14443_SAK_CASCADE;
+            }
+            else
+            {
+                c->state = CARD_ACTIVE;
+                buf[0] = c->sak;
+            }
+            resp_bytes(r, buf, 1, 1);
+            return 1;
+        }
+        known = (uint16_t)(((nvb >> 4) - 2) * 8 + (nvb & 0x07));
+        if ((nvb >> 4) < 2 || known > 32 || bits != 16U + known)
+        {
+            card_to_idle(c);
+            return 0;
+        }
+        for (i = 0; i < known; i++)
+        {
+            if (get_bit(d + 2, i) != get_bit(cl, i))
+            {
+                return 0;               // 已确定的位不同,这张卡不应答
+            }
+        }
+        memset(r->data, 0, 5);
+        for (i = known; i < 40; i++)
+        {
+            put_bit(r->data, (uint16_t)(i - known), get_bit(cl, i));
+        }
+        r->bits = (uint16_t)(40 - known);
+        return 1;
+    }
+    if (len == 4 && d[0] == PICC_HALT && d[1] == 0 && crc_ok(d, 4) && c->state == CARD_ACTIVE)
+    {
+        c->state = CARD_HALT;
+        c->from_halt = 1;
+        c->auth_sector = 0xFF;
+        c->ntag_auth = 0;
+        return 0;
+    }
+    if (c->type == HOST_CARD_CLASSIC)
+    {
+        return classic_rx(c, d, len, r);
+    }
+    if (card_is_ntag(c))
+    {
+        return ntag_rx(c, d, len, r);
+    }
+    return iso4_rx(c, d, len, r);
+}
+
+/*************************************** RC522 ***************************************/
+
+static void rc_field_set(uint8_t on)
+{
+    int i;
+
+    if (on == rc_field)
+    {
+        return;
+    }
+    rc_field = on;
+    for (i = 0; i < host_card_num; i++)
+    {
+        if (!on)
+        {
+            host_cards[i].state = CARD_OFF;
+        }
+        else if (host_cards[i].present)
+        {
+            card_power_on(&host_cards[i]);
+        }
+    }
+}
+
+static void rc_soft_reset(void)
+{
+    memset(rc_reg, 0, sizeof(rc_reg));
+    rc_reg[CommandReg] = 0x20;
+    rc_reg[ComIEnReg] = 0x80;
+    rc_reg[ComIrqReg] = 0x14;
+    rc_reg[Status1Reg] = 0x21;
+    rc_reg[WaterLevelReg] = 0x08;
+    rc_reg[ControlReg] = 0x10;
+    rc_reg[CollReg] = 0x80;
+    rc_reg[ModeReg] = 0x3F;
+    rc_reg[TxControlReg] = 0x80;
+    rc_reg[VersionReg] = 0x92;
+    rc_fifo_len = 0;
+    rc_busy = 0;
+    rc_field_set(0);
+}
+
+/* 命令完成时间到了就把结果写入寄存器 */
+static void rc_update(void)
+{
+    if (!rc_busy || host_now_ns() < rc_done_ns)
+    {
+        return;
+    }
+    rc_busy = 0;
+    rc_reg[ComIrqReg] |= rc_done_irq;
+    rc_reg[ErrorReg] = rc_done_err;
+    rc_reg[CollReg] = (uint8_t)((rc_reg[CollReg] & 0x80) | rc_done_coll);
+    rc_reg[ControlReg] = (uint8_t)((rc_reg[ControlReg] & 0xF8) | rc_done_lastbits);
+    if (rc_done_crypto)
+    {
+        rc_reg[Status2Reg] |= 0x08;
+    }
+    if (rc_done_len > DEF_FIFO_LENGTH)
+    {
+        rc_reg[ErrorReg] |= 0x10;       // BufferOvfl
+        rc_done_len = DEF_FIFO_LENGTH;
+    }
+    memcpy(rc_fifo, rc_done_fifo, rc_done_len);
+    rc_fifo_len = (uint8_t)rc_done_len;
+    if (rc_done_irq & 0x10)
+    {
+        rc_reg[CommandReg] &= 0xF0;     // 命令结束回到Idle
+    }
+}
+
+/* 开始执行命令:ns之后完成 */
+static void rc_start(uint64_t ns, uint8_t irq)
+{
+    rc_busy = 1;
+    rc_done_ns = host_now_ns() + ns;
+    rc_done_irq = irq;
+    rc_done_err = 0;
+    rc_done_coll = 0;
+    rc_done_crypto = 0;
+    rc_done_len = 0;
+    rc_done_lastbits = 0;
+    host_rc522.rf_ns += ns;
+    if (irq & 0x01)
+    {
+        host_rc522.rf_timeouts++;
+    }
+}
+
+/* Transceive:发送FIFO中的帧,收集所有卡片的应答,按位合并后放到FIFO */
+static void rc_transceive(void)
+{
+    static host_resp_t resp[HOST_CARD_MAX];
+    uint8_t frame[DEF_FIFO_LENGTH + 2];
+    uint8_t merged[HOST_RESP_MAX];
+    uint16_t bits, len = rc_fifo_len, i, k;
+    uint8_t txlast = rc_reg[BitFramingReg] & 0x07;
+    uint8_t rxalign = (rc_reg[BitFramingReg] >> 4) & 0x07;
+    uint16_t crc, rx_bits = 0, coll = 0;
+    uint32_t delay_us = 0;
+    uint64_t tx, wait;
+    int n = 0, j, v, crypto = (rc_reg[Status2Reg] & 0x08) != 0;
+
+    memcpy(frame, rc_fifo, len);
+    rc_fifo_len = 0;
+    bits = (uint16_t)(txlast ? (len - 1) * 8 + txlast : len * 8);
+    if ((rc_reg[TxModeReg] & 0x80) && txlast == 0)
+    {
+        crc = crc_a(frame, len);
+        frame[len++] = (uint8_t)crc;
+        frame[len++] = (uint8_t)(crc >> 8);
+        bits += 16;
+    }
+    host_rc522.rf_frames++;
+    tx = rf_ns(bits);
+
+    for (j = 0; j < host_card_num; j++)
+    {
+        if (card_can_answer(&host_cards[j]) && card_rx(&host_cards[j], frame, bits, crypto, &resp[n]) &&
+            resp[n].bits > 0)
+        {
+            if (resp[n].delay_us > delay_us)
+            {
+                delay_us = resp[n].delay_us;
+            }
+            if (resp[n].bits > rx_bits)
+            {
+                rx_bits = resp[n].bits;
+            }
+            n++;
+        }
+    }
+    wait = (uint64_t)HOST_FDT_NS + (uint64_t)delay_us * 1000U;
+    // TAuto:发送结束后定时器开始计时,收到应答时停止
+    if (n == 0 || ((rc_reg[TModeReg] & 0x80) && wait > timer_ns()))
+    {
+        if (rc_reg[TModeReg] & 0x80)
+        {
+            rc_start(tx + timer_ns(), 0x41);    // TxIRq、TimerIRq
+        }
+        else
+        {
+            rc_start(tx + 1000000000ULL, 0x40); // 没有定时器,只能由固件超时
+        }
+        return;
+    }
+
+    // 按位合并,第一个不同的位是冲突
+    memset(merged, 0, sizeof(merged));
+    for (i = 0; i < rx_bits; i++)
+    {
+        v = 0;
+        for (j = 0; j < n; j++)
+        {
+            if (i < resp[j].bits)
+            {
+                v |= 1 << get_bit(resp[j].data, i);
+            }
+        }
+        if (v == 3 && coll == 0)
+        {
+            coll = (uint16_t)(i + 1);
+        }
+        if (coll && !(rc_reg[CollReg] & 0x80))
+        {
+            v = 0;                      // ValuesAfterColl为0:冲突之后的位清零
+        }
+        put_bit(merged, i, v & 2 ? 1 : 0);
+    }
+    rc_start(tx + wait + rf_ns(rx_bits), 0x60);     // TxIRq、RxIRq
+    // 接收的第一位放在第RxAlign位
+    memset(rc_done_fifo, 0, sizeof(rc_done_fifo));
+    for (i = 0; i < rx_bits; i++)
+    {
+        put_bit(rc_done_fifo, (uint16_t)(i + rxalign), get_bit(merged, i));
+    }
+    k = (uint16_t)(rx_bits + rxalign);
+    rc_done_len = (uint16_t)((k + 7) / 8);
+    rc_done_lastbits = (uint8_t)(k % 8);
+    if (coll)
+    {
+        rc_done_err |= 0x08;            // CollErr
+        k = (uint16_t)(coll + rxalign);
+        rc_done_coll = k > 32 ? 0x20 : (uint8_t)(k & 0x1F);
+    }
+    if (rc_reg[RxModeReg] & 0x80)
+    {
+        if (rc_done_lastbits != 0 || !crc_ok(rc_done_fifo, rc_done_len))
+        {
+            rc_done_err |= 0x04;        // CRCErr
+        }
+        else
+        {
+            rc_done_len -= 2;           // 硬件校验后去掉CRC
+        }
+    }
+}
+
+/* MFAuthent:FIFO中是命令、块号、6字节密钥、4字节UID,和卡片交换两个来回 */
+static void rc_authent(void)
+{
+    host_card_t *c = NULL;
+    const uint8_t *trailer, *key;
+    uint64_t t1 = rf_ns(32) + HOST_FDT_NS + rf_ns(32);      // 认证命令、卡片随机数
+    uint64_t t2 = rf_ns(64) + HOST_FDT_NS + rf_ns(32);      // 读卡器应答、卡片应答
+    int j;
+
+    host_rc522.rf_frames += 2;
+    rc_fifo_len = 0;
+    for (j = 0; j < host_card_num; j++)
+    {
+        if (card_can_answer(&host_cards[j]) && host_cards[j].type == HOST_CARD_CLASSIC &&
+            host_cards[j].state == CARD_ACTIVE && rc_fifo[1] < 64 &&
+            memcmp(host_cards[j].uid + host_cards[j].uid_len - 4, rc_fifo + 8, 4) == 0)
+        {
+            c = &host_cards[j];
+        }
+    }
+    if (c == NULL)
+    {
+        rc_start(rf_ns(32) + timer_ns(), 0x01);
+        return;
+    }
+    trailer = &c->mem[(rc_fifo[1] / 4 * 4 + 3) * 16];
+    key = rc_fifo[0] == PICC_AUTHENT1A ? trailer : trailer + 10;
+    if (memcmp(rc_fifo + 2, key, CRED_NFC_KEY_SIZE) != 0)
+    {
+        // 密钥不对:卡片验证读卡器应答失败,不再应答
+        card_to_idle(c);
+        rc_start(t1 + rf_ns(64) + timer_ns(), 0x01);
+        return;
+    }
+    c->auth_sector = rc_fifo[1] / 4;
+    rc_start(t1 + t2, 0x10);            // IdleIRq
+    rc_done_crypto = 1;
+}
+
+static void rc_command(uint8_t value)
+{
+    uint16_t crc;
+
+    rc_reg[CommandReg] = value & 0x3F;
+    switch (value & 0x0F)
+    {
+        case PCD_IDLE:
+            rc_busy = 0;
+            break;
+        case PCD_CALCCRC:
+            crc = crc_a(rc_fifo, rc_fifo_len);
+            rc_fifo_len = 0;
+            rc_reg[CRCResultRegL] = (uint8_t)crc;
+            rc_reg[CRCResultRegM] = (uint8_t)(crc >> 8);
+            rc_reg[DivIrqReg] |= 0x04;
+            break;
+        case PCD_AUTHENT:
+            rc_authent();
+            break;
+        case PCD_RESETPHASE:
+            rc_soft_reset();
+            rc_reg[CommandReg] = 0x20;
+            break;
+        default:
+            break;
+    }
+}
+
+static void rc_write(uint8_t addr, uint8_t value)
+{
+    switch (addr)
+    {
+        case CommandReg:
+            rc_command(value);
+            break;
+        case ComIrqReg:
+        case DivIrqReg:
+            rc_reg[addr] = (value & 0x80) ? (uint8_t)(rc_reg[addr] | (value & 0x7F)) : (uint8_t)(rc_reg[addr] & ~value & 0x7F);
+            break;
+        case ErrorReg:
+        case Status1Reg:
+        case CRCResultRegM:
+        case CRCResultRegL:
+        case VersionReg:
+            break;
+        case Status2Reg:
+            rc_reg[addr] = (uint8_t)((value & 0xC0) | (rc_reg[addr] & value & 0x08));   // MFCrypto1On只能清零
+            break;
+        case FIFODataReg:
+            if (rc_fifo_len < DEF_FIFO_LENGTH)
+            {
+                rc_fifo[rc_fifo_len++] = value;
+            }
+            else
+            {
+                rc_reg[ErrorReg] |= 0x10;
+            }
+            break;
+        case FIFOLevelReg:
+            if (value & 0x80)
+            {
+                rc_fifo_len = 0;
+                rc_reg[ErrorReg] &= (uint8_t)~0x10;
+            }
+            break;
+        case ControlReg:
+            if (value & 0x80)
+            {
+                rc_busy = 0;            // TStopNow:没有完成的命令作废
+            }
+            break;
+        case BitFramingReg:
+            rc_reg[addr] = value & 0x77;
+            if ((value & 0x80) && (rc_reg[CommandReg] & 0x0F) == PCD_TRANSCEIVE && !rc_busy)
+            {
+                rc_transceive();
+            }
+            break;
+        case CollReg:
+            rc_reg[addr] = (uint8_t)((rc_reg[addr] & 0x7F) | (value & 0x80));
+            break;
+        case TxControlReg:
+            rc_reg[addr] = value;
+            rc_field_set((value & 0x03) != 0);
+            break;
+        default:
+            rc_reg[addr] = value;
+            break;
+    }
+}
+
+static uint8_t rc_read(uint8_t addr)
+{
+    uint8_t v;
+
+    switch (addr)
+    {
+        case FIFODataReg:
+            if (rc_fifo_len == 0)
+            {
+                return 0;
+            }
+            v = rc_fifo[0];
+            memmove(rc_fifo, rc_fifo + 1, --rc_fifo_len);
+            return v;
+        case FIFOLevelReg:
+            return rc_fifo_len;
+        default:
+            return rc_reg[addr];
+    }
+}
+
+/* 一次片选传输bytes字节的时间 */
+static void rc_spi(uint32_t bytes)
+{
+    uint64_t ns;
+
+    if (rc_mode == RC522_SPI_FAST)
+    {
+        ns = (uint64_t)bytes * 8U * (1000000000U / RC522_SPI_HZ) + HOST_SPI_CS_NS;
+        host_rc522.spi_frames++;
+    }
+    else
+    {
+        ns = (uint64_t)bytes * HOST_SPI_HAL_NS;
+        host_rc522.spi_frames += bytes / 2U;    // 每个字节一次片选
+    }
+    host_rc522.spi_ns += ns;
+    host_delay_ns(ns);
+    rc_update();
+}
+
+/*************************************** 传输层(代替rc522_spi.c) ***************************************/
+
+void RC522_SPI_Init(void)
+{
+}
+
+void RC522_SPI_HardReset(void)
+{
+    rc_soft_reset();
+}
+
+void RC522_SPI_SetMode(RC522_SpiMode_t mode)
+{
+    rc_mode = mode < RC522_SPI_MODE_NUM ? mode : RC522_SPI_FAST;
+}
+
+RC522_SpiMode_t RC522_SPI_GetMode(void)
+{
+    return rc_mode;
+}
+
+uint8_t ReadRawRC(uint8_t ucAddress)
+{
+    host_rc522.reg_reads++;
+    rc_spi(2);
+    return rc_read(ucAddress & 0x3F);
+}
+
+void WriteRawRC(uint8_t ucAddress, uint8_t ucValue)
+{
+    host_rc522.reg_writes++;
+    rc_spi(2);
+    rc_write(ucAddress & 0x3F, ucValue);
+}
+
+void RC522_ReadFifo(uint8_t *data, uint8_t len)
+{
+    uint8_t i;
+
+    if (len == 0)
+    {
+        return;
+    }
+    host_rc522.fifo_bursts++;
+    host_rc522.fifo_bytes += len;
+    rc_spi(rc_mode == RC522_SPI_FAST ? len + 1U : len * 2U);
+    for (i = 0; i < len; i++)
+    {
+        data[i] = rc_read(FIFODataReg);
+    }
+}
+
+void RC522_WriteFifo(const uint8_t *data, uint8_t len)
+{
+    uint8_t i;
+
+    if (len == 0)
+    {
+        return;
+    }
+    host_rc522.fifo_bursts++;
+    host_rc522.fifo_bytes += len;
+    rc_spi(rc_mode == RC522_SPI_FAST ? len + 1U : len * 2U);
+    for (i = 0; i < len; i++)
+    {
+        rc_write(FIFODataReg, data[i]);
+    }
+}
+
+/*************************************** 仿真接口 ***************************************/
+
+/**
+ * @brief 复位RC522,删除所有卡片,清零统计
+ */
+void host_rc522_init(void)
+{
+    rc_soft_reset();
+    host_card_num = 0;
+    memset(host_cards, 0, sizeof(host_cards));
+    memset(&host_rc522, 0, sizeof(host_rc522));
+}
+
+/**
+ * @brief 添加一张卡(不在场中),按类型初始化ATQA/SAK、存储区和默认参数
+ */
+host_card_t *host_card_add(host_card_type_t type, const uint8_t *uid, uint8_t uid_len)
+{
+    static const uint8_t trailer[16] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x07, 0x80, 0x69,
+                                        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    host_card_t *c;
+    int b;
+
+    if (host_card_num >= HOST_CARD_MAX)
+    {
+        return NULL;
+    }
+    c = &host_cards[host_card_num++];
+    memset(c, 0, sizeof(*c));
+    c->type = type;
+    memcpy(c->uid, uid, uid_len);
+    c->uid_len = uid_len;
+    c->powerup_us = 1000;
+    c->auth_sector = 0xFF;
+    c->write_block = -1;
+    c->atqa[0] = uid_len == 4 ? 0x04 : (uid_len == 7 ? 0x44 : 0x84);
+    switch (type)
+    {
+        case HOST_CARD_CLASSIC:
+            c->sak = 0x08;
+            memcpy(c->mem, uid, uid_len);
+            for (b = 3; b < 64; b += 4)
+            {
+                memcpy(&c->mem[b * 16], trailer, 16);
+            }
+            break;
+        case HOST_CARD_NTAG213:
+        case HOST_CARD_NTAG215:
+        case HOST_CARD_NTAG216:
+            c->sak = 0x00;
+            c->pages = type == HOST_CARD_NTAG213 ? 45 : (type == HOST_CARD_NTAG215 ? 135 : 231);
+            c->cfg = (uint8_t)(c->pages - 4);
+            memcpy(ntag_page(c, 0), uid, 3);
+            ntag_page(c, 0)[3] = 0x88 ^ uid[0] ^ uid[1] ^ uid[2];
+            memcpy(ntag_page(c, 1), uid + 3, 4);
+            ntag_page(c, 2)[0] = uid[3] ^ uid[4] ^ uid[5] ^ uid[6];
+            ntag_page(c, 2)[1] = 0x48;
+            ntag_page(c, c->cfg)[NTAG_AUTH0_OFFSET] = 0xFF;
+            memset(ntag_page(c, c->cfg + 2), 0xFF, 4);
+            break;
+        case HOST_CARD_ISO4:
+            c->sak = 0x20;
+            c->atqa[1] = 0x03;
+            c->fsci = 5;
+            c->fwi = 8;
+            c->delay_us = 500;
+            break;
+    }
+    return c;
+}
+
+/**
+ * @brief 把卡片放进/拿出天线场,天线打开时放入的卡片从这时开始上电
+ */
+void host_card_move(host_card_t *card, int present)
+{
+    card->present = (uint8_t)present;
+    if (!present)
+    {
+        card->state = CARD_OFF;
+    }
+    else if (rc_field)
+    {
+        card_power_on(card);
+    }
+}
@@ -0,0 +1,348 @@
+/**
+  ******************************************************************************
+  * @file    host_stub.c
+  * @author  cyytx
+  * @brief   主机回放工具的HAL/FreeRTOS/日志桩函数
+  *          1.回放只调用协议处理函数(FP_ProcessFrame等),初始化、收发、任务函数不会运行,
+  *            这里的HAL和FreeRTOS函数只为链接,全部是空实现;
+  *          2.日志按设备上的二进制格式写入文件,时间戳用回放的虚拟时间,
+  *            用tools/log_decode.py和同一份字典解码(%s参数显示为地址);
+  *          3.开锁请求记录下来作为每一帧的处理结果,人脸、指纹的识别结果不经过并行识别协调。
+  ******************************************************************************
+  */
+#include <stdlib.h>
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "timers.h"
+#include "event_groups.h"
+#include "main.h"
+#include "log.h"
+#include "uart.h"
+#include "sg90.h"
+#include "auth.h"
+#include "bio.h"
+#include "cred.h"
+#include "rng.h"
+#include "rtc.h"
+#include "host.h"
+
+uint32_t host_time_us = 0;
+int host_quiet = 0;
+int host_lock_cmd = -1;
+int host_auth_user = 0;
+FILE *host_log = NULL;
+
+/*************************************** 日志 ***************************************/
+
+static uint8_t log_seq = 0;
+
+static void host_log_rec(uint8_t type, uint32_t tag, const void *payload, uint16_t len)
+{
+    uint8_t head[12];
+
+    if (host_quiet || host_log == NULL)
+    {
+        return;
+    }
+    head[0] = LOG_SYNC_BYTE;
+    head[1] = type;
+    head[2] = (uint8_t)(len + 4U);
+    head[3] = log_seq++;
+    memcpy(&head[4], &host_time_us, 4);     /* 主机也是小端 */
+    memcpy(&head[8], &tag, 4);
+    fwrite(head, 1, sizeof(head), host_log);
+    fwrite(payload, 1, len, host_log);
+}
+
+uint32_t LOG_GetTimeUs(void)
+{
+    return host_time_us;
+}
+
+/*************************************** 虚拟时间 ***************************************/
+
+static uint32_t host_ns_rem = 0;        /* 不足1us的部分 */
+
+void host_delay_ns(uint64_t ns)
+{
+    ns += host_ns_rem;
+    host_time_us += (uint32_t)(ns / 1000U);
+    host_ns_rem = (uint32_t)(ns % 1000U);
+}
+
+uint64_t host_now_ns(void)
+{
+    return (uint64_t)host_time_us * 1000U + host_ns_rem;
+}
+
+void LOG_Write(uint32_t token, uint32_t nargs, uint32_t a0, uint32_t a1, uint32_t a2,
+               uint32_t a3, uint32_t a4, uint32_t a5)
+{
+    uint32_t args[LOG_MAX_ARGS] = {a0, a1, a2, a3, a4, a5};
+
+    if (nargs > LOG_MAX_ARGS)
+    {
+        nargs = LOG_MAX_ARGS;
+    }
+    host_log_rec(LOG_REC_FMT, token, args, (uint16_t)(nargs * 4U));
+}
+
+void LOG_Bytes(uint8_t type, uint32_t token, const uint8_t *data, uint16_t len)
+{
+    uint16_t chunk;
+
+    do {
+        chunk = (len > LOG_HEX_MAX) ? LOG_HEX_MAX : len;
+        host_log_rec(type, token, data, chunk);
+        data += chunk;
+        len -= chunk;
+    } while (len > 0U);
+}
+
+void LOG_Capture(uint8_t chan, uint8_t ctx, const uint8_t *data, uint16_t len)
+{
+}
+
+/*************************************** 门锁 ***************************************/
+
+/* 主机上不限流 */
+int AUTH_Allow(AUTH_Source_t source)
+{
+    return 1;
+}
+
+/* 没有授权任务,验证通过的开锁请求直接记为开锁 */
+int AUTH_Request(AUTH_Source_t source, int user, uint32_t capture_us)
+{
+    host_auth_user = user;
+    if (!host_quiet && user != CRED_NONE)
+    {
+        host_lock_cmd = LOCK_CMD_OPEN;
+    }
+    return 0;
+}
+
+/* 没有并行识别,每个识别结果直接作为开锁请求 */
+void BIO_Result(BIO_Modality_t m, int user, uint32_t capture_us)
+{
+    AUTH_Request(m == BIO_FACE ? AUTH_SRC_FACE : AUTH_SRC_FP, user, capture_us);
+}
+
+void BIO_Wake(uint32_t wake_us)
+{
+}
+
+void BIO_SetPresent(BIO_Modality_t m, uint8_t present)
+{
+}
+
+/*************************************** HAL ***************************************/
+
+/* 随机数用rand,只用于生成站点密钥和卡令牌,主机上不要求不可预测 */
+int RNG_Read(void *buf, uint32_t len)
+{
+    uint8_t *p = (uint8_t *)buf;
+
+    while (len--)
+    {
+        *p++ = (uint8_t)rand();
+    }
+    return 0;
+}
+
+/* 日历没有设置,一次性密码都不接受;cred_bench直接传入时间 */
+uint32_t RTC_GetTime(void)
+{
+    return 0;
+}
+
+/* 延时推进虚拟时间 */
+void delay_us(uint32_t nus)
+{
+    host_delay_ns((uint64_t)nus * 1000U);
+}
+
+void delay_ms(uint32_t nms)
+{
+    host_delay_ns((uint64_t)nms * 1000000U);
+}
+
+void _Error_Handler(char *file, int line)
+{
+    fprintf(stderr, "Error_Handler: %s:%d\n", file, line);
+    exit(1);
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+    return GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+}
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size)
+{
+    return HAL_OK;
+}
+
+void HAL_UART_IRQHandler(UART_HandleTypeDef *huart)
+{
+}
+
+HAL_StatusTypeDef UART_SetBaudRate(UART_HandleTypeDef *huart, uint32_t baud)
+{
+    return HAL_OK;
+}
+
+uint32_t UART_LoadBaudRate(uint32_t bkp_index, uint32_t default_baud)
+{
+    return default_baud;
+}
+
+void UART_SaveBaudRate(uint32_t bkp_index, uint32_t baud)
+{
+}
+
+/*************************************** FreeRTOS ***************************************/
+
+void vPortEnterCritical(void)
+{
+}
+
+void vPortExitCritical(void)
+{
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char * const pcName,
+                       const configSTACK_DEPTH_TYPE usStackDepth, void * const pvParameters,
+                       UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask)
+{
+    return pdPASS;
+}
+
+/* 单线程,延时就是推进虚拟时间 */
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    host_delay_ns((uint64_t)xTicksToDelay * portTICK_PERIOD_MS * 1000000U);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return NULL;
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction,
+                              uint32_t *pulPreviousNotificationValue)
+{
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    return 0;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return host_time_us / 1000U;
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return host_time_us / 1000U;
+}
+
+QueueHandle_t xQueueGenericCreate(const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, const uint8_t ucQueueType)
+{
+    return NULL;
+}
+
+QueueHandle_t xQueueCreateMutex(const uint8_t ucQueueType)
+{
+    return NULL;
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void * const pvItemToQueue, TickType_t xTicksToWait, const BaseType_t xCopyPosition)
+{
+    return pdPASS;
+}
+
+BaseType_t xQueueGenericSendFromISR(QueueHandle_t xQueue, const void * const pvItemToQueue, BaseType_t * const pxHigherPriorityTaskWoken, const BaseType_t xCopyPosition)
+{
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void * const pvBuffer, TickType_t xTicksToWait)
+{
+    return errQUEUE_EMPTY;
+}
+
+BaseType_t xQueueSemaphoreTake(QueueHandle_t xQueue, TickType_t xTicksToWait)
+{
+    return pdFAIL;
+}
+
+TimerHandle_t xTimerCreate(const char * const pcTimerName, const TickType_t xTimerPeriodInTicks,
+                           const UBaseType_t uxAutoReload, void * const pvTimerID,
+                           TimerCallbackFunction_t pxCallbackFunction)
+{
+    return NULL;
+}
+
+BaseType_t xTimerGenericCommand(TimerHandle_t xTimer, const BaseType_t xCommandID, const TickType_t xOptionalValue,
+                                BaseType_t * const pxHigherPriorityTaskWoken, const TickType_t xTicksToWait)
+{
+    return pdPASS;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return NULL;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToWaitFor,
+                                const BaseType_t xClearOnExit, const BaseType_t xWaitForAllBits, TickType_t xTicksToWait)
+{
+    return 0;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear)
+{
+    return 0;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet)
+{
+    return 0;
+}
+
+BaseType_t xEventGroupSetBitsFromISR(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    return pdPASS;
+}
@@ -0,0 +1,420 @@
+/**
+  ******************************************************************************
+  * @file    nfc_sim.c
+  * @author  cyytx
+  * @brief   NFC协议栈(user/nfc.c、user/iso14443.c)在RC522仿真(host_rc522.c)上的测试和基准
+  *          1.没有卡时的寻卡:一次WUPA超时,天线按寻卡调度关闭;
+  *          2.Classic 1K(4/7字节UID)、NTAG215、手机模拟卡(随机UID,SELECT应答带令牌)、
+  *            DESFire类卡(令牌在文件中,应答分块链接,读文件前S(WTX))、10字节UID卡:
+  *            通过NFC_EnrollCard + NFC_PollOnce登记,移走后再出示,检查认证的用户;
+  *          3.NTAG登记后令牌页读写要密码,重新登记走已设置密码的路径;没登记的卡不开锁;
+  *          4.两张、三张卡同时在场(UID前缀相同、ATQA不同):级联防冲突逐张选中后HLTA,
+  *            原来的PcdAnticoll在冲突时失败;
+  *          5.每个操作的射频帧数、寄存器读写次数、FIFO字节数、片选次数、SPI时间和总时间,
+  *            对比原来的PcdAnticoll+PcdSelect和ISO14443_Select、PcdRead和FAST_READ、
+  *            HAL方式和BSRR方式的SPI。时间是虚拟时间,按设备上的SPI时钟和106kbps计算。
+  *
+  * 用法: nfc_sim [-v] (-v输出每张卡的UID)
+  ******************************************************************************
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "nfc.h"
+#include "iso14443.h"
+#include "rc522_spi.h"
+#include "cred.h"
+#include "rng.h"
+#include "host.h"
+
+#define SIM_AUTH_NONE       (-100)      /* 没有开锁请求 */
+#define SIM_SETTLE_MS       NFC_POLL_SETTLE_MS
+
+static int failures = 0;
+static int verbose = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { failures++; if (failures <= 10) { printf("FAIL: " __VA_ARGS__); printf("\n"); } } } while (0)
+
+/* 一个操作开始时的统计,结束时输出差值 */
+static host_rc522_stats_t op_start;
+static uint64_t op_start_ns;
+
+static void op_begin(void)
+{
+    op_start = host_rc522;
+    op_start_ns = host_now_ns();
+}
+
+static void op_end(const char *name)
+{
+    const host_rc522_stats_t *s = &host_rc522;
+
+    printf("%-28s %5u %6u %6u %6u %6u %9.1f %9.1f %9.1f\n", name,
+           s->rf_frames - op_start.rf_frames,
+           s->reg_reads - op_start.reg_reads,
+           s->reg_writes - op_start.reg_writes,
+           s->fifo_bytes - op_start.fifo_bytes,
+           s->spi_frames - op_start.spi_frames,
+           (s->spi_ns - op_start.spi_ns) / 1e3,
+           (s->rf_ns - op_start.rf_ns) / 1e3,
+           (host_now_ns() - op_start_ns) / 1e3);
+}
+
+/* 换一组卡片:复位RC522仿真,重新初始化NFC,之前的卡片都移走 */
+static void sim_reset(void)
+{
+    host_rc522_init();
+    NFC_Init();
+}
+
+/* 出示卡片后执行一次寻卡调度,返回开锁请求中的用户 */
+static int sim_present(host_card_t *card, const char *name)
+{
+    host_auth_user = SIM_AUTH_NONE;
+    if (card != NULL)
+    {
+        host_card_move(card, 1);
+    }
+    op_begin();
+    NFC_PollOnce();
+    op_end(name);
+    if (verbose && card != NULL)
+    {
+        printf("  uid %d bytes %02X%02X%02X%02X...\n", card->uid_len, card->uid[0], card->uid[1],
+               card->uid[2], card->uid[3]);
+    }
+    return host_auth_user;
+}
+
+/* 移走卡片,寻卡调度检查到卡片移走 */
+static void sim_remove(host_card_t *card)
+{
+    host_card_move(card, 0);
+    NFC_PollOnce();
+}
+
+static void make_uid(uint8_t *uid, uint8_t len, uint8_t seed)
+{
+    uint8_t i;
+
+    uid[0] = len == 4 ? seed : 0x04;    // 7/10字节UID的第一个字节是厂商代码
+    for (i = 1; i < len; i++)
+    {
+        uid[i] = (uint8_t)(seed * 31U + i * 17U);
+    }
+}
+
+/* 登记一张卡并重新出示验证 */
+static void sim_enroll_verify(host_card_t *card, uint16_t user, const char *name)
+{
+    char label[40];
+    int got;
+
+    NFC_EnrollCard(user);
+    snprintf(label, sizeof(label), "%s enroll", name);
+    sim_present(card, label);
+    sim_remove(card);
+    snprintf(label, sizeof(label), "%s verify", name);
+    got = sim_present(card, label);
+    CHECK(got == user, "%s: user %d, expected %u", name, got, user);
+    sim_remove(card);
+}
+
+static void sim_no_card(void)
+{
+    NFC_PollPolicy_t policy;
+    uint32_t timeouts = host_rc522.rf_timeouts;
+    uint32_t next;
+
+    NFC_GetPolicy(&policy);
+    sim_reset();
+    host_auth_user = SIM_AUTH_NONE;
+    op_begin();
+    next = NFC_PollOnce();
+    op_end("poll, no card");
+    CHECK(next == policy.idle_ms, "no card: next poll in %u ms", next);
+    CHECK(host_rc522.rf_timeouts == timeouts + 1, "no card: %u timeouts", host_rc522.rf_timeouts - timeouts);
+    CHECK(host_auth_user == SIM_AUTH_NONE, "no card: auth request for %d", host_auth_user);
+}
+
+static void sim_classic(void)
+{
+    uint8_t uid[10];
+    uint8_t key[CRED_NFC_KEY_SIZE];
+    CRED_Entry_t entry;
+    host_card_t *c4, *c7, *unknown;
+
+    sim_reset();
+    make_uid(uid, 4, 0x3A);
+    c4 = host_card_add(HOST_CARD_CLASSIC, uid, 4);
+    sim_enroll_verify(c4, 1, "classic 4B");
+    CHECK(CRED_Find(CRED_TYPE_NFC_UID, uid, 4, &entry) == 1, "classic 4B: uid not enrolled");
+    CRED_NfcKey(uid, 4, NFC_SECTOR, key);
+    CHECK(memcmp(&c4->mem[NFC_TRAILER_BLOCK * 16], key, sizeof(key)) == 0, "classic 4B: sector key not diversified");
+
+    // 重新登记:扇区已经是分散密钥
+    sim_enroll_verify(c4, 1, "classic 4B re-enroll");
+
+    make_uid(uid, 7, 0x51);
+    c7 = host_card_add(HOST_CARD_CLASSIC, uid, 7);
+    sim_enroll_verify(c7, 2, "classic 7B");
+
+    // 没登记的卡:走兼容旧卡的路径,出厂密钥读出的令牌不对
+    make_uid(uid, 4, 0x77);
+    unknown = host_card_add(HOST_CARD_CLASSIC, uid, 4);
+    CHECK(sim_present(unknown, "classic unknown") == CRED_NONE, "classic unknown: accepted");
+    sim_remove(unknown);
+
+    // 被改写了令牌的卡
+    c4->mem[NFC_TOKEN_BLOCK * 16] ^= 0x01;
+    CHECK(sim_present(c4, "classic bad token") == CRED_NONE, "classic: bad token accepted");
+    sim_remove(c4);
+}
+
+static void sim_ntag(void)
+{
+    uint8_t uid[10];
+    uint8_t data[16];
+    ISO14443_Card_t card;
+    host_card_t *c;
+
+    sim_reset();
+    make_uid(uid, 7, 0x62);
+    c = host_card_add(HOST_CARD_NTAG215, uid, 7);
+    sim_enroll_verify(c, 3, "ntag215");
+    CHECK(c->mem[c->cfg * 4 + NTAG_AUTH0_OFFSET] == NFC_NTAG_TOKEN_PAGE, "ntag: AUTH0 %02X", c->mem[c->cfg * 4 + 3]);
+    CHECK(c->mem[(c->cfg + 1) * 4] & NTAG_ACCESS_PROT, "ntag: PROT not set");
+
+    // 不认证读令牌页:NAK
+    host_card_move(c, 1);
+    PcdAntennaOn();
+    vTaskDelay(pdMS_TO_TICKS(SIM_SETTLE_MS));
+    CHECK(PcdRequest(PICC_REQALL, data) == MI_OK && ISO14443_Select(&card) == MI_OK, "ntag: select failed");
+    CHECK(NTAG_FastRead(NFC_NTAG_TOKEN_PAGE, NFC_NTAG_TOKEN_PAGE + 3, data) != MI_OK, "ntag: protected pages readable");
+    PcdAntennaOff();
+    host_card_move(c, 0);
+
+    // 重新登记:配置页读不出,用已设置的密码
+    sim_enroll_verify(c, 3, "ntag215 re-enroll");
+}
+
+static void sim_iso4(void)
+{
+    uint8_t uid[10];
+    uint8_t first[4];
+    host_card_t *phone, *desfire, *long_uid;
+
+    sim_reset();
+    make_uid(uid, 4, 0x08);
+    phone = host_card_add(HOST_CARD_ISO4, uid, 4);
+    phone->random_uid = 1;
+    phone->fci_token = 1;
+    phone->has_app = 1;
+    RNG_Read(phone->token, sizeof(phone->token));
+    CHECK(sim_present(phone, "phone unknown") == CRED_NONE, "phone: accepted before enroll");
+    memcpy(first, phone->uid, sizeof(first));
+    sim_remove(phone);
+    sim_enroll_verify(phone, 4, "phone (random uid)");
+    CHECK(memcmp(first, phone->uid, sizeof(first)) != 0, "phone: uid did not change");
+
+    make_uid(uid, 7, 0x24);
+    desfire = host_card_add(HOST_CARD_ISO4, uid, 7);
+    desfire->has_app = 1;
+    desfire->chain = 8;                 // 应答每块8字节
+    desfire->fwi = 4;                   // FWT约4.8ms
+    desfire->wtx_us = 20000;            // 读文件20ms,要WTX
+    RNG_Read(desfire->token, sizeof(desfire->token));
+    sim_enroll_verify(desfire, 5, "iso4 chain+wtx");
+
+    make_uid(uid, 10, 0x19);
+    long_uid = host_card_add(HOST_CARD_ISO4, uid, 10);
+    long_uid->has_app = 1;
+    RNG_Read(long_uid->token, sizeof(long_uid->token));
+    sim_enroll_verify(long_uid, 6, "iso4 10B uid");
+
+    // 没有门锁应用的卡
+    host_card_move(long_uid, 0);
+    long_uid->has_app = 0;
+    CHECK(sim_present(long_uid, "iso4 no app") == CRED_NONE, "iso4: card without app accepted");
+    sim_remove(long_uid);
+}
+
+/* 多张卡同时在场:逐张选中后HLTA,REQA只有没休眠的卡应答 */
+static void sim_collision(void)
+{
+    uint8_t uid[3][10] = {{0x11, 0x22, 0x33, 0x44}, {0x11, 0x22, 0x33, 0xC4}, {0x04, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77}};
+    uint8_t len[3] = {4, 4, 7};
+    uint8_t atqa[2], snr[4], seen = 0;
+    ISO14443_Card_t card;
+    host_card_t *c[3];
+    char label[32];
+    int i, j, n;
+
+    for (n = 2; n <= 3; n++)
+    {
+        sim_reset();
+        for (i = 0; i < n; i++)
+        {
+            c[i] = host_card_add(HOST_CARD_CLASSIC, uid[i], len[i]);
+            host_card_move(c[i], 1);
+        }
+        PcdAntennaOn();
+        vTaskDelay(pdMS_TO_TICKS(SIM_SETTLE_MS));
+
+        // 原来的防冲突:冲突时直接失败
+        CHECK(PcdRequest(PICC_REQALL, atqa) == MI_OK, "%d cards: request failed", n);
+        CHECK(PcdAnticoll(snr) != MI_OK, "%d cards: legacy anticoll resolved a collision", n);
+
+        seen = 0;
+        PcdAntennaOff();
+        PcdAntennaOn();
+        vTaskDelay(pdMS_TO_TICKS(SIM_SETTLE_MS));
+        for (i = 0; i < n; i++)
+        {
+            snprintf(label, sizeof(label), "%d cards: select #%d", n, i + 1);
+            op_begin();
+            CHECK(PcdRequest(PICC_REQIDL, atqa) == MI_OK, "%d cards: request #%d failed", n, i + 1);
+            CHECK(ISO14443_Select(&card) == MI_OK, "%d cards: select #%d failed", n, i + 1);
+            op_end(label);
+            for (j = 0; j < n; j++)
+            {
+                if (card.uid_len == len[j] && memcmp(card.uid, uid[j], len[j]) == 0)
+                {
+                    seen |= (uint8_t)(1U << j);
+                }
+            }
+            PcdHalt();
+        }
+        CHECK(seen == (1U << n) - 1U, "%d cards: selected set %02X", n, seen);
+        CHECK(PcdRequest(PICC_REQIDL, atqa) == MI_NOTAGERR, "%d cards: halted card answered REQA", n);
+        PcdAntennaOff();
+    }
+
+    // 两张登记过的卡同时出示,选中其中一张开锁
+    sim_reset();
+    for (i = 0; i < 2; i++)
+    {
+        c[i] = host_card_add(HOST_CARD_CLASSIC, uid[i], 4);
+        sim_enroll_verify(c[i], (uint16_t)(7 + i), i == 0 ? "collision card A" : "collision card B");
+    }
+    host_card_move(c[0], 1);
+    i = sim_present(c[1], "2 enrolled cards");
+    CHECK(i == 7 || i == 8, "2 enrolled cards: user %d", i);
+}
+
+/* 原来的函数和协议层的对比,两种SPI方式 */
+static void sim_compare(void)
+{
+    static const char *mode_name[RC522_SPI_MODE_NUM] = {"hal", "fast"};
+    uint8_t uid[10], atqa[2], snr[4], data[NTAG_FAST_READ_MAX * NTAG_PAGE_SIZE];
+    uint8_t key[CRED_NFC_KEY_SIZE] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    ISO14443_Card_t card;
+    host_card_t *classic, *ntag;
+    char label[40];
+    int mode;
+
+    printf("\n%-28s %5s %6s %6s %6s %6s %9s %9s %9s\n", "compare", "rf", "rd", "wr", "fifo", "cs",
+           "spi us", "rf us", "total us");
+    for (mode = RC522_SPI_FAST; mode >= RC522_SPI_HAL; mode--)
+    {
+        sim_reset();
+        RC522_SPI_SetMode((RC522_SpiMode_t)mode);
+        make_uid(uid, 4, 0x42);
+        classic = host_card_add(HOST_CARD_CLASSIC, uid, 4);
+        host_card_move(classic, 1);
+        PcdAntennaOn();
+        vTaskDelay(pdMS_TO_TICKS(SIM_SETTLE_MS));
+
+        snprintf(label, sizeof(label), "%s request", mode_name[mode]);
+        op_begin();
+        CHECK(PcdRequest(PICC_REQALL, atqa) == MI_OK, "%s: request", mode_name[mode]);
+        op_end(label);
+        snprintf(label, sizeof(label), "%s anticoll+select (old)", mode_name[mode]);
+        op_begin();
+        CHECK(PcdAnticoll(snr) == MI_OK && PcdSelect(snr) == MI_OK, "%s: legacy select", mode_name[mode]);
+        op_end(label);
+        PcdHalt();
+
+        CHECK(PcdRequest(PICC_REQALL, atqa) == MI_OK, "%s: request", mode_name[mode]);
+        snprintf(label, sizeof(label), "%s ISO14443_Select", mode_name[mode]);
+        op_begin();
+        CHECK(ISO14443_Select(&card) == MI_OK, "%s: select", mode_name[mode]);
+        op_end(label);
+        snprintf(label, sizeof(label), "%s classic auth+read", mode_name[mode]);
+        op_begin();
+        CHECK(PcdAuthState(KEYA, NFC_TRAILER_BLOCK, key, card.uid) == MI_OK &&
+              PcdRead(NFC_TOKEN_BLOCK, data) == MI_OK, "%s: classic read", mode_name[mode]);
+        op_end(label);
+        PcdAntennaOff();
+        host_card_move(classic, 0);
+
+        make_uid(uid, 7, 0x43);
+        ntag = host_card_add(HOST_CARD_NTAG213, uid, 7);
+        host_card_move(ntag, 1);
+        PcdAntennaOn();
+        vTaskDelay(pdMS_TO_TICKS(SIM_SETTLE_MS));
+        CHECK(PcdRequest(PICC_REQALL, atqa) == MI_OK && ISO14443_Select(&card) == MI_OK, "%s: ntag select",
+              mode_name[mode]);
+        snprintf(label, sizeof(label), "%s ntag PcdRead 4 pages", mode_name[mode]);
+        op_begin();
+        CHECK(PcdRead(NFC_NTAG_TOKEN_PAGE, data) == MI_OK, "%s: ntag PcdRead", mode_name[mode]);
+        op_end(label);
+        snprintf(label, sizeof(label), "%s ntag FAST_READ 4 pages", mode_name[mode]);
+        op_begin();
+        CHECK(NTAG_FastRead(NFC_NTAG_TOKEN_PAGE, NFC_NTAG_TOKEN_PAGE + 3, data) == MI_OK, "%s: ntag fast read",
+              mode_name[mode]);
+        op_end(label);
+        snprintf(label, sizeof(label), "%s ntag FAST_READ %u pages", mode_name[mode], NTAG_FAST_READ_MAX);
+        op_begin();
+        CHECK(NTAG_FastRead(0, NTAG_FAST_READ_MAX - 1, data) == MI_OK, "%s: ntag fast read max", mode_name[mode]);
+        op_end(label);
+        PcdAntennaOff();
+        host_card_move(ntag, 0);
+    }
+    RC522_SPI_SetMode(RC522_SPI_FAST);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "v")) != -1)
+    {
+        if (opt == 'v')
+        {
+            verbose = 1;
+        }
+        else
+        {
+            fprintf(stderr, "usage: nfc_sim [-v]\n");
+            return 2;
+        }
+    }
+    srand(1);
+    CRED_Reset();
+    CRED_LoadDefaults();
+    for (opt = 1; opt <= 8; opt++)
+    {
+        CHECK(CRED_AddUser((uint16_t)opt, NULL, 0) == 0, "add user %d", opt);
+    }
+
+    printf("%-28s %5s %6s %6s %6s %6s %9s %9s %9s\n", "operation", "rf", "rd", "wr", "fifo", "cs",
+           "spi us", "rf us", "total us");
+    sim_no_card();
+    sim_classic();
+    sim_ntag();
+    sim_iso4();
+    sim_collision();
+    sim_compare();
+
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
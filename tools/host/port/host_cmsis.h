@@ -0,0 +1,17 @@
+/**
+  ******************************************************************************
+  * @file    host_cmsis.h
+  * @author  cyytx
+  * @brief   主机编译固件源文件时预先包含(见Makefile),
+  *          把CMSIS内联函数中的ARM屏障指令定义为空的汇编宏,让x86汇编器能通过;
+  *          用到屏障的代码(如D-Cache维护)在主机上运行时什么也不做
+  ******************************************************************************
+  */
+#ifndef HOST_CMSIS_H
+#define HOST_CMSIS_H
+
+__asm__(".macro dsb arg\n.endm\n"
+        ".macro isb arg\n.endm\n"
+        ".macro dmb arg\n.endm\n");
+
+#endif /* HOST_CMSIS_H */
@@ -0,0 +1,66 @@
+/**
+  ******************************************************************************
+  * @file    portmacro.h
+  * @author  cyytx
+  * @brief   主机回放用的FreeRTOS移植层,只提供类型和宏,让固件源文件能在PC上编译;
+  *          没有调度器,任务函数不会运行,用到的API由host_stub.c提供空实现
+  ******************************************************************************
+  */
+#ifndef PORTMACRO_H
+#define PORTMACRO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define portCHAR          char
+#define portFLOAT         float
+#define portDOUBLE        double
+#define portLONG          long
+#define portSHORT         short
+#define portSTACK_TYPE    uint32_t
+#define portBASE_TYPE     long
+
+typedef portSTACK_TYPE   StackType_t;
+typedef long             BaseType_t;
+typedef unsigned long    UBaseType_t;
+typedef uint32_t         TickType_t;
+
+#define portMAX_DELAY              ( TickType_t ) 0xffffffffUL
+#define portTICK_TYPE_IS_ATOMIC    1
+
+#define portSTACK_GROWTH      ( -1 )
+#define portTICK_PERIOD_MS    ( ( TickType_t ) 1000 / configTICK_RATE_HZ )
+#define portBYTE_ALIGNMENT    8
+#define portDONT_DISCARD      __attribute__( ( used ) )
+
+/* 单线程回放,没有任务切换,临界区也不需要关中断 */
+#define portYIELD()
+#define portEND_SWITCHING_ISR( xSwitchRequired )    ( void ) ( xSwitchRequired )
+#define portYIELD_FROM_ISR( x )                     portEND_SWITCHING_ISR( x )
+
+#define portSET_INTERRUPT_MASK_FROM_ISR()           0
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR( x )      ( void ) ( x )
+#define portDISABLE_INTERRUPTS()
+#define portENABLE_INTERRUPTS()
+#define portENTER_CRITICAL()                        vPortEnterCritical()
+#define portEXIT_CRITICAL()                         vPortExitCritical()
+
+void vPortEnterCritical( void );
+void vPortExitCritical( void );
+
+#define portTASK_FUNCTION_PROTO( vFunction, pvParameters )    void vFunction( void * pvParameters )
+#define portTASK_FUNCTION( vFunction, pvParameters )          void vFunction( void * pvParameters )
+
+#define portNOP()
+#define portINLINE              __inline
+#define portFORCE_INLINE        inline __attribute__( ( always_inline ) )
+#define portMEMORY_BARRIER()
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PORTMACRO_H */
@@ -0,0 +1,344 @@
+/**
+  ******************************************************************************
+  * @file    replay.c
+  * @author  cyytx
+  * @brief   模块串口抓包的主机回放工具
+  *          1.在PC上编译指纹(fingerprint.c)、人脸(face.c)、蓝牙(ble.c)的源文件,
+  *            HAL和FreeRTOS换成host_stub.c中的空实现;
+  *          2.读入回放文件(设备上用调试shell的capture命令抓包,tools/log_decode.py --replay 保存),
+  *            按设备上的10ms空闲时间重新分帧,交给FP_ProcessFrame/FACE_ProcessFrame/BLE_ProcessData;
+  *          3.统计每个模块的帧数、字节数、有效/错误帧、开锁次数和每帧的解析耗时。
+  *
+  * 用法: replay [-v] [-g 分帧空闲时间us] [-r 计时重复次数] [-l 日志输出] [-p 蓝牙密码] 回放文件...
+  * 回放文件每行: 时间(us) 通道(fp|face|ble) 上下文 十六进制数据,'#'开头为注释。
+  * 指纹的上下文是应答对应的命令(FP_MsgType_t),例如 1:获取模板数量 2:注册 3:识别。
+  ******************************************************************************
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <getopt.h>
+#include "log.h"
+#include "fingerprint.h"
+#include "face.h"
+#include "ble.h"
+#include "sg90.h"
+#include "cred.h"
+#include "host.h"
+
+#define REPLAY_GAP_US       10000   /* 设备上收到最后一个字节10ms后交给任务处理 */
+#define REPLAY_REPEAT       100     /* 每帧重复处理的次数,取平均作为解析耗时 */
+#define REPLAY_LINE_MAX     8192
+#define REPLAY_CHAN_NUM     (LOG_CAP_BLE + 1)
+
+typedef struct {
+    const char *name;
+    uint16_t size;          /* 设备上的接收缓冲区大小,超出的字节被丢弃 */
+    uint8_t buf[1024];
+    uint16_t len;
+    uint8_t ctx;
+    uint32_t last_us;       /* 最后一段数据的时间 */
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t dropped;       /* 超出接收缓冲区而丢弃的字节 */
+    uint32_t ok;
+    uint32_t bad;
+    uint32_t unlock;
+    uint64_t ns_total;
+    uint64_t ns_max;
+} Channel_t;
+
+/* 缓冲区大小和各模块源文件一致: FP_MAX_BUFFER_SIZE, FACE_BUFFER_SIZE, BLE_RX_BUFFER_SIZE(留1字节放'\0') */
+static Channel_t chans[REPLAY_CHAN_NUM] = {
+    [LOG_CAP_FP]   = {.name = "fp",   .size = 128},
+    [LOG_CAP_FACE] = {.name = "face", .size = 512},
+    [LOG_CAP_BLE]  = {.name = "ble",  .size = BLE_RX_BUFFER_SIZE - 1},
+};
+
+static uint32_t gap_us = REPLAY_GAP_US;
+static uint32_t repeat = REPLAY_REPEAT;
+static int verbose = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int process(int chan, uint8_t ctx, uint8_t *data, uint16_t len)
+{
+    switch (chan)
+    {
+        case LOG_CAP_FP:
+            return FP_ProcessFrame((FP_MsgType_t)ctx, data, len);
+        case LOG_CAP_FACE:
+            return FACE_ProcessFrame(data, len);
+        case LOG_CAP_BLE:
+            return BLE_ProcessData(data, len);
+        default:
+            return -1;
+    }
+}
+
+/* 处理一帧:先正常处理一次记录结果和日志,再静默重复repeat次计时 */
+static void dispatch(int chan)
+{
+    Channel_t *ch = &chans[chan];
+    uint64_t t0, ns;
+    uint32_t i;
+    int ret;
+
+    if (ch->len == 0)
+    {
+        return;
+    }
+    ch->buf[ch->len] = '\0';
+    host_time_us = ch->last_us;
+    host_lock_cmd = -1;
+    ret = process(chan, ch->ctx, ch->buf, ch->len);
+
+    host_quiet = 1;
+    t0 = now_ns();
+    for (i = 0; i < repeat; i++)
+    {
+        process(chan, ch->ctx, ch->buf, ch->len);
+    }
+    ns = repeat ? (now_ns() - t0) / repeat : 0;
+    host_quiet = 0;
+
+    ch->frames++;
+    ch->bytes += ch->len;
+    if (ret == 0)
+    {
+        ch->ok++;
+    }
+    else
+    {
+        ch->bad++;
+    }
+    if (host_lock_cmd == LOCK_CMD_OPEN)
+    {
+        ch->unlock++;
+    }
+    ch->ns_total += ns;
+    if (ns > ch->ns_max)
+    {
+        ch->ns_max = ns;
+    }
+    if (verbose)
+    {
+        printf("[%12.6f] %-4s ctx=%-3u len=%-4u %-3s %-6s %8llu ns\n",
+               ch->last_us / 1e6, ch->name, ch->ctx, ch->len, ret == 0 ? "ok" : "bad",
+               host_lock_cmd == LOCK_CMD_OPEN ? "unlock" : (host_lock_cmd == LOCK_CMD_CLOSE ? "lock" : "-"),
+               (unsigned long long)ns);
+    }
+    ch->len = 0;
+}
+
+/* 到时间t为止已经空闲超过gap_us的通道,按设备上的行为交给处理函数 */
+static void flush_idle(uint32_t t)
+{
+    int c;
+
+    for (c = 1; c < REPLAY_CHAN_NUM; c++)
+    {
+        if (chans[c].len && (uint32_t)(t - chans[c].last_us) > gap_us)
+        {
+            dispatch(c);
+        }
+    }
+}
+
+static void feed(uint32_t t, int chan, uint8_t ctx, const uint8_t *data, uint16_t len)
+{
+    Channel_t *ch = &chans[chan];
+    uint16_t n;
+
+    flush_idle(t);
+    if (ch->len && ch->ctx != ctx)
+    {
+        dispatch(chan);
+    }
+    n = (uint16_t)(ch->size - ch->len);
+    if (len > n)
+    {
+        ch->dropped += len - n;
+        len = n;
+    }
+    memcpy(&ch->buf[ch->len], data, len);
+    ch->len = (uint16_t)(ch->len + len);
+    ch->ctx = ctx;
+    ch->last_us = t;
+}
+
+static int hex_value(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    c = tolower(c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static int replay_file(const char *path)
+{
+    static char line[REPLAY_LINE_MAX];
+    static uint8_t data[REPLAY_LINE_MAX / 2];
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    unsigned long t;
+    unsigned ctx;
+    char name[16];
+    int pos, chan, hi, lo, lineno = 0;
+    uint16_t len;
+    char *p;
+
+    if (f == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        lineno++;
+        p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0' || *p == '#')
+        {
+            continue;
+        }
+        if (sscanf(p, "%lu %15s %u %n", &t, name, &ctx, &pos) != 3)
+        {
+            fprintf(stderr, "%s:%d: bad line\n", path, lineno);
+            continue;
+        }
+        for (chan = 1; chan < REPLAY_CHAN_NUM; chan++)
+        {
+            if (strcmp(name, chans[chan].name) == 0) break;
+        }
+        if (chan == REPLAY_CHAN_NUM)
+        {
+            fprintf(stderr, "%s:%d: unknown channel %s\n", path, lineno, name);
+            continue;
+        }
+        len = 0;
+        for (p += pos; *p != '\0'; )
+        {
+            if (isspace((unsigned char)*p))
+            {
+                p++;
+                continue;
+            }
+            hi = hex_value(p[0]);
+            lo = hex_value(p[1]);
+            if (hi < 0 || lo < 0)
+            {
+                fprintf(stderr, "%s:%d: bad hex\n", path, lineno);
+                break;
+            }
+            data[len++] = (uint8_t)(hi << 4 | lo);
+            p += 2;
+        }
+        feed((uint32_t)t, chan, (uint8_t)ctx, data, len);
+    }
+    if (f != stdin)
+    {
+        fclose(f);
+    }
+    return 0;
+}
+
+static void report(void)
+{
+    int c;
+    Channel_t *ch;
+
+    printf("%-5s %7s %8s %7s %6s %6s %6s %12s %10s %9s\n",
+           "chan", "frames", "bytes", "dropped", "ok", "bad", "unlock", "avg ns/frame", "max ns", "ns/byte");
+    for (c = 1; c < REPLAY_CHAN_NUM; c++)
+    {
+        ch = &chans[c];
+        printf("%-5s %7u %8u %7u %6u %6u %6u %12.1f %10llu %9.2f\n",
+               ch->name, ch->frames, ch->bytes, ch->dropped, ch->ok, ch->bad, ch->unlock,
+               ch->frames ? (double)ch->ns_total / ch->frames : 0.0,
+               (unsigned long long)ch->ns_max,
+               ch->bytes ? (double)ch->ns_total / ch->bytes : 0.0);
+    }
+}
+
+/* 修改管理员密码,默认是凭据库出厂设置的12345678 */
+static void set_password(const char *digits)
+{
+    uint8_t pin[CRED_PIN_MAX];
+    uint8_t n = 0;
+
+    while (*digits != '\0' && n < sizeof(pin))
+    {
+        pin[n++] = (uint8_t)(*digits++ - '0');
+    }
+    CRED_SetPin(CRED_ADMIN_USER, pin, n);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: replay [-v] [-g gap_us] [-r repeat] [-l log.bin] [-p password] file.cap...\n"
+            "  -v  print every frame\n"
+            "  -g  idle time that ends a frame, default %u us\n"
+            "  -r  runs per frame for timing, default %u\n"
+            "  -l  write log records, decode with tools/log_decode.py\n"
+            "  -p  admin PIN digits for BLE, default 12345678\n",
+            REPLAY_GAP_US, REPLAY_REPEAT);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt, i, c;
+
+    // 凭据库用出厂设置:管理员密码12345678,指纹/人脸没有登记时识别成功即为管理员
+    CRED_LoadDefaults();
+    while ((opt = getopt(argc, argv, "vg:r:l:p:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'v': verbose = 1; break;
+            case 'g': gap_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'r': repeat = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'p': set_password(optarg); break;
+            case 'l':
+                host_log = fopen(optarg, "wb");
+                if (host_log == NULL)
+                {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            default: usage();
+        }
+    }
+    if (optind >= argc)
+    {
+        usage();
+    }
+    for (i = optind; i < argc; i++)
+    {
+        if (replay_file(argv[i]) != 0)
+        {
+            return 1;
+        }
+        /* 文件结束,剩下的数据也要处理 */
+        for (c = 1; c < REPLAY_CHAN_NUM; c++)
+        {
+            dispatch(c);
+        }
+    }
+    report();
+    if (host_log != NULL)
+    {
+        fclose(host_log);
+    }
+    return 0;
+}
@@ -0,0 +1,314 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+log_decode.py - 把USART1输出的二进制日志还原成文本(对应 user/log.c)
+
+用法:
+    python tools/log_decode.py MDK-ARM/log_dict.csv capture.bin
+    python tools/log_decode.py MDK-ARM/log_dict.csv --port COM5              (需要 pyserial)
+        --port 时键盘输入的每一行作为调试shell命令发给设备(见 user/shell.c)
+    python tools/log_decode.py MDK-ARM/log_dict.csv capture.bin --replay session.cap
+        抓包记录(调试shell的capture命令打开)另存为回放文件,给 tools/host/replay 使用
+    python tools/log_decode.py MDK-ARM/log_dict.csv --elf MDK-ARM/smart_lock.axf capture.bin
+
+记录格式见 user/log.h。格式字符串在固件中只保存token,字典由 tools/log_dict.py
+在编译时从源码生成,必须使用与设备上固件同一次编译生成的字典。
+%s 参数在固件中是常量字符串的地址,给出 --elf(axf文件)或 --bin 时可以还原。
+"""
+import csv
+import argparse
+import re
+import struct
+import sys
+import threading
+
+SYNC = 0xA5
+REC_FMT = 0x01
+REC_HEX = 0x02
+REC_TEXT = 0x03
+REC_STR = 0x04
+REC_CAP = 0x05
+CAP_NAMES = {1: 'fp', 2: 'face', 3: 'ble'}
+CAP_FLAG_CONT = 0x01
+MAX_ARGS = 6
+HEX_MAX = 48
+
+
+class Image(object):
+    """固件镜像,按地址读取常量字符串"""
+
+    def __init__(self, path, base=None):
+        data = open(path, 'rb').read()
+        self.segments = []
+        if data[:4] == b'\x7fELF':
+            self._load_elf(data)
+        else:
+            self.segments.append((base if base is not None else 0x08000000, data))
+
+    def _load_elf(self, data):
+        if data[4] != 1 or data[5] != 1:
+            raise ValueError('only ELF32 little-endian is supported')
+        e_phoff, = struct.unpack_from('<I', data, 28)
+        e_phentsize, e_phnum = struct.unpack_from('<HH', data, 42)
+        for i in range(e_phnum):
+            p_type, p_offset, p_vaddr, p_paddr, p_filesz = struct.unpack_from(
+                '<IIIII', data, e_phoff + i * e_phentsize)
+            if p_type == 1 and p_filesz:  # PT_LOAD
+                self.segments.append((p_vaddr, data[p_offset:p_offset + p_filesz]))
+                if p_paddr != p_vaddr:
+                    self.segments.append((p_paddr, data[p_offset:p_offset + p_filesz]))
+
+    def string(self, addr):
+        for base, blob in self.segments:
+            if base <= addr < base + len(blob):
+                off = addr - base
+                end = blob.find(b'\x00', off)
+                if end < 0:
+                    end = len(blob)
+                return blob[off:end].decode('utf-8', 'replace')
+        return None
+
+
+_SPEC = re.compile(r'%([-+ #0]*)(\*|\d+)?(?:\.(\d+))?(hh|h|ll|l|z|t|j)?([diouxXcspfFeEgG%])')
+
+
+def c_format(fmt, args, image):
+    """按C printf规则格式化,参数都是32位整数"""
+    out = []
+    pos = 0
+    argi = 0
+
+    def next_arg():
+        nonlocal argi
+        v = args[argi] if argi < len(args) else 0
+        argi += 1
+        return v
+
+    for m in _SPEC.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, width, prec, _, conv = m.groups()
+        if conv == '%':
+            out.append('%')
+            continue
+        if width == '*':
+            width = str(next_arg())
+        v = next_arg()
+        spec = '%' + (flags or '') + (width or '') + ('.' + prec if prec else '')
+        if conv in 'di':
+            s = (spec + 'd') % (v - (1 << 32) if v & 0x80000000 else v)
+        elif conv in 'uoxX':
+            s = (spec + conv.replace('u', 'd')) % v
+        elif conv == 'c':
+            s = (spec + 'c') % chr(v & 0xFF)
+        elif conv == 's':
+            text = image.string(v) if image else None
+            s = (spec + 's') % (text if text is not None else '<0x%08X>' % v)
+        elif conv == 'p':
+            s = '0x%08x' % v
+        else:
+            f, = struct.unpack('<f', struct.pack('<I', v))
+            s = (spec + conv) % f
+        out.append(s)
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+_UNESC = {'r': '\r', 'n': '\n', 't': '\t', '\\': '\\'}
+
+
+def c_unescape(s):
+    """字典中的格式字符串由log_dict.py转义保存"""
+    return re.sub(r'\\([rnt\\])', lambda m: _UNESC[m.group(1)], s)
+
+
+def load_dict(path):
+    """token -> (module, level, format)"""
+    d = {}
+    with open(path, newline='', encoding='utf-8') as f:
+        for row in csv.DictReader(f):
+            d[int(row['token'], 16)] = (row['module'], row['level'], c_unescape(row['format']))
+    return d
+
+
+class Decoder(object):
+    def __init__(self, dictionary, image, out, cap_out=None):
+        self.dict = dictionary
+        self.image = image
+        self.out = out
+        self.cap_out = cap_out
+        self.cap = None  # 正在拼接的抓包帧 [时间us, 通道, 上下文, 数据]
+        self.buf = bytearray()
+        self.seq = None
+        self.dropped = 0
+        self.time_base = 0
+        self.last_ts = None
+        self.text = ''
+
+    def _time(self, ts):
+        # 时间戳是32位微秒,约71分钟回绕一次
+        if self.last_ts is not None and ts < self.last_ts and self.last_ts - ts > 0x80000000:
+            self.time_base += 1 << 32
+        self.last_ts = ts
+        return (self.time_base + ts) / 1e6
+
+    def _check_seq(self, seq):
+        if self.seq is not None:
+            gap = (seq - self.seq - 1) & 0xFF
+            if gap:
+                self.dropped += gap
+                self._emit(None, '<%d record(s) dropped>' % gap)
+        self.seq = seq
+
+    def _emit(self, t, line):
+        if self.text:
+            self.out.write(self.text + '\n')
+            self.text = ''
+        prefix = '[%12.6f] ' % t if t is not None else '[            ] '
+        self.out.write(prefix + line.rstrip('\r\n') + '\n')
+
+    def feed(self, data):
+        self.buf += data
+        while True:
+            i = self.buf.find(bytes([SYNC]))
+            if i < 0:
+                del self.buf[:]
+                return
+            del self.buf[:i]
+            if len(self.buf) < 4:
+                return
+            rtype, rlen, seq = self.buf[1], self.buf[2], self.buf[3]
+            if rtype == REC_TEXT:
+                if not 1 <= rlen <= 64:
+                    del self.buf[:1]
+                    continue
+                need = 4 + rlen
+            elif rtype == REC_FMT:
+                if rlen < 4 or (rlen - 4) % 4 or rlen > 4 + 4 * MAX_ARGS:
+                    del self.buf[:1]
+                    continue
+                need = 8 + rlen
+            elif rtype in (REC_HEX, REC_STR, REC_CAP):
+                if not 4 < rlen <= 4 + HEX_MAX:
+                    del self.buf[:1]
+                    continue
+                need = 8 + rlen
+            else:
+                del self.buf[:1]
+                continue
+            if len(self.buf) < need:
+                return
+            rec = bytes(self.buf[:need])
+            del self.buf[:need]
+            self._check_seq(seq)
+            self._record(rtype, rec)
+
+    def _record(self, rtype, rec):
+        if rtype == REC_TEXT:
+            for ch in rec[4:].decode('latin-1'):
+                if ch == '\n':
+                    self.out.write(self.text.rstrip('\r') + '\n')
+                    self.text = ''
+                else:
+                    self.text += ch
+            return
+        ts, tok = struct.unpack_from('<II', rec, 4)
+        t = self._time(ts)
+        if rtype == REC_CAP:
+            self._capture(t, tok, rec[12:])
+            return
+        entry = self.dict.get(tok)
+        fmt = entry[2] if entry else None
+        if rtype == REC_FMT:
+            args = struct.unpack_from('<%dI' % ((len(rec) - 12) // 4), rec, 12)
+            if fmt is None:
+                line = '<token 0x%08X> ' % tok + ' '.join('0x%X' % a for a in args)
+            else:
+                line = c_format(fmt, args, self.image)
+        else:
+            label = fmt if fmt is not None else '<token 0x%08X>' % tok
+            if rtype == REC_STR:
+                line = label + ': ' + rec[12:].decode('utf-8', 'replace').rstrip('\r\n')
+            else:
+                line = label + ': ' + ' '.join('%02X' % b for b in rec[12:])
+        if entry:
+            line = '%-6s %-5s %s' % (entry[0], entry[1], line)
+        self._emit(t, line)
+
+
+    def _capture(self, t, tag, data):
+        chan, ctx, flags = tag & 0xFF, (tag >> 8) & 0xFF, (tag >> 16) & 0xFF
+        name = CAP_NAMES.get(chan, str(chan))
+        if not flags & CAP_FLAG_CONT:
+            self.flush_capture()
+            self.cap = [int(round(t * 1e6)), name, ctx, bytearray()]
+            self._emit(t, 'CAP    %-5s ctx=%d %s' % (name, ctx, ' '.join('%02X' % b for b in data)))
+        elif self.cap is not None:
+            self.out.write('[            ] ' + ' ' * 18 + ' '.join('%02X' % b for b in data) + '\n')
+        else:
+            return  # 第一段被丢弃,后面的也不要
+        self.cap[3] += data
+
+    def flush_capture(self):
+        """回放文件每行: 时间(us) 通道 上下文 十六进制数据"""
+        if self.cap is not None and self.cap_out is not None:
+            t, name, ctx, data = self.cap
+            self.cap_out.write('%d %s %d %s\n' % (t, name, ctx, data.hex().upper()))
+            self.cap_out.flush()
+        self.cap = None
+
+
+def forward_stdin(ser):
+    """把键盘输入按行发给设备上的调试shell"""
+    for line in sys.stdin:
+        ser.write(line.rstrip('\r\n').encode('utf-8') + b'\r')
+
+
+def main():
+    ap = argparse.ArgumentParser(description='decode binary log records from USART1')
+    ap.add_argument('dict', help='token dictionary written by tools/log_dict.py')
+    ap.add_argument('capture', nargs='?', help='captured UART bytes (default: stdin)')
+    ap.add_argument('--elf', help='firmware axf, used to resolve %%s arguments')
+    ap.add_argument('--bin', help='firmware bin, used to resolve %%s arguments')
+    ap.add_argument('--base', type=lambda x: int(x, 0), default=None,
+                    help='load address of the bin image (default 0x08000000)')
+    ap.add_argument('--port', help='read directly from a serial port')
+    ap.add_argument('--baud', type=int, default=921600)
+    ap.add_argument('--replay', help='write capture records to a replay file for tools/host/replay')
+    args = ap.parse_args()
+
+    image = None
+    if args.elf or args.bin:
+        image = Image(args.elf or args.bin, args.base)
+    cap_out = open(args.replay, 'w') if args.replay else None
+    if cap_out:
+        cap_out.write('# time_us channel ctx hex\n')
+    dec = Decoder(load_dict(args.dict), image, sys.stdout, cap_out)
+    if args.port:
+        import serial  # pyserial
+        ser = serial.Serial(args.port, args.baud, timeout=0.1)
+        threading.Thread(target=forward_stdin, args=(ser,), daemon=True).start()
+        try:
+            while True:
+                dec.feed(ser.read(4096))
+                sys.stdout.flush()
+        except KeyboardInterrupt:
+            pass
+    else:
+        f = open(args.capture, 'rb') if args.capture else sys.stdin.buffer
+        while True:
+            chunk = f.read(65536)
+            if not chunk:
+                break
+            dec.feed(chunk)
+    if dec.text:
+        sys.stdout.write(dec.text + '\n')
+    dec.flush_capture()
+    if cap_out:
+        cap_out.close()
+    if dec.dropped:
+        sys.stderr.write('%d record(s) dropped on target\n' % dec.dropped)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,254 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+log_dict.py - 从源码中提取 LOG_ERR/LOG_WARN/LOG_INFO/LOG_DEBUG/LOG_HEX/LOG_STR 的格式字符串,
+计算与 user/log_token.h 相同的token,生成主机端解码字典(对应 user/log.h)。
+
+Keil工程在编译前(Before Build)自动运行:
+    python tools/log_dict.py -o MDK-ARM/log_dict.csv
+手动查看各模块的flash节省和日志吞吐估算:
+    python tools/log_dict.py --stats
+
+有token冲突(两个不同字符串的token相同)或格式字符串不是字面量时返回非0,中止编译。
+"""
+import argparse
+import csv
+import os
+import re
+import sys
+
+ROOT = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+SCAN_DIRS = ['user', 'Core/Src', 'FATFS/App']
+
+TOKEN_MAX_CHARS = 80    # 与 log_token.h 中 LOG_TOKEN_MAX_CHARS 一致
+TOKEN_K = 65599
+
+LEVELS = {'NONE': 0, 'ERR': 1, 'WARN': 2, 'INFO': 3, 'DEBUG': 4}
+MACRO_LEVEL = {'ERR': 'ERR', 'WARN': 'WARN', 'INFO': 'INFO', 'DEBUG': 'DEBUG', 'HEX': 'DEBUG', 'STR': 'INFO'}
+MACRO_KIND = {'HEX': 'hex', 'STR': 'str'}
+
+BAUD = 921600           # USART1波特率
+RECORD_HEAD = 8         # sync+type+len+seq+时间戳
+
+
+def token(data):
+    """data为字符串字面量的字节(不含结尾0),与LOG_TOKEN宏相同的65599哈希"""
+    h = len(data)
+    coef = 1
+    for c in data[:TOKEN_MAX_CHARS]:
+        coef = (coef * TOKEN_K) & 0xFFFFFFFF
+        h = (h + c * coef) & 0xFFFFFFFF
+    return h
+
+
+def strip_comments(src):
+    """去掉注释但保留字符串和换行,行号不变"""
+    out = []
+    i, n = 0, len(src)
+    while i < n:
+        c = src[i]
+        if c == '/' and i + 1 < n and src[i + 1] == '/':
+            j = src.find('\n', i)
+            i = n if j < 0 else j
+        elif c == '/' and i + 1 < n and src[i + 1] == '*':
+            j = src.find('*/', i + 2)
+            j = n if j < 0 else j + 2
+            out.append(re.sub(r'[^\n]', ' ', src[i:j]))
+            i = j
+        elif c in '"\'':
+            j = i + 1
+            while j < n and src[j] != c:
+                j += 2 if src[j] == '\\' else 1
+            out.append(src[i:j + 1])
+            i = j + 1
+        else:
+            out.append(c)
+            i += 1
+    return ''.join(out)
+
+
+_ESC = {'n': 10, 'r': 13, 't': 9, '0': 0, 'a': 7, 'b': 8, 'f': 12, 'v': 11,
+        '\\': 92, '"': 34, "'": 39, '?': 63}
+
+
+def c_unescape(body):
+    """C字符串字面量内容(源文件按UTF-8保存)转成编译后的字节"""
+    raw = body.encode('utf-8')
+    out = bytearray()
+    i = 0
+    while i < len(raw):
+        b = raw[i]
+        if b != 0x5C:
+            out.append(b)
+            i += 1
+            continue
+        e = chr(raw[i + 1])
+        if e == 'x':
+            m = re.match(rb'[0-9a-fA-F]+', raw[i + 2:])
+            out.append(int(m.group(0), 16) & 0xFF)
+            i += 2 + len(m.group(0))
+        elif e in '01234567':
+            m = re.match(rb'[0-7]{1,3}', raw[i + 1:])
+            out.append(int(m.group(0), 8) & 0xFF)
+            i += 1 + len(m.group(0))
+        else:
+            out.append(_ESC.get(e, ord(e)))
+            i += 2
+    return bytes(out)
+
+
+def c_escape(data):
+    s = data.decode('utf-8', 'replace')
+    return s.replace('\\', '\\\\').replace('\r', '\\r').replace('\n', '\\n').replace('\t', '\\t')
+
+
+_CALL = re.compile(r'\bLOG_(ERR|WARN|INFO|DEBUG|HEX|STR)\s*\(')
+_LIT = re.compile(r'\s*"((?:[^"\\\n]|\\.)*)"')
+
+
+def scan_file(path, rel):
+    src = strip_comments(open(path, encoding='utf-8', errors='replace').read())
+    m = re.search(r'^\s*#\s*define\s+LOG_MODULE\s+(\w+)', src, re.M)
+    module = m.group(1) if m else 'DEFAULT'
+    entries, errors = [], []
+    for m in _CALL.finditer(src):
+        line = src.count('\n', 0, m.start()) + 1
+        pos = m.end()
+        parts = []
+        while True:
+            lm = _LIT.match(src, pos)
+            if not lm:
+                break
+            parts.append(lm.group(1))
+            pos = lm.end()
+        if not parts:
+            errors.append('%s:%d: LOG_%s format must be a string literal' % (rel, line, m.group(1)))
+            continue
+        data = c_unescape(''.join(parts))
+        nargs = 0
+        if m.group(1) not in MACRO_KIND:
+            nargs = len(re.findall(r'%[-+ #0]*(?:\*|\d+)?(?:\.\d+)?(?:hh|h|ll|l|z|t|j)?[diouxXcspfFeEgG]', data.decode('utf-8', 'replace')))
+        entries.append({
+            'token': token(data), 'module': module, 'level': MACRO_LEVEL[m.group(1)],
+            'kind': MACRO_KIND.get(m.group(1), 'fmt'), 'file': rel, 'line': line,
+            'data': data, 'nargs': nargs,
+        })
+    return entries, errors
+
+
+def load_levels():
+    levels = {}
+    path = os.path.join(ROOT, 'user', 'log_config.h')
+    for m in re.finditer(r'#define\s+LOG_LEVEL_(\w+)\s+LOG_LEVEL_(\w+)', open(path, encoding='utf-8').read()):
+        levels[m.group(1)] = LEVELS[m.group(2)]
+    return levels
+
+
+def scan():
+    entries, errors = [], []
+    for d in SCAN_DIRS:
+        for dirpath, _, files in os.walk(os.path.join(ROOT, d)):
+            for f in sorted(files):
+                if f.endswith('.c'):
+                    path = os.path.join(dirpath, f)
+                    e, err = scan_file(path, os.path.relpath(path, ROOT).replace(os.sep, '/'))
+                    entries += e
+                    errors += err
+    return entries, errors
+
+
+def check_collisions(entries):
+    seen, errors = {}, []
+    for e in entries:
+        other = seen.setdefault(e['token'], e)
+        if other['data'] != e['data']:
+            errors.append('token 0x%08X collision: %s:%d and %s:%d' % (
+                e['token'], other['file'], other['line'], e['file'], e['line']))
+    return errors
+
+
+def text_length(e):
+    """估算格式化后文本的长度,参数按常见宽度计"""
+    s = e['data'].decode('utf-8', 'replace')
+    if e['kind'] != 'fmt':
+        return len(s) + 2 + 16 * 3      # 标签 + ": " + 16字节十六进制
+    def repl(m):
+        width = int(m.group(1)) if m.group(1) else 0
+        conv = m.group(2)
+        typical = {'c': 1, 's': 8}.get(conv, 8 if conv in 'xXp' else 3)
+        return 'x' * max(width, typical if not width else width)
+    return len(re.sub(r'%[-+ #0]*(\d+)?(?:\.\d+)?(?:hh|h|ll|l|z|t|j)?([diouxXcspfFeEgG])', repl, s))
+
+
+def record_length(e):
+    if e['kind'] != 'fmt':
+        return RECORD_HEAD + 4 + 16
+    return RECORD_HEAD + 4 + 4 * e['nargs']
+
+
+def stats(entries, levels, modules):
+    byte_rate = BAUD / 10.0
+    print('%-8s %6s %8s %10s %10s %10s %10s %10s' % (
+        'module', 'calls', 'enabled', 'str bytes', 'flash now', 'saved', 'text msg/s', 'bin msg/s'))
+    total = [0, 0, 0, 0, 0]
+    for mod in modules:
+        es = [e for e in entries if e['module'] == mod]
+        if not es:
+            continue
+        lvl = levels.get(mod, levels.get('DEFAULT', 3))
+        en = [e for e in es if LEVELS[e['level']] <= lvl]
+        strings = set(e['data'] for e in es)
+        str_bytes = sum(len(s) + 1 for s in strings)   # 原来每个字面量(去重后)占的flash
+        flash_now = 4 * len(en)                          # 每个开启的调用点一个4字节token常量
+        text = sum(text_length(e) for e in en) / float(len(en)) if en else 0
+        rec = sum(record_length(e) for e in en) / float(len(en)) if en else 0
+        print('%-8s %6d %8d %10d %10d %10d %10.0f %10.0f' % (
+            mod, len(es), len(en), str_bytes, flash_now, str_bytes - flash_now,
+            byte_rate / text if text else 0, byte_rate / rec if rec else 0))
+        total[0] += len(es)
+        total[1] += len(en)
+        total[2] += str_bytes
+        total[3] += flash_now
+    print('%-8s %6d %8d %10d %10d %10d' % ('total', total[0], total[1], total[2], total[3], total[2] - total[3]))
+    print('\nflash: format strings no longer stored, one 4-byte token per enabled call site;')
+    print('       disabled calls are removed together with their argument code.')
+    print('msg/s: messages per second USART1 can carry at %d baud, formatted text vs binary record.' % BAUD)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='extract log format strings into a token dictionary')
+    ap.add_argument('-o', '--output', help='dictionary csv to write')
+    ap.add_argument('--stats', action='store_true', help='print flash/throughput estimate per module')
+    ap.add_argument('--modules', default='FP,FACE,BLE,NFC,SDCARD,LCD,CAMERA,DEFAULT')
+    args = ap.parse_args()
+
+    entries, errors = scan()
+    errors += check_collisions(entries)
+    for e in errors:
+        sys.stderr.write('log_dict: error: %s\n' % e)
+    if errors:
+        return 1
+
+    if args.output:
+        out = os.path.join(ROOT, args.output) if not os.path.isabs(args.output) else args.output
+        if os.path.dirname(out) and not os.path.isdir(os.path.dirname(out)):
+            os.makedirs(os.path.dirname(out))
+        with open(out, 'w', newline='', encoding='utf-8') as f:
+            w = csv.writer(f)
+            w.writerow(['token', 'module', 'level', 'kind', 'file', 'line', 'format'])
+            done = set()
+            for e in entries:
+                if e['token'] in done:
+                    continue
+                done.add(e['token'])
+                w.writerow(['0x%08X' % e['token'], e['module'], e['level'], e['kind'],
+                            e['file'], e['line'], c_escape(e['data'])])
+        print('log_dict: %d strings -> %s' % (len(done), os.path.relpath(out, ROOT)))
+
+    if args.stats:
+        stats(entries, load_levels(), args.modules.split(','))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
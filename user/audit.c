@@ -0,0 +1,608 @@
+/**
+  ******************************************************************************
+  * @file    audit.c
+  * @author  cyytx
+  * @brief   开锁审计日志模块的源文件
+  *          1.AUDIT_Append在授权任务中调用,记录放入队列后立即返回,不等SD卡;
+  *          2.审计任务(低优先级)把记录编上序号和CRC放入RAM暂存区,暂存区写满
+  *            AUDIT_BUF_SECTORS个扇区、或最早一条记录等了AUDIT_FLUSH_MS时批量写入;
+  *          3.每次刷新先写IDX再写LOG,都是整扇区写在扇区对齐的偏移上,
+  *            没写满的最后一个扇区用0xFF填充,留在暂存区开头,下次刷新时重写;
+  *          4.开机时找到最新的分段,读最后一个扇区中CRC正确、序号连续的记录,接着写;
+  *            掉电最多丢失还在暂存区中的记录。
+  ******************************************************************************
+  */
+#include <string.h>
+#include <stdio.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "ff.h"
+#include "audit.h"
+#include "fstore.h"
+#include "rtc.h"
+#include "log.h"
+#include "priorities.h"
+
+#define LOG_MODULE AUDIT    /* 日志模块名,等级见log_config.h */
+
+#if AUDIT_ENABLE && SDCARD_ENABLE
+
+#define AUDIT_EMPTY         0xFFFFFFFFU
+#define AUDIT_CRC_LEN       (sizeof(AUDIT_Record_t) - 4U)
+#define AUDIT_BUF_RECORDS   (AUDIT_BUF_SECTORS * AUDIT_REC_PER_SECTOR)
+
+static QueueHandle_t AUDIT_Queue = NULL;
+static TaskHandle_t AUDIT_TaskHandle = NULL;
+static AUDIT_Stats_t audit_stats;
+static volatile uint8_t audit_flush_req = 0;
+
+/* 以下只在审计任务中访问 */
+static FIL audit_log;                       // 当前分段的LOG文件
+static FIL audit_idx;                       // 当前分段的IDX文件
+static uint8_t audit_open = 0;              // 文件是否已打开
+static uint32_t audit_seg = 0;              // 当前分段号
+static uint32_t audit_seg_first = 0;        // 最早的分段号
+static uint32_t audit_sector = 0;           // 暂存区第一个扇区在分段中的位置
+static uint32_t audit_count = 0;            // 暂存区中的记录数
+static uint32_t audit_written = 0;          // 暂存区中已写入SD卡的记录数(没写满的扇区)
+static uint32_t audit_seq = 1;              // 下一条记录的序号
+static uint32_t audit_mono = 0;             // 暂存区第一条记录之前的单调时间
+static TickType_t audit_pending_since = 0;  // 最早一条没写入的记录进入暂存区的时间
+static TickType_t audit_last_try = 0;       // 上次尝试打开的时间
+static AUDIT_Record_t audit_buf[AUDIT_BUF_RECORDS] __attribute__((aligned(4)));
+static AUDIT_Index_t audit_idx_buf[AUDIT_IDX_PER_SECTOR] __attribute__((aligned(4)));
+static uint32_t audit_idx_sector = AUDIT_EMPTY;    // audit_idx_buf对应的IDX扇区
+static char audit_path[24];
+
+static const char *AUDIT_Path(uint32_t seg, const char *ext)
+{
+    snprintf(audit_path, sizeof(audit_path), AUDIT_DIR "/A%07lu.%s", (unsigned long)seg, ext);
+    return audit_path;
+}
+
+/* 解析分段文件名"Annnnnnn.LOG",返回分段号,不是分段文件返回0 */
+static uint32_t AUDIT_ParseName(const char *name)
+{
+    uint32_t seg = 0, i;
+
+    if (strlen(name) != 12U || name[0] != 'A' || strcmp(&name[8], ".LOG") != 0)
+    {
+        return 0;
+    }
+    for (i = 1; i < 8; i++)
+    {
+        if (name[i] < '0' || name[i] > '9')
+        {
+            return 0;
+        }
+        seg = seg * 10U + (uint32_t)(name[i] - '0');
+    }
+    return seg;
+}
+
+static int AUDIT_RecValid(const AUDIT_Record_t *rec)
+{
+    return rec->seq != AUDIT_EMPTY && rec->crc == FSTORE_Crc32(0, (const uint8_t *)rec, AUDIT_CRC_LEN);
+}
+
+/* 按扇区读写,读到文件末尾之后的部分填0xFF */
+static FRESULT AUDIT_ReadSector(FIL *fp, uint32_t sector, void *buf)
+{
+    FRESULT res;
+    UINT br = 0;
+
+    res = f_lseek(fp, (FSIZE_t)sector * AUDIT_SECTOR_SIZE);
+    if (res == FR_OK)
+    {
+        res = f_read(fp, buf, AUDIT_SECTOR_SIZE, &br);
+    }
+    memset((uint8_t *)buf + br, 0xFF, AUDIT_SECTOR_SIZE - br);
+    return res;
+}
+
+static FRESULT AUDIT_WriteSectors(FIL *fp, uint32_t sector, const void *buf, uint32_t count)
+{
+    FRESULT res;
+    UINT bw;
+
+    res = f_lseek(fp, (FSIZE_t)sector * AUDIT_SECTOR_SIZE);
+    if (res == FR_OK)
+    {
+        res = f_write(fp, buf, count * AUDIT_SECTOR_SIZE, &bw);
+        if (res == FR_OK && bw != count * AUDIT_SECTOR_SIZE)
+        {
+            res = FR_DISK_ERR;  // 磁盘满
+        }
+    }
+    audit_stats.sectors += count;
+    return res;
+}
+
+/* 切换IDX扇区:新扇区在分段中第一次写入,内容为空;开机恢复时从文件读入 */
+static FRESULT AUDIT_LoadIdx(uint32_t idx_sector, uint8_t read)
+{
+    FRESULT res = FR_OK;
+
+    if (read)
+    {
+        res = AUDIT_ReadSector(&audit_idx, idx_sector, audit_idx_buf);
+    }
+    else
+    {
+        memset(audit_idx_buf, 0xFF, sizeof(audit_idx_buf));
+    }
+    audit_idx_sector = idx_sector;
+    return res;
+}
+
+static void AUDIT_Close(void)
+{
+    if (audit_open)
+    {
+        f_close(&audit_log);
+        f_close(&audit_idx);
+        audit_open = 0;
+        audit_stats.segment = 0;
+    }
+}
+
+/**
+ * @brief 打开分段,文件不存在时创建,已有记录时从最后一个扇区接着写
+ *        空分段保留当前的序号和单调时间(接着上一个分段)
+ */
+static FRESULT AUDIT_OpenSegment(uint32_t seg)
+{
+    FRESULT res;
+    uint32_t size, tail, n;
+    AUDIT_Index_t entry;
+
+    res = f_open(&audit_log, AUDIT_Path(seg, "LOG"), FA_OPEN_ALWAYS | FA_READ | FA_WRITE);
+    if (res != FR_OK)
+    {
+        return res;
+    }
+    res = f_open(&audit_idx, AUDIT_Path(seg, "IDX"), FA_OPEN_ALWAYS | FA_READ | FA_WRITE);
+    if (res != FR_OK)
+    {
+        f_close(&audit_log);
+        return res;
+    }
+    audit_open = 1;
+    audit_seg = seg;
+    audit_count = 0;
+    audit_written = 0;
+    memset(audit_buf, 0xFF, sizeof(audit_buf));
+
+    size = (uint32_t)(f_size(&audit_log) / AUDIT_SECTOR_SIZE);
+    if (size > AUDIT_SEG_SECTORS)
+    {
+        size = AUDIT_SEG_SECTORS;
+    }
+    audit_sector = size;
+    if (size == 0)
+    {
+        return AUDIT_LoadIdx(0, 0);
+    }
+
+    // 最后一个扇区:IDX先于LOG写入,索引项一定在
+    tail = size - 1U;
+    res = AUDIT_LoadIdx(tail / AUDIT_IDX_PER_SECTOR, 1);
+    if (res == FR_OK)
+    {
+        res = AUDIT_ReadSector(&audit_log, tail, audit_buf);
+    }
+    if (res != FR_OK)
+    {
+        return res;
+    }
+    entry = audit_idx_buf[tail % AUDIT_IDX_PER_SECTOR];
+    // 掉电时IDX可能已经写了后面扇区的索引项,LOG还没写,清掉
+    n = tail % AUDIT_IDX_PER_SECTOR + 1U;
+    memset(&audit_idx_buf[n], 0xFF, (AUDIT_IDX_PER_SECTOR - n) * sizeof(AUDIT_Index_t));
+    for (n = 0; n < AUDIT_REC_PER_SECTOR; n++)
+    {
+        if (!AUDIT_RecValid(&audit_buf[n]) || (n > 0 && audit_buf[n].seq != audit_buf[n - 1U].seq + 1U))
+        {
+            break;
+        }
+    }
+    if (entry.seq != AUDIT_EMPTY)
+    {
+        audit_seq = entry.seq;
+        audit_mono = entry.time;
+    }
+    if (n > 0)
+    {
+        audit_seq = audit_buf[n - 1U].seq + 1U;
+    }
+    if (n == AUDIT_REC_PER_SECTOR)
+    {
+        // 最后一个扇区已写满,下一条写在新扇区
+        for (n = 0; n < AUDIT_REC_PER_SECTOR; n++)
+        {
+            if (audit_buf[n].time > audit_mono)
+            {
+                audit_mono = audit_buf[n].time;
+            }
+        }
+        memset(audit_buf, 0xFF, sizeof(audit_buf));
+        if (size % AUDIT_IDX_PER_SECTOR == 0U)
+        {
+            res = AUDIT_LoadIdx(size / AUDIT_IDX_PER_SECTOR, 0);
+        }
+        return res;
+    }
+    // 没写满的扇区留在暂存区开头,后面的记录(掉电时写了一半)丢弃
+    memset(&audit_buf[n], 0xFF, (AUDIT_BUF_RECORDS - n) * sizeof(AUDIT_Record_t));
+    audit_sector = tail;
+    audit_count = n;
+    audit_written = n;
+    return FR_OK;
+}
+
+/* 当前分段写满,切换到下一个分段,删除最早的分段 */
+static FRESULT AUDIT_NextSegment(void)
+{
+    uint32_t seg = audit_seg + 1U;
+    FRESULT res;
+
+    AUDIT_Close();
+    res = AUDIT_OpenSegment(seg);
+    if (res != FR_OK)
+    {
+        return res;
+    }
+    while (seg - audit_seg_first + 1U > AUDIT_SEG_KEEP)
+    {
+        f_unlink(AUDIT_Path(audit_seg_first, "LOG"));
+        f_unlink(AUDIT_Path(audit_seg_first, "IDX"));
+        audit_seg_first++;
+    }
+    audit_stats.segment = seg;
+    LOG_INFO("audit: new segment %d\r\n", seg);
+    return FR_OK;
+}
+
+/* 找到最新的分段并打开 */
+static FRESULT AUDIT_Open(void)
+{
+    static DIR dir;
+    static FILINFO fno;
+    FRESULT res;
+    uint32_t seg, first = 0, last = 0;
+
+    res = f_mkdir(AUDIT_DIR);
+    if (res != FR_OK && res != FR_EXIST)
+    {
+        return res;
+    }
+    res = f_opendir(&dir, AUDIT_DIR);
+    if (res != FR_OK)
+    {
+        return res;
+    }
+    while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0] != '\0')
+    {
+        seg = AUDIT_ParseName(fno.fname);
+        if (seg != 0)
+        {
+            first = (first == 0 || seg < first) ? seg : first;
+            last = seg > last ? seg : last;
+        }
+    }
+    f_closedir(&dir);
+
+    if (last == 0)
+    {
+        first = last = 1;
+    }
+    audit_seg_first = first;
+    res = AUDIT_OpenSegment(last);
+    if (res == FR_OK && audit_sector == 0 && audit_count == 0 && last > first)
+    {
+        // 刚切换分段时掉电,新分段还是空的:序号和单调时间要从上一个分段取
+        AUDIT_Close();
+        f_unlink(AUDIT_Path(last, "LOG"));
+        f_unlink(AUDIT_Path(last, "IDX"));
+        res = AUDIT_OpenSegment(last - 1U);
+    }
+    if (res == FR_OK && audit_sector >= AUDIT_SEG_SECTORS)
+    {
+        res = AUDIT_NextSegment();
+    }
+    if (res != FR_OK)
+    {
+        AUDIT_Close();
+        return res;
+    }
+    audit_stats.segment = audit_seg;
+    audit_stats.sector = audit_sector;
+    audit_stats.next_seq = audit_seq;
+    LOG_INFO("audit: segment %d sector %d records %d next seq %d\r\n",
+             audit_seg, audit_sector, audit_count, audit_seq);
+    return FR_OK;
+}
+
+/**
+ * @brief 把暂存区写入SD卡
+ *        先更新IDX中暂存区各扇区的索引项并写入,再整扇区写LOG,最后同步目录项(文件大小)
+ */
+static FRESULT AUDIT_DoFlush(void)
+{
+    uint32_t sectors = (audit_count + AUDIT_REC_PER_SECTOR - 1U) / AUDIT_REC_PER_SECTOR;
+    uint32_t full = audit_count / AUDIT_REC_PER_SECTOR;
+    uint32_t mono = audit_mono, next_mono = audit_mono, start = LOG_GetTimeUs(), us;
+    uint32_t i, s, idx_sector;
+    FRESULT res = FR_OK;
+
+    if (audit_count == audit_written)
+    {
+        return FR_OK;
+    }
+    for (i = 0; i < audit_count; i++)
+    {
+        if (audit_buf[i].time > mono)
+        {
+            mono = audit_buf[i].time;
+        }
+        if (i % AUDIT_REC_PER_SECTOR == 0U)
+        {
+            s = audit_sector + i / AUDIT_REC_PER_SECTOR;
+            idx_sector = s / AUDIT_IDX_PER_SECTOR;
+            if (idx_sector != audit_idx_sector)
+            {
+                // 暂存区跨过IDX扇区边界,前一个IDX扇区已经完整
+                res = AUDIT_WriteSectors(&audit_idx, audit_idx_sector, audit_idx_buf, 1);
+                if (res != FR_OK)
+                {
+                    return res;
+                }
+                AUDIT_LoadIdx(idx_sector, 0);
+            }
+            audit_idx_buf[s % AUDIT_IDX_PER_SECTOR].time = mono;
+            audit_idx_buf[s % AUDIT_IDX_PER_SECTOR].seq = audit_buf[i].seq;
+        }
+        if (i + 1U == full * AUDIT_REC_PER_SECTOR)
+        {
+            next_mono = mono;   // 留在暂存区的没写满的扇区之前的单调时间
+        }
+    }
+    res = AUDIT_WriteSectors(&audit_idx, audit_idx_sector, audit_idx_buf, 1);
+    if (res == FR_OK)
+    {
+        res = AUDIT_WriteSectors(&audit_log, audit_sector, audit_buf, sectors);
+    }
+    if (res == FR_OK)
+    {
+        res = f_sync(&audit_idx);
+    }
+    if (res == FR_OK)
+    {
+        res = f_sync(&audit_log);
+    }
+    if (res != FR_OK)
+    {
+        return res;
+    }
+
+    audit_stats.written += audit_count - audit_written;
+    audit_stats.flushes++;
+    if (full == sectors)
+    {
+        audit_mono = mono;
+        audit_count = 0;
+        memset(audit_buf, 0xFF, sectors * AUDIT_SECTOR_SIZE);
+    }
+    else
+    {
+        audit_mono = next_mono;
+        audit_count -= full * AUDIT_REC_PER_SECTOR;
+        memmove(audit_buf, &audit_buf[full * AUDIT_REC_PER_SECTOR], AUDIT_SECTOR_SIZE);
+        memset(&audit_buf[audit_count], 0xFF, (AUDIT_BUF_RECORDS - audit_count) * sizeof(AUDIT_Record_t));
+    }
+    audit_written = audit_count;
+    audit_sector += full;
+    audit_stats.sector = audit_sector;
+
+    us = LOG_GetTimeUs() - start;
+    if (us > audit_stats.max_flush_us)
+    {
+        audit_stats.max_flush_us = us;
+    }
+    if (audit_sector >= AUDIT_SEG_SECTORS)
+    {
+        res = AUDIT_NextSegment();
+    }
+    return res;
+}
+
+/* 暂存区还能放的记录数,不能超过分段末尾 */
+static uint32_t AUDIT_Space(void)
+{
+    uint32_t sectors = AUDIT_SEG_SECTORS - audit_sector;
+
+    if (sectors > AUDIT_BUF_SECTORS)
+    {
+        sectors = AUDIT_BUF_SECTORS;
+    }
+    return sectors * AUDIT_REC_PER_SECTOR - audit_count;
+}
+
+/* 文件操作失败:关闭文件,暂存区中没写入的记录计为丢弃,稍后重新打开 */
+static void AUDIT_Fail(FRESULT res)
+{
+    taskENTER_CRITICAL();
+    audit_stats.errors++;
+    audit_stats.dropped += audit_count - audit_written;
+    taskEXIT_CRITICAL();
+    LOG_ERR("audit: sd error %d, %d records dropped\r\n", res, audit_count - audit_written);
+    AUDIT_Close();
+    audit_count = 0;
+    audit_written = 0;
+    audit_last_try = xTaskGetTickCount();
+}
+
+static void AUDIT_Task(void *argument)
+{
+    AUDIT_Record_t rec;
+    TickType_t now, wait;
+    FRESULT res;
+
+    for (;;)
+    {
+        now = xTaskGetTickCount();
+        if (!audit_open && now - audit_last_try >= pdMS_TO_TICKS(AUDIT_RETRY_MS))
+        {
+            audit_last_try = now;
+            res = AUDIT_Open();
+            if (res != FR_OK)
+            {
+                LOG_WARN("audit: sd not available(%d)\r\n", res);
+            }
+        }
+
+        // 只有文件打开时才取队列中的记录,SD卡不可用时记录留在队列中,队列满后丢弃
+        while (audit_open && AUDIT_Space() > 0 && xQueueReceive(AUDIT_Queue, &rec, 0) == pdPASS)
+        {
+            if (audit_count == audit_written)
+            {
+                audit_pending_since = xTaskGetTickCount();
+            }
+            rec.seq = audit_seq++;
+            rec.crc = FSTORE_Crc32(0, (const uint8_t *)&rec, AUDIT_CRC_LEN);
+            audit_buf[audit_count++] = rec;
+            audit_stats.next_seq = audit_seq;
+            if (AUDIT_Space() == 0)
+            {
+                res = AUDIT_DoFlush();
+                if (res != FR_OK)
+                {
+                    AUDIT_Fail(res);
+                }
+            }
+        }
+
+        now = xTaskGetTickCount();
+        if (audit_open && audit_count > audit_written &&
+            (audit_flush_req || now - audit_pending_since >= pdMS_TO_TICKS(AUDIT_FLUSH_MS)))
+        {
+            res = AUDIT_DoFlush();
+            if (res != FR_OK)
+            {
+                AUDIT_Fail(res);
+            }
+        }
+        audit_flush_req = 0;
+
+        if (!audit_open)
+        {
+            wait = pdMS_TO_TICKS(AUDIT_RETRY_MS);
+        }
+        else if (audit_count > audit_written)
+        {
+            now = xTaskGetTickCount() - audit_pending_since;
+            wait = now < pdMS_TO_TICKS(AUDIT_FLUSH_MS) ? pdMS_TO_TICKS(AUDIT_FLUSH_MS) - now : 0;
+        }
+        else
+        {
+            wait = portMAX_DELAY;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+/**
+ * @brief 创建审计任务,在FATFS_Init之后、授权任务之前调用
+ */
+void AUDIT_CreateTask(void)
+{
+    memset(&audit_stats, 0, sizeof(audit_stats));
+    AUDIT_Queue = xQueueCreate(AUDIT_QUEUE_SIZE, sizeof(AUDIT_Record_t));
+    audit_last_try = xTaskGetTickCount() - pdMS_TO_TICKS(AUDIT_RETRY_MS);
+    if (AUDIT_Queue == NULL ||
+        xTaskCreate(AUDIT_Task, "AUDIT_Task", STACK_SIZE_AUDIT, NULL, TASK_PRIORITY_AUDIT, &AUDIT_TaskHandle) != pdPASS)
+    {
+        Error_Handler(); /* 堆不够 */
+    }
+}
+
+/**
+ * @brief 提交一条审计记录,在任务中调用,不等待SD卡
+ * @param source 开锁方式(AUTH_Source_t)
+ * @param result 审计事件(AUTH_Event_t)
+ * @param user 用户编号,AUDIT_USER_NONE表示凭据没有对应用户
+ * @param latency_us 出示凭据到做出决定的时间(us)
+ * @param snapshot 抓拍照片的编号,0表示没有
+ */
+void AUDIT_Append(uint8_t source, uint8_t result, int user, uint32_t latency_us, uint32_t snapshot)
+{
+    AUDIT_Record_t rec;
+
+    if (AUDIT_Queue == NULL || AUDIT_TaskHandle == NULL)
+    {
+        return;
+    }
+    rec.seq = 0;    // 序号和CRC由审计任务按写入顺序填写
+    rec.time = RTC_GetTime();
+    rec.uptime_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    rec.snapshot = snapshot;
+    rec.latency_us = latency_us;
+    rec.source = source;
+    rec.result = result;
+    rec.user = (int16_t)user;
+    rec.reserved = 0;
+    rec.crc = 0;
+    taskENTER_CRITICAL();
+    audit_stats.appended++;
+    taskEXIT_CRITICAL();
+    if (xQueueSend(AUDIT_Queue, &rec, 0) != pdPASS)
+    {
+        taskENTER_CRITICAL();
+        audit_stats.dropped++;
+        taskEXIT_CRITICAL();
+        LOG_WARN("audit: queue full, record dropped\r\n");
+        return;
+    }
+    xTaskNotifyGive(AUDIT_TaskHandle);
+}
+
+/**
+ * @brief 请求审计任务立即写入暂存区中的记录(不等待写完)
+ */
+void AUDIT_Flush(void)
+{
+    if (AUDIT_TaskHandle != NULL)
+    {
+        audit_flush_req = 1;
+        xTaskNotifyGive(AUDIT_TaskHandle);
+    }
+}
+
+void AUDIT_GetStats(AUDIT_Stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = audit_stats;
+    taskEXIT_CRITICAL();
+}
+
+#else /* !(AUDIT_ENABLE && SDCARD_ENABLE) */
+
+void AUDIT_CreateTask(void)
+{
+}
+
+void AUDIT_Append(uint8_t source, uint8_t result, int user, uint32_t latency_us, uint32_t snapshot)
+{
+}
+
+void AUDIT_Flush(void)
+{
+}
+
+void AUDIT_GetStats(AUDIT_Stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* AUDIT_ENABLE && SDCARD_ENABLE */
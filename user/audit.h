@@ -0,0 +1,87 @@
+/**
+  ******************************************************************************
+  * @file    audit.h
+  * @author  cyytx
+  * @brief   开锁审计日志模块的头文件
+  *          授权任务的每个决定(开锁、失败、锁定、拒绝、等待双重验证)写成一条定长记录,
+  *          追加到SD卡0:/AUDIT目录下的分段文件,每个分段带稀疏时间索引,
+  *          主机端用 tools/audit_query.py 解码和按时间查询
+  ******************************************************************************
+  */
+
+#ifndef __AUDIT_H
+#define __AUDIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "hard_enable_ctrl.h"
+
+/*
+文件布局(所有写入都是整扇区,偏移按扇区对齐):
+  AUDIT/Annnnnnn.LOG  记录文件,每个扇区16条32字节记录,没写满的扇区用0xFF填充,
+                      下次刷新时整扇区重写;每个分段最多AUDIT_SEG_SECTORS个扇区
+  AUDIT/Annnnnnn.IDX  时间索引,LOG的每个扇区一项(扇区第一条记录的单调时间、序号),
+                      先于LOG写入;单调时间跨分段不减,查询时先二分查找分段和扇区再读记录,
+                      RTC时间被往回调过的记录按调整前的时间定位
+nnnnnnn是十进制分段号,从1开始递增,只保留最新的AUDIT_SEG_KEEP个分段
+*/
+#define AUDIT_DIR               "0:/AUDIT"
+#define AUDIT_SECTOR_SIZE       512
+#define AUDIT_REC_PER_SECTOR    (AUDIT_SECTOR_SIZE / sizeof(AUDIT_Record_t))
+#define AUDIT_SEG_SECTORS       2048        /* 每个分段1MB,32768条记录 */
+#define AUDIT_SEG_KEEP          64          /* 保留的分段数 */
+#define AUDIT_IDX_PER_SECTOR    (AUDIT_SECTOR_SIZE / sizeof(AUDIT_Index_t))
+
+#define AUDIT_BUF_SECTORS       4           /* RAM暂存的扇区数,写满后立即刷新 */
+#define AUDIT_FLUSH_MS          2000        /* 最早一条没写入的记录最多等待的时间(ms) */
+#define AUDIT_RETRY_MS          10000       /* SD卡不可用时重新打开的间隔(ms) */
+#define AUDIT_QUEUE_SIZE        16
+
+#define AUDIT_USER_NONE         (-1)        /* 与CRED_NONE相同,凭据没有对应用户 */
+
+/* 审计记录,32字节,小端 */
+typedef struct {
+    uint32_t seq;           /* 序号,从1开始,跨分段连续 */
+    uint32_t time;          /* RTC时间(Unix秒,UTC),日历没有设置时为0 */
+    uint32_t uptime_ms;     /* 开机以来的时间(ms) */
+    uint32_t snapshot;      /* 抓拍照片的编号,0表示没有 */
+    uint32_t latency_us;    /* 出示凭据到做出决定的时间(us) */
+    uint8_t source;         /* 开锁方式,AUTH_Source_t */
+    uint8_t result;         /* 审计事件,AUTH_Event_t */
+    int16_t user;           /* 用户编号,AUDIT_USER_NONE表示凭据没有对应用户 */
+    uint32_t reserved;      /* 保留,写0 */
+    uint32_t crc;           /* 前28字节的CRC32 */
+} AUDIT_Record_t;
+
+/* 时间索引项,8字节 */
+typedef struct {
+    uint32_t time;          /* 扇区第一条记录的单调时间(到这条记录为止所有记录时间的最大值) */
+    uint32_t seq;           /* 扇区第一条记录的序号,0xFFFFFFFF表示该扇区还没写 */
+} AUDIT_Index_t;
+
+typedef struct {
+    uint32_t appended;      /* 提交的记录数 */
+    uint32_t written;       /* 写入SD卡的记录数 */
+    uint32_t dropped;       /* 队列满或SD卡不可用丢弃的记录数 */
+    uint32_t flushes;       /* 刷新次数 */
+    uint32_t sectors;       /* 写入的扇区数(LOG+IDX) */
+    uint32_t errors;        /* 文件操作失败次数 */
+    uint32_t segment;       /* 当前分段号,0表示SD卡不可用 */
+    uint32_t sector;        /* 当前分段中暂存区第一个扇区的位置 */
+    uint32_t next_seq;      /* 下一条记录的序号 */
+    uint32_t max_flush_us;  /* 最长的一次刷新时间(us) */
+} AUDIT_Stats_t;
+
+void AUDIT_CreateTask(void);
+void AUDIT_Append(uint8_t source, uint8_t result, int user, uint32_t latency_us, uint32_t snapshot);
+void AUDIT_Flush(void);
+void AUDIT_GetStats(AUDIT_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIT_H */
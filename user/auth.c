@@ -0,0 +1,479 @@
+/**
+  ******************************************************************************
+  * @file    auth.c
+  * @author  cyytx
+  * @brief   开锁授权模块的源文件
+  *          1.各开锁方式验证凭据后调用AUTH_Request提交请求(验证失败时用户为CRED_NONE),
+  *            请求带出示凭据的时间,由授权任务依次处理;
+  *          2.限流:每种开锁方式(来源和凭据类型一一对应)单独计连续失败次数,
+  *            达到AUTH_FAIL_LIMIT次后锁定该方式,锁定时间从AUTH_LOCKOUT_MS起每次加倍,
+  *            验证成功后清零;失败计数在AUTH_Request中立即更新,各开锁方式在哈希、读卡、
+  *            给模块发识别命令之前调用AUTH_Allow,锁定期间直接拒绝,不做任何计算也不打印;
+  *            状态写在RTC备份寄存器中,复位不会清除,锁定结束的日历时间也保存下来,
+  *            日历没有设置时复位后按完整的锁定时间重新计时;
+  *            带CRED_USER_MFA标志的用户要在AUTH_MFA_WINDOW_MS内用两种不同方式验证才开锁;
+  *          3.授权后把请求的来源和出示时间交给舵机任务,舵机开始转动时调用AUTH_BoltMoving,
+  *            按来源统计"出示凭据->舵机转动"的延时直方图,shell的auth命令查看;
+  *          4.每个决定输出一条日志(事件、来源、用户),并写入SD卡审计日志(audit.c)。
+  ******************************************************************************
+  */
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "auth.h"
+#include "cred.h"
+#include "sg90.h"
+#include "audit.h"
+#include "rtc.h"
+#include "log.h"
+#include "priorities.h"
+
+#define LOG_MODULE AUTH    /* 日志模块名,等级见log_config.h */
+
+#define AUTH_QUEUE_SIZE     8
+
+/* 限流状态在备份寄存器中的格式:
+   状态寄存器[31:24]魔数,[16]锁定中,[15:8]连续锁定次数,[7:0]连续失败次数;
+   结束时间寄存器是锁定结束的日历时间(Unix秒),日历没有设置时为0 */
+#define AUTH_BKP_MAGIC          0xA5000000U
+#define AUTH_BKP_MAGIC_MASK     0xFF000000U
+#define AUTH_BKP_LOCKED         0x00010000U
+#define AUTH_BKP_STATE(src)     (RTC_BKP_AUTH_LIMIT + 2U * (src))
+#define AUTH_BKP_UNTIL(src)     (RTC_BKP_AUTH_LIMIT + 2U * (src) + 1U)
+
+/* 一种开锁方式的限流状态,在临界区中访问 */
+typedef struct {
+    uint8_t fails;              /* 连续失败次数 */
+    uint8_t level;              /* 连续锁定次数 */
+    uint8_t locked;
+    TickType_t until;           /* 锁定结束的tick */
+} AUTH_Gate_t;
+
+static QueueHandle_t AUTH_Queue = NULL;
+static TaskHandle_t AUTH_TaskHandle = NULL;
+static AUTH_Stats_t auth_stats[AUTH_SRC_NUM];
+static AUTH_Gate_t auth_gate[AUTH_SRC_NUM];
+
+/* 以下只在授权任务中访问 */
+static int16_t auth_mfa_user = CRED_NONE;   // 已通过第一种方式、等待第二种方式的用户
+static uint8_t auth_mfa_source = 0;
+static TickType_t auth_mfa_time = 0;
+
+/* 本次开锁的用户和方式,授权开锁时设置,关锁时清除,在临界区中访问 */
+static int16_t auth_open_user = CRED_NONE;
+static uint8_t auth_open_source = 0;
+
+/* 延时对应的直方图档:小于4us直接对应,之后每个2的幂分4档 */
+static uint32_t AUTH_Bucket(uint32_t us)
+{
+    uint32_t msb, b;
+
+    if (us < (1U << AUTH_HIST_SUB_BITS))
+    {
+        return us;
+    }
+    msb = 31U - (uint32_t)__builtin_clz(us);
+    b = ((msb - AUTH_HIST_SUB_BITS + 1U) << AUTH_HIST_SUB_BITS) |
+        ((us >> (msb - AUTH_HIST_SUB_BITS)) & ((1U << AUTH_HIST_SUB_BITS) - 1U));
+    return b < AUTH_HIST_BUCKETS ? b : AUTH_HIST_BUCKETS - 1U;
+}
+
+/* 直方图档的下限(us) */
+static uint32_t AUTH_BucketLow(uint32_t b)
+{
+    uint32_t sub = 1U << AUTH_HIST_SUB_BITS;
+
+    if (b < sub)
+    {
+        return b;
+    }
+    return (sub | (b & (sub - 1U))) << ((b >> AUTH_HIST_SUB_BITS) - 1U);
+}
+
+static void AUTH_CountEvent(uint8_t source, AUTH_Event_t ev)
+{
+    taskENTER_CRITICAL();
+    auth_stats[source].events[ev]++;
+    taskEXIT_CRITICAL();
+}
+
+/* 第level次锁定的时间(tick) */
+static TickType_t AUTH_LockoutTicks(uint8_t level)
+{
+    return pdMS_TO_TICKS(AUTH_LOCKOUT_MS) << (level - 1U);
+}
+
+/* 限流状态写入备份寄存器,先写结束时间再写状态,调用者在临界区中 */
+static void AUTH_GateSave(uint8_t source, TickType_t now)
+{
+    const AUTH_Gate_t *g = &auth_gate[source];
+    uint32_t time = RTC_GetTime();
+
+    RTC_BkpWrite(AUTH_BKP_UNTIL(source), (g->locked && time != 0U) ?
+                 time + (g->until - now) / configTICK_RATE_HZ + 1U : 0U);
+    RTC_BkpWrite(AUTH_BKP_STATE(source), AUTH_BKP_MAGIC | (g->locked ? AUTH_BKP_LOCKED : 0U) |
+                 ((uint32_t)g->level << 8) | g->fails);
+}
+
+/* 复位后从备份寄存器恢复限流状态 */
+static void AUTH_GateLoad(TickType_t now)
+{
+    uint32_t state, until, time = RTC_GetTime();
+    TickType_t full, remain;
+    uint8_t src;
+
+    for (src = 0; src < AUTH_SRC_NUM; src++)
+    {
+        AUTH_Gate_t *g = &auth_gate[src];
+
+        memset(g, 0, sizeof(*g));
+        state = RTC_BkpRead(AUTH_BKP_STATE(src));
+        if ((state & AUTH_BKP_MAGIC_MASK) != AUTH_BKP_MAGIC)
+        {
+            continue;
+        }
+        g->fails = (uint8_t)state;
+        g->level = (uint8_t)(state >> 8);
+        if (g->level > AUTH_LOCKOUT_MAX_LEVEL)
+        {
+            g->level = AUTH_LOCKOUT_MAX_LEVEL;
+        }
+        if (!(state & AUTH_BKP_LOCKED) || g->level == 0)
+        {
+            continue;
+        }
+        // 按保存的结束时间算剩余时间;日历没有设置、被往回调过(剩余比完整时间还长)时重新计时
+        full = AUTH_LockoutTicks(g->level);
+        remain = full;
+        until = RTC_BkpRead(AUTH_BKP_UNTIL(src));
+        if (until != 0U && time != 0U)
+        {
+            remain = until <= time ? 0U : (until - time) * configTICK_RATE_HZ;
+            if (remain > full)
+            {
+                remain = full;
+            }
+        }
+        g->locked = 1;
+        g->until = now + remain;
+        LOG_WARN("auth: source %d locked %dms after reset, level %d\r\n", src,
+                 remain * portTICK_PERIOD_MS, g->level);
+    }
+}
+
+/* 锁定到期后解除:失败次数清零,锁定次数保留,再失败AUTH_FAIL_LIMIT次锁定时间加倍;调用者在临界区中 */
+static uint8_t AUTH_GateLocked(uint8_t source, TickType_t now)
+{
+    AUTH_Gate_t *g = &auth_gate[source];
+
+    if (g->locked && (int32_t)(g->until - now) <= 0)
+    {
+        g->locked = 0;
+        g->fails = 0;
+        AUTH_GateSave(source, now);
+    }
+    return g->locked;
+}
+
+/* 审计事件:计数、输出日志并写入审计日志 */
+static void AUTH_Audit(AUTH_Event_t ev, const AUTH_Request_t *req)
+{
+    AUTH_CountEvent(req->source, ev);
+    AUDIT_Append(req->source, (uint8_t)ev, req->user, LOG_GetTimeUs() - req->capture_us, 0);
+    if (ev == AUTH_EV_UNLOCK || ev == AUTH_EV_MFA_PENDING)
+    {
+        LOG_INFO("audit: event %d source %d user %d\r\n", ev, req->source, req->user);
+    }
+    else
+    {
+        LOG_WARN("audit: event %d source %d user %d\r\n", ev, req->source, req->user);
+    }
+}
+
+/* 按策略处理一个请求 */
+static void AUTH_Handle(const AUTH_Request_t *req)
+{
+    TickType_t now = xTaskGetTickCount();
+    CRED_User_t info;
+
+    // 失败和锁定已经在AUTH_Request中计入限流状态,这里只审计
+    if (req->result == AUTH_EV_DENIED)
+    {
+        AUTH_Audit(AUTH_EV_DENIED, req);
+        return;
+    }
+    if (req->result == AUTH_EV_FAIL || req->result == AUTH_EV_LOCKOUT)
+    {
+        AUTH_Audit(AUTH_EV_FAIL, req);
+        if (req->result == AUTH_EV_LOCKOUT)
+        {
+            auth_mfa_user = CRED_NONE;
+            AUTH_Audit(AUTH_EV_LOCKOUT, req);
+        }
+        return;
+    }
+
+    // 双重验证:第一种方式先记下,同一用户在时间窗口内用另一种方式验证才开锁
+    if (CRED_GetUser((uint16_t)req->user, &info) == 0 && (info.flags & CRED_USER_MFA))
+    {
+        if (auth_mfa_user != req->user || auth_mfa_source == req->source ||
+            now - auth_mfa_time > pdMS_TO_TICKS(AUTH_MFA_WINDOW_MS))
+        {
+            auth_mfa_user = req->user;
+            auth_mfa_source = req->source;
+            auth_mfa_time = now;
+            AUTH_Audit(AUTH_EV_MFA_PENDING, req);
+            return;
+        }
+    }
+    auth_mfa_user = CRED_NONE;
+    taskENTER_CRITICAL();
+    auth_open_user = (int16_t)req->user;
+    auth_open_source = req->source;
+    taskEXIT_CRITICAL();
+#if SG90_ENABLE
+    SG90_Unlock(req->source, req->capture_us);
+#endif
+    AUTH_Audit(AUTH_EV_UNLOCK, req);
+}
+
+static void AUTH_Task(void *argument)
+{
+    AUTH_Request_t req;
+
+    for (;;)
+    {
+        if (xQueueReceive(AUTH_Queue, &req, portMAX_DELAY) == pdPASS)
+        {
+            AUTH_Handle(&req);
+        }
+    }
+}
+
+/**
+ * @brief 创建授权任务,在各开锁方式的任务之前创建
+ */
+void AUTH_CreateTask(void)
+{
+    AUTH_ResetStats();
+    AUTH_GateLoad(xTaskGetTickCount());
+    AUTH_Queue = xQueueCreate(AUTH_QUEUE_SIZE, sizeof(AUTH_Request_t));
+    if (AUTH_Queue == NULL ||
+        xTaskCreate(AUTH_Task, "AUTH_Task", STACK_SIZE_AUTH, NULL, TASK_PRIORITY_AUTH, &AUTH_TaskHandle) != pdPASS)
+    {
+        Error_Handler(); /* 堆不够 */
+    }
+}
+
+/**
+ * @brief 这种开锁方式现在能否验证凭据,在哈希、读卡、发识别命令等耗时操作之前调用
+ *        锁定期间只计数(AUTH_EV_DENIED),不输出日志
+ * @return 1: 可以验证; 0: 锁定中
+ */
+int AUTH_Allow(AUTH_Source_t source)
+{
+    uint8_t locked;
+
+    if (source >= AUTH_SRC_NUM)
+    {
+        return 0;
+    }
+    taskENTER_CRITICAL();
+    locked = AUTH_GateLocked((uint8_t)source, xTaskGetTickCount());
+    if (locked)
+    {
+        auth_stats[source].events[AUTH_EV_DENIED]++;
+    }
+    taskEXIT_CRITICAL();
+    return !locked;
+}
+
+/**
+ * @brief 提交开锁请求,在任务中调用;失败次数立即计入限流状态,下一次AUTH_Allow就能看到
+ * @param source 开锁方式
+ * @param user 凭据对应的用户,CRED_NONE表示验证失败(计入失败次数)
+ * @param capture_us 出示凭据的时间(LOG_GetTimeUs),用于统计延时
+ * @return 0: 已提交; -1: 队列满或任务没有创建
+ */
+int AUTH_Request(AUTH_Source_t source, int user, uint32_t capture_us)
+{
+    AUTH_Request_t req;
+    AUTH_Gate_t *g;
+    TickType_t now = xTaskGetTickCount();
+
+    if (AUTH_Queue == NULL || source >= AUTH_SRC_NUM)
+    {
+        return -1;
+    }
+    req.source = (uint8_t)source;
+    req.user = (int16_t)user;
+    req.capture_us = capture_us;
+    req.result = AUTH_EV_UNLOCK;
+    g = &auth_gate[source];
+    taskENTER_CRITICAL();
+    if (AUTH_GateLocked(req.source, now))
+    {
+        // 调用者没有先检查AUTH_Allow,或者验证期间被锁定
+        req.result = AUTH_EV_DENIED;
+    }
+    else if (user == CRED_NONE)
+    {
+        req.result = AUTH_EV_FAIL;
+        if (++g->fails >= AUTH_FAIL_LIMIT)
+        {
+            if (g->level < AUTH_LOCKOUT_MAX_LEVEL)
+            {
+                g->level++;
+            }
+            g->locked = 1;
+            g->until = now + AUTH_LockoutTicks(g->level);
+            req.result = AUTH_EV_LOCKOUT;
+        }
+        AUTH_GateSave(req.source, now);
+    }
+    else if (g->fails != 0 || g->level != 0)
+    {
+        g->fails = 0;
+        g->level = 0;
+        AUTH_GateSave(req.source, now);
+    }
+    taskEXIT_CRITICAL();
+    return xQueueSend(AUTH_Queue, &req, 0) == pdPASS ? 0 : -1;
+}
+
+/**
+ * @brief 舵机开始转动时由舵机任务调用,记录出示凭据到此刻的延时
+ */
+void AUTH_BoltMoving(uint8_t source, uint32_t capture_us)
+{
+    uint32_t us = LOG_GetTimeUs() - capture_us;
+    AUTH_Stats_t *st;
+
+    if (source >= AUTH_SRC_NUM)
+    {
+        return;
+    }
+    st = &auth_stats[source];
+    taskENTER_CRITICAL();
+    st->count++;
+    st->total_us += us;
+    if (us < st->min_us)
+    {
+        st->min_us = us;
+    }
+    if (us > st->max_us)
+    {
+        st->max_us = us;
+    }
+    st->hist[AUTH_Bucket(us)]++;
+    taskEXIT_CRITICAL();
+    LOG_INFO("auth: source %d bolt moving %dus after capture\r\n", source, us);
+}
+
+/**
+ * @brief 本次开锁的用户,按键设置密码、登记卡片前用来确认是谁开的锁
+ * @param source 输出开锁方式,可以为NULL
+ * @return 用户编号,门锁关着或复位后不知道是谁开的锁时为CRED_NONE
+ */
+int AUTH_OpenedBy(uint8_t *source)
+{
+    int user;
+
+    taskENTER_CRITICAL();
+    user = auth_open_user;
+    if (source != NULL)
+    {
+        *source = auth_open_source;
+    }
+    taskEXIT_CRITICAL();
+    return user;
+}
+
+/**
+ * @brief 关锁时由舵机任务调用,清除本次开锁的用户
+ */
+void AUTH_DoorLocked(void)
+{
+    taskENTER_CRITICAL();
+    auth_open_user = CRED_NONE;
+    taskEXIT_CRITICAL();
+}
+
+void AUTH_GetStats(AUTH_Source_t source, AUTH_Stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = auth_stats[source];
+    taskEXIT_CRITICAL();
+}
+
+void AUTH_ResetStats(void)
+{
+    uint8_t i;
+
+    taskENTER_CRITICAL();
+    memset(auth_stats, 0, sizeof(auth_stats));
+    for (i = 0; i < AUTH_SRC_NUM; i++)
+    {
+        auth_stats[i].min_us = 0xFFFFFFFFU;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief 由直方图估计延时的百分位数
+ * @return 该百分位所在档的上限(us),不超过最大值;没有样本时为0
+ */
+uint32_t AUTH_Percentile(const AUTH_Stats_t *stats, uint8_t percent)
+{
+    uint64_t need = ((uint64_t)stats->count * percent + 99U) / 100U;
+    uint64_t sum = 0;
+    uint32_t b, high;
+
+    if (stats->count == 0)
+    {
+        return 0;
+    }
+    for (b = 0; b < AUTH_HIST_BUCKETS; b++)
+    {
+        sum += stats->hist[b];
+        if (sum >= need && sum > 0)
+        {
+            break;
+        }
+    }
+    high = (b + 1U < AUTH_HIST_BUCKETS) ? AUTH_BucketLow(b + 1U) - 1U : stats->max_us;
+    return high < stats->max_us ? high : stats->max_us;
+}
+
+/**
+ * @brief 一种开锁方式的限流状态,shell的auth命令查看
+ */
+void AUTH_GetLimit(AUTH_Source_t source, AUTH_Limit_t *limit)
+{
+    TickType_t now = xTaskGetTickCount();
+    const AUTH_Gate_t *g = &auth_gate[source];
+
+    taskENTER_CRITICAL();
+    limit->remain_ms = AUTH_GateLocked((uint8_t)source, now) ? (g->until - now) * portTICK_PERIOD_MS : 0U;
+    limit->fails = g->fails;
+    limit->level = g->level;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief 清除所有开锁方式的失败次数和锁定(管理员在调试shell中执行)
+ */
+void AUTH_ClearLimits(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    uint8_t src;
+
+    taskENTER_CRITICAL();
+    memset(auth_gate, 0, sizeof(auth_gate));
+    for (src = 0; src < AUTH_SRC_NUM; src++)
+    {
+        AUTH_GateSave(src, now);
+    }
+    taskEXIT_CRITICAL();
+}
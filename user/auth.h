@@ -0,0 +1,93 @@
+/**
+  ******************************************************************************
+  * @file    auth.h
+  * @author  cyytx
+  * @brief   开锁授权模块的头文件
+  *          键盘、蓝牙、NFC、指纹、人脸验证后不再直接驱动舵机,而是提交开锁请求
+  *          (来源、用户、凭据出示时间),由授权任务按策略决定是否开锁,
+  *          并统计每种开锁方式从出示凭据到舵机开始转动的延时分布;
+  *          每种开锁方式单独限流,连续失败后按指数增长的时间锁定,状态保存在RTC备份寄存器中
+  ******************************************************************************
+  */
+
+#ifndef __AUTH_H
+#define __AUTH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define AUTH_FAIL_LIMIT         5       /* 同一开锁方式连续验证失败次数达到后锁定该方式 */
+#define AUTH_LOCKOUT_MS         60000   /* 第一次锁定的时间(ms),之后每次锁定时间加倍 */
+#define AUTH_LOCKOUT_MAX_LEVEL  6       /* 锁定时间最多加倍到AUTH_LOCKOUT_MS<<(6-1),约32分钟 */
+#define AUTH_MFA_WINDOW_MS      15000   /* 双重验证的用户两种方式的间隔不能超过该时间(ms) */
+
+/* 延时直方图:按2的幂分档,每档再分4个子档,最大约16s */
+#define AUTH_HIST_SUB_BITS      2
+#define AUTH_HIST_OCTAVES       24
+#define AUTH_HIST_BUCKETS       (AUTH_HIST_OCTAVES << AUTH_HIST_SUB_BITS)
+
+/* 开锁请求来源 */
+typedef enum {
+    AUTH_SRC_KEY = 0,       /* 键盘密码 */
+    AUTH_SRC_BLE,           /* 蓝牙密码 */
+    AUTH_SRC_NFC,           /* NFC卡 */
+    AUTH_SRC_FP,            /* 指纹 */
+    AUTH_SRC_FACE,          /* 人脸 */
+    AUTH_SRC_PHONE,         /* 蓝牙手机钥匙 */
+    AUTH_SRC_NUM
+} AUTH_Source_t;
+
+/* 审计事件 */
+typedef enum {
+    AUTH_EV_UNLOCK = 0,     /* 开锁 */
+    AUTH_EV_FAIL,           /* 凭据验证失败 */
+    AUTH_EV_LOCKOUT,        /* 失败次数过多,开始锁定 */
+    AUTH_EV_DENIED,         /* 锁定期间的请求被拒绝(包括AUTH_Allow拒绝的) */
+    AUTH_EV_MFA_PENDING,    /* 双重验证用户通过了第一种方式,等待第二种 */
+    AUTH_EV_NUM
+} AUTH_Event_t;
+
+typedef struct {
+    uint8_t source;         /* AUTH_Source_t */
+    int16_t user;           /* 凭据对应的用户,CRED_NONE表示验证失败 */
+    uint32_t capture_us;    /* 出示凭据的时间,LOG_GetTimeUs() */
+    uint8_t result;         /* AUTH_Event_t,提交时限流判定的结果:开锁(待授权)、失败、锁定或拒绝 */
+} AUTH_Request_t;
+
+/* 一种开锁方式的限流状态 */
+typedef struct {
+    uint8_t fails;          /* 连续失败次数 */
+    uint8_t level;          /* 连续锁定次数,本次锁定时间为AUTH_LOCKOUT_MS<<(level-1) */
+    uint32_t remain_ms;     /* 锁定剩余时间,0表示没有锁定 */
+} AUTH_Limit_t;
+
+/* 每种开锁方式的计数和出示凭据到舵机转动的延时分布 */
+typedef struct {
+    uint32_t events[AUTH_EV_NUM];       /* 各审计事件次数 */
+    uint32_t count;                     /* 延时样本数 */
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t hist[AUTH_HIST_BUCKETS];
+} AUTH_Stats_t;
+
+void AUTH_CreateTask(void);
+int AUTH_Allow(AUTH_Source_t source);
+int AUTH_Request(AUTH_Source_t source, int user, uint32_t capture_us);
+void AUTH_BoltMoving(uint8_t source, uint32_t capture_us);
+int AUTH_OpenedBy(uint8_t *source);
+void AUTH_DoorLocked(void);
+void AUTH_GetStats(AUTH_Source_t source, AUTH_Stats_t *stats);
+void AUTH_ResetStats(void);
+uint32_t AUTH_Percentile(const AUTH_Stats_t *stats, uint8_t percent);
+void AUTH_GetLimit(AUTH_Source_t source, AUTH_Limit_t *limit);
+void AUTH_ClearLimits(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUTH_H */
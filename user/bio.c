@@ -0,0 +1,335 @@
+/**
+  ******************************************************************************
+  * @file    bio.c
+  * @author  cyytx
+  * @brief   生物识别协调模块的源文件
+  *          1.唤醒事件(手指按下、红外/取消键)调用BIO_Wake,同时启动所有可用的识别方式,
+  *            识别进行中的唤醒不重复启动;
+  *          2.人脸、指纹的识别结果交给BIO_Result:第一个匹配的方式胜出,提交开锁请求,
+  *            其他还在识别的方式取消(发取消命令,模块回到空闲),取消后的应答丢弃;
+  *            胜出的用户需要双重验证(CRED_USER_MFA)时不取消,让第二种方式继续;
+  *          3.一种方式没匹配时先不提交,所有方式都没匹配才提交一次失败,
+  *            同时出示两种生物特征失败只计一次失败;
+  *          4.开锁请求的出示时间是唤醒时间,授权模块的延时统计从唤醒开始;
+  *            本模块按方式统计胜出次数和唤醒到匹配的耗时,shell的bio命令查看。
+  *          状态在临界区中修改,调用者是键盘、指纹、人脸任务和定时器任务。
+  ******************************************************************************
+  */
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+#include "bio.h"
+#include "auth.h"
+#include "cred.h"
+#include "face.h"
+#include "fingerprint.h"
+#include "log.h"
+
+#define LOG_MODULE BIO    /* 日志模块名,等级见log_config.h */
+
+#if BIO_ENABLE && (FACE_ENABLE || FINGERPRINT_ENABLE)
+
+#define BIO_BIT(m)      (1U << (m))
+#define BIO_NONE        (-1)
+
+static const uint8_t bio_source[BIO_NUM] = {AUTH_SRC_FACE, AUTH_SRC_FP};
+
+static TimerHandle_t bio_timer = NULL;
+static uint8_t bio_present = 0;         /* 可用的方式 */
+static uint8_t bio_active = 0;          /* 1: 识别进行中 */
+static uint8_t bio_pending = 0;         /* 已启动、还没有结果的方式 */
+static uint8_t bio_cancelled = 0;       /* 已取消、应答要丢弃的方式 */
+static int8_t bio_winner = BIO_NONE;    /* 本次胜出的方式 */
+static int8_t bio_failed = BIO_NONE;    /* 本次最后一个没匹配的方式 */
+static uint32_t bio_wake_us = 0;        /* 本次唤醒时间 */
+static BIO_Stats_t bio_stats;
+
+/* 启动一种方式的识别,命令由各模块的任务发送 */
+static void BIO_Start(uint8_t mask)
+{
+#if FACE_ENABLE
+    if (mask & BIO_BIT(BIO_FACE))
+    {
+        FACE_Identify_Cmd();
+    }
+#endif
+#if FINGERPRINT_ENABLE
+    if (mask & BIO_BIT(BIO_FP))
+    {
+        FP_Identify_Cmd();
+    }
+#endif
+}
+
+/* 取消识别,模块回到空闲 */
+static void BIO_Cancel(uint8_t mask)
+{
+#if FACE_ENABLE
+    if (mask & BIO_BIT(BIO_FACE))
+    {
+        FACE_Cancel_Cmd();
+    }
+#endif
+#if FINGERPRINT_ENABLE
+    if (mask & BIO_BIT(BIO_FP))
+    {
+        FP_Cancel_Cmd();
+    }
+#endif
+}
+
+/* 超时:取消还没有结果的方式,有方式没匹配过就提交一次失败 */
+static void BIO_TimerCallback(TimerHandle_t xTimer)
+{
+    uint8_t cancel;
+    int8_t failed;
+    uint32_t wake_us;
+
+    taskENTER_CRITICAL();
+    if (!bio_active)
+    {
+        taskEXIT_CRITICAL();
+        return;
+    }
+    cancel = bio_pending;
+    failed = bio_winner == BIO_NONE ? bio_failed : BIO_NONE;
+    wake_us = bio_wake_us;
+    bio_cancelled |= cancel;
+    bio_pending = 0;
+    bio_active = 0;
+    bio_stats.timeouts++;
+    if (failed != BIO_NONE)
+    {
+        bio_stats.fails++;
+    }
+    taskEXIT_CRITICAL();
+
+    BIO_Cancel(cancel);
+    LOG_WARN("bio: timeout, cancel 0x%x\r\n", cancel);
+    if (failed != BIO_NONE)
+    {
+        AUTH_Request((AUTH_Source_t)bio_source[failed], CRED_NONE, wake_us);
+    }
+}
+
+/**
+ * @brief 初始化,在指纹、人脸任务之前调用
+ */
+void BIO_Init(void)
+{
+#if FACE_ENABLE
+    bio_present |= BIO_BIT(BIO_FACE);
+#endif
+#if FINGERPRINT_ENABLE
+    bio_present |= BIO_BIT(BIO_FP);
+#endif
+    BIO_ResetStats();
+    bio_timer = xTimerCreate("BioTimer", pdMS_TO_TICKS(BIO_RACE_TIMEOUT_MS), pdFALSE, NULL, BIO_TimerCallback);
+}
+
+/**
+ * @brief 模块是否可用,波特率协商失败(模块没有应答)的方式不再启动
+ */
+void BIO_SetPresent(BIO_Modality_t m, uint8_t present)
+{
+    taskENTER_CRITICAL();
+    if (present)
+    {
+        bio_present |= BIO_BIT(m);
+    }
+    else
+    {
+        bio_present &= ~BIO_BIT(m);
+    }
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief 唤醒事件,同时启动所有可用的识别方式,在任务中调用
+ * @param wake_us 唤醒时间(LOG_GetTimeUs),作为出示生物特征的时间
+ */
+void BIO_Wake(uint32_t wake_us)
+{
+    uint8_t start, allow = 0;
+    uint8_t m;
+
+    // 被限流锁定的方式不启动,不给模块发识别命令
+    for (m = 0; m < BIO_NUM; m++)
+    {
+        if (AUTH_Allow((AUTH_Source_t)bio_source[m]))
+        {
+            allow |= BIO_BIT(m);
+        }
+    }
+    taskENTER_CRITICAL();
+    if (bio_active || (bio_present & allow) == 0)
+    {
+        taskEXIT_CRITICAL();
+        return;
+    }
+    start = bio_present & allow;
+    bio_active = 1;
+    bio_pending = start;
+    bio_cancelled &= ~start;
+    bio_winner = BIO_NONE;
+    bio_failed = BIO_NONE;
+    bio_wake_us = wake_us;
+    bio_stats.races++;
+    taskEXIT_CRITICAL();
+
+    xTimerReset(bio_timer, 0);
+    BIO_Start(start);
+    LOG_INFO("bio: wake, start 0x%x\r\n", start);
+}
+
+/**
+ * @brief 一种方式的识别结果,由人脸、指纹任务调用
+ * @param user 匹配的用户,CRED_NONE表示没匹配
+ * @param capture_us 模块自己记录的出示时间,不在识别中(没有经过BIO_Wake)时使用
+ */
+void BIO_Result(BIO_Modality_t m, int user, uint32_t capture_us)
+{
+    CRED_User_t info;
+    uint8_t bit = BIO_BIT(m);
+    uint8_t cancel = 0, forward = 0, mfa = 0, done;
+    uint32_t us, wake_us;
+
+    if (user != CRED_NONE && CRED_GetUser((uint16_t)user, &info) == 0)
+    {
+        mfa = (info.flags & CRED_USER_MFA) != 0;
+    }
+
+    taskENTER_CRITICAL();
+    if (bio_cancelled & bit)
+    {
+        // 取消后模块返回的中止/失败应答
+        bio_cancelled &= ~bit;
+        taskEXIT_CRITICAL();
+        LOG_DEBUG("bio: drop result of cancelled %d\r\n", m);
+        return;
+    }
+    if (!(bio_pending & bit))
+    {
+        // 不是这次识别启动的(如注册后的识别),直接提交
+        taskEXIT_CRITICAL();
+        AUTH_Request((AUTH_Source_t)bio_source[m], user, capture_us);
+        return;
+    }
+    bio_pending &= ~bit;
+    wake_us = bio_wake_us;
+    us = LOG_GetTimeUs() - wake_us;
+    if (user != CRED_NONE)
+    {
+        forward = 1;
+        if (bio_winner == BIO_NONE)
+        {
+            bio_winner = (int8_t)m;
+            bio_stats.wins[m]++;
+            bio_stats.total_us[m] += us;
+            if (us < bio_stats.min_us[m])
+            {
+                bio_stats.min_us[m] = us;
+            }
+            if (us > bio_stats.max_us[m])
+            {
+                bio_stats.max_us[m] = us;
+            }
+            bio_stats.last_winner = (int8_t)m;
+            bio_stats.last_us = us;
+            if (!mfa)
+            {
+                cancel = bio_pending;
+                bio_cancelled |= cancel;
+                bio_pending = 0;
+            }
+        }
+    }
+    else
+    {
+        bio_failed = (int8_t)m;
+        if (bio_pending == 0 && bio_winner == BIO_NONE)
+        {
+            forward = 1;
+            bio_stats.fails++;
+        }
+    }
+    done = bio_pending == 0;
+    if (done)
+    {
+        bio_active = 0;
+    }
+    taskEXIT_CRITICAL();
+
+    if (done)
+    {
+        xTimerStop(bio_timer, 0);
+    }
+    BIO_Cancel(cancel);
+    if (user != CRED_NONE)
+    {
+        LOG_INFO("bio: %d matched user %d in %dus, cancel 0x%x\r\n", m, user, us, cancel);
+    }
+    else
+    {
+        LOG_INFO("bio: %d no match in %dus\r\n", m, us);
+    }
+    if (forward)
+    {
+        AUTH_Request((AUTH_Source_t)bio_source[m], user, wake_us);
+    }
+}
+
+void BIO_GetStats(BIO_Stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = bio_stats;
+    taskEXIT_CRITICAL();
+}
+
+void BIO_ResetStats(void)
+{
+    uint8_t m;
+
+    taskENTER_CRITICAL();
+    memset(&bio_stats, 0, sizeof(bio_stats));
+    for (m = 0; m < BIO_NUM; m++)
+    {
+        bio_stats.min_us[m] = 0xFFFFFFFFU;
+    }
+    bio_stats.last_winner = BIO_NONE;
+    taskEXIT_CRITICAL();
+}
+
+#else /* !(BIO_ENABLE && (FACE_ENABLE || FINGERPRINT_ENABLE)) */
+
+static const uint8_t bio_source[BIO_NUM] = {AUTH_SRC_FACE, AUTH_SRC_FP};
+
+void BIO_Init(void)
+{
+}
+
+void BIO_SetPresent(BIO_Modality_t m, uint8_t present)
+{
+}
+
+void BIO_Wake(uint32_t wake_us)
+{
+}
+
+void BIO_Result(BIO_Modality_t m, int user, uint32_t capture_us)
+{
+    AUTH_Request((AUTH_Source_t)bio_source[m], user, capture_us);
+}
+
+void BIO_GetStats(BIO_Stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->last_winner = -1;
+}
+
+void BIO_ResetStats(void)
+{
+}
+
+#endif /* BIO_ENABLE && (FACE_ENABLE || FINGERPRINT_ENABLE) */
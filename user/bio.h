@@ -0,0 +1,53 @@
+/**
+  ******************************************************************************
+  * @file    bio.h
+  * @author  cyytx
+  * @brief   生物识别协调模块的头文件
+  *          唤醒(手指按下、红外/取消键)时同时启动人脸和指纹识别,第一个匹配的方式胜出,
+  *          取消其他方式,统计每种方式胜出的次数和唤醒到匹配的耗时
+  ******************************************************************************
+  */
+
+#ifndef __BIO_H
+#define __BIO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "hard_enable_ctrl.h"
+
+#define BIO_RACE_TIMEOUT_MS     12000   /* 一次识别最长时间(ms),大于人脸、指纹模块自身的超时 */
+
+/* 识别方式 */
+typedef enum {
+    BIO_FACE = 0,
+    BIO_FP,
+    BIO_NUM
+} BIO_Modality_t;
+
+typedef struct {
+    uint32_t races;                 /* 唤醒启动的识别次数 */
+    uint32_t fails;                 /* 所有方式都没匹配的次数 */
+    uint32_t timeouts;              /* 超时结束的次数 */
+    uint32_t wins[BIO_NUM];         /* 各方式胜出次数 */
+    uint32_t min_us[BIO_NUM];       /* 唤醒到匹配的最短耗时(us) */
+    uint32_t max_us[BIO_NUM];
+    uint64_t total_us[BIO_NUM];     /* 除以wins为平均值 */
+    int8_t last_winner;             /* 最近一次胜出的方式,-1表示没有 */
+    uint32_t last_us;               /* 最近一次胜出的耗时(us) */
+} BIO_Stats_t;
+
+void BIO_Init(void);
+void BIO_Wake(uint32_t wake_us);
+void BIO_Result(BIO_Modality_t m, int user, uint32_t capture_us);
+void BIO_SetPresent(BIO_Modality_t m, uint8_t present);
+void BIO_GetStats(BIO_Stats_t *stats);
+void BIO_ResetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BIO_H */
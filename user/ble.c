@@ -3,6 +3,7 @@
   * @file    ble.c
   * @author  cyytx
   * @brief   蓝牙模块的源文件,实现蓝牙的初始化、数据收发等功能 (FreeRTOS适配版)
+  *          透传数据支持数字密码和手机钥匙(P-256签名的挑战应答,协议见ble.h)
   ******************************************************************************
   */
 #include <string.h>
@@ -14,7 +15,15 @@
 #include "ble.h"
 #include "priorities.h"
 #include "key.h"   
-#include "sg90.h"
+#include "cred.h"
+#include "auth.h"
+#include "rtc.h"
+#include "rng.h"
+#include "sha256.h"
+#include "p256.h"
+#include "log.h"
+
+#define LOG_MODULE BLE    /* 日志模块名,等级见log_config.h */
 
 
 /* FreeRTOS头文件 */
@@ -42,9 +51,18 @@ static uint8_t BLE_Link_Status = 0;
 /* 接收数据结构定义 */
 typedef struct {
     uint8_t data;
-    uint32_t timestamp;
+    uint32_t timestamp;     /* 收到的时间(us),LOG_GetTimeUs */
 } BLE_RxData_t;
 
+static uint32_t BLE_FrameUs = 0;    /* 当前透传数据第一个字节的时间,作为出示密码的时间 */
+
+/* 手机钥匙:当前的挑战随机数,只在蓝牙任务中访问;登记状态由shell设置 */
+static uint8_t BLE_Nonce[BLE_KEY_NONCE_SIZE];
+static uint8_t BLE_NonceValid = 0;
+static TickType_t BLE_NonceTick = 0;
+static volatile int BLE_EnrollUser = CRED_NONE;
+static volatile TickType_t BLE_EnrollTick = 0;
+
 /* 接收缓冲区 - 仅在AT命令模式使用 */
 static uint8_t BLE_RxBuffer[BLE_RX_BUFFER_SIZE];
 static uint16_t BLE_RxSize = 0;
@@ -147,7 +165,10 @@ HAL_StatusTypeDef BLE_Send_AT_Command(char* command, char* response_buffer, uint
         response_buffer[copy_size] = '\0';
         taskEXIT_CRITICAL();
     }
-    printf("AT RETURN %s",response_buffer);
+    if (response_buffer != NULL)
+    {
+        LOG_STR("BLE AT RETURN", response_buffer);
+    }
     
     /* 释放发送互斥量 */
     xSemaphoreGive(BLE_TxMutex);
@@ -723,29 +744,13 @@ HAL_StatusTypeDef BLE_Get_AMData(char* data_buffer, uint16_t buffer_size)
     return status;
 }
 
-/* BLE密码验证函数，用于验证蓝牙接收到的密码是否正确 */
-static uint8_t BLE_ValidatePassword(uint8_t* password, uint8_t length)
+static void BLE_Reply(const char *str)
 {
-    extern LockPassword_t lock_passWard; // 引用key.c中定义的lock_passWard变量
-    
-    if (length != lock_passWard.password_len)
-    {
-        return 0; // 密码长度不匹配
-    }
-    
-    for (uint8_t i = 0; i < length; i++)
-    {
-        if (password[i] != lock_passWard.password[i])
-        {
-            return 0; // 密码内容不匹配
-        }
-    }
-    
-    return 1; // 密码匹配
+    BLE_Send((uint8_t *)str, (uint16_t)strlen(str));
 }
 
-/* BLE透传模式下的密码处理函数 */
-static void BLE_ProcessPassword(uint8_t* data, uint16_t length)
+/* BLE透传模式下的密码处理函数,返回0表示密码正确已开锁,-1表示不是密码或密码错误 */
+static int BLE_ProcessPassword(uint8_t* data, uint16_t length)
 {
     // 确保数据长度合理
     if (length > 0 && length <= 16) // 最大密码长度为16
@@ -767,20 +772,222 @@ static void BLE_ProcessPassword(uint8_t* data, uint16_t length)
             }
         }
         
-        // 验证密码
+        // 验证密码,和键盘共用凭据库中的密码,密码不对时再按一次性密码验证
         if (password_len > 0)
         {
-            if (BLE_ValidatePassword(password, password_len))
+            if (!AUTH_Allow(AUTH_SRC_BLE))
+            {
+                BLE_Reply("LOCKED\r\n"); // 锁定期间不做哈希
+                return -1;
+            }
+            int user = CRED_MatchPin(password, password_len);
+            if (user == CRED_NONE)
+            {
+                user = CRED_MatchTotp(password, password_len, RTC_GetTime());
+            }
+            if (user != CRED_NONE)
             {
-                printf("BLE: Password correct! Unlocking door.\r\n");
-                SendLockCommand(1); // 发送开锁命令
+                LOG_INFO("BLE: Password correct! User %d, unlocking door.\r\n", user);
+                AUTH_Request(AUTH_SRC_BLE, user, BLE_FrameUs); // 提交开锁请求
+                return 0;
             }
             else
             {
-                printf("BLE: Password incorrect!\r\n");
+                LOG_ERR("BLE: Password incorrect!\r\n");
+                AUTH_Request(AUTH_SRC_BLE, CRED_NONE, BLE_FrameUs);
             }
         }
     }
+    return -1;
+}
+
+/* 十六进制字符串转字节,必须正好是2*len个字符 */
+static int BLE_HexDecode(const char *hex, uint16_t hex_len, uint8_t *out, uint16_t len)
+{
+    uint16_t i;
+    uint8_t v = 0;
+    char c;
+
+    if (hex_len != 2 * len)
+    {
+        return -1;
+    }
+    for (i = 0; i < hex_len; i++)
+    {
+        c = hex[i];
+        if (c >= '0' && c <= '9')
+        {
+            v = (uint8_t)((v << 4) | (c - '0'));
+        }
+        else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+        {
+            v = (uint8_t)((v << 4) | ((c | 0x20) - 'a' + 10));
+        }
+        else
+        {
+            return -1;
+        }
+        if (i & 1)
+        {
+            out[i / 2] = v;
+        }
+    }
+    return 0;
+}
+
+/* 回复一行:前缀加十六进制数据 */
+static void BLE_ReplyHex(const char *prefix, const uint8_t *data, uint16_t len)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    char line[16 + 2 * BLE_KEY_NONCE_SIZE + 3];
+    uint16_t n = (uint16_t)strlen(prefix);
+    uint16_t i;
+
+    memcpy(line, prefix, n);
+    for (i = 0; i < len; i++)
+    {
+        line[n++] = digits[data[i] >> 4];
+        line[n++] = digits[data[i] & 0x0F];
+    }
+    line[n++] = '\r';
+    line[n++] = '\n';
+    BLE_Send((uint8_t *)line, n);
+}
+
+/* CHAL:生成新的挑战随机数,之前的随机数作废 */
+static int BLE_KeyChallenge(void)
+{
+    BLE_NonceValid = 0;
+    if (!AUTH_Allow(AUTH_SRC_PHONE))
+    {
+        BLE_Reply("LOCKED\r\n");
+        return -1;
+    }
+    if (RNG_Read(BLE_Nonce, sizeof(BLE_Nonce)) != 0)
+    {
+        LOG_ERR("BLE: rng failed\r\n");
+        BLE_Reply("FAIL\r\n");
+        return -1;
+    }
+    BLE_NonceTick = xTaskGetTickCount();
+    BLE_NonceValid = 1;
+    BLE_ReplyHex("NONCE ", BLE_Nonce, sizeof(BLE_Nonce));
+    return -1;
+}
+
+/* SIG <钥匙ID> <r|s>:验证对当前随机数的签名,随机数不论成败都作废 */
+static int BLE_KeySign(const char *arg, uint16_t len)
+{
+    uint8_t key_id[CRED_PHONE_ID_SIZE];
+    uint8_t sig[P256_SIG_SIZE];
+    uint8_t hash[SHA256_DIGEST_SIZE];
+    SHA256_Ctx_t ctx;
+    int user;
+
+    if (len != 2 * CRED_PHONE_ID_SIZE + 1 + 2 * P256_SIG_SIZE || arg[2 * CRED_PHONE_ID_SIZE] != ' ' ||
+        BLE_HexDecode(arg, 2 * CRED_PHONE_ID_SIZE, key_id, sizeof(key_id)) != 0 ||
+        BLE_HexDecode(arg + 2 * CRED_PHONE_ID_SIZE + 1, 2 * P256_SIG_SIZE, sig, sizeof(sig)) != 0)
+    {
+        LOG_WARN("BLE: bad SIG command\r\n");
+        BLE_Reply("FAIL\r\n");
+        return -1;
+    }
+    if (!BLE_NonceValid || (xTaskGetTickCount() - BLE_NonceTick) > pdMS_TO_TICKS(BLE_KEY_NONCE_MS))
+    {
+        BLE_NonceValid = 0;
+        LOG_WARN("BLE: SIG without valid nonce\r\n");
+        BLE_Reply("FAIL\r\n");
+        return -1;
+    }
+    BLE_NonceValid = 0;
+    if (!AUTH_Allow(AUTH_SRC_PHONE))
+    {
+        BLE_Reply("LOCKED\r\n"); // 锁定期间不做签名验证
+        return -1;
+    }
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, BLE_KEY_DOMAIN, sizeof(BLE_KEY_DOMAIN) - 1);
+    SHA256_Update(&ctx, BLE_Nonce, sizeof(BLE_Nonce));
+    SHA256_Final(&ctx, hash);
+    user = CRED_MatchPhone(key_id, hash, sig);
+    AUTH_Request(AUTH_SRC_PHONE, user, BLE_FrameUs);
+    if (user == CRED_NONE)
+    {
+        LOG_ERR("BLE: phone key rejected\r\n");
+        BLE_Reply("FAIL\r\n");
+        return -1;
+    }
+    LOG_INFO("BLE: phone key ok! User %d, unlocking door.\r\n", user);
+    BLE_Reply("OK\r\n");
+    return 0;
+}
+
+/* ENROLL <X|Y>:登记手机公钥,只在shell开启登记后的BLE_KEY_ENROLL_MS内接受 */
+static int BLE_KeyEnroll(const char *arg, uint16_t len)
+{
+    uint8_t pub[P256_PUB_SIZE];
+    uint8_t key_id[CRED_PHONE_ID_SIZE];
+    int user = BLE_EnrollUser;
+
+    if (user == CRED_NONE || (xTaskGetTickCount() - BLE_EnrollTick) > pdMS_TO_TICKS(BLE_KEY_ENROLL_MS))
+    {
+        LOG_WARN("BLE: phone enroll not armed\r\n");
+        BLE_Reply("FAIL\r\n");
+        return -1;
+    }
+    if (BLE_HexDecode(arg, len, pub, sizeof(pub)) != 0 || CRED_AddPhone((uint16_t)user, pub) != 0)
+    {
+        LOG_ERR("BLE: phone enroll failed\r\n");
+        BLE_Reply("FAIL\r\n");
+        return -1;
+    }
+    BLE_EnrollUser = CRED_NONE;
+    CRED_PhoneId(pub, key_id);
+    LOG_INFO("BLE: phone key enrolled for user %d\r\n", user);
+    BLE_ReplyHex("ENROLLED ", key_id, sizeof(key_id));
+    return -1;
+}
+
+/**
+  * @brief  登记下一个通过蓝牙发来ENROLL命令的手机钥匙(调试shell调用)
+  * @param  user: 钥匙所属用户
+  */
+void BLE_EnrollPhone(uint16_t user)
+{
+    BLE_EnrollTick = xTaskGetTickCount();
+    BLE_EnrollUser = user;
+}
+
+/**
+  * @brief  处理透传模式下收到的一段数据,蓝牙任务和主机回放工具(tools/host)共用
+  * @param  data: 接收数据,必须以'\0'结尾
+  * @param  length: 数据长度(不含结尾的'\0')
+  * @retval 0: 密码或手机钥匙正确已开锁; -1: 其他命令、密码错误或签名不对
+  */
+int BLE_ProcessData(uint8_t* data, uint16_t length)
+{
+    LOG_STR("BLE_DataReceived", data);
+
+    // 命令去掉行尾的回车换行
+    while (length > 0 && (data[length - 1] == '\r' || data[length - 1] == '\n' || data[length - 1] == ' '))
+    {
+        data[--length] = '\0';
+    }
+    if (length == 4 && memcmp(data, "CHAL", 4) == 0)
+    {
+        return BLE_KeyChallenge();
+    }
+    if (length > 4 && memcmp(data, "SIG ", 4) == 0)
+    {
+        return BLE_KeySign((const char *)data + 4, length - 4);
+    }
+    if (length > 7 && memcmp(data, "ENROLL ", 7) == 0)
+    {
+        return BLE_KeyEnroll((const char *)data + 7, length - 7);
+    }
+
+    // 处理接收到的密码
+    return BLE_ProcessPassword(data, length);
 }
 
 /**
@@ -823,13 +1030,13 @@ static void BLE_Task(void *pvParameters)
             if (BLE_Link_Status)
             {
                 xEventGroupSetBits(BLE_EventGroup, BLE_EVENT_CONNECTED);
-                printf("BLE Connected\r\n");
+                LOG_INFO("BLE Connected\r\n");
                 /* 这里可以执行连接后的初始化操作 */
             }
             else
             {
                 xEventGroupClearBits(BLE_EventGroup, BLE_EVENT_CONNECTED);
-                printf("BLE Disconnected\r\n");
+                LOG_INFO("BLE Disconnected\r\n");
                 /* 这里可以执行断开连接后的清理操作 */
             }
             
@@ -868,13 +1075,23 @@ static void BLE_Task(void *pvParameters)
             {
                 if (dataIndex < BLE_RX_BUFFER_SIZE)
                 {
+                    if (dataIndex == 0)
+                    {
+                        BLE_FrameUs = rxData.timestamp;
+                    }
                     dataBuffer[dataIndex++] = rxData.data;
                     hasData = 1;
                     lastActivityTime = xTaskGetTickCount();
                 }
             }
-            /* 判断是否需要处理接收到的数据 */
-            if (((dataIndex > 0) && ((xTaskGetTickCount() - lastActivityTime) > pdMS_TO_TICKS(10))) ||
+            /* 判断是否需要处理接收到的数据:密码空闲10ms算一帧;
+               手机钥匙命令(大写字母开头)可能被拆成多个BLE包,收到'\n'或包间隔超过BLE_LINE_GAP_MS才算一帧 */
+            TickType_t frameGap = pdMS_TO_TICKS(10);
+            if (dataIndex > 0 && dataBuffer[0] >= 'A' && dataBuffer[0] <= 'Z' && dataBuffer[dataIndex - 1] != '\n')
+            {
+                frameGap = pdMS_TO_TICKS(BLE_LINE_GAP_MS);
+            }
+            if (((dataIndex > 0) && ((xTaskGetTickCount() - lastActivityTime) > frameGap)) ||
                 dataIndex >= BLE_RX_BUFFER_SIZE)
             {  
                 /* 确保数据以null结尾，形成有效的C字符串 */
@@ -884,12 +1101,11 @@ static void BLE_Task(void *pvParameters)
                     dataBuffer[BLE_RX_BUFFER_SIZE - 1] = '\0';
                 }
                 
-                
-                printf("BLE_DataReceived: %s\r\n", (char*)dataBuffer);
-                
-                // 处理接收到的密码
-                BLE_ProcessPassword(dataBuffer, dataIndex);
-                
+
+                /* 抓包(调试shell的capture命令打开),用于主机回放 */
+                LOG_Capture(LOG_CAP_BLE, 0, dataBuffer, dataIndex);
+                BLE_ProcessData(dataBuffer, dataIndex);
+
                 dataIndex = 0;
             }
         }
@@ -1005,7 +1221,7 @@ void BLE_RxCpltCallback(void)
     
     /* 将接收到的字节放入队列 */
     rxData.data = BLE_RxTempBuffer[0];
-    rxData.timestamp = xTaskGetTickCountFromISR();
+    rxData.timestamp = LOG_GetTimeUs();
     
     /* 将接收到的字节发送到队列中 */
     xQueueSendFromISR(BLE_RxQueue, &rxData, &xHigherPriorityTaskWoken);
@@ -1038,14 +1254,14 @@ void BLE_KEY_TEST(void)
     BLE_WakeUp();
     vTaskDelay(10);
     BLE_Get_MAC(buffer, sizeof(buffer));
-    printf("BLE_Get_MAC: %s\r\n", buffer);
+    LOG_STR("BLE_Get_MAC", buffer);
     BLE_Set_Name("BLE_TEST");// #BUG 会出问题
     BLE_Get_Name(buffer, sizeof(buffer));// #BUG 会出问题
-    printf("BLE_Get_Name: %s\r\n", buffer);
+    LOG_STR("BLE_Get_Name", buffer);
     BLE_Set_ADV(1);
     vTaskDelay(10);
     BLE_Get_ADV(buffer, sizeof(buffer));
-    printf("BLE_Get_ADV: %s\r\n", buffer);
+    LOG_STR("BLE_Get_ADV", buffer);
 }
 
 #endif /* BLE_ENABLE */ 
\ No newline at end of file
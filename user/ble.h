@@ -26,6 +26,19 @@ extern "C" {
 /* 接收缓冲区大小 */
 #define BLE_RX_BUFFER_SIZE 256
 
+/* 手机钥匙(透传模式,ASCII命令,以'\n'结尾):
+ * 1.手机发"CHAL",门锁回"NONCE <随机数,32个十六进制字符>",随机数只能用一次;
+ * 2.手机用登记的P-256私钥对SHA-256(BLE_KEY_DOMAIN|随机数)做ECDSA签名,
+ *   发"SIG <钥匙ID,16个十六进制字符> <签名r|s,128个十六进制字符>",门锁回"OK"或"FAIL";
+ * 3.登记:调试shell执行"cred phone 用户"后BLE_KEY_ENROLL_MS内,
+ *   手机发"ENROLL <公钥X|Y,128个十六进制字符>",门锁回"ENROLLED <钥匙ID>"或"FAIL"。
+ * 不是命令的数据仍按数字密码处理(见BLE_ProcessPassword) */
+#define BLE_KEY_DOMAIN        "SLKEY1"  /* 签名消息的前缀,区分其他用途的签名 */
+#define BLE_KEY_NONCE_SIZE    16
+#define BLE_KEY_NONCE_MS      10000     /* 随机数有效期 */
+#define BLE_KEY_ENROLL_MS     60000     /* 登记等待时间 */
+#define BLE_LINE_GAP_MS       500       /* 命令被拆成多个BLE包时,包之间最长的间隔 */
+
 /* AT指令集定义 - \r\n 为 ASCII 码 0x0d 及 0x0a */
 /* 上电或重启成功的串口提示：(+READY\r\n)，HOST MCU 必须在收到此消息后，才能执行指令和数据的操作 */
 
@@ -83,6 +96,8 @@ HAL_StatusTypeDef BLE_Reboot(void);
 HAL_StatusTypeDef BLE_Set_TxPower(uint8_t power);
 HAL_StatusTypeDef BLE_Get_TxPower(char* power_buffer, uint16_t buffer_size);
 void BLE_RxCpltCallback(void);
+int BLE_ProcessData(uint8_t* data, uint16_t length);
+void BLE_EnrollPhone(uint16_t user);
 void BLE_Process(void);
 void BLE_CreateTask(void);
 void BLE_KEY_TEST(void);
@@ -0,0 +1,1220 @@
+/**
+  ******************************************************************************
+  * @file    cred.c
+  * @author  cyytx
+  * @brief   凭据库的源文件
+  *          1.凭据紧凑地存放在cred_entries数组中,删除时用最后一个凭据填补空位;
+  *          2.所有类型共用一个开放寻址(线性探测)哈希索引,键为(类型,键值),
+  *            槽中存凭据下标,删除时后移回填,不留墓碑,查找长度不会随增删变长;
+  *          3.每个用户、每条凭据是Flash记录存储(fstore)中的一条记录,
+  *            凭据的记录号分配后不变,修改一条凭据只追加一条几十字节的记录;
+  *            CRED_Init之前(主机测试)只修改内存;
+  *          4.旧版本在扇区7开头保存的键盘密码,第一次启动时迁移为管理员的密码;
+  *          5.NFC卡的扇区密钥 = SHA-256(站点密钥|扇区号|UID)的前6字节,每张卡不同,
+  *            破解一张卡的密钥不影响其他卡,站点密钥第一次启动时用RNG生成并保存;
+  *          6.密码只存PBKDF2-HMAC-SHA256(密码,盐,迭代次数)的24字节派生值:前8字节是索引键,
+  *            后16字节存在令牌中,查到后按常数时间比对;盐和迭代次数第一次启动时生成,
+  *            迭代次数按CRED_PIN_BUDGET_MS标定。输入密码时不知道是哪个用户,只能用全站一个盐,
+  *            验证一次只派生一次,与用户数无关;旧版本的FNV摘要在验证通过时换成新的派生值;
+  *          7.一次性密码(TOTP,RFC 6238,HMAC-SHA1、6位、30秒):每个用户一个128位密钥,
+  *            输入时不知道是哪个用户,逐个密钥计算当前和前后各一个时间步的码,
+  *            只有一个用户匹配时才通过;通过的时间步记在内存中,同一个码不能再用;
+  *          8.手机钥匙:凭据的键是公钥摘要前8字节(钥匙ID),64字节的公钥放不进凭据记录,
+  *            单独存为一条记录(FSTORE_KEY_CRED_PHONE+槽号)并常驻内存,槽号存在令牌中;
+  *            添加时先写公钥再写凭据,删除时先删凭据再删公钥,没有凭据引用的公钥在CRED_Init中删除。
+  ******************************************************************************
+  */
+#include <string.h>
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "stm32f7xx_hal.h"
+#include "cred.h"
+#include "fstore.h"
+#include "sha256.h"
+#include "sha1.h"
+#include "p256.h"
+#include "rng.h"
+#include "log.h"
+
+#define LOG_MODULE CRED    /* 日志模块名,等级见log_config.h */
+
+#if (CRED_INDEX_SIZE & (CRED_INDEX_SIZE - 1)) != 0 || CRED_INDEX_SIZE < 2 * CRED_MAX_ENTRIES
+#error "CRED_INDEX_SIZE must be a power of 2 and at least 2 * CRED_MAX_ENTRIES"
+#endif
+
+#if CRED_MAX_USERS > (FSTORE_KEY_CRED_ENTRY - FSTORE_KEY_CRED_USER) || CRED_MAX_ENTRIES > (FSTORE_KEY_INVALID - FSTORE_KEY_CRED_ENTRY)
+#error "CRED_MAX_USERS/CRED_MAX_ENTRIES overflow the fstore key range"
+#endif
+
+#if CRED_PHONE_MAX > 32 || CRED_PHONE_MAX > (FSTORE_KEY_CRED_USER - FSTORE_KEY_CRED_PHONE)
+#error "CRED_PHONE_MAX must fit in a 32-bit slot mask and the fstore key range"
+#endif
+
+#define CRED_INDEX_MASK         (CRED_INDEX_SIZE - 1)
+#define CRED_SLOT_EMPTY         0xFFFF
+
+#define CRED_INIT_VERSION       1       /* 初始化记录的内容,写入后不再恢复出厂设置 */
+
+/* 旧版本key.c保存在扇区7开头的密码,扇区7现在是fstore的扇区1 */
+typedef struct {
+    uint8_t password_len;
+    uint8_t password[CRED_PIN_MAX];
+} CRED_LegacyPassword_t;
+
+/* 出厂默认密码和NFC令牌,和旧版本key.c、nfc.c中的一致 */
+static const uint8_t CRED_DEFAULT_PIN[] = {1, 2, 3, 4, 5, 6, 7, 8};
+/* 全0令牌:只登记了UID的NFC卡、旧版本的密码摘要 */
+static const uint8_t CRED_ZERO_TOKEN[CRED_TOKEN_SIZE] = {0};
+static const uint8_t CRED_DEFAULT_NFC_TOKEN[CRED_TOKEN_SIZE] = {0x12, 0x34, 0x56, 0x78, 0x90, 0xAB, 0xCD, 0xEF,
+                                                               0x12, 0x34, 0x56, 0x78, 0x90, 0xAB, 0xCD, 0xEF};
+
+static CRED_User_t cred_users[CRED_MAX_USERS];
+static CRED_Entry_t cred_entries[CRED_MAX_ENTRIES];
+static uint16_t cred_count = 0;
+static uint16_t cred_type_count[CRED_TYPE_NUM];
+static uint16_t cred_index[CRED_INDEX_SIZE];     /* 哈希索引,存cred_entries下标 */
+static uint32_t cred_rec_used[(CRED_MAX_ENTRIES + 31) / 32];  /* 已分配的凭据记录号 */
+static uint8_t cred_persist = 0;                /* 1: 修改写入Flash,CRED_Init加载完成后置1 */
+static uint8_t cred_site_key[CRED_SITE_KEY_SIZE];   /* 站点密钥,CRED_Init中加载 */
+
+/* 密码派生参数,改变后已有的密码都验证不了,只在第一次启动时生成 */
+typedef struct {
+    uint8_t salt[CRED_PIN_SALT_SIZE];
+    uint32_t iterations;
+} CRED_PinKdf_t;
+
+static CRED_PinKdf_t cred_pin_kdf = {{0}, CRED_PIN_ITER_MIN};   /* CRED_Init中加载 */
+static uint16_t cred_pin_legacy = 0;            /* 旧版本密码摘要数,删除时不减,只是上限 */
+static uint32_t cred_pin_last_us = 0;           /* 最近一次密码派生耗时 */
+static uint32_t cred_totp_used[CRED_MAX_USERS]; /* 每个用户最近一次通过的TOTP时间步,重启后清零 */
+static uint32_t cred_totp_last_us = 0;          /* 最近一次验证一次性密码的耗时 */
+static uint8_t cred_phone_pub[CRED_PHONE_MAX][P256_PUB_SIZE];  /* 手机钥匙公钥,下标是槽号 */
+static uint32_t cred_phone_last_us = 0;         /* 最近一次验证手机钥匙签名的耗时 */
+static SemaphoreHandle_t CRED_Mutex = NULL;
+
+static void CRED_Lock(void)
+{
+    if (CRED_Mutex != NULL)
+    {
+        xSemaphoreTake(CRED_Mutex, portMAX_DELAY);
+    }
+}
+
+static void CRED_Unlock(void)
+{
+    if (CRED_Mutex != NULL)
+    {
+        xSemaphoreGive(CRED_Mutex);
+    }
+}
+
+/* 比较两段数据是否相同,耗时与内容无关(不在第一个不同的字节提前返回) */
+static int CRED_Equal(const uint8_t *a, const uint8_t *b, uint8_t len)
+{
+    uint8_t diff = 0;
+
+    while (len--)
+    {
+        diff |= *a++ ^ *b++;
+    }
+    return diff == 0;
+}
+
+/* 分配凭据记录号,-1表示没有空闲 */
+static int32_t CRED_RecAlloc(void)
+{
+    uint32_t w, b;
+
+    for (w = 0; w < (CRED_MAX_ENTRIES + 31) / 32; w++)
+    {
+        if (cred_rec_used[w] != 0xFFFFFFFFU)
+        {
+            for (b = 0; b < 32; b++)
+            {
+                if (!(cred_rec_used[w] & (1UL << b)) && w * 32 + b < CRED_MAX_ENTRIES)
+                {
+                    cred_rec_used[w] |= 1UL << b;
+                    return (int32_t)(w * 32 + b);
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+static void CRED_RecFree(uint16_t rec)
+{
+    cred_rec_used[rec / 32] &= ~(1UL << (rec % 32));
+}
+
+/* 写入/删除Flash记录,加载完成前不写 */
+static int CRED_PersistWrite(uint16_t key, const void *data, uint16_t len)
+{
+    return cred_persist ? FSTORE_Write(key, data, len) : 0;
+}
+
+static int CRED_PersistDelete(uint16_t key)
+{
+    return cred_persist ? FSTORE_Delete(key) : 0;
+}
+
+static uint32_t CRED_Fnv1a(uint32_t h, const uint8_t *data, uint32_t len)
+{
+    while (len--)
+    {
+        h ^= *data++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static uint32_t CRED_Hash(uint8_t type, const uint8_t *key, uint8_t key_len)
+{
+    uint32_t h = CRED_Fnv1a(2166136261U, &type, 1);
+
+    h = CRED_Fnv1a(h, key, key_len);
+    // FNV低位分布较差,索引只用低位,再混合一次
+    h ^= h >> 16;
+    h *= 0x7FEB352DU;
+    h ^= h >> 15;
+    return h;
+}
+
+/**
+  * @brief  在索引中查找凭据
+  * @param  slot: 返回找到的槽,没找到时为可插入的空槽
+  * @retval 凭据下标,-1表示没找到
+  */
+static int32_t CRED_IndexFind(uint8_t type, const uint8_t *key, uint8_t key_len, uint32_t *slot)
+{
+    uint32_t i = CRED_Hash(type, key, key_len) & CRED_INDEX_MASK;
+    const CRED_Entry_t *e;
+
+    while (cred_index[i] != CRED_SLOT_EMPTY)
+    {
+        e = &cred_entries[cred_index[i]];
+        if (e->type == type && e->key_len == key_len && memcmp(e->key, key, key_len) == 0)
+        {
+            *slot = i;
+            return cred_index[i];
+        }
+        i = (i + 1) & CRED_INDEX_MASK;
+    }
+    *slot = i;
+    return -1;
+}
+
+/* 清空一个槽,把后面探测链上的凭据往前移,保证每个凭据从它的起始槽都能连续探测到 */
+static void CRED_IndexRemove(uint32_t slot)
+{
+    uint32_t i = slot, j = slot, home;
+    const CRED_Entry_t *e;
+
+    for (;;)
+    {
+        j = (j + 1) & CRED_INDEX_MASK;
+        if (cred_index[j] == CRED_SLOT_EMPTY)
+        {
+            break;
+        }
+        e = &cred_entries[cred_index[j]];
+        home = CRED_Hash(e->type, e->key, e->key_len) & CRED_INDEX_MASK;
+        // 起始槽不在(i, j]之间的凭据才能移到i
+        if (((j - home) & CRED_INDEX_MASK) >= ((j - i) & CRED_INDEX_MASK))
+        {
+            cred_index[i] = cred_index[j];
+            i = j;
+        }
+    }
+    cred_index[i] = CRED_SLOT_EMPTY;
+}
+
+static void CRED_IndexRebuild(void)
+{
+    uint16_t n = cred_count, k;
+    uint32_t slot;
+
+    memset(cred_index, 0xFF, sizeof(cred_index));
+    memset(cred_type_count, 0, sizeof(cred_type_count));
+    memset(cred_rec_used, 0, sizeof(cred_rec_used));
+    cred_count = 0;
+    for (k = 0; k < n; k++)
+    {
+        const CRED_Entry_t *e = &cred_entries[k];
+
+        // 丢弃损坏或重复的凭据,它的记录号空出来,以后分配时覆盖
+        if (e->type == CRED_TYPE_NONE || e->type >= CRED_TYPE_NUM || e->key_len == 0 || e->key_len > CRED_KEY_SIZE ||
+            e->user >= CRED_MAX_USERS || !(cred_users[e->user].flags & CRED_USER_USED) ||
+            e->rec >= CRED_MAX_ENTRIES || (cred_rec_used[e->rec / 32] & (1UL << (e->rec % 32))) ||
+            CRED_IndexFind(e->type, e->key, e->key_len, &slot) >= 0)
+        {
+            continue;
+        }
+        cred_rec_used[e->rec / 32] |= 1UL << (e->rec % 32);
+        cred_entries[cred_count] = *e;
+        cred_index[slot] = cred_count++;
+        cred_type_count[e->type]++;
+    }
+}
+
+/* 删除下标为pos的凭据,调用者持有锁 */
+static int CRED_RemoveAt(uint16_t pos, uint32_t slot)
+{
+    CRED_Entry_t *e = &cred_entries[pos];
+    uint16_t last = cred_count - 1;
+    uint32_t last_slot;
+    uint8_t phone = e->token[0];
+
+    if (CRED_PersistDelete(FSTORE_KEY_CRED_ENTRY + e->rec) != 0)
+    {
+        return -1;
+    }
+    // 凭据已删,公钥删除失败也只是留下一条没人引用的记录,下次启动时删掉
+    if (e->type == CRED_TYPE_PHONE && phone < CRED_PHONE_MAX)
+    {
+        CRED_PersistDelete(FSTORE_KEY_CRED_PHONE + phone);
+        memset(cred_phone_pub[phone], 0, P256_PUB_SIZE);
+    }
+    CRED_RecFree(e->rec);
+    cred_type_count[e->type]--;
+    CRED_IndexRemove(slot);
+    if (pos != last)
+    {
+        // 最后一个凭据移到空位,索引槽跟着改
+        CRED_IndexFind(cred_entries[last].type, cred_entries[last].key, cred_entries[last].key_len, &last_slot);
+        cred_index[last_slot] = pos;
+        *e = cred_entries[last];
+    }
+    memset(&cred_entries[last], 0, sizeof(CRED_Entry_t));
+    cred_count = last;
+    return 0;
+}
+
+/**
+  * @brief  清空内存中的凭据库,不删除Flash记录
+  */
+void CRED_Reset(void)
+{
+    CRED_Lock();
+    memset(cred_users, 0, sizeof(cred_users));
+    memset(cred_entries, 0, sizeof(cred_entries));
+    memset(cred_totp_used, 0, sizeof(cred_totp_used));
+    memset(cred_phone_pub, 0, sizeof(cred_phone_pub));
+    cred_count = 0;
+    CRED_IndexRebuild();
+    CRED_Unlock();
+}
+
+/**
+  * @brief  出厂设置:管理员用户、默认密码12345678、默认NFC令牌
+  */
+void CRED_LoadDefaults(void)
+{
+    CRED_Reset();
+    CRED_AddUser(CRED_ADMIN_USER, "admin", CRED_USER_ADMIN);
+    CRED_SetPin(CRED_ADMIN_USER, CRED_DEFAULT_PIN, sizeof(CRED_DEFAULT_PIN));
+    CRED_Add(CRED_TYPE_NFC_TOKEN, CRED_ADMIN_USER, CRED_DEFAULT_NFC_TOKEN, CRED_KEY_SIZE, CRED_DEFAULT_NFC_TOKEN);
+}
+
+static int CRED_LoadUser(uint16_t key, const uint8_t *data, uint16_t len, void *arg)
+{
+    if (len == sizeof(CRED_User_t))
+    {
+        memcpy(&cred_users[key - FSTORE_KEY_CRED_USER], data, len);
+    }
+    return 0;
+}
+
+static int CRED_LoadEntry(uint16_t key, const uint8_t *data, uint16_t len, void *arg)
+{
+    CRED_Entry_t *e = &cred_entries[cred_count];
+
+    if (len == sizeof(CRED_Entry_t) && cred_count < CRED_MAX_ENTRIES)
+    {
+        memcpy(e, data, len);
+        if (e->rec == key - FSTORE_KEY_CRED_ENTRY)
+        {
+            cred_count++;
+        }
+    }
+    return 0;
+}
+
+static int CRED_LoadPhone(uint16_t key, const uint8_t *data, uint16_t len, void *arg)
+{
+    if (len == P256_PUB_SIZE)
+    {
+        memcpy(cred_phone_pub[key - FSTORE_KEY_CRED_PHONE], data, len);
+    }
+    return 0;
+}
+
+/* 手机钥匙凭据引用的公钥槽,调用者持有锁 */
+static uint32_t CRED_PhoneSlots(void)
+{
+    uint32_t used = 0;
+    uint16_t k;
+
+    for (k = 0; k < cred_count; k++)
+    {
+        if (cred_entries[k].type == CRED_TYPE_PHONE && cred_entries[k].token[0] < CRED_PHONE_MAX)
+        {
+            used |= 1UL << cred_entries[k].token[0];
+        }
+    }
+    return used;
+}
+
+/* 旧版本只保存了一个键盘密码,读出来迁移为管理员的密码,返回密码长度,0表示没有 */
+static uint8_t CRED_ReadLegacyPassword(uint8_t *digits)
+{
+    const CRED_LegacyPassword_t *legacy = (const CRED_LegacyPassword_t *)FSTORE_SECTOR1_ADDR;
+    FSTORE_Stats_t st;
+    uint8_t i;
+
+    // 只有fstore还没用过扇区1(没有格式化,或者刚格式化的扇区0序号为1)时,扇区7开头才可能是旧版本的密码
+    FSTORE_GetStats(&st);
+    if (!(st.active == 0xFF || (st.active == 0 && st.seq == 1U)))
+    {
+        return 0;
+    }
+    if (legacy->password_len == 0 || legacy->password_len > CRED_PIN_MAX)
+    {
+        return 0;
+    }
+    for (i = 0; i < legacy->password_len; i++)
+    {
+        if (legacy->password[i] > 9)
+        {
+            return 0;
+        }
+        digits[i] = legacy->password[i];
+    }
+    return legacy->password_len;
+}
+
+/* 加载站点密钥,没有时生成;RNG不可用时用芯片唯一ID代替(同一芯片固定,不保密) */
+static void CRED_LoadSiteKey(void)
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+
+    if (FSTORE_Read(FSTORE_KEY_CRED_SITE, cred_site_key, sizeof(cred_site_key)) == (int)sizeof(cred_site_key))
+    {
+        return;
+    }
+    if (RNG_Read(cred_site_key, sizeof(cred_site_key)) != 0)
+    {
+        SHA256((const void *)UID_BASE, 12, digest);
+        memcpy(cred_site_key, digest, sizeof(cred_site_key));
+        LOG_WARN("cred: no RNG, site key from chip id\r\n");
+    }
+    if (FSTORE_Write(FSTORE_KEY_CRED_SITE, cred_site_key, sizeof(cred_site_key)) != 0)
+    {
+        LOG_ERR("cred: save site key failed\r\n");
+    }
+    LOG_INFO("cred: new site key\r\n");
+}
+
+/* 加载密码派生参数,没有时生成盐,并试算CRED_PIN_CAL_ITER次迭代,按耗时标定迭代次数 */
+static void CRED_LoadPinKdf(void)
+{
+    static const uint8_t digits[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint8_t dk[CRED_PIN_DK_SIZE];
+    uint64_t iterations;
+    uint32_t start, us;
+
+    if (FSTORE_Read(FSTORE_KEY_CRED_PIN, &cred_pin_kdf, sizeof(cred_pin_kdf)) == (int)sizeof(cred_pin_kdf) &&
+        cred_pin_kdf.iterations >= CRED_PIN_ITER_MIN && cred_pin_kdf.iterations <= CRED_PIN_ITER_MAX)
+    {
+        return;
+    }
+    if (RNG_Read(cred_pin_kdf.salt, sizeof(cred_pin_kdf.salt)) != 0)
+    {
+        HMAC_SHA256(cred_site_key, sizeof(cred_site_key), "pin", 3, dk);
+        memcpy(cred_pin_kdf.salt, dk, sizeof(cred_pin_kdf.salt));
+    }
+    start = LOG_GetTimeUs();
+    PBKDF2_SHA256(digits, sizeof(digits), cred_pin_kdf.salt, sizeof(cred_pin_kdf.salt),
+                  CRED_PIN_CAL_ITER, dk, sizeof(dk));
+    us = LOG_GetTimeUs() - start;
+    iterations = (uint64_t)CRED_PIN_CAL_ITER * CRED_PIN_BUDGET_MS * 1000U / (us > 0 ? us : 1U);
+    if (iterations < CRED_PIN_ITER_MIN)
+    {
+        iterations = CRED_PIN_ITER_MIN;
+    }
+    if (iterations > CRED_PIN_ITER_MAX)
+    {
+        iterations = CRED_PIN_ITER_MAX;
+    }
+    cred_pin_kdf.iterations = (uint32_t)iterations;
+    if (FSTORE_Write(FSTORE_KEY_CRED_PIN, &cred_pin_kdf, sizeof(cred_pin_kdf)) != 0)
+    {
+        LOG_ERR("cred: save pin kdf failed\r\n");
+    }
+    LOG_INFO("cred: pin kdf %d iterations (%d in %dus)\r\n", cred_pin_kdf.iterations, CRED_PIN_CAL_ITER, us);
+}
+
+/**
+  * @brief  凭据库初始化,从Flash记录存储加载,在FSTORE_Init之后调用
+  */
+void CRED_Init(void)
+{
+    uint8_t legacy[CRED_PIN_MAX];
+    uint8_t legacy_len;
+    uint16_t rec;
+    uint32_t phones;
+    uint32_t init;
+
+    CRED_Mutex = xSemaphoreCreateMutex();
+    CRED_LoadSiteKey();
+    CRED_LoadPinKdf();
+    CRED_Reset();
+    CRED_Lock();
+    FSTORE_Foreach(FSTORE_KEY_CRED_USER, FSTORE_KEY_CRED_USER + CRED_MAX_USERS - 1, CRED_LoadUser, NULL);
+    FSTORE_Foreach(FSTORE_KEY_CRED_ENTRY, FSTORE_KEY_CRED_ENTRY + CRED_MAX_ENTRIES - 1, CRED_LoadEntry, NULL);
+    FSTORE_Foreach(FSTORE_KEY_CRED_PHONE, FSTORE_KEY_CRED_PHONE + CRED_PHONE_MAX - 1, CRED_LoadPhone, NULL);
+    CRED_IndexRebuild();
+    cred_pin_legacy = 0;
+    for (rec = 0; rec < cred_count; rec++)
+    {
+        if (cred_entries[rec].type == CRED_TYPE_PIN &&
+            CRED_Equal(cred_entries[rec].token, CRED_ZERO_TOKEN, CRED_TOKEN_SIZE))
+        {
+            cred_pin_legacy++;
+        }
+    }
+    // 丢弃的凭据(所属用户已删除、重复等)也从Flash删掉,以后添加同编号的用户时不会复活
+    for (rec = 0; rec < CRED_MAX_ENTRIES; rec++)
+    {
+        if (!(cred_rec_used[rec / 32] & (1UL << (rec % 32))))
+        {
+            FSTORE_Delete(FSTORE_KEY_CRED_ENTRY + rec);
+        }
+    }
+    phones = CRED_PhoneSlots();
+    for (rec = 0; rec < CRED_PHONE_MAX; rec++)
+    {
+        if (!(phones & (1UL << rec)))
+        {
+            FSTORE_Delete(FSTORE_KEY_CRED_PHONE + rec);
+            memset(cred_phone_pub[rec], 0, P256_PUB_SIZE);
+        }
+    }
+    CRED_Unlock();
+    cred_persist = 1;
+    LOG_INFO("cred: %d entries loaded\r\n", cred_count);
+    if (FSTORE_Read(FSTORE_KEY_CRED_INIT, &init, sizeof(init)) == (int)sizeof(init))
+    {
+        // 已经初始化过:用户和密码被删光也是有意的,不恢复出厂设置
+        if (cred_type_count[CRED_TYPE_PIN] == 0)
+        {
+            LOG_WARN("cred: no password enrolled\r\n");
+        }
+        return;
+    }
+
+    // 第一次启动:写出厂设置,迁移旧版本的密码,最后写初始化记录;中途掉电时下次启动重做。
+    // 旧版本的密码在扇区7开头,格式化先用扇区6,这时还没有被擦除。
+    // 升级前已经有凭据的只补写初始化记录
+    if (cred_count == 0)
+    {
+        legacy_len = CRED_ReadLegacyPassword(legacy);
+        CRED_LoadDefaults();
+        if (legacy_len > 0)
+        {
+            CRED_SetPin(CRED_ADMIN_USER, legacy, legacy_len);
+            LOG_INFO("cred: legacy password migrated\r\n");
+        }
+        else
+        {
+            LOG_INFO("cred: first boot, load defaults\r\n");
+        }
+    }
+    init = CRED_INIT_VERSION;
+    FSTORE_Write(FSTORE_KEY_CRED_INIT, &init, sizeof(init));
+}
+
+/**
+  * @brief  添加或修改用户
+  * @param  flags: CRED_USER_ADMIN等,CRED_USER_USED自动加上
+  * @retval 0: 成功; -1: 用户编号超出范围或写Flash失败
+  */
+int CRED_AddUser(uint16_t user, const char *name, uint8_t flags)
+{
+    CRED_User_t u;
+    int ret;
+
+    if (user >= CRED_MAX_USERS)
+    {
+        return -1;
+    }
+    memset(&u, 0, sizeof(u));
+    u.flags = flags | CRED_USER_USED;
+    if (name != NULL)
+    {
+        strncpy(u.name, name, CRED_NAME_SIZE - 1);
+    }
+    CRED_Lock();
+    ret = CRED_PersistWrite(FSTORE_KEY_CRED_USER + user, &u, sizeof(u));
+    if (ret == 0)
+    {
+        cred_users[user] = u;
+    }
+    CRED_Unlock();
+    return ret;
+}
+
+/**
+  * @brief  删除用户和他的所有凭据
+  */
+int CRED_DelUser(uint16_t user)
+{
+    uint16_t k;
+    uint32_t slot;
+    int ret = 0;
+
+    if (user >= CRED_MAX_USERS)
+    {
+        return -1;
+    }
+    CRED_Lock();
+    // 从后往前删,被移来填空位的凭据已经检查过
+    for (k = cred_count; k-- > 0 && ret == 0; )
+    {
+        if (cred_entries[k].user == user)
+        {
+            CRED_IndexFind(cred_entries[k].type, cred_entries[k].key, cred_entries[k].key_len, &slot);
+            ret = CRED_RemoveAt(k, slot);
+        }
+    }
+    // 凭据都删掉后才删用户,中途掉电时剩下的凭据仍然属于这个用户
+    if (ret == 0)
+    {
+        ret = CRED_PersistDelete(FSTORE_KEY_CRED_USER + user);
+    }
+    if (ret == 0)
+    {
+        memset(&cred_users[user], 0, sizeof(CRED_User_t));
+    }
+    CRED_Unlock();
+    return ret;
+}
+
+/**
+  * @brief  读取用户信息
+  * @retval 0: 成功; -1: 用户不存在
+  */
+int CRED_GetUser(uint16_t user, CRED_User_t *info)
+{
+    int ret = -1;
+
+    if (user >= CRED_MAX_USERS)
+    {
+        return -1;
+    }
+    CRED_Lock();
+    if (cred_users[user].flags & CRED_USER_USED)
+    {
+        *info = cred_users[user];
+        ret = 0;
+    }
+    CRED_Unlock();
+    return ret;
+}
+
+/**
+  * @brief  添加凭据,键已存在时改为新的用户和令牌
+  * @param  token: NFC令牌,其他类型为NULL
+  * @retval 0: 成功; -1: 参数错误、用户不存在、凭据库已满或写Flash失败
+  */
+int CRED_Add(CRED_Type_t type, uint16_t user, const uint8_t *key, uint8_t key_len, const uint8_t *token)
+{
+    CRED_Entry_t e;
+    uint32_t slot;
+    int32_t pos, rec;
+    int ret = 0;
+
+    if (type == CRED_TYPE_NONE || type >= CRED_TYPE_NUM || key_len == 0 || key_len > CRED_KEY_SIZE ||
+        user >= CRED_MAX_USERS)
+    {
+        return -1;
+    }
+    CRED_Lock();
+    pos = CRED_IndexFind(type, key, key_len, &slot);
+    // 修改已有凭据时沿用它的记录号
+    rec = pos >= 0 ? cred_entries[pos].rec : (cred_count < CRED_MAX_ENTRIES ? CRED_RecAlloc() : -1);
+    if (!(cred_users[user].flags & CRED_USER_USED) || rec < 0)
+    {
+        ret = -1;
+    }
+    else
+    {
+        memset(&e, 0, sizeof(e));
+        e.type = type;
+        e.key_len = key_len;
+        e.user = user;
+        e.rec = (uint16_t)rec;
+        memcpy(e.key, key, key_len);
+        if (token != NULL)
+        {
+            memcpy(e.token, token, CRED_TOKEN_SIZE);
+        }
+        ret = CRED_PersistWrite(FSTORE_KEY_CRED_ENTRY + e.rec, &e, sizeof(e));
+    }
+    if (ret == 0)
+    {
+        if (pos < 0)
+        {
+            pos = cred_count++;
+            cred_index[slot] = pos;
+            cred_type_count[type]++;
+        }
+        cred_entries[pos] = e;
+    }
+    else if (pos < 0 && rec >= 0)
+    {
+        CRED_RecFree((uint16_t)rec);
+    }
+    CRED_Unlock();
+    return ret;
+}
+
+/**
+  * @brief  删除凭据
+  * @retval 0: 成功; -1: 不存在或写Flash失败
+  */
+int CRED_Remove(CRED_Type_t type, const uint8_t *key, uint8_t key_len)
+{
+    uint32_t slot;
+    int32_t pos;
+    int ret = -1;
+
+    CRED_Lock();
+    pos = CRED_IndexFind(type, key, key_len, &slot);
+    if (pos >= 0)
+    {
+        ret = CRED_RemoveAt(pos, slot);
+    }
+    CRED_Unlock();
+    return ret;
+}
+
+/**
+  * @brief  查找凭据
+  * @param  entry: 返回凭据内容,可以为NULL
+  * @retval 所属用户,CRED_NONE表示没找到
+  */
+int CRED_Find(CRED_Type_t type, const uint8_t *key, uint8_t key_len, CRED_Entry_t *entry)
+{
+    uint32_t slot;
+    int32_t pos;
+    int user = CRED_NONE;
+
+    if (key_len == 0 || key_len > CRED_KEY_SIZE)
+    {
+        return CRED_NONE;
+    }
+    CRED_Lock();
+    pos = CRED_IndexFind(type, key, key_len, &slot);
+    if (pos >= 0)
+    {
+        user = cred_entries[pos].user;
+        if (entry != NULL)
+        {
+            *entry = cred_entries[pos];
+        }
+    }
+    CRED_Unlock();
+    return user;
+}
+
+/**
+  * @brief  按存放顺序读取凭据,用于列出全部凭据
+  * @retval 0: 成功; -1: 下标超出凭据个数
+  */
+int CRED_Get(uint16_t index, CRED_Entry_t *entry)
+{
+    int ret = -1;
+
+    CRED_Lock();
+    if (index < cred_count)
+    {
+        *entry = cred_entries[index];
+        ret = 0;
+    }
+    CRED_Unlock();
+    return ret;
+}
+
+/* 旧版本的密码摘要(FNV-1a 64位),只用于迁移 */
+static void CRED_PinLegacyDigest(const uint8_t *digits, uint8_t len, uint8_t *digest)
+{
+    static const uint8_t salt[] = "smart_lock.pin";
+    uint64_t h = 14695981039346656037ULL;
+    uint8_t i;
+
+    for (i = 0; i < sizeof(salt) - 1; i++)
+    {
+        h = (h ^ salt[i]) * 1099511628211ULL;
+    }
+    h = (h ^ len) * 1099511628211ULL;
+    for (i = 0; i < len; i++)
+    {
+        h = (h ^ digits[i]) * 1099511628211ULL;
+    }
+    for (i = 0; i < CRED_PIN_DIGEST_SIZE; i++)
+    {
+        digest[i] = (uint8_t)(h >> (56 - 8 * i));
+    }
+}
+
+/**
+  * @brief  计算密码派生值,凭据库和Flash中不保存明文密码
+  * @param  digits: 密码数字0~9
+  * @param  dk: 返回CRED_PIN_DK_SIZE字节,耗时约CRED_PIN_BUDGET_MS
+  */
+void CRED_PinDerive(const uint8_t *digits, uint8_t len, uint8_t *dk)
+{
+    uint32_t start = LOG_GetTimeUs();
+
+    PBKDF2_SHA256(digits, len, cred_pin_kdf.salt, sizeof(cred_pin_kdf.salt),
+                  cred_pin_kdf.iterations, dk, CRED_PIN_DK_SIZE);
+    cred_pin_last_us = LOG_GetTimeUs() - start;
+}
+
+/* 按派生值设置用户的密码,替换他原来的密码 */
+static int CRED_SetPinKey(uint16_t user, const uint8_t *dk)
+{
+    uint16_t k;
+    uint32_t slot;
+    int owner, ret;
+
+    // 密码单独就能确定用户,不能两个用户用同一个密码
+    owner = CRED_Find(CRED_TYPE_PIN, dk, CRED_PIN_DIGEST_SIZE, NULL);
+    if (owner == user)
+    {
+        return 0;
+    }
+    if (owner != CRED_NONE)
+    {
+        return -1;
+    }
+    // 先写新密码再删旧密码,中途掉电时用户至少还有一个密码能开锁
+    ret = CRED_Add(CRED_TYPE_PIN, user, dk, CRED_PIN_DIGEST_SIZE, dk + CRED_PIN_DIGEST_SIZE);
+    CRED_Lock();
+    for (k = cred_count; k-- > 0 && ret == 0; )
+    {
+        if (cred_entries[k].type == CRED_TYPE_PIN && cred_entries[k].user == user &&
+            memcmp(cred_entries[k].key, dk, CRED_PIN_DIGEST_SIZE) != 0)
+        {
+            CRED_IndexFind(CRED_TYPE_PIN, cred_entries[k].key, cred_entries[k].key_len, &slot);
+            ret = CRED_RemoveAt(k, slot);
+        }
+    }
+    CRED_Unlock();
+    return ret;
+}
+
+/**
+  * @brief  设置用户的密码,替换他原来的密码
+  * @retval 0: 成功; -1: 长度错误、用户不存在、密码已被其他用户使用或写Flash失败
+  */
+int CRED_SetPin(uint16_t user, const uint8_t *digits, uint8_t len)
+{
+    uint8_t dk[CRED_PIN_DK_SIZE];
+
+    if (len == 0 || len > CRED_PIN_MAX || user >= CRED_MAX_USERS)
+    {
+        return -1;
+    }
+    CRED_PinDerive(digits, len, dk);
+    return CRED_SetPinKey(user, dk);
+}
+
+/**
+  * @brief  验证键盘/蓝牙输入的密码,密码对错耗时相同(都是一次派生、一次查找)
+  * @retval 用户编号,CRED_NONE表示密码错误
+  */
+int CRED_MatchPin(const uint8_t *digits, uint8_t len)
+{
+    uint8_t dk[CRED_PIN_DK_SIZE];
+    uint8_t legacy[CRED_PIN_DIGEST_SIZE];
+    CRED_Entry_t e;
+    int user;
+
+    if (len == 0 || len > CRED_PIN_MAX)
+    {
+        return CRED_NONE;
+    }
+    CRED_PinDerive(digits, len, dk);
+    user = CRED_Find(CRED_TYPE_PIN, dk, CRED_PIN_DIGEST_SIZE, &e);
+    if (user != CRED_NONE)
+    {
+        return CRED_Equal(e.token, dk + CRED_PIN_DIGEST_SIZE, CRED_TOKEN_SIZE) ? user : CRED_NONE;
+    }
+    if (cred_pin_legacy == 0)
+    {
+        return CRED_NONE;
+    }
+    // 旧版本的摘要:验证通过后换成新的派生值
+    CRED_PinLegacyDigest(digits, len, legacy);
+    user = CRED_Find(CRED_TYPE_PIN, legacy, sizeof(legacy), &e);
+    if (user == CRED_NONE || !CRED_Equal(e.token, CRED_ZERO_TOKEN, CRED_TOKEN_SIZE))
+    {
+        return CRED_NONE;
+    }
+    if (CRED_SetPinKey((uint16_t)user, dk) == 0 && cred_pin_legacy > 0)
+    {
+        cred_pin_legacy--;
+        LOG_INFO("cred: pin of user %d rehashed\r\n", user);
+    }
+    return user;
+}
+
+/**
+  * @brief  验证NFC卡:先按UID查,登记了令牌的卡还要比对卡内数据块;
+  *         UID没登记的再按数据块查旧版本写的卡
+  * @param  block: 卡内数据块,CRED_TOKEN_SIZE字节
+  * @retval 用户编号,CRED_NONE表示验证失败
+  */
+int CRED_MatchNfc(const uint8_t *uid, uint8_t uid_len, const uint8_t *block)
+{
+    CRED_Entry_t e;
+
+    if (CRED_Find(CRED_TYPE_NFC_UID, uid, uid_len, &e) != CRED_NONE)
+    {
+        return CRED_CheckNfcToken(&e, block);
+    }
+    if (CRED_Find(CRED_TYPE_NFC_TOKEN, block, CRED_KEY_SIZE, &e) != CRED_NONE)
+    {
+        return CRED_CheckNfcToken(&e, block);
+    }
+    return CRED_NONE;
+}
+
+/**
+  * @brief  比对卡内数据块和凭据的令牌,比较时间与内容无关(不在第一个不同的字节提前返回)
+  * @param  entry: CRED_Find查到的NFC凭据
+  * @param  block: 卡内数据块,CRED_TOKEN_SIZE字节;没有登记令牌的UID凭据不比对,可为NULL
+  * @retval 用户编号,CRED_NONE表示令牌不符
+  */
+int CRED_CheckNfcToken(const CRED_Entry_t *entry, const uint8_t *block)
+{
+    if (entry->type == CRED_TYPE_NFC_UID && CRED_Equal(entry->token, CRED_ZERO_TOKEN, CRED_TOKEN_SIZE))
+    {
+        return entry->user;
+    }
+    if (block == NULL)
+    {
+        return CRED_NONE;
+    }
+    return CRED_Equal(entry->token, block, CRED_TOKEN_SIZE) ? entry->user : CRED_NONE;
+}
+
+/**
+  * @brief  计算NFC卡的扇区密钥(分散密钥):SHA-256(站点密钥|扇区号|UID)的前6字节
+  * @param  uid: 卡UID,4/7/10字节
+  * @param  sector: 扇区号
+  * @param  key: 输出CRED_NFC_KEY_SIZE字节
+  */
+void CRED_NfcKey(const uint8_t *uid, uint8_t uid_len, uint8_t sector, uint8_t *key)
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    SHA256_Ctx_t ctx;
+
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, cred_site_key, sizeof(cred_site_key));
+    SHA256_Update(&ctx, &sector, 1);
+    SHA256_Update(&ctx, uid, uid_len);
+    SHA256_Final(&ctx, digest);
+    memcpy(key, digest, CRED_NFC_KEY_SIZE);
+}
+
+/**
+  * @brief  读取用户的NFC令牌,用于写卡
+  * @retval 0: 成功; -1: 用户没有令牌
+  */
+int CRED_GetNfcToken(uint16_t user, uint8_t *token)
+{
+    static const uint8_t zero[CRED_TOKEN_SIZE] = {0};
+    uint16_t k;
+    int ret = -1;
+
+    CRED_Lock();
+    for (k = 0; k < cred_count; k++)
+    {
+        const CRED_Entry_t *e = &cred_entries[k];
+
+        if (e->user == user && (e->type == CRED_TYPE_NFC_TOKEN || e->type == CRED_TYPE_NFC_UID) &&
+            memcmp(e->token, zero, CRED_TOKEN_SIZE) != 0)
+        {
+            memcpy(token, e->token, CRED_TOKEN_SIZE);
+            ret = 0;
+            break;
+        }
+    }
+    CRED_Unlock();
+    return ret;
+}
+
+/**
+  * @brief  设置用户的TOTP密钥,替换原来的密钥
+  * @param  secret: CRED_TOTP_SECRET_SIZE字节
+  * @retval 0: 成功; -1: 用户不存在或写Flash失败
+  */
+int CRED_SetTotp(uint16_t user, const uint8_t *secret)
+{
+    uint8_t key[2] = {(uint8_t)(user >> 8), (uint8_t)user};
+    int ret;
+
+    ret = CRED_Add(CRED_TYPE_TOTP, user, key, sizeof(key), secret);
+    if (ret == 0)
+    {
+        cred_totp_used[user] = 0;
+    }
+    return ret;
+}
+
+/**
+  * @brief  验证键盘/蓝牙输入的一次性密码,逐个TOTP密钥比对前后CRED_TOTP_WINDOW个时间步,
+  *         耗时只与密钥数有关(每个密钥2+2*(2*CRED_TOTP_WINDOW+1)次SHA-1压缩),与输入无关
+  * @param  digits: 数字0~9,CRED_TOTP_DIGITS位
+  * @param  now: 当前时间(Unix秒,UTC),日历没有设置时为0
+  * @retval 用户编号,CRED_NONE表示不匹配、多个用户同时匹配或这个码已经用过
+  */
+int CRED_MatchTotp(const uint8_t *digits, uint8_t len, uint32_t now)
+{
+    HMAC_SHA1_Key_t hk;
+    uint32_t code = 0, mod = 1, step, s, used = 0, start;
+    uint16_t k, matches = 0;
+    uint8_t i;
+    int user = CRED_NONE;
+
+    if (len != CRED_TOTP_DIGITS || now < CRED_TOTP_STEP * (CRED_TOTP_WINDOW + 1) ||
+        cred_type_count[CRED_TYPE_TOTP] == 0)
+    {
+        return CRED_NONE;
+    }
+    for (i = 0; i < len; i++)
+    {
+        if (digits[i] > 9)
+        {
+            return CRED_NONE;
+        }
+        code = code * 10U + digits[i];
+        mod *= 10U;
+    }
+    start = LOG_GetTimeUs();
+    step = now / CRED_TOTP_STEP;
+    CRED_Lock();
+    // 不提前结束:匹配与否、匹配的是哪个密钥,耗时都一样
+    for (k = 0; k < cred_count; k++)
+    {
+        const CRED_Entry_t *e = &cred_entries[k];
+
+        if (e->type != CRED_TYPE_TOTP)
+        {
+            continue;
+        }
+        HMAC_SHA1_Init(&hk, e->token, CRED_TOTP_SECRET_SIZE);
+        for (s = step - CRED_TOTP_WINDOW; s <= step + CRED_TOTP_WINDOW; s++)
+        {
+            if (HOTP_Value(&hk, s) % mod == code && s > cred_totp_used[e->user])
+            {
+                user = e->user;
+                used = s;
+                matches++;
+            }
+        }
+    }
+    if (matches == 1)
+    {
+        cred_totp_used[user] = used;
+    }
+    CRED_Unlock();
+    memset(&hk, 0, sizeof(hk));
+    cred_totp_last_us = LOG_GetTimeUs() - start;
+    if (matches > 1)
+    {
+        // 6位码在多个密钥间重复的概率约为密钥数*3/10^6,让用户等下一个码
+        LOG_WARN("cred: totp code matches %d secrets\r\n", matches);
+        return CRED_NONE;
+    }
+    return user;
+}
+
+/**
+  * @brief  手机钥匙ID:SHA-256(公钥X|Y)的前CRED_PHONE_ID_SIZE字节,手机签名时带上它,门锁按它查公钥
+  */
+void CRED_PhoneId(const uint8_t *pub, uint8_t *key_id)
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+
+    SHA256(pub, P256_PUB_SIZE, digest);
+    memcpy(key_id, digest, CRED_PHONE_ID_SIZE);
+}
+
+/**
+  * @brief  登记手机钥匙,同一个公钥再次登记时改为新的用户
+  *         分配公钥槽到写入凭据之间不持有锁,只在蓝牙任务中调用
+  * @param  pub: 公钥X|Y,P256_PUB_SIZE字节
+  * @retval 0: 成功; -1: 公钥不在曲线上、用户不存在、槽已满或写Flash失败
+  */
+int CRED_AddPhone(uint16_t user, const uint8_t *pub)
+{
+    uint8_t key_id[CRED_PHONE_ID_SIZE];
+    uint8_t token[CRED_TOKEN_SIZE];
+    CRED_Entry_t e;
+    uint32_t used;
+    uint8_t phone;
+    int ret = 0;
+
+    if (P256_CheckPublic(pub) != 0)
+    {
+        return -1;
+    }
+    CRED_PhoneId(pub, key_id);
+    memset(token, 0, sizeof(token));
+    if (CRED_Find(CRED_TYPE_PHONE, key_id, sizeof(key_id), &e) != CRED_NONE)
+    {
+        // 已登记:沿用原来的槽,公钥不变
+        return CRED_Add(CRED_TYPE_PHONE, user, key_id, sizeof(key_id), e.token);
+    }
+    CRED_Lock();
+    used = CRED_PhoneSlots();
+    phone = 0;
+    while (phone < CRED_PHONE_MAX && (used & (1UL << phone)))
+    {
+        phone++;
+    }
+    if (phone >= CRED_PHONE_MAX ||
+        CRED_PersistWrite(FSTORE_KEY_CRED_PHONE + phone, pub, P256_PUB_SIZE) != 0)
+    {
+        ret = -1;
+    }
+    else
+    {
+        memcpy(cred_phone_pub[phone], pub, P256_PUB_SIZE);
+    }
+    CRED_Unlock();
+    if (ret == 0)
+    {
+        // 凭据写入失败时公钥记录没人引用,下次登记覆盖或启动时删除
+        token[0] = phone;
+        ret = CRED_Add(CRED_TYPE_PHONE, user, key_id, sizeof(key_id), token);
+    }
+    return ret;
+}
+
+/**
+  * @brief  验证手机钥匙对挑战的签名
+  * @param  key_id: 钥匙ID,CRED_PHONE_ID_SIZE字节
+  * @param  hash: 挑战消息的SHA-256摘要
+  * @param  sig: 签名r|s,P256_SIG_SIZE字节
+  * @retval 用户编号,CRED_NONE表示钥匙没有登记或签名不对
+  */
+int CRED_MatchPhone(const uint8_t *key_id, const uint8_t *hash, const uint8_t *sig)
+{
+    uint8_t pub[P256_PUB_SIZE];
+    CRED_Entry_t e;
+    uint32_t start;
+    int user;
+
+    user = CRED_Find(CRED_TYPE_PHONE, key_id, CRED_PHONE_ID_SIZE, &e);
+    if (user == CRED_NONE || e.token[0] >= CRED_PHONE_MAX)
+    {
+        return CRED_NONE;
+    }
+    CRED_Lock();
+    memcpy(pub, cred_phone_pub[e.token[0]], P256_PUB_SIZE);
+    CRED_Unlock();
+    // 验签几十毫秒,不持有锁
+    start = LOG_GetTimeUs();
+    if (P256_Verify(pub, hash, sig) != 0)
+    {
+        user = CRED_NONE;
+    }
+    cred_phone_last_us = LOG_GetTimeUs() - start;
+    return user;
+}
+
+/**
+  * @brief  登记指纹模板ID或人脸用户ID
+  */
+int CRED_AddId(CRED_Type_t type, uint16_t user, uint16_t id)
+{
+    uint8_t key[2] = {(uint8_t)(id >> 8), (uint8_t)id};
+
+    if (type != CRED_TYPE_FP && type != CRED_TYPE_FACE)
+    {
+        return -1;
+    }
+    return CRED_Add(type, user, key, sizeof(key), NULL);
+}
+
+/**
+  * @brief  把指纹/人脸模块识别出的ID转换为用户
+  *         没有登记的ID一律拒绝,升级前录入的指纹/人脸用shell的cred migrate登记到用户
+  * @retval 用户编号,CRED_NONE表示没有登记
+  */
+int CRED_MatchId(CRED_Type_t type, uint16_t id)
+{
+    uint8_t key[2] = {(uint8_t)(id >> 8), (uint8_t)id};
+
+    if (type != CRED_TYPE_FP && type != CRED_TYPE_FACE)
+    {
+        return CRED_NONE;
+    }
+    return CRED_Find(type, key, sizeof(key), NULL);
+}
+
+/**
+  * @brief  某种凭据的条数,不遍历凭据表
+  */
+uint16_t CRED_Count(CRED_Type_t type)
+{
+    return type < CRED_TYPE_NUM ? cred_type_count[type] : 0;
+}
+
+/**
+  * @brief  统计凭据库使用情况和索引探测长度
+  */
+void CRED_GetStats(CRED_Stats_t *stats)
+{
+    uint32_t i, home, dist;
+    uint16_t u;
+    const CRED_Entry_t *e;
+
+    memset(stats, 0, sizeof(CRED_Stats_t));
+    CRED_Lock();
+    for (u = 0; u < CRED_MAX_USERS; u++)
+    {
+        if (cred_users[u].flags & CRED_USER_USED)
+        {
+            stats->users++;
+        }
+    }
+    stats->entries = cred_count;
+    stats->pin_iterations = cred_pin_kdf.iterations;
+    stats->pin_last_us = cred_pin_last_us;
+    stats->pin_legacy = cred_pin_legacy;
+    stats->totp_last_us = cred_totp_last_us;
+    stats->phone_last_us = cred_phone_last_us;
+    memcpy(stats->by_type, cred_type_count, sizeof(stats->by_type));
+    for (i = 0; i < CRED_INDEX_SIZE; i++)
+    {
+        if (cred_index[i] == CRED_SLOT_EMPTY)
+        {
+            continue;
+        }
+        e = &cred_entries[cred_index[i]];
+        home = CRED_Hash(e->type, e->key, e->key_len) & CRED_INDEX_MASK;
+        dist = (i - home) & CRED_INDEX_MASK;
+        stats->total_probe += dist + 1;
+        if (dist + 1 > stats->max_probe)
+        {
+            stats->max_probe = (uint16_t)(dist + 1);
+        }
+    }
+    CRED_Unlock();
+}
@@ -0,0 +1,137 @@
+/**
+  ******************************************************************************
+  * @file    cred.h
+  * @author  cyytx
+  * @brief   凭据库的头文件,统一管理用户和各开锁方式的凭据:
+  *          键盘/蓝牙密码(只存加盐的PBKDF2派生值)、NFC卡UID和卡内令牌、指纹模板ID、人脸用户ID、
+  *          一次性密码(TOTP)的密钥、蓝牙手机钥匙的P-256公钥,
+  *          每张NFC卡的扇区密钥由站点密钥和卡UID分散得到,
+  *          哈希索引让每种开锁方式都能O(1)查到对应的用户,
+  *          每个用户、每条凭据是Flash记录存储(fstore)中的一条记录,修改后立即写入
+  ******************************************************************************
+  */
+
+#ifndef __CRED_H
+#define __CRED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "hard_enable_ctrl.h"
+
+/* 容量可在编译选项中修改,主机测试(tools/host)用更大的值 */
+#ifndef CRED_MAX_USERS
+#define CRED_MAX_USERS          256     /* 最多用户数,用户编号0~CRED_MAX_USERS-1 */
+#endif
+#ifndef CRED_MAX_ENTRIES
+#define CRED_MAX_ENTRIES        512     /* 所有用户的凭据总数 */
+#endif
+#ifndef CRED_INDEX_SIZE
+#define CRED_INDEX_SIZE         1024    /* 哈希索引槽数,必须是2的幂且不小于凭据数的2倍 */
+#endif
+
+#define CRED_KEY_SIZE           10      /* 凭据键最大长度,NFC卡UID最长10字节 */
+#define CRED_TOKEN_SIZE         16      /* NFC卡内令牌,一个数据块 */
+#define CRED_NAME_SIZE          15      /* 用户名最大长度(含'\0') */
+#define CRED_PIN_MAX            16      /* 密码最大位数 */
+#define CRED_PIN_DIGEST_SIZE    8       /* 密码派生值中作为索引键的长度,其后CRED_TOKEN_SIZE字节存在令牌中 */
+#define CRED_PIN_DK_SIZE        (CRED_PIN_DIGEST_SIZE + CRED_TOKEN_SIZE)
+#define CRED_PIN_SALT_SIZE      16      /* 密码派生的盐,第一次启动时随机生成 */
+#define CRED_PIN_BUDGET_MS      20      /* 验证一次密码的目标耗时(ms),第一次启动时按它标定迭代次数 */
+#define CRED_PIN_CAL_ITER       256     /* 标定时试算的迭代次数 */
+#define CRED_PIN_ITER_MIN       100
+#define CRED_PIN_ITER_MAX       100000
+#define CRED_SITE_KEY_SIZE      16      /* 站点密钥长度,第一次启动时随机生成 */
+#define CRED_NFC_KEY_SIZE       6       /* MIFARE Classic扇区密钥长度 */
+#define CRED_TOTP_SECRET_SIZE   CRED_TOKEN_SIZE /* TOTP密钥长度(128位),存在令牌中 */
+#define CRED_TOTP_DIGITS        6       /* TOTP位数 */
+#define CRED_TOTP_STEP          30      /* TOTP时间步长(s) */
+#define CRED_TOTP_WINDOW        1       /* 前后各接受几个时间步,容忍时钟误差和输入耗时 */
+#define CRED_PHONE_MAX          16      /* 手机钥匙最多个数,公钥常驻内存(每个64字节) */
+#define CRED_PHONE_ID_SIZE      8       /* 手机钥匙ID:SHA-256(公钥)的前8字节 */
+
+#define CRED_ADMIN_USER         0       /* 管理员用户,出厂默认密码和NFC令牌属于它 */
+#define CRED_NONE               (-1)    /* 没有匹配的用户 */
+
+#define CRED_USER_USED          0x01    /* 用户标志:已使用 */
+#define CRED_USER_ADMIN         0x02    /* 用户标志:管理员 */
+#define CRED_USER_MFA           0x04    /* 用户标志:开锁需要两种不同的方式(见auth.c) */
+
+/* 凭据类型,同一类型内键唯一 */
+typedef enum {
+    CRED_TYPE_NONE = 0,
+    CRED_TYPE_PIN,          /* 键盘/蓝牙密码,键为派生值前8字节,令牌为其后16字节(全0是旧版本的摘要) */
+    CRED_TYPE_NFC_UID,      /* NFC卡UID,令牌非空时还要比对卡内数据块 */
+    CRED_TYPE_NFC_TOKEN,    /* 只按卡内数据块识别的卡(旧版本写卡方式),键为令牌前10字节 */
+    CRED_TYPE_FP,           /* 指纹模块中的模板ID,2字节大端 */
+    CRED_TYPE_FACE,         /* 人脸模块中的用户ID,2字节大端 */
+    CRED_TYPE_TOTP,         /* 一次性密码,键为用户编号(2字节大端),令牌为HMAC-SHA1密钥 */
+    CRED_TYPE_PHONE,        /* 蓝牙手机钥匙,键为钥匙ID,令牌第1字节为公钥槽号 */
+    CRED_TYPE_NUM
+} CRED_Type_t;
+
+typedef struct {
+    uint8_t type;                       /* CRED_Type_t */
+    uint8_t key_len;
+    uint16_t user;                      /* 所属用户 */
+    uint8_t key[CRED_KEY_SIZE];
+    uint8_t token[CRED_TOKEN_SIZE];     /* NFC令牌、密码校验值等,见CRED_Type_t */
+    uint16_t rec;                       /* Flash记录号,凭据在数组中移动时不变 */
+} CRED_Entry_t;
+
+typedef struct {
+    uint8_t flags;                      /* CRED_USER_xxx */
+    char name[CRED_NAME_SIZE];
+} CRED_User_t;
+
+typedef struct {
+    uint16_t users;                     /* 已使用的用户数 */
+    uint16_t entries;                   /* 凭据总数 */
+    uint16_t by_type[CRED_TYPE_NUM];    /* 各类型凭据数 */
+    uint16_t max_probe;                 /* 索引中最长的探测距离 */
+    uint32_t total_probe;               /* 所有凭据探测距离之和,除以entries为平均值 */
+    uint32_t pin_iterations;            /* 密码派生的迭代次数 */
+    uint32_t pin_last_us;               /* 最近一次密码派生耗时(us) */
+    uint16_t pin_legacy;                /* 还没迁移的旧版本密码摘要数(上限) */
+    uint32_t totp_last_us;              /* 最近一次验证一次性密码的耗时(us),与TOTP密钥数成正比 */
+    uint32_t phone_last_us;             /* 最近一次验证手机钥匙签名的耗时(us) */
+} CRED_Stats_t;
+
+void CRED_Init(void);
+void CRED_Reset(void);
+void CRED_LoadDefaults(void);
+
+int CRED_AddUser(uint16_t user, const char *name, uint8_t flags);
+int CRED_DelUser(uint16_t user);
+int CRED_GetUser(uint16_t user, CRED_User_t *info);
+
+int CRED_Add(CRED_Type_t type, uint16_t user, const uint8_t *key, uint8_t key_len, const uint8_t *token);
+int CRED_Remove(CRED_Type_t type, const uint8_t *key, uint8_t key_len);
+int CRED_Find(CRED_Type_t type, const uint8_t *key, uint8_t key_len, CRED_Entry_t *entry);
+int CRED_Get(uint16_t index, CRED_Entry_t *entry);
+
+void CRED_PinDerive(const uint8_t *digits, uint8_t len, uint8_t *dk);
+int CRED_SetPin(uint16_t user, const uint8_t *digits, uint8_t len);
+int CRED_MatchPin(const uint8_t *digits, uint8_t len);
+int CRED_MatchNfc(const uint8_t *uid, uint8_t uid_len, const uint8_t *block);
+int CRED_CheckNfcToken(const CRED_Entry_t *entry, const uint8_t *block);
+void CRED_NfcKey(const uint8_t *uid, uint8_t uid_len, uint8_t sector, uint8_t *key);
+int CRED_GetNfcToken(uint16_t user, uint8_t *token);
+int CRED_SetTotp(uint16_t user, const uint8_t *secret);
+int CRED_MatchTotp(const uint8_t *digits, uint8_t len, uint32_t now);
+void CRED_PhoneId(const uint8_t *pub, uint8_t *key_id);
+int CRED_AddPhone(uint16_t user, const uint8_t *pub);
+int CRED_MatchPhone(const uint8_t *key_id, const uint8_t *hash, const uint8_t *sig);
+int CRED_AddId(CRED_Type_t type, uint16_t user, uint16_t id);
+int CRED_MatchId(CRED_Type_t type, uint16_t id);
+
+uint16_t CRED_Count(CRED_Type_t type);
+void CRED_GetStats(CRED_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CRED_H */
@@ -11,7 +11,14 @@
 #include "queue.h"
 #include "timers.h"
 #include "priorities.h"
-#include "sg90.h"
+#include "auth.h"
+#include "bio.h"
+#include "log.h"
+#include "uart.h"
+#include "rtc.h"
+#include "cred.h"
+
+#define LOG_MODULE FACE    /* 日志模块名,等级见log_config.h */
 #if FACE_ENABLE
 
 
@@ -23,6 +30,21 @@
 #define FACE_ENROLL_TIMEOUT  10 //10s
 #define FACE_IDENTIFY_TIMEOUT 10 //10s
 
+/* 消息ID,模块发给主控的消息 */
+#define FACE_MID_REPLY        0x00    /* 命令应答 */
+#define FACE_MID_NOTE         0x01    /* 模块主动通知 */
+
+/* 波特率协商 */
+#define FACE_BAUD_DEFAULT     115200  /* 模块出厂波特率 */
+/*
+使用的最高波特率序号,见FACE_BaudTable。模块最高支持1500000,
+但接收是每字节一次中断(HAL中断处理+复位定时器),1500000时每字节只有6.7us,
+-O0下容易溢出,所以用460800
+*/
+#define FACE_BAUD_MAX_INDEX   3
+#define FACE_BAUD_CMD_TIMEOUT 200     /* 协商时每条命令等待应答的时间(ms) */
+#define FACE_PING_RETRY       3       /* 状态查询重试次数,刚上电时模块可能还没准备好 */
+
 
 
 /* 私有变量定义 */
@@ -31,6 +53,11 @@ static uint8_t FACE_RxBuffer[FACE_BUFFER_SIZE];   // 接收缓冲区
 static uint16_t FACE_RxIndex = 0;                 // 接收缓冲区索引
 static uint8_t FACE_RxTempBuffer[1];         // 单字节接收缓冲区
 static uint8_t FACE_RegisterUserNum = 0;              // 注册用户数量
+static uint32_t FACE_BaudRate = FACE_BAUD_DEFAULT;    // 当前通信波特率
+static uint32_t FACE_IdentifyUs = 0;                 // 发起识别的时间,作为出示人脸的时间
+
+/* MID_CONFIG_BAUDRATE的波特率序号对应的波特率,序号0不使用 */
+static const uint32_t FACE_BaudTable[] = {0, 115200, 230400, 460800, 1500000};
 
 /* FreeRTOS相关变量 */
 static TaskHandle_t faceTaskHandle = NULL;   // 人脸识别任务句柄
@@ -108,17 +135,12 @@ static FACE_StatusTypeDef FACE_SendCommand(uint8_t *data, uint16_t length)
     /* 计算校验和 */
     checksum = FACE_CalculateChecksum(data, length);
     data[length++] = checksum;
-    for(uint16_t i=0;i<length;i++)
-    {
-        printf("%02X ",data[i]);
-    }
-    printf("\r\n");
-    printf("length:%d\r\n",length);
+    LOG_HEX("FACE TX", data, length);
 
     /* 使用UART发送数据 */
     if (HAL_UART_Transmit(&huart5, data, length, FACE_TX_TIMEOUT) != HAL_OK) {
         return FACE_ERROR;
-        printf("face send cmd error\r\n");
+        LOG_ERR("face send cmd error\r\n");
     }
     
     return FACE_OK;
@@ -132,7 +154,7 @@ static FACE_StatusTypeDef FACE_SendCommand_test(void)
     /* 使用UART发送数据 */
     if (HAL_UART_Transmit(&huart5, txBuffer, sizeof(txBuffer), FACE_TX_TIMEOUT) != HAL_OK) {
         return FACE_ERROR;
-        printf("face send cmd error\r\n");
+        LOG_ERR("face send cmd error\r\n");
     }
     
     return FACE_OK;
@@ -149,6 +171,9 @@ void FACE_TimerCallback(TimerHandle_t xTimer)
     FACE_Msg msg;
     msg.msgType = FACE_MSG_DATA_READY;
     msg.data = FACE_RxIndex;
+
+    /* 抓包(调试shell的capture命令打开),用于主机回放 */
+    LOG_Capture(LOG_CAP_FACE, 0, FACE_RxBuffer, FACE_RxIndex);
     
     /* 向人脸识别任务发送超时消息 */
     xQueueSend(faceMsgQueue, &msg, 0);
@@ -176,12 +201,25 @@ void FACE_RxCpltCallback(void)
     else
     {
         FACE_RxIndex = 0;
-        printf("face rtos not start:%x\r\n",FACE_RxTempBuffer[0]);
+        LOG_ERR("face rtos not start:%x\r\n",FACE_RxTempBuffer[0]);
         HAL_UART_Receive_IT(&huart5, FACE_RxTempBuffer, 1);
     }
 }
 
 
+/**
+  * @brief  串口错误回调,溢出错误会中止中断接收,这里重新开始接收,在uart.c中调用
+  * @param  无
+  * @retval 无
+  */
+void FACE_ErrorCallback(void)
+{
+    if (huart5.RxState == HAL_UART_STATE_READY)
+    {
+        HAL_UART_Receive_IT(&huart5, FACE_RxTempBuffer, 1);
+    }
+}
+
 /**
   * @brief  UART中断回调函数
   * @param  无
@@ -203,53 +241,58 @@ void UART5_IRQHandler(void)
 
 /**
   * @brief  检查接收到的帧是否完整
-  * @param  无
+  * @param  data: 接收数据
+  * @param  dataLength: 接收数据长度
   * @retval 0: 帧不完整, 1: 帧完整
   * //SyncWord(2byte EFAA)+MsgID(1byte)+Size(2byte)+Data(Nbyte)+ParityCheck(1byte) 
   */
-static uint8_t FACE_CheckFrameComplete(uint16_t dataLength)
+static uint8_t FACE_CheckFrameComplete(uint8_t *data, uint16_t dataLength)
 {
     uint16_t length = 0;
-    for(uint16_t i=0;i<dataLength;i++)
-    {
-        printf("%02X ",FACE_RxBuffer[i]);
-    }
-    printf("\r\n");
-    if(FACE_RxIndex < 6)
+    LOG_HEX("FACE RX", data, dataLength);
+    if(dataLength < 6)
     {
-        printf("face check frame complete base length failed\r\n");
+        LOG_ERR("face check frame complete base length failed\r\n");
         return 0;
     }
-    if(FACE_RxBuffer[0] != 0xEF || FACE_RxBuffer[1] != 0xAA)
+    if(data[0] != 0xEF || data[1] != 0xAA)
     {
-        printf("face check frame complete syncword failed\r\n");
+        LOG_ERR("face check frame complete syncword failed\r\n");
         return 0;
     }
-    length = (FACE_RxBuffer[3] << 8) | FACE_RxBuffer[4];
+    length = (data[3] << 8) | data[4];
     if(length+6 != dataLength)
     {
-        printf("face check frame complete length failed \r\n");
+        LOG_ERR("face check frame complete length failed \r\n");
         return 0;
     }
     //检验校验和
-    uint8_t checksum = FACE_CalculateChecksum(FACE_RxBuffer, dataLength-1);
-    if(checksum != FACE_RxBuffer[dataLength-1])
+    uint8_t checksum = FACE_CalculateChecksum(data, dataLength-1);
+    if(checksum != data[dataLength-1])
     {
-        printf("face check frame complete checksum failed length:%d,dataLength:%d,checksum:%d\r\n",length,dataLength,checksum);
+        LOG_ERR("face check frame complete checksum failed length:%d,dataLength:%d,checksum:%d\r\n",length,dataLength,checksum);
         return 0;
     }
     return 1;
 }
 
-void FACE_Register_Single_Handle(void)
+void FACE_Register_Single_Handle(uint8_t *data)
 {
-    if(FACE_RxBuffer[6] == MR_SUCCESS)
+    uint16_t face_id;
+
+    if(data[6] == MR_SUCCESS)
     {
-        printf("face register success %x \r\n",FACE_RxBuffer[6]);
+        //应答数据为模块分配的用户ID(2byte),登记给管理员
+        face_id = (data[7] << 8) | data[8];
+        LOG_INFO("face register success, id %d\r\n", face_id);
+        if (CRED_AddId(CRED_TYPE_FACE, CRED_ADMIN_USER, face_id) != 0)
+        {
+            LOG_ERR("face id %d not saved to cred\r\n", face_id);
+        }
     }
     else
     {
-        printf("face register failed %x\r\n",FACE_RxBuffer[6]);
+        LOG_ERR("face register failed %x\r\n",data[6]);
     }
 }
 //SyncWord(2byte EFAA)+MsgID(1byte)+Size(2byte)+Data(Nbyte)+ParityCheck(1byte) 
@@ -292,18 +335,41 @@ FACE_StatusTypeDef FACE_Register_Single(void)
     return FACE_OK;
 }
 
+//识别结果交给生物识别协调(bio.c),由它决定是否提交开锁请求
+static void FACE_Report(int user)
+{
+#if BIO_ENABLE
+    BIO_Result(BIO_FACE, user, FACE_IdentifyUs);
+#else
+    AUTH_Request(AUTH_SRC_FACE, user, FACE_IdentifyUs);
+#endif
+}
+
 //人脸识别结果处理
-void FACE_Identify_Result_Handle(void)
+void FACE_Identify_Result_Handle(uint8_t *data)
 {
-    if(FACE_RxBuffer[6] == MR_SUCCESS)
+    uint16_t face_id;
+    int user;
+
+    if(data[6] == MR_SUCCESS)
     {
-        printf("face identify success\r\n");
-        //开锁
-        SendLockCommand(LOCK_CMD_OPEN);
+        //应答数据开头为模块中的用户ID(2byte),对应到凭据库中的用户后开锁
+        face_id = (data[7] << 8) | data[8];
+        user = CRED_MatchId(CRED_TYPE_FACE, face_id);
+        if (user == CRED_NONE)
+        {
+            LOG_ERR("face id %d not in cred\r\n", face_id);
+            FACE_Report(CRED_NONE);
+            return;
+        }
+        LOG_INFO("face identify success, id %d user %d\r\n", face_id, user);
+        //提交开锁请求
+        FACE_Report(user);
     }
     else
     {
-        printf("face identify failed,result:%x\r\n",FACE_RxBuffer[6]);
+        LOG_ERR("face identify failed,result:%x\r\n",data[6]);
+        FACE_Report(CRED_NONE);
     }
 }
 //人脸识别指令填充和发送
@@ -312,19 +378,33 @@ uint8_t FACE_Identify_Cmd_Send(void)
 {
     uint8_t txBuffer[]={0xEF,0xAA,0x12,0x00,0x02,0x00,0x0A,0x1A};
     txBuffer[6] = FACE_IDENTIFY_TIMEOUT;//设置超时时间
-    uint8_t status = FACE_SendCommand(txBuffer, sizeof(txBuffer));
+    //最后一个字节是校验码的位置,由FACE_SendCommand计算填入
+    uint8_t status = FACE_SendCommand(txBuffer, sizeof(txBuffer) - 1);
     if (status != FACE_OK) {
-        printf("face identify cmd send failed\r\n");
+        LOG_ERR("face identify cmd send failed\r\n");
+        return status;
+    }
+    return FACE_OK;
+}
+
+//停止模块正在进行的识别/注册,回到空闲
+//ef aa 10 00 00 10
+uint8_t FACE_Reset_Cmd_Send(void)
+{
+    uint8_t txBuffer[]={0xEF,0xAA,0x10,0x00,0x00,0x10};
+    uint8_t status = FACE_SendCommand(txBuffer, sizeof(txBuffer) - 1);
+    if (status != FACE_OK) {
+        LOG_ERR("face reset cmd send failed\r\n");
         return status;
     }
     return FACE_OK;
 }
 
 //获取用户数量和ID结果处理
-void FACE_Get_User_Num_And_ID_Handle(void)
+void FACE_Get_User_Num_And_ID_Handle(uint8_t *data)
 {
-    FACE_RegisterUserNum = FACE_RxBuffer[7];
-    printf("face get user num and id success,num:%d\r\n",FACE_RegisterUserNum);
+    FACE_RegisterUserNum = data[7];
+    LOG_INFO("face get user num and id success,num:%d\r\n",FACE_RegisterUserNum);
 }
 
 //获取用户数量和ID
@@ -332,19 +412,55 @@ void FACE_Get_User_Num_And_ID_Handle(void)
 uint8_t FACE_Get_User_Num_Cmd_Send(void)
 {
     uint8_t txBuffer[]={0xEF,0xAA,0x24,0x00,0x01,0x00,0x25};
-    uint8_t status = FACE_SendCommand(txBuffer, sizeof(txBuffer));
+    uint8_t status = FACE_SendCommand(txBuffer, sizeof(txBuffer) - 1);
     if (status != FACE_OK) {
-        printf("face get user num and id cmd send failed\r\n");
+        LOG_ERR("face get user num and id cmd send failed\r\n");
         return status;
     }
     return FACE_OK;
 }
 
+/**
+  * @brief  处理一帧模块消息,按应答的命令分发,人脸识别任务和主机回放工具(tools/host)共用
+  * @param  data: 接收数据
+  * @param  length: 接收数据长度
+  * @retval 0: 帧有效; -1: 帧不完整或校验错误
+  * //SyncWord(2byte)+MsgID(1byte)+Size(2byte)+Data(Nbyte)+ParityCheck(1byte)
+  * // SyncWord=EFAA   Data(Nbyte)=mid(1byte)+result(1byte)+data(n-byte)
+  */
+int FACE_ProcessFrame(uint8_t *data, uint16_t length)
+{
+    if (FACE_CheckFrameComplete(data, length) == 0)
+    {
+        return -1;
+    }
+    switch (data[5])
+    {
+        case FACE_CMD_ENROLL_SINGLE:
+            FACE_Register_Single_Handle(data);
+            break;
+        case FACE_CMD_VERIFY:
+            FACE_Identify_Result_Handle(data);
+            break;
+        case FACE_CMD_GET_ALL_USERID:
+            FACE_Get_User_Num_And_ID_Handle(data);
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+uint32_t FACE_GetBaudRate(void)
+{
+    return FACE_BaudRate;
+}
+
 void FACE_Register_Cmd(void)
 {
     FACE_Msg msg;
     msg.msgType = FACE_MSG_ENROLL;
-    printf("face register cmd\r\n");
+    LOG_INFO("face register cmd\r\n");
     /* 向人脸识别任务发送超时消息 */
     xQueueSend(faceMsgQueue, &msg, 0);
 }
@@ -353,11 +469,172 @@ void FACE_Register_Cmd(void)
 void FACE_Identify_Cmd(void)
 {
     FACE_Msg msg;
+    FACE_IdentifyUs = LOG_GetTimeUs();
     msg.msgType = FACE_MSG_IDENTIFY;
-    printf("face identify cmd\r\n");
+    LOG_INFO("face identify cmd\r\n");
+    xQueueSend(faceMsgQueue, &msg, 0);
+}
+
+//取消正在进行的人脸识别,生物识别协调在其他方式先匹配时调用
+void FACE_Cancel_Cmd(void)
+{
+    FACE_Msg msg;
+    msg.msgType = FACE_MSG_CANCEL;
     xQueueSend(faceMsgQueue, &msg, 0);
 }
 
+/**
+  * @brief  发送命令并等待应答,只能在人脸识别任务中调用(波特率协商等同步操作)
+  * @param  data: 命令数据,末尾要留1字节放校验码
+  * @param  length: 不含校验码的长度
+  * @param  timeout: 等待应答的时间(ms)
+  * @retval 0: 应答成功; -1: 超时或应答错误
+  */
+static int FACE_Transact(uint8_t *data, uint16_t length, uint32_t timeout)
+{
+    FACE_Msg msg;
+    uint8_t mid = data[2];
+    TickType_t start = xTaskGetTickCount();
+    TickType_t wait = pdMS_TO_TICKS(timeout);
+    TickType_t elapsed;
+    int ret = -1;
+
+    FACE_RxIndex = 0;
+    if (FACE_SendCommand(data, length) != FACE_OK)
+    {
+        return -1;
+    }
+    while ((elapsed = xTaskGetTickCount() - start) < wait)
+    {
+        if (xQueueReceive(faceMsgQueue, &msg, wait - elapsed) != pdPASS)
+        {
+            break;
+        }
+        if (msg.msgType != FACE_MSG_DATA_READY)
+        {
+            continue; /* 同步操作期间的注册/识别请求直接丢弃 */
+        }
+        if (FACE_CheckFrameComplete(FACE_RxBuffer, msg.data) && FACE_RxBuffer[2] == FACE_MID_REPLY
+            && FACE_RxBuffer[5] == mid)
+        {
+            ret = (FACE_RxBuffer[6] == MR_SUCCESS) ? 0 : -1;
+            break;
+        }
+        FACE_RxIndex = 0; /* 模块通知或错误帧,继续等应答 */
+    }
+    FACE_RxIndex = 0;
+    return ret;
+}
+
+/* 查询模块状态,确认当前波特率下能正常通信 */
+static int FACE_Ping(void)
+{
+    uint8_t txBuffer[6] = {0xEF, 0xAA, FACE_CMD_GET_STATUS, 0x00, 0x00};
+
+    return FACE_Transact(txBuffer, 5, FACE_BAUD_CMD_TIMEOUT);
+}
+
+/* 设置模块波特率,模块用原波特率应答后再切换 */
+static int FACE_ConfigBaud(uint8_t index)
+{
+    uint8_t txBuffer[7] = {0xEF, 0xAA, FACE_CMD_CONFIG_BAUDRATE, 0x00, 0x01, 0x00};
+
+    txBuffer[5] = index;
+    return FACE_Transact(txBuffer, 6, FACE_BAUD_CMD_TIMEOUT);
+}
+
+/* 修改串口波特率并重新开始接收 */
+static void FACE_SetBaud(uint32_t baud)
+{
+    if (UART_SetBaudRate(&huart5, baud) != HAL_OK)
+    {
+        Error_Handler();
+    }
+    FACE_RxIndex = 0;
+    HAL_UART_Receive_IT(&huart5, FACE_RxTempBuffer, 1);
+}
+
+/* 用指定波特率查询状态 */
+static int FACE_TryBaud(uint32_t baud)
+{
+    uint8_t i;
+
+    FACE_SetBaud(baud);
+    for (i = 0; i < FACE_PING_RETRY; i++)
+    {
+        if (FACE_Ping() == 0)
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* 查找模块当前的波特率,先试first,不通再从高到低扫描,返回0表示找不到 */
+static uint32_t FACE_FindBaud(uint32_t first)
+{
+    uint8_t i;
+
+    if (FACE_TryBaud(first) == 0)
+    {
+        return first;
+    }
+    for (i = sizeof(FACE_BaudTable) / sizeof(FACE_BaudTable[0]) - 1; i > 0; i--)
+    {
+        if (FACE_BaudTable[i] != first && FACE_TryBaud(FACE_BaudTable[i]) == 0)
+        {
+            return FACE_BaudTable[i];
+        }
+    }
+    return 0;
+}
+
+/**
+  * @brief  波特率协商,在人脸识别任务开始时调用
+  *
+  * 先用上次保存在备份寄存器的波特率查询状态,不通则扫描找到模块当前的波特率;
+  * 不是目标波特率就发MID_CONFIG_BAUDRATE,切换后查询状态确认,不通则重新扫描,
+  * 最终能通信的波特率保存到备份寄存器,下次启动直接使用
+  */
+static void FACE_NegotiateBaud(void)
+{
+    uint32_t target = FACE_BaudTable[FACE_BAUD_MAX_INDEX];
+    uint32_t current;
+
+    current = FACE_FindBaud(UART_LoadBaudRate(RTC_BKP_FACE_BAUD, FACE_BAUD_DEFAULT));
+    if (current != 0 && current != target)
+    {
+        if (FACE_ConfigBaud(FACE_BAUD_MAX_INDEX) != 0)
+        {
+            LOG_ERR("face config baudrate failed, keep %d\r\n", current);
+        }
+        else if (FACE_TryBaud(target) == 0)
+        {
+            current = target;
+        }
+        else
+        {
+            current = FACE_FindBaud(current);
+        }
+        if (current != 0)
+        {
+            FACE_SetBaud(current);
+        }
+    }
+    if (current == 0)
+    {
+        LOG_ERR("face baud negotiation failed, module no answer\r\n");
+        FACE_SetBaud(FACE_BAUD_DEFAULT);
+#if BIO_ENABLE
+        BIO_SetPresent(BIO_FACE, 0);
+#endif
+        return;
+    }
+    FACE_BaudRate = current;
+    UART_SaveBaudRate(RTC_BKP_FACE_BAUD, current);
+    LOG_INFO("face baud rate:%d\r\n", FACE_BaudRate);
+}
+
 /**
   * @brief  人脸识别任务函数
   * @param  argument: 任务参数
@@ -365,13 +642,13 @@ void FACE_Identify_Cmd(void)
   */
 static void FACE_Task(void *argument)
 {
-    printf("FACE_Task started\r\n");
+    LOG_INFO("FACE_Task started\r\n");
     FACE_Msg msg;
-    uint8_t complete = 0;
     faceRxTimer = xTimerCreate("FaceTimer", FACE_RX_TIMEOUT, 
                             pdFALSE, (void*)0, FACE_TimerCallback);
     xTimerStart(faceRxTimer, 0);
     xTimerStop(faceRxTimer, 0);
+    FACE_NegotiateBaud();//协商通信波特率
     FACE_Get_User_Num_Cmd_Send();//获取用户数量
 
     for(;;)
@@ -391,32 +668,13 @@ static void FACE_Task(void *argument)
                     FACE_Identify_Cmd_Send();
                     /* 处理人脸识别消息 */
                     break;
-                //SyncWord(2byte)+MsgID(1byte)+Size(2byte)+Data(Nbyte)+ParityCheck(1byte) 
-                // SyncWord=EFAA   Data(Nbyte)=mid(1byte)+result(1byte)+data(n-byte)
+                case FACE_MSG_CANCEL:
+                    FACE_Reset_Cmd_Send();
+                    break;
                 case FACE_MSG_DATA_READY:
-                    complete = FACE_CheckFrameComplete(msg.data);
-                    if(complete == 0)
-                    {
-                        FACE_RxIndex = 0;
-                        break;
-                    }
-                   uint8_t mid=FACE_RxBuffer[5];
-                   switch(mid)  
-                   {
-                    case FACE_CMD_ENROLL_SINGLE:
-                        FACE_Register_Single_Handle();
-                        break;
-                    case FACE_CMD_VERIFY:
-                        FACE_Identify_Result_Handle();
-                        break;
-                    case FACE_CMD_GET_ALL_USERID:
-                        FACE_Get_User_Num_And_ID_Handle();
-                        break;
-                    default:
+                    FACE_ProcessFrame(FACE_RxBuffer, msg.data);
+                    FACE_RxIndex = 0;
                     break;
-                   }
-                   FACE_RxIndex = 0;
-                break;
                 
                 default:
                     break;
@@ -432,7 +690,7 @@ static void FACE_Task(void *argument)
   */
 void FACE_CreateTask(void)
 {
-    printf("FACE_CreateTask called\r\n");
+    LOG_INFO("FACE_CreateTask called\r\n");
     /* 创建消息队列 */
     faceMsgQueue = xQueueCreate(10, sizeof(FACE_Msg));
     /* 创建人脸识别任务 */
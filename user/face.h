@@ -49,10 +49,13 @@ typedef enum {
 
 typedef enum {
     FACE_CMD_NONE = 0x00,
+    FACE_CMD_RESET = 0x10,
+    FACE_CMD_GET_STATUS = 0x11,
     FACE_CMD_VERIFY = 0x12,
     FACE_CMD_ENROLL = 0x13,
     FACE_CMD_ENROLL_SINGLE = 0x1D,
     FACE_CMD_GET_ALL_USERID = 0x24,
+    FACE_CMD_CONFIG_BAUDRATE = 0x51,
 } FACE_CmdTypeDef;
 
 /* 定义人脸识别返回状态码 */
@@ -93,7 +96,8 @@ typedef enum {
     FACE_MSG_SET_SECURITY,
     FACE_MSG_GET_VERSION,
     FACE_MSG_TIMEOUT,
-    FACE_MSG_DATA_READY
+    FACE_MSG_DATA_READY,
+    FACE_MSG_CANCEL
 } FACE_MsgType;
 
 /* 定义任务消息结构体 */
@@ -121,8 +125,12 @@ FACE_StatusTypeDef FACE_Register(void);          /* 注册人脸 */
 void FACE_IRQ_Callback(void);                               /* UART中断回调函数 */
 void FACE_CreateTask(void);                                 /* 创建人脸识别任务 */
 void FACE_RxCpltCallback(void);                             /* 接收完成回调函数 */
+void FACE_ErrorCallback(void);                              /* 串口错误回调函数 */
+uint32_t FACE_GetBaudRate(void);                            /* 当前通信波特率 */
 void FACE_Register_Cmd(void);                               /* 注册人脸命令 */
 void FACE_Identify_Cmd(void);                               /* 人脸识别命令 */
+void FACE_Cancel_Cmd(void);                                 /* 取消正在进行的识别 */
+int FACE_ProcessFrame(uint8_t *data, uint16_t length);      /* 处理一帧模块消息,主机回放工具也调用 */
 #endif /* FACE_ENABLE */
 
 #ifdef __cplusplus
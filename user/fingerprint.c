@@ -4,15 +4,31 @@
 #include "queue.h"
 #include "fingerprint.h"
 #include "priorities.h"
-#include "sg90.h"
+#include "auth.h"
+#include "bio.h"
 #include "semphr.h"
 #include "timers.h"
+#include "log.h"
+#include "uart.h"
+#include "rtc.h"
+#include "cred.h"
+
+#define LOG_MODULE FP    /* 日志模块名,等级见log_config.h */
 
 #if FINGERPRINT_ENABLE
 
 #define FP_QUEUE_SIZE 20 //队列长度
 #define FP_MAX_BUFFER_SIZE        128     // 最大缓冲区大小
 #define FP_RECEIVE_TIMEOUT pdMS_TO_TICKS(10)  // 定义接收超时时间为10ms
+
+/* 波特率协商 */
+#define FP_BAUD_DEFAULT           57600   // ZW101出厂波特率
+#define FP_BAUD_UNIT              9600    // 波特率寄存器的单位,波特率=N*9600
+#define FP_BAUD_N_MAX             12      // 波特率寄存器最大值,12*9600=115200
+#define FP_BAUD_CMD_TIMEOUT       100     // 协商时每条命令等待应答的时间(ms)
+#define FP_HANDSHAKE_RETRY        3       // 握手重试次数,刚上电时模块可能还没准备好
+#define FP_POWER_OFF_TIME         100     // 重新上电时的断电时间(ms)
+#define FP_POWER_ON_TIME          200     // 上电到模块能接收命令的时间(ms)
 /* 定义全局变量 */
 static UART_HandleTypeDef huart4;             // 指纹模块串口句柄
 static TaskHandle_t FP_TaskHandle = NULL;          // 指纹任务句柄
@@ -30,6 +46,9 @@ static TimerHandle_t FP_Timer = NULL; // 指纹模块定时器
 uint8_t FP_CMD_SEND_RECORD = 0;//发送指令记录,返回数据就是该指令的返回数据
 uint16_t FP_TemplateNum = 0; //有效模板数量
 uint8_t FP_Mode = FP_MODE_IDENTIFY; //指纹模式，注册还是识别,0:识别，1:注册
+static uint16_t FP_EnrollId = 0; //正在注册的模板ID,注册成功后登记到凭据库
+static uint32_t FP_BaudRate = FP_BAUD_DEFAULT; //当前通信波特率
+static volatile uint32_t FP_TouchUs = 0; //手指按下(TOUCH_OUT中断)的时间,作为出示指纹的时间
 
 
 // 指纹上电控制
@@ -150,16 +169,12 @@ uint8_t FP_AtCmdCheck(uint8_t *data, uint16_t length)
     uint16_t original_checksum = (data[length-2] << 8) | data[length-1]; //指令中原本的校验和
     uint16_t original_packet_length = (data[7] << 8) | data[8];// 指令中原本的包长度
 
-    for(i=0;i<length;i++)
-    {
-        printf("%02X ",data[i]);
-    }
-    printf("\r\n");
+    LOG_HEX("FP TX", data, length);
     
     //包长度为指令码+参数+校验和长度，前面的包头、设备地址、包标识、包长度为固定长度9byte
     if(original_packet_length != length-9)
     {
-        printf("packet length error,original_packet_length:%d,length:%d\r\n",original_packet_length,length);
+        LOG_ERR("packet length error,original_packet_length:%d,length:%d\r\n",original_packet_length,length);
         return -1;
     }
     //校验和从包标识到检验和之前，包标识是第七个字节也就是data[6]
@@ -190,17 +205,13 @@ uint8_t FP_AtReturnDataCheck(uint8_t *data,uint16_t length)
     //固定的码数组
     uint8_t fixed_code[7]={0XEF,0X01,0XFF,0XFF,0XFF,0XFF,0X07};
 
-    for(uint16_t i=0;i<length;i++)
-    {
-        printf("%02X ",data[i]);
-    }
-    printf("\r\n");
+    LOG_HEX("FP RX", data, length);
     //检验固定码
     for(uint16_t i=0;i<7;i++)
     {
         if(data[i] != fixed_code[i])
         {
-            printf("fixed code error\r\n");
+            LOG_ERR("fixed code error\r\n");
             return -1;
         }
     }
@@ -209,7 +220,7 @@ uint8_t FP_AtReturnDataCheck(uint8_t *data,uint16_t length)
     uint16_t one_packet_length= 9 + data_length; //固定码+包长度（2byte)=9byte
     if(length < one_packet_length)
     {
-        printf("data length error\r\n");
+        LOG_ERR("data length error\r\n");
         return -1;
     }
     //校验和
@@ -220,7 +231,7 @@ uint8_t FP_AtReturnDataCheck(uint8_t *data,uint16_t length)
     }
     if(checksum != ((data[one_packet_length-2] << 8) | data[one_packet_length-1]))
     {
-        printf("checksum error,checksum:%d,data[length-2]:%d,data[length-1]:%d\r\n",checksum,data[length-2],data[length-1]);
+        LOG_ERR("checksum error,checksum:%d,data[length-2]:%d,data[length-1]:%d\r\n",checksum,data[length-2],data[length-1]);
         return -1;
     }
     return 0;
@@ -229,22 +240,23 @@ uint8_t FP_AtReturnDataCheck(uint8_t *data,uint16_t length)
 //处理有效指纹模板数量返回数据
 // 包头 (2 bytes) + 设备地址 (4 bytes) + 包标识 (1 byte) + 包长度 (2 bytes) + 确认码 (1 byte)\
 // + 有效模板数量 (2 bytes) + 校验和 (2 bytes)
-void FP_HandleValidTemplateNum(uint8_t *data,uint16_t length)
+int FP_HandleValidTemplateNum(uint8_t *data,uint16_t length)
 {
     if(FP_AtReturnDataCheck(data,length) != 0)
     {
-        printf("get valid template num error\r\n");
-        return;
+        LOG_ERR("get valid template num error\r\n");
+        return -1;
     }
     //确认码 00成功 01接收包有错
     if(data[9] != 0X00)
     {
-        printf("confirm code error\r\n");
-        return;
+        LOG_ERR("confirm code error\r\n");
+        return -1;
     }
     //有效模板数量
     FP_TemplateNum = (data[10] << 8) | data[11];
-    printf("valid template num:%d\r\n",FP_TemplateNum);
+    LOG_INFO("valid template num:%d\r\n",FP_TemplateNum);
+    return 0;
 }   
 
 /**
@@ -260,7 +272,7 @@ uint16_t FP_GetValidTemplateNum(void)
     
     if (FP_AtCmdCheck(cmd, sizeof(cmd)) != 0)
     {
-        printf("packck length error\r\n");
+        LOG_ERR("packck length error\r\n");
         return -1;
     }
 
@@ -277,49 +289,55 @@ uint16_t FP_GetValidTemplateNum(void)
  */
 // 包头 (2 bytes) + 设备地址 (4 bytes) + 包标识 (1 byte) + 包长度 (2 bytes) + 确认码 (1 byte)\
 // + 参数 1 (1 byte) + 参数 2 (1 byte) + 校验和 (2 bytes) + 备注 (2 bytes)
-void FP_HandleEnrollACK(uint8_t *data,uint16_t length)
+int FP_HandleEnrollACK(uint8_t *data,uint16_t length)
 {
     // 校验返回数据
     if(FP_AtReturnDataCheck(data,length) != 0)
     {
-        printf("enroll start error\r\n");
-        return;
+        LOG_ERR("enroll start error\r\n");
+        return -1;
     }
     //确认码 00成功 其余错误参考FP_ConfirmCode_t
     if(data[9] != FP_ENROLL_CONFIRM_SUCCESS)
     {
-        printf("enroll error code:%d\r\n",data[9]);
-        return;
+        LOG_ERR("enroll error code:%d\r\n",data[9]);
+        return -1;
     }
     // 参数1，显示注册过程，参考FP_Param1_t，只需要根据进程打印
     switch(data[10])
     {
         case FP_PARAM1_FINGERPRINT_CHECK:
-            printf("fingerprint check\r\n");
+            LOG_INFO("fingerprint check\r\n");
             break;
         case FP_PARAM1_GET_IMAGE:
-            printf("get image\r\n");
+            LOG_INFO("get image\r\n");
             break;
         case FP_PARAM1_GENERATE_FEATURE:
-            printf("generate feature\r\n");
+            LOG_INFO("generate feature\r\n");
             break;
         case FP_PARAM1_JUDGE_FINGER:
-            printf("judge finger\r\n");
+            LOG_INFO("judge finger\r\n");
             break;
         case FP_PARAM1_MERGE_TEMPLATE:
-            printf("merge template\r\n");
+            LOG_INFO("merge template\r\n");
             break;
         case FP_PARAM1_REGISTER_CHECK:
-            printf("register check\r\n");
+            LOG_INFO("register check\r\n");
             break;
         case FP_PARAM1_STORAGE_TEMPLATE:
-            printf("storage template, enroll success\r\n");
+            LOG_INFO("storage template, enroll success\r\n");
             FP_Mode = FP_MODE_IDENTIFY;//注册结束
+            //模板ID登记给管理员
+            if (CRED_AddId(CRED_TYPE_FP, CRED_ADMIN_USER, FP_EnrollId) != 0)
+            {
+                LOG_ERR("fp template %d not saved to cred\r\n", FP_EnrollId);
+            }
             break;
         default:
-            printf("unknown param1\r\n");
+            LOG_INFO("unknown param1\r\n");
             break;
     }
+    return 0;
 }
 /**
  * @brief 开始注册指纹
@@ -344,7 +362,7 @@ int FP_EnrollStart(uint16_t template_id,uint8_t recode_num,uint16_t param)
     cmd[14] = (uint8_t)(param & 0xFF);
     if(FP_AtCmdCheck(cmd, sizeof(cmd)) != 0)
     {
-        printf("packck length error\r\n");
+        LOG_ERR("packck length error\r\n");
         return -1;
     }
     // 发送命令
@@ -353,42 +371,64 @@ int FP_EnrollStart(uint16_t template_id,uint8_t recode_num,uint16_t param)
 }
 
 
+//识别结果交给生物识别协调(bio.c),由它决定是否提交开锁请求
+static void FP_Report(int user)
+{
+#if BIO_ENABLE
+    BIO_Result(BIO_FP, user, FP_TouchUs);
+#else
+    AUTH_Request(AUTH_SRC_FP, user, FP_TouchUs);
+#endif
+}
+
 //处理识别开始返回数据
 // 包头 (2 bytes) + 设备地址 (4 bytes) + 包标识 (1 byte) + 包长度 (2 bytes) + 确认码 (1 byte)\
 // + 参数 (1 byte) + ID号 (2 bytes) + 得分 (2 bytes) + 校验和 (2 bytes)
-void FP_HandleIdentify(uint8_t *data,uint16_t length)
+int FP_HandleIdentify(uint8_t *data,uint16_t length)
 {
+    uint16_t template_id;
+    int user;
+
     // 校验返回数据
     if(FP_AtReturnDataCheck(data,length) != 0)
     {
-        printf("identify error\r\n");
-        return;
+        LOG_ERR("identify error\r\n");
+        return -1;
     }
     //确认码 00成功 其余错误参考 FP_IdentifyConfirmCode_t
     if(data[9] != FP_IDENTIFY_CONFIRM_SUCCESS)
     {
-        printf("identify error code:%d\r\n",data[9]);
-        return;
+        LOG_ERR("identify error code:%d\r\n",data[9]);
+        FP_Report(CRED_NONE);
+        return -1;
     }
     // 参数1，显示识别过程，参考FP_IdentifyParam_t，只需要根据进程打印
     switch(data[10])
     {
         case FP_PARAM_FINGERPRINT_CHECK:
-            printf("fingerprint check\r\n");
+            LOG_INFO("fingerprint check\r\n");
             break;
         case FP_PARAM_GET_IMAGE:
-            printf("get image\r\n");
+            LOG_INFO("get image\r\n");
             break;
         case FP_PARAM_REGISTERED_FINGER_COMPARE:
-            printf("registered finger compare success\r\n");
-            //对比成功，开锁
-            SendLockCommand(LOCK_CMD_OPEN);
+            //对比成功，模板ID对应到用户后开锁
+            template_id = (data[11] << 8) | data[12];
+            user = CRED_MatchId(CRED_TYPE_FP, template_id);
+            if (user == CRED_NONE)
+            {
+                LOG_ERR("template %d not in cred\r\n", template_id);
+                FP_Report(CRED_NONE);
+                return -1;
+            }
+            LOG_INFO("registered finger compare success, template %d user %d\r\n", template_id, user);
+            FP_Report(user);
             break;
         default:
-            printf("unknown param1\r\n");
+            LOG_INFO("unknown param1\r\n");
             break;
     }
-
+    return 0;
 }
 /**
  * @brief 开始识别指纹
@@ -416,7 +456,7 @@ int FP_IdentifyStart(uint8_t score_level,uint16_t template_id,uint16_t param)
 
     if(FP_AtCmdCheck(cmd, sizeof(cmd)) != 0)    
     {
-        printf("packck length error\r\n");
+        LOG_ERR("packck length error\r\n");
         return -1;
     }
     // 发送命令 
@@ -425,12 +465,225 @@ int FP_IdentifyStart(uint8_t score_level,uint16_t template_id,uint16_t param)
     return 0;
 }
 
+/**
+ * @brief 取消模块正在进行的注册/识别(PS_Cancel),模块回到空闲
+ * @return 0: 成功; 其他: 错误码
+ */
+int FP_CancelStart(void)
+{
+    //取消指令 指令码0X30
+    uint8_t cmd[]={0XEF,0X01,0XFF,0XFF,0XFF,0XFF,0X01,0X00,0X03,0X30,0X00,0X34};
+
+    if(FP_AtCmdCheck(cmd, sizeof(cmd)) != 0)
+    {
+        LOG_ERR("packck length error\r\n");
+        return -1;
+    }
+    FP_SendCommand(cmd, sizeof(cmd));
+    return 0;
+}
+
+/**
+ * @brief 处理一帧模块应答,按发出的命令分发,指纹任务和主机回放工具(tools/host)共用
+ * @param type 应答对应的命令,即收到数据时的FP_CMD_SEND_RECORD
+ * @param data 应答数据
+ * @param length 数据长度
+ * @return 0: 应答有效; -1: 校验失败、确认码错误或没有对应的命令
+ */
+int FP_ProcessFrame(FP_MsgType_t type, uint8_t *data, uint16_t length)
+{
+    switch (type)
+    {
+        case FP_MSG_GET_TEMPLATE_NUM:
+            return FP_HandleValidTemplateNum(data, length);
+        case FP_MSG_ENROLL:
+            return FP_HandleEnrollACK(data, length);
+        case FP_MSG_IDENTIFY:
+            return FP_HandleIdentify(data, length);
+        case FP_MSG_HANDSHAKE:
+        case FP_MSG_WRITE_REG:
+        case FP_MSG_CANCEL:
+            if (FP_AtReturnDataCheck(data, length) == 0 && data[9] == FP_ACK_SUCCESS)
+            {
+                return 0;
+            }
+            return -1;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief 发送命令并等待应答,只能在指纹任务中调用(波特率协商等同步操作)
+ * @param cmd 命令包
+ * @param length 命令包长度
+ * @param type 应答对应的消息类型
+ * @param timeout 等待应答的时间(ms)
+ * @return 0: 应答成功(确认码为0); -1: 超时或应答错误
+ */
+static int FP_Transact(uint8_t *cmd, uint16_t length, FP_MsgType_t type, uint32_t timeout)
+{
+    FP_Msg_t msg;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t wait = pdMS_TO_TICKS(timeout);
+    TickType_t elapsed;
+    int ret = -1;
+
+    if (FP_AtCmdCheck(cmd, length) != 0)
+    {
+        return -1;
+    }
+    taskENTER_CRITICAL();
+    FP_RxIndex = 0;
+    taskEXIT_CRITICAL();
+    FP_CMD_SEND_RECORD = type;
+    FP_SendCommand(cmd, length);
+
+    while ((elapsed = xTaskGetTickCount() - start) < wait)
+    {
+        if (xQueueReceive(FP_MsgQueue, &msg, wait - elapsed) != pdPASS)
+        {
+            break;
+        }
+        if (msg.type != type)
+        {
+            continue; //同步操作期间的手指按下等消息直接丢弃
+        }
+        ret = FP_ProcessFrame(type, FP_RxBuffer, msg.param);
+        break;
+    }
+    taskENTER_CRITICAL();
+    FP_RxIndex = 0;
+    taskEXIT_CRITICAL();
+    return ret;
+}
+
+//握手,确认模块在当前波特率下能正常通信
+static int FP_Handshake(void)
+{
+    uint8_t cmd[]={0XEF,0X01,0XFF,0XFF,0XFF,0XFF,0X01,0X00,0X03,FP_CMD_HANDSHAKE,0X00,0X39};
+
+    return FP_Transact(cmd, sizeof(cmd), FP_MSG_HANDSHAKE, FP_BAUD_CMD_TIMEOUT);
+}
+
+//写系统寄存器
+// 包头 (2 bytes) + 设备地址 (4 bytes) + 包标识 (1 byte) + 包长度 (2 bytes) + 指令码 (1 byte)\
+// + 寄存器序号 (1 byte) + 内容 (1 byte) + 校验和 (2 bytes)
+static int FP_WriteReg(uint8_t reg, uint8_t value)
+{
+    uint8_t cmd[]={0XEF,0X01,0XFF,0XFF,0XFF,0XFF,0X01,0X00,0X05,FP_CMD_WRITE_REG,0X00,0X00,0X00,0X00};
+
+    cmd[10] = reg;
+    cmd[11] = value;
+    return FP_Transact(cmd, sizeof(cmd), FP_MSG_WRITE_REG, FP_BAUD_CMD_TIMEOUT);
+}
+
+//修改串口波特率并重新开始接收
+static void FP_SetBaud(uint32_t baud)
+{
+    if (UART_SetBaudRate(&huart4, baud) != HAL_OK)
+    {
+        Error_Handler();
+    }
+    FP_ResetRxBuffer();
+    HAL_UART_Receive_IT(&huart4, FP_RxTempBuffer, 1);
+}
+
+//用指定波特率握手
+static int FP_TryBaud(uint32_t baud)
+{
+    uint8_t i;
+
+    FP_SetBaud(baud);
+    for (i = 0; i < FP_HANDSHAKE_RETRY; i++)
+    {
+        if (FP_Handshake() == 0)
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+//查找模块当前的波特率,先试first,不通再从高到低扫描ZW101支持的全部波特率,返回0表示找不到
+static uint32_t FP_FindBaud(uint32_t first)
+{
+    uint8_t n;
+
+    if (FP_TryBaud(first) == 0)
+    {
+        return first;
+    }
+    for (n = FP_BAUD_N_MAX; n > 0; n--)
+    {
+        if (FP_BAUD_UNIT * n != first && FP_TryBaud(FP_BAUD_UNIT * n) == 0)
+        {
+            return FP_BAUD_UNIT * n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 波特率协商,在指纹任务开始时调用
+ *
+ * 1、先用上次保存在备份寄存器的波特率握手,正常重启只需要一次握手
+ * 2、不通则扫描,找到模块当前的波特率
+ * 3、不是最高波特率就写波特率寄存器,切换后握手确认;不通则给模块重新上电再找
+ *    (有的固件重新上电后才用新波特率),找不到最高波特率时沿用扫描到的波特率
+ * 4、最终能通信的波特率保存到备份寄存器,下次启动直接使用
+ */
+static void FP_NegotiateBaud(void)
+{
+    uint32_t target = FP_BAUD_UNIT * FP_BAUD_N_MAX;
+    uint32_t current;
+
+    current = FP_FindBaud(UART_LoadBaudRate(RTC_BKP_FP_BAUD, FP_BAUD_DEFAULT));
+    if (current != 0 && current != target)
+    {
+        if (FP_WriteReg(FP_REG_BAUD, FP_BAUD_N_MAX) != 0)
+        {
+            LOG_ERR("FP write baud reg failed, keep %d\r\n", current);
+        }
+        else if (FP_TryBaud(target) == 0)
+        {
+            current = target;
+        }
+        else
+        {
+            FP_Power_Off();
+            vTaskDelay(pdMS_TO_TICKS(FP_POWER_OFF_TIME));
+            FP_Power_On();
+            vTaskDelay(pdMS_TO_TICKS(FP_POWER_ON_TIME));
+            current = FP_FindBaud(target);
+        }
+        if (current != 0)
+        {
+            FP_SetBaud(current);
+        }
+    }
+    if (current == 0)
+    {
+        LOG_ERR("FP baud negotiation failed, module no answer\r\n");
+        FP_SetBaud(FP_BAUD_DEFAULT);
+#if BIO_ENABLE
+        BIO_SetPresent(BIO_FP, 0);
+#endif
+        return;
+    }
+    FP_BaudRate = current;
+    UART_SaveBaudRate(RTC_BKP_FP_BAUD, current);
+    LOG_INFO("FP baud rate:%d\r\n", FP_BaudRate);
+}
+
 void FP_TimerCallback(TimerHandle_t xTimer)
 {
     FP_Msg_t msg;
     // 判断是否接收完成
     if (FP_RxIndex != 0)
     {
+        //抓包(调试shell的capture命令打开),用于主机回放
+        LOG_Capture(LOG_CAP_FP, FP_CMD_SEND_RECORD, FP_RxBuffer, FP_RxIndex);
         //发送队列消息
         msg.type = FP_CMD_SEND_RECORD;
         msg.param = FP_RxIndex;
@@ -448,7 +701,7 @@ void FP_TimerCallback(TimerHandle_t xTimer)
 static void FP_Task(void *argument)
 {
     FP_Msg_t msg;
-    BaseType_t xResult;
+    uint8_t frame = 0;                  //本条消息是模块应答帧
         // 上电
     
     //创建一个定时器，并启动
@@ -456,6 +709,9 @@ static void FP_Task(void *argument)
     xTimerStart(FP_Timer, 0);
     xTimerStop(FP_Timer, 0);       // 立即停止定时器，目前还不需要用
 
+    //协商通信波特率
+    FP_NegotiateBaud();
+
     //获取模板数量
     FP_CMD_SEND_RECORD = FP_MSG_GET_TEMPLATE_NUM;
     FP_GetValidTemplateNum();
@@ -471,29 +727,48 @@ static void FP_Task(void *argument)
                     if (FP_Mode == FP_MODE_ENROLL)
                     {
                         FP_CMD_SEND_RECORD = FP_MSG_ENROLL;
-                        FP_EnrollStart(FP_TemplateNum+1,2,0); // ID 1,录入次数2，参数0
+                        FP_EnrollId = FP_TemplateNum+1;
+                        FP_EnrollStart(FP_EnrollId,2,0); // ID 1,录入次数2，参数0
                     }
                     else
                     {
+#if BIO_ENABLE
+                        //唤醒生物识别协调,人脸和指纹同时识别,指纹识别由FP_MSG_REQ_IDENTIFY启动
+                        BIO_Wake(FP_TouchUs);
+#else
+                        if (AUTH_Allow(AUTH_SRC_FP)) // 锁定期间不发识别命令
+                        {
+                            FP_CMD_SEND_RECORD = FP_MSG_IDENTIFY;
+                            FP_IdentifyStart(2,0xffff,0);//分数等级2，搜索所有模板，参数0
+                        }
+#endif
+                    }
+                    break;
+                case FP_MSG_REQ_IDENTIFY:
+                    if (FP_Mode != FP_MODE_ENROLL)
+                    {
                         FP_CMD_SEND_RECORD = FP_MSG_IDENTIFY;
                         FP_IdentifyStart(2,0xffff,0);//分数等级2，搜索所有模板，参数0
                     }
                     break;
-                case FP_MSG_GET_TEMPLATE_NUM:
-                    FP_HandleValidTemplateNum(FP_RxBuffer,msg.param);
+                case FP_MSG_REQ_CANCEL:
+                    FP_CMD_SEND_RECORD = FP_MSG_CANCEL;
+                    FP_CancelStart();
                     break;
-                    
+                case FP_MSG_GET_TEMPLATE_NUM:
                 case FP_MSG_ENROLL:
-                    FP_HandleEnrollACK(FP_RxBuffer,msg.param);
-                    break;
-                    
                 case FP_MSG_IDENTIFY:
-                    FP_HandleIdentify(FP_RxBuffer,msg.param);
+                case FP_MSG_CANCEL:
+                    FP_ProcessFrame(msg.type, FP_RxBuffer, msg.param);
+                    frame = 1;
+                    break;
+
                 default:
                     break;
             }
-            if(msg.type != FP_MSG_FINGER_PRESSED)
+            if(frame) //收到的应答处理完,移走这一帧
             {
+                frame = 0;
                 if(FP_RxIndex > msg.param) //说明处理期间有新的数据
                 {   uint8_t i;
                     taskENTER_CRITICAL(); // 关闭中断，并记录当前中断状态
@@ -535,11 +810,43 @@ void FP_CreateTask(void)
     );
 }
 
+/**
+ * @brief 开始识别,生物识别协调在唤醒时调用,命令由指纹任务发送
+ */
+void FP_Identify_Cmd(void)
+{
+    FP_Msg_t msg;
+
+    msg.type = FP_MSG_REQ_IDENTIFY;
+    msg.param = 0;
+    xQueueSend(FP_MsgQueue, &msg, 0);
+}
+
+/**
+ * @brief 取消正在进行的识别,生物识别协调在其他方式先匹配时调用
+ */
+void FP_Cancel_Cmd(void)
+{
+    FP_Msg_t msg;
+
+    msg.type = FP_MSG_REQ_CANCEL;
+    msg.param = 0;
+    xQueueSend(FP_MsgQueue, &msg, 0);
+}
+
+/**
+ * @brief 获取当前通信波特率
+ */
+uint32_t FP_GetBaudRate(void)
+{
+    return FP_BaudRate;
+}
+
 //注册指纹按键测试
 void FP_EnrollTest(void)
 {
     FP_Mode = FP_MODE_ENROLL;
-    printf("enter enroll mode\r\n");
+    LOG_INFO("enter enroll mode\r\n");
 }
 
 /**
@@ -554,6 +861,7 @@ void FP_IRQ_Callback(void)
     // 检查是否是指纹模块的中断引脚
     if (HAL_GPIO_ReadPin(FP_IRQ_GPIO_Port, FP_IRQ_Pin) == GPIO_PIN_SET)
     {
+        FP_TouchUs = LOG_GetTimeUs();
         //发送队列
         FP_Msg_t msg;
         msg.type = FP_MSG_FINGER_PRESSED;
@@ -569,7 +877,7 @@ void FP_IRQ_Callback(void)
         }
         else
         {
-            printf("system not start\r\n");
+            LOG_ERR("system not start\r\n");
         }
     }
 }
@@ -597,12 +905,23 @@ void Fingerprint_RxCpltCallback(void)
     else
     {
         FP_RxIndex = 0;
-        printf("rtos not start:%x\r\n",FP_RxTempBuffer[0]);
+        LOG_ERR("rtos not start:%x\r\n",FP_RxTempBuffer[0]);
          HAL_UART_Receive_IT(&huart4, FP_RxTempBuffer, 1);
     }
    
 }
 
+/**
+ * @brief 串口错误回调,溢出错误会中止中断接收,这里重新开始接收,在uart.c中调用
+ */
+void Fingerprint_ErrorCallback(void)
+{
+    if (huart4.RxState == HAL_UART_STATE_READY)
+    {
+        HAL_UART_Receive_IT(&huart4, FP_RxTempBuffer, 1);
+    }
+}
+
 /**
  * @brief 检查接收帧是否完整
  * @return 1: 完整; 0: 不完整
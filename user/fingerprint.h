@@ -40,6 +40,11 @@ extern "C" {
 #define FP_CMD_GET_VALID_TEMPLATE_NUM    0x20   // 获取有效模板个数
 #define FP_CMD_AUTO_ENROLL_TEMPLATE      0x31   // 自动注册指纹模板
 #define FP_CMD_AUTO_IDENTIFY             0x32   // 自动验证指纹
+#define FP_CMD_WRITE_REG                 0x0E   // 写系统寄存器
+#define FP_CMD_HANDSHAKE                 0x35   // 握手
+
+/* ZW101系统寄存器 */
+#define FP_REG_BAUD                      4      // 波特率控制,波特率=N*9600,N=1~12
 
 /* ZW101回应定义 */
 #define FP_ACK_SUCCESS               0x00    // 操作成功
@@ -152,6 +157,11 @@ typedef enum {
     FP_MSG_ENROLL,          // 注册指纹
     FP_MSG_IDENTIFY,        // 识别指纹
     FP_MSG_FINGER_PRESSED,  // 手指按下
+    FP_MSG_HANDSHAKE,       // 握手,波特率协商时确认链路
+    FP_MSG_WRITE_REG,       // 写系统寄存器
+    FP_MSG_CANCEL,          // 取消注册/识别
+    FP_MSG_REQ_IDENTIFY,    // 请求开始识别(生物识别协调发给指纹任务)
+    FP_MSG_REQ_CANCEL,      // 请求取消识别
 } FP_MsgType_t;
 
 /**
@@ -182,6 +192,10 @@ int FP_EnrollStart(uint16_t template_id,uint8_t recode_num,uint16_t param);
 
 int FP_IdentifyStart(uint8_t score_level,uint16_t template_id,uint16_t param);
 
+int FP_CancelStart(void);
+void FP_Identify_Cmd(void);
+void FP_Cancel_Cmd(void);
+
 /**
  * @brief 检查手指是否按下
  * @return 1-按下, 0-未按下
@@ -204,7 +218,16 @@ void FP_SetState(FP_State_t state);
  * @brief 外部中断回调函数，用于FP_IRQ_Pin中断
  */
 void FP_IRQ_Callback(void);
+
+/**
+ * @brief 处理一帧模块应答(不含收发),主机回放工具tools/host也调用这个函数
+ * @param type 应答对应的命令
+ * @return 0: 应答有效; -1: 应答错误
+ */
+int FP_ProcessFrame(FP_MsgType_t type, uint8_t *data, uint16_t length);
 void Fingerprint_RxCpltCallback(void);
+void Fingerprint_ErrorCallback(void);
+uint32_t FP_GetBaudRate(void);
 void FP_EnrollTest(void);
 
 #endif /* FINGERPRINT_ENABLE */
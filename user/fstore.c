@@ -0,0 +1,547 @@
+/**
+  ******************************************************************************
+  * @file    fstore.c
+  * @author  cyytx
+  * @brief   Flash记录存储的源文件
+  *          1.扇区开头16字节为扇区头(魔数、序号、序号取反、版本),两个扇区都有效时用序号大的;
+  *          2.记录 = 键(16bit)+长度(16bit) | CRC32 | 数据(补齐到字),长度为0表示删除;
+  *            先写键和数据,最后写CRC,写到一半掉电的记录CRC不对,启动时跳过,旧值仍然有效;
+  *          3.启动时从扇区末尾往前找到最后写过的字作为写入位置,
+  *            从前往后扫描记录重建内存索引(键->记录位置),损坏的部分按字跳过;
+  *          4.写满时整理:擦除另一个扇区,搬入有效记录,最后写扇区头,
+  *            整理中掉电时新扇区没有扇区头,启动后继续用旧扇区。
+  ******************************************************************************
+  */
+#include <string.h>
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "stm32f7xx_hal.h"
+#include "fstore.h"
+#include "log.h"
+
+#define LOG_MODULE FSTORE    /* 日志模块名,等级见log_config.h */
+
+#if (FSTORE_INDEX_SIZE & (FSTORE_INDEX_SIZE - 1)) != 0
+#error "FSTORE_MAX_KEYS must be a power of 2"
+#endif
+#if FSTORE_SECTOR_SIZE > 0x40000
+#error "FSTORE_SECTOR_SIZE must fit in one 256KB sector"
+#endif
+
+#define FSTORE_MAGIC            0x52545346      // "FSTR"
+#define FSTORE_VERSION          1
+#define FSTORE_HDR_SIZE         16              // 扇区头大小
+#define FSTORE_REC_HDR_SIZE     8               // 记录头大小:键+长度,CRC
+#define FSTORE_ERASED           0xFFFFFFFFU
+#define FSTORE_NO_SECTOR        0xFF
+#define FSTORE_INDEX_MASK       (FSTORE_INDEX_SIZE - 1)
+
+#define FSTORE_ALIGN(n)         (((uint32_t)(n) + 3U) & ~3U)
+#define FSTORE_REC_SIZE(len)    (FSTORE_REC_HDR_SIZE + FSTORE_ALIGN(len))
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t seq_inv;           /* ~seq,和seq一起校验扇区头 */
+    uint32_t version;
+} FSTORE_SectorHdr_t;
+
+/* 内存索引槽:键和最新记录在扇区中的字偏移(256KB扇区的字偏移不超过16位) */
+typedef struct {
+    uint16_t key;
+    uint16_t word;
+} FSTORE_Slot_t;
+
+static const uint32_t fstore_addr[2] = {FSTORE_SECTOR0_ADDR, FSTORE_SECTOR1_ADDR};
+static const uint32_t fstore_sector[2] = {FSTORE_SECTOR0, FSTORE_SECTOR1};
+
+static FSTORE_Slot_t fstore_index[FSTORE_INDEX_SIZE];
+static uint8_t fstore_active = FSTORE_NO_SECTOR;   // 当前扇区
+static uint32_t fstore_seq = 0;                     // 当前扇区序号
+static uint32_t fstore_tail = 0;                    // 写入位置(扇区内偏移)
+static FSTORE_Stats_t fstore_stats;
+static SemaphoreHandle_t FSTORE_Mutex = NULL;
+
+/**
+ * @brief CRC32(多项式0xEDB88320,与zlib的crc32相同),半字节查表,审计日志也使用
+ * @param crc 上一段的结果,第一段为0
+ */
+uint32_t FSTORE_Crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static uint32_t FSTORE_RecCrc(uint32_t head, const uint8_t *data, uint16_t len)
+{
+    uint8_t h[4] = {(uint8_t)head, (uint8_t)(head >> 8), (uint8_t)(head >> 16), (uint8_t)(head >> 24)};
+
+    return FSTORE_Crc32(FSTORE_Crc32(0, h, 4), data, len);
+}
+
+static const uint8_t *FSTORE_Ptr(uint8_t s, uint32_t off)
+{
+    return (const uint8_t *)(fstore_addr[s] + off);
+}
+
+static uint32_t FSTORE_Word(uint8_t s, uint32_t off)
+{
+    return *(const volatile uint32_t *)(fstore_addr[s] + off);
+}
+
+static void FSTORE_Lock(void)
+{
+    if (FSTORE_Mutex != NULL)
+    {
+        xSemaphoreTake(FSTORE_Mutex, portMAX_DELAY);
+    }
+}
+
+static void FSTORE_Unlock(void)
+{
+    if (FSTORE_Mutex != NULL)
+    {
+        xSemaphoreGive(FSTORE_Mutex);
+    }
+}
+
+/* Flash区域被修改后,D-Cache中的旧数据作废 */
+static void FSTORE_InvalidateCache(uint32_t addr, uint32_t len)
+{
+    uint32_t start = addr & ~31U;
+    uint32_t end = (addr + len + 31U) & ~31U;
+
+    if (SCB->CCR & SCB_CCR_DC_Msk)
+    {
+        SCB_InvalidateDCache_by_Addr((uint32_t *)start, (int32_t)(end - start));
+    }
+}
+
+/* 按字编程,words个字 */
+static HAL_StatusTypeDef FSTORE_Program(uint32_t addr, const uint32_t *data, uint32_t words)
+{
+    HAL_StatusTypeDef status;
+    uint32_t i;
+
+    status = HAL_FLASH_Unlock();
+    for (i = 0; i < words && status == HAL_OK; i++)
+    {
+        status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr + i * 4U, data[i]);
+    }
+    HAL_FLASH_Lock();
+    FSTORE_InvalidateCache(addr, words * 4U);
+    return status;
+}
+
+static HAL_StatusTypeDef FSTORE_Erase(uint8_t s)
+{
+    HAL_StatusTypeDef status;
+    FLASH_EraseInitTypeDef EraseInitStruct;
+    uint32_t SectorError = 0;
+
+    status = HAL_FLASH_Unlock();
+    if (status == HAL_OK)
+    {
+        // 清除所有Flash标志
+        __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                               FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_ERSERR);
+        EraseInitStruct.TypeErase = FLASH_TYPEERASE_SECTORS;
+        EraseInitStruct.VoltageRange = FLASH_VOLTAGE_RANGE_3; // 2.7V-3.6V,按字擦写
+        EraseInitStruct.Sector = fstore_sector[s];
+        EraseInitStruct.NbSectors = 1;
+        status = HAL_FLASHEx_Erase(&EraseInitStruct, &SectorError);
+    }
+    HAL_FLASH_Lock();
+    FSTORE_InvalidateCache(fstore_addr[s], FSTORE_SECTOR_SIZE);
+    return status;
+}
+
+/* 查找键的索引槽,没有时返回可插入的空槽 */
+static FSTORE_Slot_t *FSTORE_IndexFind(uint16_t key)
+{
+    uint32_t i = ((uint32_t)key * 0x9E3779B1U) >> 16;
+
+    for (;;)
+    {
+        i &= FSTORE_INDEX_MASK;
+        if (fstore_index[i].key == key || fstore_index[i].key == FSTORE_KEY_INVALID)
+        {
+            return &fstore_index[i];
+        }
+        i++;
+    }
+}
+
+/* 索引槽指向的记录的数据长度,0表示已删除 */
+static uint16_t FSTORE_SlotLen(const FSTORE_Slot_t *slot)
+{
+    return (uint16_t)(FSTORE_Word(fstore_active, slot->word * 4U) >> 16);
+}
+
+/* 检查off处是否是完整有效的记录 */
+static int FSTORE_RecValid(uint8_t s, uint32_t off, uint32_t end, uint16_t *key, uint16_t *len)
+{
+    uint32_t head;
+
+    if (off + FSTORE_REC_HDR_SIZE > end)
+    {
+        return 0;
+    }
+    head = FSTORE_Word(s, off);
+    *key = (uint16_t)head;
+    *len = (uint16_t)(head >> 16);
+    if (head == FSTORE_ERASED || *key == FSTORE_KEY_INVALID || *len > FSTORE_DATA_MAX ||
+        off + FSTORE_REC_SIZE(*len) > end)
+    {
+        return 0;
+    }
+    return FSTORE_Word(s, off + 4U) == FSTORE_RecCrc(head, FSTORE_Ptr(s, off + FSTORE_REC_HDR_SIZE), *len);
+}
+
+/* 扫描扇区,重建索引和写入位置 */
+static void FSTORE_Scan(uint8_t s)
+{
+    uint32_t end = FSTORE_SECTOR_SIZE, off = FSTORE_HDR_SIZE, i;
+    FSTORE_Slot_t *slot;
+    uint16_t key, len;
+
+    memset(fstore_index, 0xFF, sizeof(fstore_index));
+    fstore_stats.keys = 0;
+    fstore_stats.live = 0;
+    fstore_active = s;
+    fstore_seq = ((const FSTORE_SectorHdr_t *)FSTORE_Ptr(s, 0))->seq;
+
+    // 最后写过的字之后才是可写的,中间写坏的记录占用的空间不能再写
+    while (end > FSTORE_HDR_SIZE && FSTORE_Word(s, end - 4U) == FSTORE_ERASED)
+    {
+        end -= 4U;
+    }
+    // 最后一条记录末尾的数据可能正好是0xFF,记录可以超出end
+    while (off < end)
+    {
+        if (!FSTORE_RecValid(s, off, FSTORE_SECTOR_SIZE, &key, &len))
+        {
+            fstore_stats.skipped += 4U;
+            off += 4U;
+            continue;
+        }
+        slot = FSTORE_IndexFind(key);
+        if (slot->key == FSTORE_KEY_INVALID)
+        {
+            if (fstore_stats.keys >= FSTORE_MAX_KEYS)
+            {
+                LOG_ERR("fstore: too many keys, %x dropped\r\n", key);
+                off += FSTORE_REC_SIZE(len);
+                continue;
+            }
+            slot->key = key;
+            fstore_stats.keys++;
+        }
+        slot->word = (uint16_t)(off / 4U);
+        off += FSTORE_REC_SIZE(len);
+    }
+    fstore_tail = off > end ? off : end;
+
+    for (i = 0; i < FSTORE_INDEX_SIZE; i++)
+    {
+        if (fstore_index[i].key != FSTORE_KEY_INVALID && (len = FSTORE_SlotLen(&fstore_index[i])) != 0)
+        {
+            fstore_stats.live += FSTORE_REC_SIZE(len);
+        }
+    }
+}
+
+static int FSTORE_SectorValid(uint8_t s)
+{
+    const FSTORE_SectorHdr_t *hdr = (const FSTORE_SectorHdr_t *)FSTORE_Ptr(s, 0);
+
+    return hdr->magic == FSTORE_MAGIC && hdr->version == FSTORE_VERSION && hdr->seq == ~hdr->seq_inv;
+}
+
+static HAL_StatusTypeDef FSTORE_WriteSectorHdr(uint8_t s, uint32_t seq)
+{
+    FSTORE_SectorHdr_t hdr = {FSTORE_MAGIC, seq, ~seq, FSTORE_VERSION};
+
+    return FSTORE_Program(fstore_addr[s], (const uint32_t *)&hdr, sizeof(hdr) / 4U);
+}
+
+/**
+  * @brief  整理:有效记录搬到另一个扇区,丢掉旧值和删除记录
+  *         还没有格式化时只擦除扇区0并写扇区头
+  * @retval 0: 成功; -1: 擦写失败,继续使用原扇区
+  */
+static int FSTORE_Gc(void)
+{
+    uint8_t t = (fstore_active == FSTORE_NO_SECTOR) ? 0 : (uint8_t)(fstore_active ^ 1U);
+    uint32_t start = LOG_GetTimeUs();
+    uint32_t off = FSTORE_HDR_SIZE, i, size;
+    HAL_StatusTypeDef status;
+    const FSTORE_Slot_t *slot;
+    uint16_t len;
+
+    status = FSTORE_Erase(t);
+    for (i = 0; i < FSTORE_INDEX_SIZE && status == HAL_OK; i++)
+    {
+        slot = &fstore_index[i];
+        if (slot->key == FSTORE_KEY_INVALID || (len = FSTORE_SlotLen(slot)) == 0)
+        {
+            continue;
+        }
+        // 记录原样复制,CRC不变
+        size = FSTORE_REC_SIZE(len);
+        status = FSTORE_Program(fstore_addr[t] + off, (const uint32_t *)FSTORE_Ptr(fstore_active, slot->word * 4U),
+                                size / 4U);
+        off += size;
+    }
+    // 扇区头最后写,之前掉电的话这个扇区无效,启动时仍用旧扇区
+    if (status == HAL_OK)
+    {
+        status = FSTORE_WriteSectorHdr(t, fstore_seq + 1U);
+    }
+    if (status != HAL_OK)
+    {
+        LOG_ERR("fstore: gc to sector %d failed %d\r\n", t, status);
+        return -1;
+    }
+    FSTORE_Scan(t);
+    fstore_stats.gcs++;
+    fstore_stats.last_gc_ms = (LOG_GetTimeUs() - start) / 1000U;
+    LOG_INFO("fstore: gc to sector %d, %d bytes live\r\n", t, fstore_stats.live);
+    return 0;
+}
+
+/* 追加一条记录,len为0表示删除,调用者持有锁 */
+static int FSTORE_Append(uint16_t key, const uint8_t *data, uint16_t len)
+{
+    uint32_t buf[FSTORE_ALIGN(FSTORE_DATA_MAX) / 4U];
+    uint32_t head = (uint32_t)key | ((uint32_t)len << 16);
+    uint32_t size = FSTORE_REC_SIZE(len), off, crc, start;
+    FSTORE_Slot_t *slot = FSTORE_IndexFind(key);
+    HAL_StatusTypeDef status;
+    uint16_t old_len;
+
+    if (slot->key == FSTORE_KEY_INVALID && len == 0)
+    {
+        return 0; // 删除不存在的键
+    }
+    if (fstore_active == FSTORE_NO_SECTOR ||
+        (slot->key == FSTORE_KEY_INVALID && fstore_stats.keys >= FSTORE_MAX_KEYS) ||
+        fstore_tail + size > FSTORE_SECTOR_SIZE)
+    {
+        if (FSTORE_Gc() != 0)
+        {
+            return -1;
+        }
+        slot = FSTORE_IndexFind(key);
+        if ((slot->key == FSTORE_KEY_INVALID && fstore_stats.keys >= FSTORE_MAX_KEYS) ||
+            fstore_tail + size > FSTORE_SECTOR_SIZE)
+        {
+            LOG_ERR("fstore: full\r\n");
+            return -1;
+        }
+        if (slot->key == FSTORE_KEY_INVALID && len == 0)
+        {
+            return 0;
+        }
+    }
+
+    start = LOG_GetTimeUs();
+    off = fstore_tail;
+    memset(buf, 0xFF, sizeof(buf));
+    if (len > 0)
+    {
+        memcpy(buf, data, len);
+    }
+    crc = FSTORE_RecCrc(head, (const uint8_t *)buf, len);
+    // 键和长度、数据、CRC依次写入,CRC写完这条记录才生效
+    status = FSTORE_Program(fstore_addr[fstore_active] + off, &head, 1);
+    if (status == HAL_OK && len > 0)
+    {
+        status = FSTORE_Program(fstore_addr[fstore_active] + off + FSTORE_REC_HDR_SIZE, buf, FSTORE_ALIGN(len) / 4U);
+    }
+    if (status == HAL_OK)
+    {
+        status = FSTORE_Program(fstore_addr[fstore_active] + off + 4U, &crc, 1);
+    }
+    // 失败时这段空间也可能写过,不再使用
+    fstore_tail = off + size;
+    if (status != HAL_OK)
+    {
+        LOG_ERR("fstore: program failed %d\r\n", status);
+        return -1;
+    }
+
+    if (slot->key == FSTORE_KEY_INVALID)
+    {
+        slot->key = key;
+        fstore_stats.keys++;
+    }
+    else if ((old_len = FSTORE_SlotLen(slot)) != 0)
+    {
+        fstore_stats.live -= FSTORE_REC_SIZE(old_len);
+    }
+    slot->word = (uint16_t)(off / 4U);
+    if (len > 0)
+    {
+        fstore_stats.live += size;
+    }
+    fstore_stats.writes++;
+    fstore_stats.last_write_us = LOG_GetTimeUs() - start;
+    if (fstore_stats.last_write_us > fstore_stats.max_write_us)
+    {
+        fstore_stats.max_write_us = fstore_stats.last_write_us;
+    }
+    return 0;
+}
+
+/**
+  * @brief  初始化:选择有效扇区,扫描记录重建索引,不擦写Flash
+  *         两个扇区都无效时为空,第一次写入时才格式化
+  */
+void FSTORE_Init(void)
+{
+    uint8_t v0, v1;
+
+    if (FSTORE_Mutex == NULL)
+    {
+        FSTORE_Mutex = xSemaphoreCreateMutex();
+    }
+    memset(&fstore_stats, 0, sizeof(fstore_stats));
+    memset(fstore_index, 0xFF, sizeof(fstore_index));
+    fstore_active = FSTORE_NO_SECTOR;
+    fstore_seq = 0;
+    fstore_tail = 0;
+
+    v0 = FSTORE_SectorValid(0);
+    v1 = FSTORE_SectorValid(1);
+    if (v0 && v1)
+    {
+        // 整理后旧扇区没有擦除,用序号新的
+        FSTORE_Scan((int32_t)(((const FSTORE_SectorHdr_t *)FSTORE_Ptr(1, 0))->seq -
+                              ((const FSTORE_SectorHdr_t *)FSTORE_Ptr(0, 0))->seq) > 0 ? 1 : 0);
+    }
+    else if (v0 || v1)
+    {
+        FSTORE_Scan(v0 ? 0 : 1);
+    }
+    else
+    {
+        LOG_INFO("fstore: empty\r\n");
+        return;
+    }
+    LOG_INFO("fstore: sector %d seq %d, %d keys, %d bytes used\r\n",
+             fstore_active, fstore_seq, fstore_stats.keys, fstore_tail);
+    if (fstore_stats.skipped)
+    {
+        LOG_WARN("fstore: %d bytes of torn records skipped\r\n", fstore_stats.skipped);
+    }
+}
+
+/**
+  * @brief  写入记录,替换该键原来的值
+  * @retval 0: 成功; -1: 参数错误、存储已满或擦写失败
+  */
+int FSTORE_Write(uint16_t key, const void *data, uint16_t len)
+{
+    int ret;
+
+    if (key == FSTORE_KEY_INVALID || len == 0 || len > FSTORE_DATA_MAX)
+    {
+        return -1;
+    }
+    FSTORE_Lock();
+    ret = FSTORE_Append(key, (const uint8_t *)data, len);
+    FSTORE_Unlock();
+    return ret;
+}
+
+/**
+  * @brief  删除记录,键不存在时也返回成功
+  */
+int FSTORE_Delete(uint16_t key)
+{
+    int ret;
+
+    if (key == FSTORE_KEY_INVALID)
+    {
+        return -1;
+    }
+    FSTORE_Lock();
+    ret = FSTORE_Append(key, NULL, 0);
+    FSTORE_Unlock();
+    return ret;
+}
+
+/**
+  * @brief  读取记录
+  * @param  size: buf大小,数据较长时只复制size字节
+  * @retval 数据长度,-1表示不存在
+  */
+int FSTORE_Read(uint16_t key, void *buf, uint16_t size)
+{
+    const FSTORE_Slot_t *slot;
+    uint16_t len;
+    int ret = -1;
+
+    FSTORE_Lock();
+    slot = FSTORE_IndexFind(key);
+    if (slot->key != FSTORE_KEY_INVALID && (len = FSTORE_SlotLen(slot)) != 0)
+    {
+        memcpy(buf, FSTORE_Ptr(fstore_active, slot->word * 4U + FSTORE_REC_HDR_SIZE), len < size ? len : size);
+        ret = len;
+    }
+    FSTORE_Unlock();
+    return ret;
+}
+
+/**
+  * @brief  遍历键在[first, last]范围内的记录,顺序不固定
+  *         回调中不能再调用FSTORE的函数
+  * @retval 遍历的记录数
+  */
+int FSTORE_Foreach(uint16_t first, uint16_t last, FSTORE_Callback cb, void *arg)
+{
+    const FSTORE_Slot_t *slot;
+    uint32_t i;
+    uint16_t len;
+    int n = 0;
+
+    FSTORE_Lock();
+    for (i = 0; i < FSTORE_INDEX_SIZE; i++)
+    {
+        slot = &fstore_index[i];
+        if (slot->key == FSTORE_KEY_INVALID || slot->key < first || slot->key > last ||
+            (len = FSTORE_SlotLen(slot)) == 0)
+        {
+            continue;
+        }
+        n++;
+        if (cb(slot->key, FSTORE_Ptr(fstore_active, slot->word * 4U + FSTORE_REC_HDR_SIZE), len, arg) != 0)
+        {
+            break;
+        }
+    }
+    FSTORE_Unlock();
+    return n;
+}
+
+void FSTORE_GetStats(FSTORE_Stats_t *stats)
+{
+    FSTORE_Lock();
+    *stats = fstore_stats;
+    stats->active = fstore_active;
+    stats->seq = fstore_seq;
+    stats->used = fstore_tail;
+    FSTORE_Unlock();
+}
@@ -0,0 +1,76 @@
+/**
+  ******************************************************************************
+  * @file    fstore.h
+  * @author  cyytx
+  * @brief   Flash记录存储的头文件,扇区6、7轮流使用,只追加写入:
+  *          每条记录带CRC,按字编程,修改一条记录只写几个字;
+  *          一个扇区写满后把有效记录搬到另一个扇区再继续,只有这时才擦除
+  ******************************************************************************
+  */
+
+#ifndef __FSTORE_H
+#define __FSTORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "hard_enable_ctrl.h"
+
+/* 使用的两个扇区,程序不能超过扇区6的起始地址(工程中IROM大小限制为512KB) */
+#define FSTORE_SECTOR0          FLASH_SECTOR_6
+#define FSTORE_SECTOR0_ADDR     0x08080000
+#define FSTORE_SECTOR1          FLASH_SECTOR_7
+#define FSTORE_SECTOR1_ADDR     0x080C0000
+#ifndef FSTORE_SECTOR_SIZE
+#define FSTORE_SECTOR_SIZE      0x40000     /* 每个扇区使用的大小,主机仿真时改小以便频繁整理 */
+#endif
+
+#define FSTORE_DATA_MAX         256         /* 一条记录的最大数据长度 */
+#ifndef FSTORE_MAX_KEYS
+#define FSTORE_MAX_KEYS         1024        /* 最多记录键数(含已删除、未整理的) */
+#endif
+#define FSTORE_INDEX_SIZE       (FSTORE_MAX_KEYS * 2)   /* 内存索引槽数,2的幂 */
+
+/*
+记录键分配,新增使用者在这里登记,0xFFFF保留
+*/
+#define FSTORE_KEY_CRED_SITE    0x0F00      /* 凭据库站点密钥,NFC卡密钥由它分散 */
+#define FSTORE_KEY_CRED_PIN     0x0F01      /* 密码派生参数(盐、迭代次数) */
+#define FSTORE_KEY_CRED_INIT    0x0F02      /* 凭据库已初始化:出厂设置和旧版本密码迁移只做一次 */
+#define FSTORE_KEY_CRED_PHONE   0x0F10      /* 手机钥匙公钥,0x0F10+公钥槽号 */
+#define FSTORE_KEY_CRED_USER    0x1000      /* 凭据库用户,0x1000+用户编号 */
+#define FSTORE_KEY_CRED_ENTRY   0x2000      /* 凭据库凭据,0x2000+凭据记录号 */
+#define FSTORE_KEY_INVALID      0xFFFF
+
+typedef struct {
+    uint8_t active;             /* 当前使用的扇区,0/1,0xFF表示还没有格式化 */
+    uint32_t seq;               /* 当前扇区的序号,每次整理加1 */
+    uint32_t used;              /* 当前扇区已写入字节(含扇区头) */
+    uint32_t live;              /* 有效记录占用字节 */
+    uint16_t keys;              /* 索引中的键数 */
+    uint32_t skipped;           /* 启动扫描时跳过的损坏字节(写入时掉电) */
+    uint32_t writes;            /* 本次启动后写入的记录数 */
+    uint32_t gcs;               /* 本次启动后整理次数 */
+    uint32_t last_write_us;     /* 最近一次写入耗时(不含整理) */
+    uint32_t max_write_us;      /* 最长写入耗时(不含整理) */
+    uint32_t last_gc_ms;        /* 最近一次整理耗时(含擦除) */
+} FSTORE_Stats_t;
+
+/* 遍历记录的回调,data指向Flash中的数据,返回非0停止遍历 */
+typedef int (*FSTORE_Callback)(uint16_t key, const uint8_t *data, uint16_t len, void *arg);
+
+void FSTORE_Init(void);
+int FSTORE_Write(uint16_t key, const void *data, uint16_t len);
+int FSTORE_Delete(uint16_t key);
+int FSTORE_Read(uint16_t key, void *buf, uint16_t size);
+int FSTORE_Foreach(uint16_t first, uint16_t last, FSTORE_Callback cb, void *arg);
+void FSTORE_GetStats(FSTORE_Stats_t *stats);
+uint32_t FSTORE_Crc32(uint32_t crc, const uint8_t *data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FSTORE_H */
@@ -29,6 +29,10 @@ extern "C" {
 /* NFC模块使能控制 */
 #define NFC_ENABLE 1
 
+/* NFC中断引脚使能控制:板上RC522排针的IRQ(5脚)没有连接,飞线到PF10后置1,
+   置0时收发命令期间NFC任务每个tick查询一次RC522 */
+#define NFC_IRQ_ENABLE 0
+
 /* 指纹模块使能控制 */
 #define FINGERPRINT_ENABLE 1
 
@@ -59,6 +63,21 @@ extern "C" {
 /* SD卡使能控制 */
 #define SDCARD_ENABLE 1
 
+/* SD卡开锁审计日志使能控制(需要SDCARD_ENABLE) */
+#define AUDIT_ENABLE 1
+
+/* 人脸和指纹并行识别协调使能控制(需要FACE_ENABLE或FINGERPRINT_ENABLE) */
+#define BIO_ENABLE 1
+
+/* 延迟日志使能控制,1:日志写入环形缓冲区由USART1 DMA发送 0:直接printf */
+#define LOG_ENABLE 1
+
+/* RTC和备份寄存器使能控制 */
+#define RTC_ENABLE 1
+
+/* 调试shell使能控制(USART1接收命令) */
+#define SHELL_ENABLE 1
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,472 @@
+/**
+  ******************************************************************************
+  * @file    iso14443.c
+  * @author  cyytx
+  * @brief   ISO14443A协议层,在nfc.c的PcdTransceive之上实现:
+  *          1.级联防冲突和选卡,支持4/7/10字节UID,多张卡时按CollReg的冲突位逐位区分;
+  *            SELECT用RC522硬件CRC,不再用CalulateCRC往返;
+  *          2.NTAG21x:FAST_READ一帧读多页(受FIFO限制最多15页)、WRITE、PWD_AUTH;
+  *          3.ISO14443-4:RATS/ATS、I块链接收发、R(ACK)、S(WTX)、DESELECT,
+  *            用于DESFire EV2/EV3和手机模拟卡。帧长按FIFO(64字节)限制,
+  *            链接收发时每块直接在调用者的缓冲区和FIFO之间读写,不另外组帧拷贝。
+  *          只用106kbps、不用CID和NAD;出错时不重发,由调用者重新寻卡。
+  ******************************************************************************
+  */
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "iso14443.h"
+
+#if NFC_ENABLE
+
+/* PCB(不带CID和NAD) */
+#define ISO14443_PCB_I              0x02
+#define ISO14443_PCB_CHAIN          0x10
+#define ISO14443_PCB_R_ACK          0xA2
+#define ISO14443_PCB_S_DESELECT     0xC2
+#define ISO14443_PCB_S_WTX          0xF2
+#define ISO14443_CMD_RATS           0xE0
+#define ISO14443_FSCI_DEFAULT       2       /* 没有T0时FSC为32字节 */
+#define ISO14443_WTX_MAX            16      /* 一次收发最多接受的WTX次数,防止卡片一直拖延 */
+
+static const uint8_t iso14443_sel[3] = {PICC_ANTICOLL1, PICC_ANTICOLL2, PICC_ANTICOLL3};
+static const uint16_t iso14443_fsc[9] = {16, 24, 32, 40, 48, 64, 96, 128, 256};
+
+//帧等待时间FWT=302us*2^fwi*wtxm换算成RC522定时器计数,多留2个计数
+static uint16_t ISO14443_Timer(uint8_t fwi, uint8_t wtxm)
+{
+    uint32_t counts = ((302UL << fwi) * wtxm + NFC_TIMER_US - 1U) / NFC_TIMER_US + 2U;
+
+    return counts > 0xFFFFU ? 0xFFFFU : (uint16_t)counts;
+}
+
+//一级防冲突:得到CLn的4字节和BCC(cl[5])。有冲突时选冲突位为1的卡,
+//已确定的位随ANTICOLLISION命令发出,其他卡不再应答,最多32轮
+static char ISO14443_Anticoll(uint8_t sel, uint8_t *cl)
+{
+    NFC_Frame_t tx, rx;
+    uint8_t known = 0;      // 已确定的位数
+    uint8_t nbytes, nbits, keep, coll, pos, round;
+    char status = MI_ERR;
+
+    ClearBitMask(CollReg, 0x80);            // 冲突之后收到的位清零
+    for (round = 0; round <= 32; round++)
+    {
+        nbytes = known / 8;
+        nbits = known % 8;
+        tx.hdr[0] = sel;
+        tx.hdr[1] = (uint8_t)(0x20 + (nbytes << 4) + nbits);   // NVB
+        tx.hdr_len = 2;
+        tx.data = cl;
+        tx.len = nbytes + (nbits ? 1 : 0);
+        keep = cl[nbytes];                  // 不完整字节中已确定的低位,接收时被覆盖
+        rx.hdr_len = 0;
+        rx.data = cl + nbytes;
+        rx.max = 5 - nbytes;
+        // 最后一个字节只发nbits位,接收的第一位放在第nbits位
+        status = PcdTransceive(&tx, &rx, (uint8_t)((nbits << 4) | nbits), 0, NFC_TIMER_RELOAD);
+        if (status != MI_OK && status != MI_COLLERR)
+        {
+            break;
+        }
+        if (nbits)
+        {
+            cl[nbytes] = (uint8_t)((keep & ((1U << nbits) - 1U)) | (cl[nbytes] & (0xFFU << nbits)));
+        }
+        if (status == MI_OK)
+        {
+            if (rx.len != 5 - nbytes || (cl[0] ^ cl[1] ^ cl[2] ^ cl[3]) != cl[4])
+            {
+                status = MI_ERR;
+            }
+            break;
+        }
+        // 冲突位置从接收到的第一个字节的第0位算起(含RxAlign空出的位),从1开始,0表示第32位
+        coll = ReadRawRC(CollReg);
+        pos = coll & 0x1F;
+        if (coll & 0x20)
+        {
+            status = MI_ERR;                // CollPosNotValid
+            break;
+        }
+        if (pos == 0)
+        {
+            pos = 32;
+        }
+        pos += nbytes * 8;                  // 换算成CLn中的位置
+        if (pos <= known || pos > 32)
+        {
+            status = MI_ERR;
+            break;
+        }
+        known = pos;
+        cl[(known - 1) / 8] |= (uint8_t)(1U << ((known - 1) % 8));
+    }
+    SetBitMask(CollReg, 0x80);
+    return status;
+}
+
+/**
+ * @brief 级联防冲突并选卡,卡片需已应答REQA/WUPA
+ * @param card 输出UID、SAK,ISO14443-4参数恢复为默认值
+ * @return MI_OK;没有应答MI_NOTAGERR;其他MI_ERR
+ */
+char ISO14443_Select(ISO14443_Card_t *card)
+{
+    NFC_Frame_t tx, rx;
+    uint8_t cl[5];
+    uint8_t level, sak;
+    char status;
+
+    card->uid_len = 0;
+    ClearBitMask(Status2Reg, 0x08);         // 清MFCrypto1On
+    for (level = 0; level < 3; level++)
+    {
+        memset(cl, 0, sizeof(cl));
+        status = ISO14443_Anticoll(iso14443_sel[level], cl);
+        if (status != MI_OK)
+        {
+            return status;
+        }
+        tx.hdr[0] = iso14443_sel[level];
+        tx.hdr[1] = 0x70;
+        tx.hdr_len = 2;
+        tx.data = cl;
+        tx.len = 5;
+        rx.hdr_len = 0;
+        rx.data = &sak;
+        rx.max = 1;
+        if (PcdTransceive(&tx, &rx, 0, NFC_CRC_BOTH, NFC_TIMER_RELOAD) != MI_OK || rx.len != 1)
+        {
+            return MI_ERR;
+        }
+        if (!(sak & ISO14443_SAK_CASCADE))
+        {
+            memcpy(card->uid + card->uid_len, cl, 4);
+            card->uid_len += 4;
+            card->sak = sak;
+            card->fsc = (uint8_t)iso14443_fsc[ISO14443_FSCI_DEFAULT];
+            card->fwi = ISO14443_FWI_DEFAULT;
+            card->block = 0;
+            return MI_OK;
+        }
+        if (cl[0] != ISO14443_CASCADE_TAG || level == 2)
+        {
+            return MI_ERR;
+        }
+        memcpy(card->uid + card->uid_len, cl + 1, 3);
+        card->uid_len += 3;
+    }
+    return MI_ERR;
+}
+
+/**
+ * @brief 按SAK判断卡片类型,兼容Classic的双界面卡按Classic处理
+ */
+ISO14443_CardType_t ISO14443_Type(const ISO14443_Card_t *card)
+{
+    if (card->sak & ISO14443_SAK_CLASSIC)
+    {
+        return ISO14443_CARD_CLASSIC;
+    }
+    if (card->sak & ISO14443_SAK_ISO4)
+    {
+        return ISO14443_CARD_ISO4;
+    }
+    return card->sak == 0 ? ISO14443_CARD_NTAG : ISO14443_CARD_UNKNOWN;
+}
+
+/**
+ * @brief NTAG GET_VERSION,version输出NTAG_VERSION_SIZE字节
+ */
+char NTAG_GetVersion(uint8_t *version)
+{
+    NFC_Frame_t tx, rx;
+
+    tx.hdr[0] = NTAG_CMD_GET_VERSION;
+    tx.hdr_len = 1;
+    tx.data = NULL;
+    tx.len = 0;
+    rx.hdr_len = 0;
+    rx.data = version;
+    rx.max = NTAG_VERSION_SIZE;
+    if (PcdTransceive(&tx, &rx, 0, NFC_CRC_BOTH, NFC_TIMER_RELOAD) != MI_OK || rx.len != NTAG_VERSION_SIZE)
+    {
+        return MI_ERR;
+    }
+    return MI_OK;
+}
+
+/**
+ * @brief 由GET_VERSION的存储容量字节得到配置页CFG0的页号
+ * @return 页号,0表示不是NTAG213/215/216
+ */
+uint8_t NTAG_ConfigPage(const uint8_t *version)
+{
+    if (version[2] != 0x04)                 // 产品类型NTAG
+    {
+        return 0;
+    }
+    switch (version[6])
+    {
+        case 0x0F: return 0x29;             // NTAG213
+        case 0x11: return 0x83;             // NTAG215
+        case 0x13: return 0xE3;             // NTAG216
+        default:   return 0;
+    }
+}
+
+/**
+ * @brief NTAG FAST_READ,一帧读start~end页
+ * @param data 输出(end-start+1)*4字节
+ */
+char NTAG_FastRead(uint8_t start, uint8_t end, uint8_t *data)
+{
+    NFC_Frame_t tx, rx;
+    uint8_t pages = (uint8_t)(end - start + 1);
+
+    if (end < start || pages > NTAG_FAST_READ_MAX)
+    {
+        return MI_ERR;
+    }
+    tx.hdr[0] = NTAG_CMD_FAST_READ;
+    tx.hdr[1] = start;
+    tx.hdr_len = 2;
+    tx.data = &end;
+    tx.len = 1;
+    rx.hdr_len = 0;
+    rx.data = data;
+    rx.max = pages * NTAG_PAGE_SIZE;
+    if (PcdTransceive(&tx, &rx, 0, NFC_CRC_BOTH, NFC_TIMER_RELOAD) != MI_OK || rx.len != rx.max)
+    {
+        return MI_ERR;                      // NAK是4位应答,没有CRC,也按错误返回
+    }
+    return MI_OK;
+}
+
+/**
+ * @brief NTAG WRITE,写一页(4字节),卡片回4位ACK
+ */
+char NTAG_Write(uint8_t page, const uint8_t *data)
+{
+    NFC_Frame_t tx, rx;
+    uint8_t ack = 0;
+
+    tx.hdr[0] = NTAG_CMD_WRITE;
+    tx.hdr[1] = page;
+    tx.hdr_len = 2;
+    tx.data = (uint8_t *)data;
+    tx.len = NTAG_PAGE_SIZE;
+    rx.hdr_len = 0;
+    rx.data = &ack;
+    rx.max = 1;
+    if (PcdTransceive(&tx, &rx, 0, NFC_CRC_TX, NFC_TIMER_RELOAD) != MI_OK ||
+        rx.len != 1 || (ack & 0x0F) != NTAG_ACK)
+    {
+        return MI_ERR;
+    }
+    return MI_OK;
+}
+
+/**
+ * @brief NTAG PWD_AUTH,卡片回的PACK和pack一致才算成功;失败后卡片回到IDLE,要重新寻卡
+ */
+char NTAG_PwdAuth(const uint8_t *pwd, const uint8_t *pack)
+{
+    NFC_Frame_t tx, rx;
+    uint8_t resp[NTAG_PACK_SIZE];
+
+    tx.hdr[0] = NTAG_CMD_PWD_AUTH;
+    tx.hdr_len = 1;
+    tx.data = (uint8_t *)pwd;
+    tx.len = NTAG_PWD_SIZE;
+    rx.hdr_len = 0;
+    rx.data = resp;
+    rx.max = sizeof(resp);
+    if (PcdTransceive(&tx, &rx, 0, NFC_CRC_BOTH, NFC_TIMER_RELOAD) != MI_OK ||
+        rx.len != NTAG_PACK_SIZE || memcmp(resp, pack, NTAG_PACK_SIZE) != 0)
+    {
+        return MI_ERR;
+    }
+    return MI_OK;
+}
+
+/**
+ * @brief RATS,解析ATS得到FSC、FWI,按SFGI等待后卡片进入ISO14443-4协议
+ */
+char ISO14443_Rats(ISO14443_Card_t *card)
+{
+    NFC_Frame_t tx, rx;
+    uint8_t ats[ISO14443_FRAME_MAX];
+    uint8_t t0, i, sfgi = 0;
+
+    tx.hdr[0] = ISO14443_CMD_RATS;
+    tx.hdr[1] = ISO14443_FSDI << 4;         // CID 0
+    tx.hdr_len = 2;
+    tx.data = NULL;
+    tx.len = 0;
+    rx.hdr_len = 0;
+    rx.data = ats;
+    rx.max = sizeof(ats);
+    if (PcdTransceive(&tx, &rx, 0, NFC_CRC_BOTH, ISO14443_Timer(ISO14443_FWI_DEFAULT, 1)) != MI_OK ||
+        rx.len == 0 || ats[0] != rx.len)
+    {
+        return MI_ERR;
+    }
+    card->fsc = (uint8_t)iso14443_fsc[ISO14443_FSCI_DEFAULT];
+    card->fwi = ISO14443_FWI_DEFAULT;
+    if (ats[0] > 1)
+    {
+        t0 = ats[1];
+        i = 2;
+        card->fsc = (t0 & 0x0F) < 9 && iso14443_fsc[t0 & 0x0F] < ISO14443_FRAME_MAX ?
+                    (uint8_t)iso14443_fsc[t0 & 0x0F] : ISO14443_FRAME_MAX;
+        if (t0 & 0x10)
+        {
+            i++;                            // TA(1),只用106kbps
+        }
+        if ((t0 & 0x20) && i < rx.len)
+        {
+            card->fwi = ats[i] >> 4;        // TB(1)
+            sfgi = ats[i] & 0x0F;
+        }
+    }
+    if (card->fwi > ISO14443_FWI_MAX)
+    {
+        card->fwi = ISO14443_FWI_DEFAULT;
+    }
+    card->block = 0;
+    if (sfgi > 0 && sfgi <= ISO14443_FWI_MAX)
+    {
+        vTaskDelay(pdMS_TO_TICKS((302UL << sfgi) / 1000U) + 1);
+    }
+    return MI_OK;
+}
+
+//发送一个块并接收应答,卡片回S(WTX)时回应同样的WTXM,按延长后的FWT继续等待
+static char ISO14443_Block(ISO14443_Card_t *card, uint8_t pcb, const uint8_t *data, uint8_t len, NFC_Frame_t *rx)
+{
+    NFC_Frame_t tx;
+    uint16_t timer = ISO14443_Timer(card->fwi, 1);
+    uint8_t wtxm, n;
+    char status;
+
+    tx.hdr[0] = pcb;
+    tx.hdr_len = 1;
+    tx.data = (uint8_t *)data;
+    tx.len = len;
+    rx->hdr_len = 1;
+    for (n = 0; n < ISO14443_WTX_MAX; n++)
+    {
+        status = PcdTransceive(&tx, rx, 0, NFC_CRC_BOTH, timer);
+        if (status != MI_OK || (rx->hdr[0] & 0xF7) != ISO14443_PCB_S_WTX)
+        {
+            return status;
+        }
+        wtxm = rx->len == 1 ? (rx->data[0] & 0x3F) : 0;
+        if (wtxm == 0 || wtxm > 59)
+        {
+            return MI_ERR;
+        }
+        tx.hdr[0] = ISO14443_PCB_S_WTX;
+        tx.data = &wtxm;
+        tx.len = 1;
+        timer = ISO14443_Timer(card->fwi, wtxm);
+    }
+    return MI_ERR;
+}
+
+/**
+ * @brief ISO14443-4收发一个APDU。发送超过FSC时分块链接,接收时卡片链接的块依次
+ *        接收到rx中;每块直接从tx/写入rx,不经过中间缓冲区
+ * @param rx_max rx缓冲区大小,卡片返回的数据超过时返回MI_ERR
+ * @param rx_len 输出收到的长度
+ */
+char ISO14443_Exchange(ISO14443_Card_t *card, const uint8_t *tx, uint16_t tx_len,
+                       uint8_t *rx, uint16_t rx_max, uint16_t *rx_len)
+{
+    NFC_Frame_t frame;
+    uint16_t off = 0;
+    uint8_t chunk, pcb;
+    uint8_t inf_max = card->fsc - 3;        // 减去PCB和CRC
+    char status;
+
+    *rx_len = 0;
+    if (rx_max == 0)
+    {
+        return MI_ERR;
+    }
+    frame.data = rx;
+    frame.max = rx_max < ISO14443_INF_MAX ? (uint8_t)rx_max : ISO14443_INF_MAX;
+    while (1)
+    {
+        chunk = tx_len - off > inf_max ? inf_max : (uint8_t)(tx_len - off);
+        pcb = ISO14443_PCB_I | card->block;
+        if (off + chunk < tx_len)
+        {
+            pcb |= ISO14443_PCB_CHAIN;
+        }
+        status = ISO14443_Block(card, pcb, tx + off, chunk, &frame);
+        if (status != MI_OK)
+        {
+            return status;
+        }
+        off += chunk;
+        if (!(pcb & ISO14443_PCB_CHAIN))
+        {
+            break;
+        }
+        // 链接的块卡片回R(ACK),块号和发出的相同
+        if ((frame.hdr[0] & 0xF6) != ISO14443_PCB_R_ACK || (frame.hdr[0] & 0x01) != card->block)
+        {
+            return MI_ERR;
+        }
+        card->block ^= 1;
+    }
+    while (1)
+    {
+        if ((frame.hdr[0] & 0xE2) != ISO14443_PCB_I || (frame.hdr[0] & 0x01) != card->block)
+        {
+            return MI_ERR;
+        }
+        card->block ^= 1;
+        *rx_len += frame.len;
+        if (!(frame.hdr[0] & ISO14443_PCB_CHAIN))
+        {
+            return MI_OK;
+        }
+        if (*rx_len >= rx_max)
+        {
+            return MI_ERR;
+        }
+        // 卡片还有后续块:回R(ACK),下一块接在已收到的数据后面
+        frame.data = rx + *rx_len;
+        frame.max = rx_max - *rx_len < ISO14443_INF_MAX ? (uint8_t)(rx_max - *rx_len) : ISO14443_INF_MAX;
+        status = ISO14443_Block(card, ISO14443_PCB_R_ACK | card->block, NULL, 0, &frame);
+        if (status != MI_OK)
+        {
+            return status;
+        }
+    }
+}
+
+/**
+ * @brief S(DESELECT),卡片进入HALT状态
+ */
+char ISO14443_Deselect(ISO14443_Card_t *card)
+{
+    NFC_Frame_t rx;
+    uint8_t buf[1];
+    char status;
+
+    rx.data = buf;
+    rx.max = sizeof(buf);
+    status = ISO14443_Block(card, ISO14443_PCB_S_DESELECT, NULL, 0, &rx);
+    if (status == MI_OK && (rx.hdr[0] & 0xF7) != ISO14443_PCB_S_DESELECT)
+    {
+        status = MI_ERR;
+    }
+    return status;
+}
+
+#endif /* NFC_ENABLE */
@@ -0,0 +1,93 @@
+/**
+  ******************************************************************************
+  * @file    iso14443.h
+  * @author  cyytx
+  * @brief   ISO14443A协议层头文件:级联防冲突/选卡(4/7/10字节UID)、NTAG21x命令、
+  *          ISO14443-4块传输(RATS、I块链接、WTX)。收发都通过nfc.c的PcdTransceive,
+  *          帧长受RC522 FIFO限制(DEF_FIFO_LENGTH)
+  ******************************************************************************
+  */
+
+#ifndef __ISO14443_H
+#define __ISO14443_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+#include "hard_enable_ctrl.h"
+#include "nfc.h"
+
+#if NFC_ENABLE
+
+#define ISO14443_UID_MAX        10      /* 三重UID */
+#define ISO14443_CASCADE_TAG    0x88    /* UID CLn的第一个字节,表示还有下一级 */
+
+/* SAK */
+#define ISO14443_SAK_CASCADE    0x04    /* UID不完整 */
+#define ISO14443_SAK_CLASSIC    0x08    /* MIFARE Classic(1K/4K/Mini,含兼容Classic的双界面卡) */
+#define ISO14443_SAK_ISO4       0x20    /* 支持ISO14443-4:DESFire、CPU卡、手机模拟卡 */
+
+/* 卡片类型,由SAK判断 */
+typedef enum {
+    ISO14443_CARD_CLASSIC = 0,
+    ISO14443_CARD_NTAG,                 /* SAK为0:Ultralight/NTAG21x */
+    ISO14443_CARD_ISO4,
+    ISO14443_CARD_UNKNOWN
+} ISO14443_CardType_t;
+
+/* ISO14443-4帧长:FSD按FIFO取64字节(FSDI=5),FSC超过FIFO时按FIFO算;
+ * 一帧的INF最多FIFO长度减PCB和CRC */
+#define ISO14443_FSDI           5
+#define ISO14443_FRAME_MAX      DEF_FIFO_LENGTH
+#define ISO14443_INF_MAX        (ISO14443_FRAME_MAX - 3)
+#define ISO14443_FWI_DEFAULT    4       /* 没有TB(1)时的FWI,约4.8ms */
+#define ISO14443_FWI_MAX        14
+
+typedef struct {
+    uint8_t uid[ISO14443_UID_MAX];
+    uint8_t uid_len;        /* 4/7/10 */
+    uint8_t sak;
+    uint8_t fsc;            /* 卡片能接收的最大帧长(含PCB和CRC),RATS之后有效 */
+    uint8_t fwi;            /* 帧等待时间FWT=302us*2^fwi */
+    uint8_t block;          /* PCD当前块号,0/1 */
+} ISO14443_Card_t;
+
+/* NTAG21x */
+#define NTAG_CMD_GET_VERSION    0x60
+#define NTAG_CMD_READ           0x30
+#define NTAG_CMD_FAST_READ      0x3A
+#define NTAG_CMD_WRITE          0xA2
+#define NTAG_CMD_PWD_AUTH       0x1B
+#define NTAG_ACK                0x0A    /* 4位应答 */
+#define NTAG_PAGE_SIZE          4
+#define NTAG_FAST_READ_MAX      ((DEF_FIFO_LENGTH - 2) / NTAG_PAGE_SIZE)    /* 一帧最多15页 */
+#define NTAG_VERSION_SIZE       8
+#define NTAG_PWD_SIZE           4
+#define NTAG_PACK_SIZE          2
+/* 配置页:CFG0(AUTH0在第3字节)、CFG1(ACCESS在第0字节)、PWD、PACK,起始页随型号不同 */
+#define NTAG_AUTH0_OFFSET       3
+#define NTAG_ACCESS_PROT        0x80    /* AUTH0之后的页读写都要认证 */
+
+char ISO14443_Select(ISO14443_Card_t *card);
+ISO14443_CardType_t ISO14443_Type(const ISO14443_Card_t *card);
+
+char NTAG_GetVersion(uint8_t *version);
+uint8_t NTAG_ConfigPage(const uint8_t *version);
+char NTAG_FastRead(uint8_t start, uint8_t end, uint8_t *data);
+char NTAG_Write(uint8_t page, const uint8_t *data);
+char NTAG_PwdAuth(const uint8_t *pwd, const uint8_t *pack);
+
+char ISO14443_Rats(ISO14443_Card_t *card);
+char ISO14443_Exchange(ISO14443_Card_t *card, const uint8_t *tx, uint16_t tx_len,
+                       uint8_t *rx, uint16_t rx_max, uint16_t *rx_len);
+char ISO14443_Deselect(ISO14443_Card_t *card);
+
+#endif /* NFC_ENABLE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ISO14443_H */
@@ -7,6 +7,7 @@
   */
 #include "stdio.h"
 #include "cmsis_os.h"
+#include "timers.h"
 #include <string.h>
 #include "stm32f7xx_hal.h"
 #include "key.h"
@@ -17,13 +18,15 @@
 #include "fingerprint.h"
 #include "priorities.h"
 #include "face.h"
+#include "cred.h"
+#include "auth.h"
+#include "bio.h"
+#include "rtc.h"
+#include "nfc.h"
+#include "log.h"
 
 #if KEY_ENABLE
 
-// 使用最后一个扇区(扇区7)存储密码
-#define FLASH_SECTOR_PASSWORD    FLASH_SECTOR_7      // 使用扇区7存储密码
-#define FLASH_PASSWORD_ADDR      0x080C0000          // 扇区7的起始地址
-
 /* 定义行引脚和列引脚 */
 static const uint16_t KEY_ROW_PINS[] = {KEY_R1_Pin, KEY_R2_Pin, KEY_R3_Pin};
 static const GPIO_TypeDef* KEY_ROW_PORTS[] = {KEY_R1_GPIO_Port, KEY_R2_GPIO_Port, KEY_R3_GPIO_Port};
@@ -31,21 +34,34 @@ static const uint16_t KEY_COL_PINS[] = {KEY_C1_Pin, KEY_C2_Pin, KEY_C3_Pin, KEY_
 static const GPIO_TypeDef* KEY_COL_PORTS[] = {KEY_C1_GPIO_Port, KEY_C2_GPIO_Port, KEY_C3_GPIO_Port, KEY_C4_GPIO_Port};
 
 /* 按键映射表 */
-static const KeyValue_t KEY_MAP[3][4] = {
+static const KeyValue_t KEY_MAP[KEY_ROWS][KEY_COLS] = {
     {KEY_1, KEY_2, KEY_3, KEY_4},
     {KEY_5, KEY_6, KEY_7, KEY_8},
     {KEY_9, KEY_0, KEY_ENTER,KEY_CANCEL}
 };
 
-LockPassword_t lock_passWard; // 门锁密码
 static uint8_t input_password[16];    // 输入密码缓存
 static uint8_t input_password_len = 0; // 输入密码长度
-static uint32_t last_key_time = 0;     // 上次按键时间
-static uint8_t enter_press_count = 0;  // ENTER键连续按下次数，连续按下3次KEY_ENTHER进入密码设置模式
-static uint8_t setting_password_mode = 0; // 是否处于密码设置模式
-
-static uint8_t scanning_flag = 0; // 扫描标志,为1时正在扫描
-static uint8_t row_pressed = 0; // 行按键，标志哪个行按键被按下，减少扫描次数
+static int pin_user = CRED_NONE;       // 最近一次输入的密码对应的用户;一次性密码、密码错误时为CRED_NONE
+static int key_session_pin = CRED_NONE; // 进入设置密码/菜单时确认的用密码开锁的用户,设置密码修改他的密码,回到输入模式时清除
+static int key_session_user = CRED_NONE; // 进入菜单时本次开锁的用户(任何方式),登记卡片给他,回到输入模式时清除
+
+/* 矩阵扫描:TIM7每KEY_SCAN_STEP_US中断一次,读当前列的3个行再切到下一列,4列1ms扫完整个矩阵。
+ * 列电平切换后等一个步长再读,不用在中断里延时。没有键按下时定时器关闭,由行的下降沿中断唤醒 */
+#define KEY_TIM_FREQ_MHZ        96      /* APB1 48MHz,定时器时钟96MHz */
+#define KEY_ROW_EXTI            (KEY_R1_Pin | KEY_R2_Pin | KEY_R3_Pin)  /* 行引脚号就是EXTI线号 */
+
+static TIM_HandleTypeDef htim7;
+static osMessageQueueId_t keyQueueHandle;
+
+static uint8_t  key_col = 0;                    // 正在扫描的列
+static uint16_t key_raw = 0;                    // 本轮扫描的原始采样,bit(row*KEY_COLS+col)为1表示按下
+static uint16_t key_down = 0;                   // 消抖后的按键状态
+static uint8_t  key_integ[KEY_NUM];             // 积分消抖计数,0~KEY_DEBOUNCE_MS
+static uint32_t key_edge_us[KEY_NUM];           // 开始变化的时间,作为事件时间
+static uint32_t key_wake_us = 0;                // 行中断唤醒扫描的时间
+static uint8_t  key_first_scan = 0;             // 唤醒后的第一轮扫描,按下时间取行中断的时间
+static KEY_Stats_t key_stats = {0};
 
 // 键盘任务句柄
 static osThreadId_t keyboardTaskHandle;
@@ -55,7 +71,6 @@ static const osThreadAttr_t keyboard_attributes = {
     .priority = (osPriority_t) TASK_PRIORITY_KEYBOARD,
 };
 
-void ReadPassWardFromFlash(void);
 /**
   * @brief  键盘模块初始化
   * @param  None
@@ -69,8 +84,8 @@ void KEY_Init(void)
     __HAL_RCC_GPIOB_CLK_ENABLE();
     __HAL_RCC_GPIOC_CLK_ENABLE();
     
-    // 配置列引脚为推挽输出+低电平
-    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    // 配置列引脚为开漏输出+低电平。推挽输出时同一行按下两个键会把高低两列短路
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
     GPIO_InitStruct.Pull = GPIO_NOPULL;
     GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
     
@@ -90,6 +105,21 @@ void KEY_Init(void)
         HAL_GPIO_Init((GPIO_TypeDef*)KEY_ROW_PORTS[i], &GPIO_InitStruct);
     }
     
+    /* 扫描定时器,每KEY_SCAN_STEP_US更新一次,先不启动 */
+    __HAL_RCC_TIM7_CLK_ENABLE();
+    htim7.Instance = TIM7;
+    htim7.Init.Prescaler = KEY_TIM_FREQ_MHZ - 1;      // 1MHz
+    htim7.Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim7.Init.Period = KEY_SCAN_STEP_US - 1;
+    htim7.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    HAL_TIM_Base_Init(&htim7);
+    TIM7->SR = 0;
+    __HAL_TIM_ENABLE_IT(&htim7, TIM_IT_UPDATE);
+    HAL_NVIC_SetPriority(TIM7_IRQn, KEY_IRQ_PRIORITY_TIM7, 0); // 和行中断同一优先级,互不打断
+    HAL_NVIC_EnableIRQ(TIM7_IRQn);
+
+    keyQueueHandle = osMessageQueueNew(KEY_EVENT_QUEUE_LEN, sizeof(KEY_Event_t), NULL);
+
     /* EXTI中断初始化 */
     HAL_NVIC_EnableIRQ(EXTI1_IRQn);
     HAL_NVIC_SetPriority(EXTI1_IRQn, KEY_IRQ_PRIORITY_EXTI, 0); //设置中断优先级要低于或等于 configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
@@ -99,77 +129,267 @@ void KEY_Init(void)
     HAL_NVIC_SetPriority(EXTI3_IRQn, KEY_IRQ_PRIORITY_EXTI, 0);
 
     //KEY_CreateTask();
-    //读取密码
-    ReadPassWardFromFlash();
+    //密码保存在凭据库中,由CRED_Init读出
+}
 
+/* 选中一列:这一列输出低,其他列开漏释放,由行的上拉拉高 */
+static void KEY_SelectCol(uint8_t col)
+{
+    for (uint8_t i = 0; i < KEY_COLS; i++)
+    {
+        ((GPIO_TypeDef*)KEY_COL_PORTS[i])->BSRR = (i == col) ? ((uint32_t)KEY_COL_PINS[i] << 16) : KEY_COL_PINS[i];
+    }
+}
+
+/* 所有列输出低,任何键按下都会拉低所在的行 */
+static void KEY_SelectAll(void)
+{
+    for (uint8_t i = 0; i < KEY_COLS; i++)
+    {
+        ((GPIO_TypeDef*)KEY_COL_PORTS[i])->BSRR = (uint32_t)KEY_COL_PINS[i] << 16;
+    }
+}
+
+/* 读当前选中列的各行,返回按下的行(bit0为第1行) */
+static uint8_t KEY_ReadRows(void)
+{
+    uint8_t rows = 0;
+
+    for (uint8_t row = 0; row < KEY_ROWS; row++)
+    {
+        if ((((GPIO_TypeDef*)KEY_ROW_PORTS[row])->IDR & KEY_ROW_PINS[row]) == 0U)
+        {
+            rows |= (uint8_t)(1U << row);
+        }
+    }
+    return rows;
+}
+
+/* 开始扫描,在行中断里调用。扫描期间列电平变化会触发行中断,先关掉 */
+static void KEY_ScanStart(void)
+{
+    EXTI->IMR &= ~(uint32_t)KEY_ROW_EXTI;
+    key_col = 0;
+    key_raw = 0;
+    key_first_scan = 1;
+    KEY_SelectCol(0);
+    TIM7->CNT = 0;
+    TIM7->SR = 0;
+    TIM7->CR1 |= TIM_CR1_CEN;
+    key_stats.wakeups++;
+}
+
+/* 所有键都松开并消抖完成,停止扫描,打开行中断 */
+static void KEY_ScanStop(void)
+{
+    TIM7->CR1 &= ~TIM_CR1_CEN;
+    TIM7->SR = 0;
+    KEY_SelectAll();
+    EXTI->PR = KEY_ROW_EXTI;
+    EXTI->IMR |= KEY_ROW_EXTI;
+    // 刚才最后一列之后按下的键,在打开中断之前已经拉低了行,不会再有下降沿
+    if (KEY_ReadRows() != 0U)
+    {
+        key_wake_us = LOG_GetTimeUs();
+        KEY_ScanStart();
+    }
+}
+
+/* 鬼键:没有二极管的矩阵里,三个键按在矩形的三个角上时第四个角也读到按下,
+ * 这时分不清哪个是真的。任意两行有两个以上相同的列按下就是这种情况 */
+static uint8_t KEY_IsGhost(uint16_t raw)
+{
+    uint16_t r0, r1, common;
+
+    for (uint8_t i = 0; i < KEY_ROWS; i++)
+    {
+        r0 = (uint16_t)((raw >> (i * KEY_COLS)) & ((1U << KEY_COLS) - 1U));
+        for (uint8_t j = (uint8_t)(i + 1U); j < KEY_ROWS; j++)
+        {
+            r1 = (uint16_t)((raw >> (j * KEY_COLS)) & ((1U << KEY_COLS) - 1U));
+            common = r0 & r1;
+            if ((common & (common - 1U)) != 0U)
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static uint8_t KEY_CountBits(uint16_t v)
+{
+    uint8_t n = 0;
+
+    for (; v != 0U; v &= (uint16_t)(v - 1U))
+    {
+        n++;
+    }
+    return n;
+}
+
+/* 发送按下/松开事件,队列满时丢弃并计数 */
+static void KEY_PutEvent(uint8_t idx, uint8_t type, uint32_t now)
+{
+    KEY_Event_t ev;
+
+    ev.key = (uint8_t)KEY_MAP[idx / KEY_COLS][idx % KEY_COLS];
+    ev.type = type;
+    ev.down = KEY_CountBits(key_down);
+    ev.time_us = key_edge_us[idx];
+    if (osMessageQueuePut(keyQueueHandle, &ev, 0U, 0U) != osOK)
+    {
+        key_stats.dropped++;
+        return;
+    }
+    if (type == KEY_EVT_PRESS)
+    {
+        key_stats.last_us = now - ev.time_us;
+        if (key_stats.last_us > key_stats.max_us)
+        {
+            key_stats.max_us = key_stats.last_us;
+        }
+    }
 }
 
 /**
-  * @brief  键盘扫描函数
-  * @param  None
-  * @retval KeyValue_t: 按键值
+  * @brief  一轮扫描结束,每个键做积分消抖:采样为按下时计数加1,松开时减1,
+  *         加到KEY_DEBOUNCE_MS算按下,减到0算松开。抖动只会让计数来回,不会产生事件
+  * @param  raw: 这一轮的原始采样
+  * @retval 1: 还有键按下或没消抖完,继续扫描;0: 可以停止扫描
   */
-KeyValue_t KEY_Scan(void)
+static uint8_t KEY_Debounce(uint16_t raw)
 {
-    KeyValue_t key = KEY_NONE;
-    uint8_t row, col;
+    uint32_t now = LOG_GetTimeUs();
+    uint8_t ghost = KEY_IsGhost(raw);
+    uint8_t busy = 0;
+    uint16_t bit;
 
-    scanning_flag = 1;
+    key_stats.scans++;
+    if (ghost)
+    {
+        key_stats.ghosts++;
+    }
 
-    // 扫描列
-    for(col = 0; col < 4; col++) {
-        // 将当前列置低，其他列置高
-        for(uint8_t i = 0; i < 4; i++) {
-            HAL_GPIO_WritePin((GPIO_TypeDef*)KEY_COL_PORTS[i], KEY_COL_PINS[i], 
-                            i == col ? GPIO_PIN_RESET : GPIO_PIN_SET);
+    for (uint8_t i = 0; i < KEY_NUM; i++)
+    {
+        bit = (uint16_t)(1U << i);
+        if (raw & bit)
+        {
+            if (key_integ[i] == 0U)
+            {
+                key_edge_us[i] = key_first_scan ? key_wake_us : now;
+            }
+            if (key_integ[i] < KEY_DEBOUNCE_MS)
+            {
+                key_integ[i]++;
+            }
         }
-        //printf("col: %d\r\n", col);
-        // 延时等待电平稳定
-        osDelay(pdMS_TO_TICKS(1));
-        
-        // // 检查行状态
-        // for(row = 0; row < 3; row++) {
-        //     if(HAL_GPIO_ReadPin((GPIO_TypeDef*)KEY_ROW_PORTS[row], KEY_ROW_PINS[row]) == GPIO_PIN_RESET) {
-        //         key = KEY_MAP[row][col];
-        //         break;
-        //     }
-        // }
-        if(HAL_GPIO_ReadPin((GPIO_TypeDef*)KEY_ROW_PORTS[row_pressed], KEY_ROW_PINS[row_pressed]) == GPIO_PIN_RESET) {
-                key = KEY_MAP[row_pressed][col];
-                break;
+        else if (key_integ[i] > 0U)
+        {
+            if (key_integ[i] == KEY_DEBOUNCE_MS && (key_down & bit))
+            {
+                key_edge_us[i] = now;
+            }
+            key_integ[i]--;
         }
 
+        if (key_integ[i] == KEY_DEBOUNCE_MS && !(key_down & bit))
+        {
+            if (ghost)
+            {
+                // 有鬼键时不接受新的按下,计数保持在满值,鬼键消失后再判断
+                key_stats.blocked++;
+                busy = 1;
+                continue;
+            }
+            if (key_down != 0U)
+            {
+                key_stats.rollovers++; // 前一个键还没松开又按下一个
+            }
+            key_down |= bit;
+            key_stats.presses++;
+            if (KEY_CountBits(key_down) > key_stats.max_down)
+            {
+                key_stats.max_down = KEY_CountBits(key_down);
+            }
+            KEY_PutEvent(i, KEY_EVT_PRESS, now);
+        }
+        else if (key_integ[i] == 0U && (key_down & bit))
+        {
+            key_down &= (uint16_t)~bit;
+            key_stats.releases++;
+            KEY_PutEvent(i, KEY_EVT_RELEASE, now);
+        }
+        if (key_integ[i] != 0U)
+        {
+            busy = 1;
+        }
     }
-    
-    // 恢复所有列为低电平   
-    for(uint8_t i = 0; i < 4; i++) {
-        HAL_GPIO_WritePin((GPIO_TypeDef*)KEY_COL_PORTS[i], KEY_COL_PINS[i], GPIO_PIN_RESET);
+    key_first_scan = 0;
+    return busy;
+}
+
+/**
+  * @brief  扫描定时器中断:读当前列,切到下一列,4列读完做一次消抖
+  */
+void TIM7_IRQHandler(void)
+{
+    uint8_t rows, busy;
+
+    TIM7->SR = ~TIM_SR_UIF;
+
+    rows = KEY_ReadRows();
+    for (uint8_t row = 0; row < KEY_ROWS; row++)
+    {
+        if (rows & (1U << row))
+        {
+            key_raw |= (uint16_t)(1U << (row * KEY_COLS + key_col));
+        }
+    }
+    if (++key_col < KEY_COLS)
+    {
+        KEY_SelectCol(key_col);
+        return;
     }
 
-    scanning_flag = 0;
-    return key;
+    key_col = 0;
+    busy = KEY_Debounce(key_raw);
+    key_raw = 0;
+    if (busy)
+    {
+        KEY_SelectCol(0);
+    }
+    else
+    {
+        KEY_ScanStop();
+    }
+}
 
+/**
+  * @brief  获取扫描统计
+  */
+void KEY_GetStats(KEY_Stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = key_stats;
+    taskEXIT_CRITICAL();
 }
 
 
 /**
-  * @brief  键盘中断处理函数
+  * @brief  键盘中断处理函数,行的下降沿唤醒扫描
   * @param  GPIO_Pin: 触发中断的引脚
   * @retval None
   */
 void KEY_IRQHandler(uint16_t GPIO_Pin)
 {
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    //printf("irq handler\r\n");
-    if(scanning_flag == 0) //只有在非扫描期间，才能再次触发扫描
+    (void)GPIO_Pin;
+    if ((TIM7->CR1 & TIM_CR1_CEN) == 0U) // 扫描期间的行中断是切换列产生的,忽略
     {
-        // 通知键盘扫描任务
-        vTaskNotifyGiveFromISR(keyboardTaskHandle, &xHigherPriorityTaskWoken);
+        key_wake_us = LOG_GetTimeUs();
+        KEY_ScanStart();
     }
-
-    // 如果需要，进行上下文切换
-    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
-
 }
 
 
@@ -181,7 +401,6 @@ void EXTI1_IRQHandler(void)
     if(__HAL_GPIO_EXTI_GET_IT(KEY_R3_Pin) != RESET)
     {
         __HAL_GPIO_EXTI_CLEAR_IT(KEY_R3_Pin);
-        row_pressed = 2;
         KEY_IRQHandler(KEY_R3_Pin);
     }
 }
@@ -194,7 +413,6 @@ void EXTI2_IRQHandler(void)
     if(__HAL_GPIO_EXTI_GET_IT(KEY_R2_Pin) != RESET)
     {
         __HAL_GPIO_EXTI_CLEAR_IT(KEY_R2_Pin);
-        row_pressed = 1;
         KEY_IRQHandler(KEY_R2_Pin);
     }
 
@@ -208,274 +426,492 @@ void EXTI3_IRQHandler(void)
     if(__HAL_GPIO_EXTI_GET_IT(KEY_R1_Pin) != RESET)
     {
         __HAL_GPIO_EXTI_CLEAR_IT(KEY_R1_Pin);
-        row_pressed = 0;
         KEY_IRQHandler(KEY_R1_Pin);
     }
 
 }
 
 
-// 从Flash读取门锁密码
-void ReadPassWardFromFlash(void)
+/// 修改密码
+static int ChangePassword(uint8_t* new_password, uint8_t length)
 {
-    // 直接从Flash地址读取数据到密码结构体
-    memcpy(&lock_passWard, (void*)FLASH_PASSWORD_ADDR, sizeof(LockPassword_t));
-    
-    // 检查密码是否有效（如果是空Flash，数据会是0xFF）
-    if(lock_passWard.password_len == 0xFF) {
-        // Flash为空，设置默认密码
-        lock_passWard.password_len = 8;
-        lock_passWard.password[0] = 1;
-        lock_passWard.password[1] = 2;
-        lock_passWard.password[2] = 3;
-        lock_passWard.password[3] = 4;
-        lock_passWard.password[4] = 5;
-        lock_passWard.password[5] = 6;
-        lock_passWard.password[6] = 7;
-        lock_passWard.password[7] = 8;
-        printf("Flash is empty, set default password\r\n");
-    } else {
-        printf("Flash is not empty, read password from flash\r\n");
-    }   
-}
-
-// 保存门锁密码到Flash
-HAL_StatusTypeDef SavePassWardToFlash(void)
-{
-    HAL_StatusTypeDef status = HAL_OK;
-    uint32_t FirstSector = 0, NbOfSectors = 0;
-    uint32_t SectorError = 0;
-    FLASH_EraseInitTypeDef EraseInitStruct;
-    
-    // 解锁Flash
-    status = HAL_FLASH_Unlock();
-    if(status != HAL_OK) {
-        return status;
+    // 检查密码长度是否有效
+    if(length == 0 || length > CRED_PIN_MAX || key_session_pin == CRED_NONE) {
+        return -1;
     }
     
-    // 清除所有Flash标志
-    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | 
-                          FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_ERSERR);
-    
-    // 设置要擦除的扇区
-    FirstSector = FLASH_SECTOR_PASSWORD;
-    NbOfSectors = 1;
-    
-    // 填充擦除结构体
-    EraseInitStruct.TypeErase = FLASH_TYPEERASE_SECTORS;
-    EraseInitStruct.VoltageRange = FLASH_VOLTAGE_RANGE_3; // 2.7V-3.6V
-    EraseInitStruct.Sector = FirstSector;
-    EraseInitStruct.NbSectors = NbOfSectors;
-    
-    // 执行擦除操作
-    status = HAL_FLASHEx_Erase(&EraseInitStruct, &SectorError);
-    if(status != HAL_OK) {
-        HAL_FLASH_Lock();
-        return status;
+    // 更新密码,凭据库立即写入Flash
+    return CRED_SetPin((uint16_t)key_session_pin, new_password, length);
+}
+
+
+// 清除输入密码
+void ClearInputPassword(void)
+{
+    memset(input_password, 0, sizeof(input_password));
+    input_password_len = 0;
+}
+
+// 验证密码是否匹配,返回用户编号,CRED_NONE表示密码错误
+// 密码不对时再按一次性密码(TOTP)验证;用一次性密码开锁的用户不能进入密码设置模式
+static int ValidatePassword(void)
+{
+    int user = CRED_MatchPin(input_password, input_password_len);
+
+    pin_user = user;
+    if (user != CRED_NONE)
+    {
+        return user;
     }
-    
-    // 按字节写入数据
-    uint8_t *pData = (uint8_t*)&lock_passWard;
-    uint32_t address = FLASH_PASSWORD_ADDR;
-    
-    for(uint32_t i = 0; i < sizeof(LockPassword_t); i++) {
-        status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_BYTE, address, pData[i]);
-        if(status != HAL_OK) {
-            HAL_FLASH_Lock();
-            return status;
+    return CRED_MatchTotp(input_password, input_password_len, RTC_GetTime());
+}
+
+
+/*************************************** 输入引擎 ***************************************/
+
+#define KEY_DIGITS      0xFFU   // 绑定表里表示任意数字键
+
+typedef int (*KEY_Action_t)(KeyValue_t key);
+
+/* 按键绑定:当前模式下某个键做出某个手势时执行action;action返回非0表示条件不满足,继续查下一条 */
+typedef struct {
+    uint8_t mode;           // KeyMode_t
+    uint8_t gesture;        // KeyGesture_t
+    uint8_t key;            // KeyValue_t或KEY_DIGITS;组合键为先按住的键
+    uint8_t key2;           // 组合键后按的键,其他手势为KEY_NONE
+    uint8_t taps;           // 至少连按几次,0/1表示不要求
+    KEY_Action_t action;
+} KEY_Binding_t;
+
+/* 各模式的名字和无操作超时 */
+typedef struct {
+    const char *name;
+    uint16_t timeout_ms;
+} KEY_ModeDesc_t;
+
+/* 手势识别状态,只在键盘任务中访问 */
+typedef struct {
+    uint8_t  mode;          // KeyMode_t
+    uint8_t  held;          // 按住的键,组合键为先按住的那个;KEY_NONE表示没有
+    uint8_t  hold_state;    // 0:普通按住 1:已触发长按 2:已作为组合键,松开时都不再算单击
+    uint8_t  taps;          // held连续按下的次数
+    uint8_t  last_key;      // 上一次按下的键,用来计算连按
+    uint32_t press_us;      // held按下的时间
+    uint32_t last_press_us;
+} KEY_Input_t;
+
+static KEY_Input_t key_input = {KEY_MODE_ENTRY, KEY_NONE, 0, 0, KEY_NONE, 0, 0};
+static TimerHandle_t key_hold_timer;   // 长按/连发
+static TimerHandle_t key_idle_timer;   // 无操作超时
+
+static const KEY_ModeDesc_t key_modes[KEY_MODE_NUM] = {
+    {"entry", KEY_ENTRY_TIMEOUT_MS},
+    {"admin", KEY_ADMIN_TIMEOUT_MS},
+    {"menu",  KEY_MENU_TIMEOUT_MS},
+};
+
+/* 定时器回调在定时器任务中执行,只发事件,状态都由键盘任务处理 */
+static void KEY_TimerCallback(TimerHandle_t xTimer)
+{
+    KEY_Event_t ev;
+
+    ev.key = KEY_NONE;
+    ev.type = (xTimer == key_hold_timer) ? KEY_EVT_HOLD : KEY_EVT_TIMEOUT;
+    ev.down = 0;
+    ev.time_us = LOG_GetTimeUs();
+    if (osMessageQueuePut(keyQueueHandle, &ev, 0U, 0U) != osOK)
+    {
+        key_stats.dropped++;
+    }
+}
+
+static void KEY_SetMode(uint8_t mode)
+{
+    if (mode != key_input.mode)
+    {
+        printf("Key mode: %s -> %s\r\n", key_modes[key_input.mode].name, key_modes[mode].name);
+        key_input.mode = mode;
+    }
+    if (key_input.held != KEY_NONE)
+    {
+        key_input.hold_state = 2; // 换模式时按着的键,松开和长按都不再按新模式处理
+    }
+    if (mode == KEY_MODE_ENTRY)
+    {
+        key_session_pin = CRED_NONE;
+        key_session_user = CRED_NONE;
+    }
+    ClearInputPassword();
+    key_input.taps = 0;
+    key_input.last_key = KEY_NONE;
+}
+
+/* 输入密码模式下没有输入时不需要超时,其他情况每次操作后重新计时 */
+static void KEY_ArmIdleTimer(void)
+{
+    if (key_input.mode == KEY_MODE_ENTRY && input_password_len == 0)
+    {
+        xTimerStop(key_idle_timer, 0);
+    }
+    else
+    {
+        xTimerChangePeriod(key_idle_timer, pdMS_TO_TICKS(key_modes[key_input.mode].timeout_ms), 0);
+    }
+}
+
+/* 数字键:追加到输入的密码 */
+static int KEY_ActDigit(KeyValue_t key)
+{
+    uint8_t digit = (key == KEY_0) ? 0 : (uint8_t)key; // KEY_1 到 KEY_9 分别对应 1 到 9
+
+    if (input_password_len >= sizeof(input_password))
+    {
+        printf("Password too long! Max 16 digits.\r\n");
+        return 0;
+    }
+    input_password[input_password_len++] = digit;
+    printf("Input: %d, Length: %d\r\n", digit, input_password_len);
+    return 0;
+}
+
+/* 删除最后一位,长按连发 */
+static int KEY_ActBackspace(KeyValue_t key)
+{
+    if (input_password_len == 0)
+    {
+        return 0;
+    }
+    input_password[--input_password_len] = 0;
+    printf("Delete, Length: %d\r\n", input_password_len);
+    return 0;
+}
+
+static int KEY_ActClear(KeyValue_t key)
+{
+    printf("Input cleared\r\n");
+    ClearInputPassword();
+    return 0;
+}
+
+/* 验证输入的密码,没有输入时交给下一条绑定 */
+static int KEY_ActVerify(KeyValue_t key)
+{
+    int user;
+
+    if (input_password_len == 0)
+    {
+        return -1;
+    }
+    if (!AUTH_Allow(AUTH_SRC_KEY))
+    {
+        ClearInputPassword(); // 锁定期间不验证密码
+        return 0;
+    }
+    user = ValidatePassword();
+    if (user != CRED_NONE)
+    {
+        printf("Password correct! User %d, unlocking door.\r\n", user);
+    }
+    else
+    {
+        printf("Password incorrect!\r\n");
+    }
+    AUTH_Request(AUTH_SRC_KEY, user, key_input.press_us); // 提交开锁请求,时间为按下ENTER的时间
+    ClearInputPassword();
+    return 0;
+}
+
+/* 开锁状态下、没有输入时才能进入设置密码和菜单 */
+static int KEY_AdminAllowed(void)
+{
+    return IsDoorUnlocked() && input_password_len == 0;
+}
+
+/* 这次是不是用密码开的锁:授权任务记录的开锁用户和方式要和最近输入的密码对得上,
+ * 指纹、人脸、卡片、手机、一次性密码开的锁都返回CRED_NONE */
+static int KEY_PinUser(void)
+{
+    uint8_t source;
+    int user = AUTH_OpenedBy(&source);
+
+    if (!IsDoorUnlocked() || user == CRED_NONE || source != AUTH_SRC_KEY || user != pin_user)
+    {
+        return CRED_NONE;
+    }
+    return user;
+}
+
+/* 连按三次ENTER进入密码设置模式,只能修改这次用密码开锁的用户自己的密码 */
+static int KEY_ActAdmin(KeyValue_t key)
+{
+    if (key_input.mode == KEY_MODE_ENTRY)
+    {
+        if (!KEY_AdminAllowed())
+        {
+            return -1;
         }
-        address++;
+        key_session_pin = KEY_PinUser();
     }
-    
-    // 锁定Flash
-    HAL_FLASH_Lock();
-    
-    return status;
+    if (key_session_pin == CRED_NONE)
+    {
+        printf("Password setting needs a password unlock\r\n");
+        return 0;
+    }
+    printf("Entering password setting mode...\r\n");
+    KEY_SetMode(KEY_MODE_ADMIN);
+    return 0;
 }
 
-/// 修改密码
-HAL_StatusTypeDef ChangePassword(uint8_t* new_password, uint8_t length)
+/* 开锁状态下单按ENTER,提示还要按几次 */
+static int KEY_ActEnterCount(KeyValue_t key)
 {
-    // 检查密码长度是否有效
-    if(length == 0 || length > 16) {
-        return HAL_ERROR;
+    if (KEY_AdminAllowed())
+    {
+        printf("Enter pressed %d times\r\n", key_input.taps);
     }
-    
-    // 更新密码
-    lock_passWard.password_len = length;
-    memcpy(lock_passWard.password, new_password, length);
-    
-    // 保存到Flash
-    return SavePassWardToFlash();
+    return 0;
 }
 
+static int KEY_ActMenu(KeyValue_t key)
+{
+    if (!KEY_AdminAllowed())
+    {
+        return -1;
+    }
+    printf("Menu: 1 set password, 2 enroll nfc card, CANCEL exit\r\n");
+    KEY_SetMode(KEY_MODE_MENU);
+    key_session_pin = KEY_PinUser(); // 门锁几秒后自动关上,进菜单时先记下
+    key_session_user = AUTH_OpenedBy(NULL);
+    return 0;
+}
 
-// 清除输入密码
-void ClearInputPassword(void)
+static int KEY_ActExit(KeyValue_t key)
 {
-    memset(input_password, 0, sizeof(input_password));
-    input_password_len = 0;
+    KEY_SetMode(KEY_MODE_ENTRY);
+    return 0;
 }
 
-// 验证密码是否匹配
-uint8_t ValidatePassword(void)
+/* 设置模式下ENTER保存新密码 */
+static int KEY_ActSavePin(KeyValue_t key)
 {
-    if (input_password_len != lock_passWard.password_len)
+    if (input_password_len < 4)
     {
-        return 0; // 密码长度不匹配
+        printf("Invalid password length! Must be 4-16 digits.\r\n");
+        return 0;
     }
-    
-    for (uint8_t i = 0; i < input_password_len; i++)
+    printf("Saving new password...\r\n");
+    if (ChangePassword(input_password, input_password_len) == 0)
+    {
+        printf("Password changed successfully!\r\n");
+    }
+    else
+    {
+        printf("Password change failed!\r\n");
+    }
+    KEY_SetMode(KEY_MODE_ENTRY);
+    return 0;
+}
+
+#if NFC_ENABLE
+/* 登记下一张出示的卡给本次开锁的用户,只有管理员可以登记 */
+static int KEY_ActEnrollNfc(KeyValue_t key)
+{
+    CRED_User_t info;
+
+    if (key_session_user == CRED_NONE || CRED_GetUser((uint16_t)key_session_user, &info) != 0 ||
+        !(info.flags & CRED_USER_ADMIN))
+    {
+        printf("Enroll needs an admin unlock\r\n");
+        return 0;
+    }
+    printf("Present card to enroll for user %d\r\n", key_session_user);
+    NFC_EnrollCard((uint16_t)key_session_user);
+    KEY_SetMode(KEY_MODE_ENTRY);
+    return 0;
+}
+#endif
+
+/* 取消键先作为红外触发,红外触发在开发期间不好控制。单击松开时触发,唤醒时间仍按按下的时间算 */
+static int KEY_ActWake(KeyValue_t key)
+{
+#if BIO_ENABLE
+    BIO_Wake(key_input.press_us); // 人脸和指纹同时识别
+#else
+    if (AUTH_Allow(AUTH_SRC_FACE)) // 锁定期间不发识别命令
+    {
+        FACE_Identify_Cmd();
+    }
+#endif
+    return 0;
+}
+
+/* 绑定表,同一模式、手势、按键按顺序匹配,连按次数多的放前面 */
+static const KEY_Binding_t key_bindings[] = {
+    /* 输入密码 */
+    {KEY_MODE_ENTRY, KEY_GES_PRESS,  KEY_DIGITS, KEY_NONE,   0, KEY_ActDigit},
+    {KEY_MODE_ENTRY, KEY_GES_PRESS,  KEY_ENTER,  KEY_NONE,   0, KEY_ActVerify},
+    {KEY_MODE_ENTRY, KEY_GES_PRESS,  KEY_ENTER,  KEY_NONE,   3, KEY_ActAdmin},
+    {KEY_MODE_ENTRY, KEY_GES_PRESS,  KEY_ENTER,  KEY_NONE,   0, KEY_ActEnterCount},
+    {KEY_MODE_ENTRY, KEY_GES_LONG,   KEY_ENTER,  KEY_NONE,   0, KEY_ActMenu},
+    {KEY_MODE_ENTRY, KEY_GES_TAP,    KEY_CANCEL, KEY_NONE,   0, KEY_ActWake},     // 松开时才唤醒,按住取消做组合键时不唤醒
+    {KEY_MODE_ENTRY, KEY_GES_CHORD,  KEY_CANCEL, KEY_ENTER,  0, KEY_ActClear},    // 按住取消再按确认,清除输入
+    /* 设置新密码 */
+    {KEY_MODE_ADMIN, KEY_GES_PRESS,  KEY_DIGITS, KEY_NONE,   0, KEY_ActDigit},
+    {KEY_MODE_ADMIN, KEY_GES_TAP,    KEY_ENTER,  KEY_NONE,   0, KEY_ActSavePin},
+    {KEY_MODE_ADMIN, KEY_GES_TAP,    KEY_CANCEL, KEY_NONE,   0, KEY_ActExit},
+    {KEY_MODE_ADMIN, KEY_GES_LONG,   KEY_CANCEL, KEY_NONE,   0, KEY_ActBackspace},
+    {KEY_MODE_ADMIN, KEY_GES_REPEAT, KEY_CANCEL, KEY_NONE,   0, KEY_ActBackspace},
+    {KEY_MODE_ADMIN, KEY_GES_CHORD,  KEY_ENTER,  KEY_CANCEL, 0, KEY_ActExit},     // 按住确认再按取消,不保存退出
+    /* 菜单 */
+    {KEY_MODE_MENU,  KEY_GES_TAP,    KEY_1,      KEY_NONE,   0, KEY_ActAdmin},
+#if NFC_ENABLE
+    {KEY_MODE_MENU,  KEY_GES_TAP,    KEY_2,      KEY_NONE,   0, KEY_ActEnrollNfc},
+#endif
+    {KEY_MODE_MENU,  KEY_GES_TAP,    KEY_CANCEL, KEY_NONE,   0, KEY_ActExit},
+};
+
+/**
+  * @brief  按当前模式查绑定表执行手势
+  * @retval 0: 有绑定执行了;-1: 没有绑定或条件都不满足
+  */
+static int KEY_Dispatch(uint8_t gesture, uint8_t key, uint8_t key2)
+{
+    const KEY_Binding_t *b;
+    uint8_t mode = key_input.mode;
+
+    for (b = key_bindings; b < key_bindings + sizeof(key_bindings) / sizeof(key_bindings[0]); b++)
+    {
+        if (b->mode != mode || b->gesture != gesture || b->key2 != key2)
+        {
+            continue;
+        }
+        if (b->key != key && !(b->key == KEY_DIGITS && key >= KEY_1 && key <= KEY_0))
+        {
+            continue;
+        }
+        if (b->taps > 1 && key_input.taps < b->taps)
+        {
+            continue;
+        }
+        if (b->action((KeyValue_t)key) == 0)
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void KEY_OnPress(const KEY_Event_t *ev)
+{
+    // 按住一个键时按下另一个键,先查组合键绑定
+    if (key_input.held != KEY_NONE && key_input.held != ev->key)
     {
-        if (input_password[i] != lock_passWard.password[i])
+        if (KEY_Dispatch(KEY_GES_CHORD, key_input.held, ev->key) == 0)
         {
-            return 0; // 密码内容不匹配
+            key_input.hold_state = 2;
+            xTimerStop(key_hold_timer, 0);
+            return;
         }
     }
-    
-    return 1; // 密码匹配
+
+    if (ev->key == key_input.last_key && ev->time_us - key_input.last_press_us < KEY_MULTI_TAP_MS * 1000U)
+    {
+        key_input.taps++;
+    }
+    else
+    {
+        key_input.taps = 1;
+    }
+    key_input.last_key = ev->key;
+    key_input.last_press_us = ev->time_us;
+    key_input.held = ev->key;
+    key_input.hold_state = 0;
+    key_input.press_us = ev->time_us;
+    xTimerChangePeriod(key_hold_timer, pdMS_TO_TICKS(KEY_LONG_MS), 0);
+
+    printf("Key pressed: %d\r\n", ev->key);
+    KEY_Dispatch(KEY_GES_PRESS, ev->key, KEY_NONE);
+}
+
+static void KEY_OnRelease(const KEY_Event_t *ev)
+{
+    uint8_t key = key_input.held;
+
+    if (ev->key != key)
+    {
+        return; // 组合键后按的键,或者已经处理过的键
+    }
+    xTimerStop(key_hold_timer, 0);
+    key_input.held = KEY_NONE;
+    if (key_input.hold_state == 0)
+    {
+        KEY_Dispatch(KEY_GES_TAP, key, KEY_NONE);
+    }
+}
+
+/* 长按和连发:定时器到时发来的事件可能在松开之后才处理,按下的时间不够长就是过期的 */
+static void KEY_OnHold(const KEY_Event_t *ev)
+{
+    uint8_t gesture;
+
+    if (key_input.held == KEY_NONE || key_input.hold_state == 2 ||
+        ev->time_us - key_input.press_us < KEY_LONG_MS * 1000U - 1000U)
+    {
+        return;
+    }
+    gesture = (key_input.hold_state == 0) ? KEY_GES_LONG : KEY_GES_REPEAT;
+    if (KEY_Dispatch(gesture, key_input.held, KEY_NONE) == 0)
+    {
+        key_input.hold_state = 1;
+        xTimerChangePeriod(key_hold_timer, pdMS_TO_TICKS(KEY_REPEAT_MS), 0);
+    }
 }
 
+static void KEY_OnTimeout(void)
+{
+    if (key_input.mode == KEY_MODE_ENTRY)
+    {
+        printf("Input timeout, clearing password\r\n");
+    }
+    else
+    {
+        printf("%s timeout, exiting\r\n", key_modes[key_input.mode].name);
+    }
+    KEY_SetMode(KEY_MODE_ENTRY);
+}
 
 /**
-  * @brief  键盘任务函数
+  * @brief  键盘任务函数:从队列取按键事件和定时器事件,识别手势后查绑定表执行。
+  *         两次按键之间不做任何事,超时由单次定时器准时触发
   * @param  argument: 任务参数
   * @retval None
   */
 void KeyboardScanTask(void *pvParameters)
 {
-    KeyValue_t key = KEY_NONE;
-    uint32_t current_time;
+    KEY_Event_t ev;
 
     while (1)
     {
-        // 等待中断通知，会一直阻塞直到收到通知
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-        
-        // 消除抖动
-        osDelay(pdMS_TO_TICKS(20));// 等待20ms
-        
-        // 执行键盘扫描
-        key = KEY_Scan();
-        
-        // 处理按键事件
-        if (key != KEY_NONE) {
-            printf("Key pressed: %d\r\n", key);
-            
-            current_time = osKernelGetTickCount();
-            
-            // 检查按键间隔
-            if (last_key_time > 0)
-            {
-                if (!setting_password_mode && (current_time - last_key_time) > pdMS_TO_TICKS(6000))
-                {
-                    // 密码输入模式下，两次按键间隔超过6秒，清除已输入密码
-                    printf("Input timeout, clearing password\r\n");
-                    ClearInputPassword();
-                    enter_press_count = 0;
-                }
-                else if (setting_password_mode && (current_time - last_key_time) > pdMS_TO_TICKS(10000))
-                {
-                    // 密码设置模式下，10秒内没有按键操作，退出设置模式
-                    printf("Setting timeout, exiting setting mode\r\n");
-                    setting_password_mode = 0;
-                    ClearInputPassword();
-                    enter_press_count = 0;
-                }
-            }
-            
-            last_key_time = current_time;
-            
-            // 处理按键
-            if (key == KEY_ENTER)
-            {
-                if (setting_password_mode)
-                {
-                    // 密码设置模式下处理ENTER
-                    if (input_password_len >= 4 && input_password_len <= 16)
-                    {
-                        // 保存新密码
-                        printf("Saving new password...\r\n");
-                        ChangePassword(input_password, input_password_len);
-                        printf("Password changed successfully!\r\n");
-                        setting_password_mode = 0;
-                        ClearInputPassword();
-                    }
-                    else
-                    {
-                        printf("Invalid password length! Must be 4-16 digits.\r\n");
-                    }
-                    enter_press_count = 0;
-                }
-                else if (IsDoorUnlocked() && input_password_len == 0)
-                {
-                    // 在解锁状态下连续按三次ENTER进入密码设置模式
-                    enter_press_count++;
-                    printf("Enter pressed %d times\r\n", enter_press_count);
-                    
-                    if (enter_press_count >= 3)
-                    {
-                        printf("Entering password setting mode...\r\n");
-                        setting_password_mode = 1;
-                        enter_press_count = 0;
-                    }
-                }
-                else
-                {
-                    // 验证输入的密码
-                    if (input_password_len > 0)
-                    {
-                        if (ValidatePassword())
-                        {
-                            printf("Password correct! Unlocking door.\r\n");
-                            SendLockCommand(1); // 发送开锁命令
-                            ClearInputPassword();
-                        }
-                        else
-                        {
-                            printf("Password incorrect!\r\n");
-                            ClearInputPassword();
-                        }
-                    }
-                    enter_press_count = 0;
-                }
-            }
-            else if (key == KEY_CANCEL)//先将取消按键作为红外触发，红外触发在开发期间不好控制。
-            {
-                // // 取消键清除当前输入并退出密码设置模式
-                // printf("Input cancelled\r\n");
-                // ClearInputPassword();
-                // setting_password_mode = 0;
-                // enter_press_count = 0;
-                //FP_EnrollTest();
-                //FACE_Register_Cmd();
-                FACE_Identify_Cmd();
-            }
-            else if (key >= KEY_1 && key <= KEY_0)
-            {
-                // 处理数字键输入
-                if (input_password_len < 16)
-                {
-                    uint8_t digit;
-                    if (key == KEY_0)
-                    {
-                        digit = 0;
-                    }
-                    else
-                    {
-                        digit = key; // KEY_1 到 KEY_9 分别对应 1 到 9
-                    }
-                    
-                    input_password[input_password_len++] = digit;
-                    printf("Input: %d, Length: %d\r\n", digit, input_password_len);
-                    enter_press_count = 0;
-                }
-                else
-                {
-                    printf("Password too long! Max 16 digits.\r\n");
-                }
-            }
+        if (osMessageQueueGet(keyQueueHandle, &ev, NULL, osWaitForever) != osOK)
+        {
+            continue;
         }
+        switch (ev.type)
+        {
+            case KEY_EVT_PRESS:
+                KEY_OnPress(&ev);
+                break;
+            case KEY_EVT_RELEASE:
+                KEY_OnRelease(&ev);
+                break;
+            case KEY_EVT_HOLD:
+                KEY_OnHold(&ev);
+                break;
+            default:
+                KEY_OnTimeout();
+                break;
+        }
+        KEY_ArmIdleTimer();
     }
 }
 
@@ -486,7 +922,13 @@ void KeyboardScanTask(void *pvParameters)
   */
 void KEY_CreateTask(void)
 {
+    key_hold_timer = xTimerCreate("KeyHold", pdMS_TO_TICKS(KEY_LONG_MS), pdFALSE, NULL, KEY_TimerCallback);
+    key_idle_timer = xTimerCreate("KeyIdle", pdMS_TO_TICKS(KEY_ENTRY_TIMEOUT_MS), pdFALSE, NULL, KEY_TimerCallback);
     keyboardTaskHandle = osThreadNew(KeyboardScanTask, NULL, &keyboard_attributes);
+    if (keyQueueHandle == NULL || key_hold_timer == NULL || key_idle_timer == NULL || keyboardTaskHandle == NULL)
+    {
+        Error_Handler(); /* 堆不够 */
+    }
 }
 
 #endif /* KEY_ENABLE */
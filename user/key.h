@@ -3,7 +3,8 @@
   ******************************************************************************
   * @file    key.h
   * @author  cyytx
-  * @brief   键盘模块的头文件,包含键盘的初始化、扫描等功能函数声明
+  * @brief   键盘模块的头文件,包含键盘的初始化、扫描等功能函数声明。
+  *          3x4矩阵由TIM7定时扫描,每个键积分消抖,按下/松开事件带时间戳放进队列
   ******************************************************************************
   */
 
@@ -56,21 +57,72 @@ typedef enum {
 } KeyValue_t;
 
 
-// 定义密码结构体
+#define KEY_ROWS                3
+#define KEY_COLS                4
+#define KEY_NUM                 (KEY_ROWS * KEY_COLS)
+#define KEY_SCAN_STEP_US        250     /* 每列的扫描间隔,4列1ms扫完整个矩阵 */
+#define KEY_DEBOUNCE_MS         4       /* 积分消抖:累计4次(4ms)采样为按下才算按下,松开同样 */
+#define KEY_EVENT_QUEUE_LEN     16
+
+typedef enum {
+    KEY_EVT_PRESS = 0,
+    KEY_EVT_RELEASE,
+    KEY_EVT_HOLD,           /* 长按/连发定时器到时,由定时器回调放进队列 */
+    KEY_EVT_TIMEOUT,        /* 无操作超时 */
+} KeyEventType_t;
+
+/* 按键事件,按下/松开由扫描中断放进队列 */
+typedef struct {
+    uint8_t  key;           /* KeyValue_t */
+    uint8_t  type;          /* KeyEventType_t */
+    uint8_t  down;          /* 事件之后还按着的键数 */
+    uint32_t time_us;       /* 开始按下/松开的时间(LOG_GetTimeUs),消抖之前 */
+} KEY_Event_t;
+
 typedef struct {
-    uint8_t password_len;        // 密码长度
-    uint8_t password[16];        // 密码内容，最多16位
-} LockPassword_t;
+    uint32_t wakeups;       /* 行中断唤醒扫描的次数 */
+    uint32_t scans;         /* 整个矩阵的扫描次数 */
+    uint32_t presses;
+    uint32_t releases;
+    uint32_t rollovers;     /* 前一个键没松开又按下一个键 */
+    uint32_t ghosts;        /* 采样到鬼键(矩形的三个角按下)的扫描次数 */
+    uint32_t blocked;       /* 因为鬼键推迟判断按下的次数 */
+    uint32_t dropped;       /* 队列满丢掉的事件 */
+    uint8_t  max_down;      /* 同时按下的最多键数 */
+    uint32_t last_us;       /* 最近一次按下:开始按下到事件入队的时间 */
+    uint32_t max_us;
+} KEY_Stats_t;
+
+/* 输入引擎:按键事件识别成手势,按当前模式查绑定表执行 */
+#define KEY_LONG_MS             800     /* 按住超过这个时间为长按 */
+#define KEY_REPEAT_MS           200     /* 长按之后的连发间隔 */
+#define KEY_MULTI_TAP_MS        1500    /* 同一个键两次按下间隔小于这个时间算连按 */
+#define KEY_ENTRY_TIMEOUT_MS    6000    /* 输入密码时无操作超时,清除已输入的密码 */
+#define KEY_ADMIN_TIMEOUT_MS    10000   /* 设置密码时无操作超时,退出设置 */
+#define KEY_MENU_TIMEOUT_MS     10000   /* 菜单无操作超时,退出菜单 */
+
+typedef enum {
+    KEY_MODE_ENTRY = 0,     /* 输入密码开锁 */
+    KEY_MODE_ADMIN,         /* 设置新密码 */
+    KEY_MODE_MENU,          /* 开锁状态下的管理菜单 */
+    KEY_MODE_NUM
+} KeyMode_t;
 
+typedef enum {
+    KEY_GES_PRESS = 0,      /* 按下,立即响应,带连按次数 */
+    KEY_GES_TAP,            /* 没有长按、没有组合就松开 */
+    KEY_GES_LONG,           /* 按住KEY_LONG_MS */
+    KEY_GES_REPEAT,         /* 长按之后每KEY_REPEAT_MS一次 */
+    KEY_GES_CHORD,          /* 按住一个键再按另一个键 */
+} KeyGesture_t;
 
 /* 键盘相关函数声明 */
 void KEY_Init(void);
-KeyValue_t KEY_Scan(void);
 void KEY_IRQHandler(uint16_t GPIO_Pin);
+void KEY_GetStats(KEY_Stats_t *stats);
 
 /* 任务相关声明 */
 void KEY_CreateTask(void);
-void ReadPassWardFromFlash(void);
 
 #endif /* KEY_ENABLE */
 
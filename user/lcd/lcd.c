@@ -8,6 +8,9 @@
 #include "lcd_font.h"  // 字体文件
 #include "camera.h"
 #include "priorities.h"
+#include "log.h"
+
+#define LOG_MODULE LCD    /* 日志模块名,等级见log_config.h */
 
 
 /* 显示任务参数结构体 
@@ -612,7 +615,7 @@ void vDisplayTask(void *pvParameters)
                     xDisplayParams.transferred += send_data_num;
                 } else  {
                       // 超时处理
-                    printf("DMA transfer timeout!\r\n");
+                    LOG_ERR("DMA transfer timeout!\r\n");
                     g_dma_transfer_in_progress = 0;  // 重置DMA状态
                     // 可以在这里添加重试逻辑或错误处理
                     break;
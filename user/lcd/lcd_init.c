@@ -7,6 +7,9 @@
   */
 #include "lcd_init.h"
 #include "priorities.h"
+#include "log.h"
+
+#define LOG_MODULE LCD    /* 日志模块名,等级见log_config.h */
 
 #if LCD_ENABLE
 
@@ -122,37 +125,37 @@ void Print_DMA_Error(SPI_HandleTypeDef *hspi)
 {
     // 检查SPI错误标志
     if (__HAL_SPI_GET_FLAG(hspi, SPI_FLAG_MODF)) {
-        printf("SPI Mode Fault Error\r\n");
+        LOG_ERR("SPI Mode Fault Error\r\n");
     }
     if (__HAL_SPI_GET_FLAG(hspi, SPI_FLAG_OVR)) {
-        printf("SPI Overrun Error\r\n");
+        LOG_ERR("SPI Overrun Error\r\n");
     }
     if (__HAL_SPI_GET_FLAG(hspi, SPI_FLAG_FRE)) {
-        printf("SPI Frame Format Error\r\n");
+        LOG_ERR("SPI Frame Format Error\r\n");
     }
     if (__HAL_SPI_GET_FLAG(hspi, SPI_FLAG_CRCERR)) {
-        printf("SPI CRC Error\r\n");
+        LOG_ERR("SPI CRC Error\r\n");
     }
 
     // 检查DMA错误标志
     DMA_HandleTypeDef *hdma = hspi->hdmatx; // 获取DMA句柄
     if (hdma->ErrorCode != HAL_DMA_ERROR_NONE) {
         if (hdma->ErrorCode & HAL_DMA_ERROR_TE) {
-            printf("DMA Transfer Error\r\n");
+            LOG_ERR("DMA Transfer Error\r\n");
         }
         if (hdma->ErrorCode & HAL_DMA_ERROR_FE) {
-            printf("DMA FIFO Error\r\n");
+            LOG_ERR("DMA FIFO Error\r\n");
            //__HAL_DMA_DISABLE_IT(&hdma_spi_tx, DMA_IT_FE);  // 关闭FIFO错误中断[[1]][[7]]
 
         }
         if (hdma->ErrorCode & HAL_DMA_ERROR_DME) {
-            printf("DMA Direct Mode Error\r\n");
+            LOG_ERR("DMA Direct Mode Error\r\n");
         }
         if (hdma->ErrorCode & HAL_DMA_ERROR_TIMEOUT) {
-            printf("DMA Timeout Error\r\n");
+            LOG_ERR("DMA Timeout Error\r\n");
         }
         if (hdma->ErrorCode & HAL_DMA_ERROR_NO_XFER) {
-            printf("DMA No Transfer Error\r\n");
+            LOG_ERR("DMA No Transfer Error\r\n");
         }
     }
 
@@ -170,7 +173,7 @@ void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
 {
     if (hspi->Instance == SPI2) // 确保是SPI2触发的回调
     {
-        printf("SPI2 DMA Error Detected!\r\n");
+        LOG_ERR("SPI2 DMA Error Detected!\r\n");
         Print_DMA_Error(hspi); // 打印详细的错误信息
     }
 }
@@ -0,0 +1,623 @@
+/**
+  ******************************************************************************
+  * @file    log.c
+  * @author  cyytx
+  * @brief   延迟二进制日志模块的源文件
+  *          1.日志调用只把 时间戳+格式字符串token+参数 拷贝进环形缓冲区,不做格式化,
+  *            不等待串口,任务和中断中都可以调用;
+  *          2.缓冲区用LDREX/STREX实现无锁预留,多个写者(任务被中断打断)互不阻塞;
+  *          3.USART1 TX DMA(DMA2 Stream7 Channel4)在后台把已提交的数据发出去;
+  *          4.主机端用tools/log_decode.py配合tools/log_dict.py生成的字典还原出文本。
+  ******************************************************************************
+  */
+#include <string.h>
+#include "log.h"
+#include "uart.h"
+#include "priorities.h"
+
+extern TIM_HandleTypeDef htim6;
+
+/**
+ * @brief 获取微秒时间戳,由HAL时基(TIM6,1MHz计数,1ms溢出)拼出来,约71分钟回绕一次
+ * @note  在优先级高于TIM6的中断里调用时,TIM6溢出中断可能还没处理,需要补1ms
+ */
+uint32_t LOG_GetTimeUs(void)
+{
+    uint32_t ms, cnt;
+
+    do {
+        ms = HAL_GetTick();
+        cnt = TIM6->CNT;
+    } while (ms != HAL_GetTick());
+
+    if ((TIM6->SR & TIM_SR_UIF) && cnt < 500U)
+    {
+        ms++;
+    }
+    return ms * 1000U + cnt;
+}
+
+/* 轮询方式发送一个字节,用于LOG_Init之前和异常处理中 */
+static void LOG_PollSend(uint8_t ch)
+{
+    while((USART1->ISR & 0X40) == 0);   //循环发送,直到发送完毕
+    USART1->TDR = ch;
+}
+
+#if LOG_ENABLE
+
+extern UART_HandleTypeDef huart1;
+static DMA_HandleTypeDef hdma_usart1_tx;    // USART1 TX DMA句柄
+
+#define LOG_RING_MASK           (LOG_RING_SIZE - 1U)
+#define LOG_STATE_HEAD_MASK     0x0000FFFFUL
+#define LOG_STATE_WRITER        (1UL << 16)
+#define LOG_STATE_WRITER_MASK   0x00FF0000UL
+#define LOG_STATE_SEQ           (1UL << 24)
+
+static uint8_t log_ring[LOG_RING_SIZE] __attribute__((aligned(32)));
+/*
+log_state 打包了三个字段,一次STREX同时更新:
+  [15:0]  预留位置(自由递增,取模后才是下标)
+  [23:16] 正在写入的写者数量
+  [31:24] 记录序号
+单核上写者只会被更高优先级的写者打断,后来的写者一定先写完(后进先出),
+所以当写者数量减到0时,所有已预留的区域都已写完,可以整体提交。
+*/
+static volatile uint32_t log_state = 0;
+static volatile uint16_t log_commit = 0;    /* 已提交位置,DMA只发送到这里 */
+static volatile uint16_t log_tail = 0;      /* 发送位置,只有DMA完成回调修改 */
+static volatile uint16_t log_dma_len = 0;   /* 当前DMA发送的长度 */
+static volatile uint32_t log_dma_busy = 0;  /* DMA占用标志 */
+static volatile uint8_t log_running = 0;    /* 0:轮询发送 1:DMA后台发送 */
+static LOG_Stats_t log_stats;               /* 统计信息,仅用于调试,不保证严格原子 */
+static volatile uint32_t log_capture = 0;   /* 抓包通道掩码,调试shell的capture命令设置 */
+
+static void LOG_Kick(void);
+
+/**
+ * @brief 在环形缓冲区中预留len字节
+ * @param len: 预留长度
+ * @param pos: 返回预留的起始位置
+ * @param seq: 返回记录序号
+ * @retval 1:成功 0:空间不足(序号仍然加1,主机端可以看到丢包)
+ */
+static uint8_t LOG_Reserve(uint16_t len, uint16_t *pos, uint8_t *seq)
+{
+    uint32_t old_state, new_state;
+    uint16_t head, used;
+    uint8_t ok;
+
+    do {
+        old_state = __LDREXW(&log_state);
+        head = (uint16_t)(old_state & LOG_STATE_HEAD_MASK);
+        used = (uint16_t)(head - log_tail);
+        ok = ((uint32_t)used + len <= LOG_RING_SIZE) ? 1U : 0U;
+
+        new_state = (old_state & ~LOG_STATE_HEAD_MASK) + LOG_STATE_SEQ;
+        if (ok)
+        {
+            new_state += LOG_STATE_WRITER;
+            new_state |= (uint16_t)(head + len);
+        }
+        else
+        {
+            new_state |= head;
+        }
+    } while (__STREXW(new_state, &log_state) != 0U);
+
+    *pos = head;
+    *seq = (uint8_t)(old_state >> 24);
+
+    if (ok)
+    {
+        used = (uint16_t)(used + len);
+        if (used > log_stats.max_used) log_stats.max_used = used;
+        log_stats.written++;
+    }
+    else
+    {
+        log_stats.dropped++;
+    }
+    return ok;
+}
+
+/**
+ * @brief 写者完成,最外层写者负责把预留位置发布为已提交,并启动DMA
+ */
+static void LOG_Commit(void)
+{
+    uint32_t old_state, new_state;
+    uint16_t head, commit;
+
+    do {
+        old_state = __LDREXW(&log_state);
+        new_state = old_state - LOG_STATE_WRITER;
+    } while (__STREXW(new_state, &log_state) != 0U);
+
+    if ((new_state & LOG_STATE_WRITER_MASK) != 0U)
+    {
+        return; /* 还有被打断的写者没写完,由它来提交 */
+    }
+
+    head = (uint16_t)(new_state & LOG_STATE_HEAD_MASK);
+    do {
+        commit = __LDREXH(&log_commit);
+        if ((int16_t)(head - commit) <= 0)
+        {
+            __CLREX(); /* 已经有更新的提交了 */
+            break;
+        }
+    } while (__STREXH(head, &log_commit) != 0U);
+
+    LOG_Kick();
+}
+
+/* 拷贝到环形缓冲区,处理回绕 */
+static void LOG_Copy(uint16_t pos, const void *src, uint16_t len)
+{
+    uint16_t off = pos & LOG_RING_MASK;
+    uint16_t first = LOG_RING_SIZE - off;
+
+    if (first >= len)
+    {
+        memcpy(&log_ring[off], src, len);
+    }
+    else
+    {
+        memcpy(&log_ring[off], src, first);
+        memcpy(log_ring, (const uint8_t *)src + first, len - first);
+    }
+}
+
+/**
+ * @brief 如果DMA空闲且有已提交的数据,启动一次DMA发送
+ * @note  一次只发送到缓冲区末尾为止,回绕部分在完成回调里接着发
+ */
+static void LOG_Kick(void)
+{
+    uint16_t tail, len, off;
+
+    if (!log_running)
+    {
+        return;
+    }
+
+    while (log_commit != log_tail)
+    {
+        /* 抢占DMA,抢不到说明DMA正在发送,完成回调会接着发 */
+        if (__LDREXW(&log_dma_busy) != 0U)
+        {
+            __CLREX();
+            return;
+        }
+        if (__STREXW(1U, &log_dma_busy) != 0U)
+        {
+            continue;
+        }
+
+        tail = log_tail;
+        len = (uint16_t)(log_commit - tail);
+        if (len == 0U)
+        {
+            log_dma_busy = 0U;
+            continue;
+        }
+        off = tail & LOG_RING_MASK;
+        if (len > LOG_RING_SIZE - off)
+        {
+            len = LOG_RING_SIZE - off;
+        }
+
+        if(SCB->CCR & SCB_CCR_DC_Msk) // 检查D-Cache是否启用
+        {
+            SCB_CleanDCache_by_Addr((uint32_t *)((uint32_t)&log_ring[off] & ~31U), len + 32);
+        }
+
+        log_dma_len = len;
+        if (HAL_UART_Transmit_DMA(&huart1, &log_ring[off], len) != HAL_OK)
+        {
+            log_dma_len = 0U;
+            log_dma_busy = 0U;
+            return;
+        }
+        log_stats.dma_started++;
+        return;
+    }
+}
+
+/**
+ * @brief  初始化日志DMA,在UART_Init之后调用
+ *         LOG_Init之前写入的日志会先缓存在环形缓冲区中,初始化后一起发出
+ */
+void LOG_Init(void)
+{
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    hdma_usart1_tx.Instance = DMA2_Stream7;                     // USART1_TX: DMA2 Stream7
+    hdma_usart1_tx.Init.Channel = DMA_CHANNEL_4;                // 通道4
+    hdma_usart1_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;       // 存储器到外设
+    hdma_usart1_tx.Init.PeriphInc = DMA_PINC_DISABLE;           // 外设非增量模式
+    hdma_usart1_tx.Init.MemInc = DMA_MINC_ENABLE;               // 存储器增量模式
+    hdma_usart1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart1_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart1_tx.Init.Mode = DMA_NORMAL;
+    hdma_usart1_tx.Init.Priority = DMA_PRIORITY_LOW;            // 日志优先级最低
+    hdma_usart1_tx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if (HAL_DMA_Init(&hdma_usart1_tx) != HAL_OK)
+    {
+        Error_Handler();
+    }
+    __HAL_LINKDMA(&huart1, hdmatx, hdma_usart1_tx);
+
+    HAL_NVIC_SetPriority(DMA2_Stream7_IRQn, LOG_IRQ_PRIORITY_DMA_USART1, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream7_IRQn);
+    HAL_NVIC_SetPriority(USART1_IRQn, LOG_IRQ_PRIORITY_USART1, 0);
+    HAL_NVIC_EnableIRQ(USART1_IRQn);
+
+    /* 等待之前轮询发送的字符发完 */
+    while((USART1->ISR & USART_ISR_TC) == 0);
+
+    log_running = 1;
+    LOG_Kick();
+}
+
+/**
+ * @brief 写一条格式化日志记录,一般通过LOG_ERR/LOG_WARN/LOG_INFO/LOG_DEBUG宏调用
+ * @param token: 格式字符串token
+ * @param nargs: 参数个数
+ */
+void LOG_Write(uint32_t token, uint32_t nargs, uint32_t a0, uint32_t a1, uint32_t a2,
+               uint32_t a3, uint32_t a4, uint32_t a5)
+{
+    uint32_t rec[3 + LOG_MAX_ARGS];
+    uint16_t len, pos;
+    uint8_t seq;
+
+    if (nargs > LOG_MAX_ARGS)
+    {
+        nargs = LOG_MAX_ARGS;
+    }
+    len = (uint16_t)(12U + nargs * 4U);
+    if (!LOG_Reserve(len, &pos, &seq))
+    {
+        return;
+    }
+
+    rec[0] = LOG_SYNC_BYTE | (LOG_REC_FMT << 8) | ((uint32_t)(len - 8U) << 16) | ((uint32_t)seq << 24);
+    rec[1] = LOG_GetTimeUs();
+    rec[2] = token;
+    rec[3] = a0;
+    rec[4] = a1;
+    rec[5] = a2;
+    rec[6] = a3;
+    rec[7] = a4;
+    rec[8] = a5;
+
+    LOG_Copy(pos, rec, len);
+    LOG_Commit();
+}
+
+/**
+ * @brief 写一段原始字节,超过LOG_HEX_MAX拆成多条记录,同一段数据的记录使用同一个时间戳
+ * @param type: 记录类型
+ * @param tag: 第一条记录的标签
+ * @param tag_next: 后续记录的标签
+ */
+static void LOG_Chunks(uint8_t type, uint32_t tag, uint32_t tag_next, const uint8_t *data, uint16_t len)
+{
+    uint32_t rec[3 + LOG_HEX_MAX / 4];
+    uint32_t ts = LOG_GetTimeUs();
+    uint16_t chunk, rec_len, pos;
+    uint8_t seq;
+
+    do {
+        chunk = (len > LOG_HEX_MAX) ? LOG_HEX_MAX : len;
+        rec_len = (uint16_t)(12U + chunk);
+        if (!LOG_Reserve(rec_len, &pos, &seq))
+        {
+            return;
+        }
+
+        rec[0] = LOG_SYNC_BYTE | ((uint32_t)type << 8) | ((uint32_t)(rec_len - 8U) << 16) | ((uint32_t)seq << 24);
+        rec[1] = ts;
+        rec[2] = tag;
+        memcpy(&rec[3], data, chunk);
+
+        LOG_Copy(pos, rec, rec_len);
+        LOG_Commit();
+
+        tag = tag_next;
+        data += chunk;
+        len -= chunk;
+    } while (len > 0U);
+}
+
+/**
+ * @brief 记录一段原始字节(代替逐字节printf("%02X ")),超过LOG_HEX_MAX自动拆成多条,
+ *        一般通过LOG_HEX/LOG_STR宏调用
+ * @param type: LOG_REC_HEX 十六进制显示, LOG_REC_STR 文本显示
+ * @param token: 标签token
+ * @param data: 数据
+ * @param len: 数据长度
+ */
+void LOG_Bytes(uint8_t type, uint32_t token, const uint8_t *data, uint16_t len)
+{
+    LOG_Chunks(type, token, token, data, len);
+}
+
+/**
+ * @brief 抓包:记录模块串口收到的一帧,超过LOG_HEX_MAX拆成多条,后面的记录带LOG_CAP_FLAG_CONT标志
+ *        通道没有用LOG_SetCapture打开时直接返回,平时只多一次判断
+ * @param chan: 通道 LOG_CAP_xxx
+ * @param ctx: 上下文,回放时原样传给协议处理函数(例如指纹应答对应的命令)
+ * @param data: 数据
+ * @param len: 数据长度
+ */
+void LOG_Capture(uint8_t chan, uint8_t ctx, const uint8_t *data, uint16_t len)
+{
+    uint32_t tag;
+
+    if ((log_capture & (1UL << chan)) == 0U || len == 0U)
+    {
+        return;
+    }
+    tag = chan | ((uint32_t)ctx << 8);
+    LOG_Chunks(LOG_REC_CAP, tag, tag | ((uint32_t)LOG_CAP_FLAG_CONT << 16), data, len);
+}
+
+void LOG_SetCapture(uint32_t mask)
+{
+    log_capture = mask;
+}
+
+uint32_t LOG_GetCapture(void)
+{
+    return log_capture;
+}
+
+/**
+ * @brief printf的输出,fputc调用,每个字符作为一条TEXT记录(没有时间戳)
+ * @note  剩下的printf主要是启动阶段的信息,其他地方请用LOG_INFO等宏
+ */
+int LOG_PutChar(int ch)
+{
+    uint8_t rec[5];
+    uint16_t pos;
+    uint8_t seq;
+
+    if (!log_running)
+    {
+        LOG_PollSend((uint8_t)ch);
+        return ch;
+    }
+    if (!LOG_Reserve(sizeof(rec), &pos, &seq))
+    {
+        return ch;
+    }
+    rec[0] = LOG_SYNC_BYTE;
+    rec[1] = LOG_REC_TEXT;
+    rec[2] = 1;
+    rec[3] = seq;
+    rec[4] = (uint8_t)ch;
+    LOG_Copy(pos, rec, sizeof(rec));
+    LOG_Commit();
+    return ch;
+}
+
+/**
+ * @brief 输出一段文本,每LOG_TEXT_MAX个字符一条TEXT记录,调试shell使用
+ * @param text: 文本
+ * @param len: 长度
+ * @retval 写入的字符数,缓冲区满时小于len,调用者可以稍后继续写剩下的部分
+ */
+uint16_t LOG_Text(const char *text, uint16_t len)
+{
+    uint8_t rec[4 + LOG_TEXT_MAX];
+    uint16_t done = 0, chunk, pos;
+    uint8_t seq;
+
+    if (!log_running)
+    {
+        for (done = 0; done < len; done++)
+        {
+            LOG_PollSend((uint8_t)text[done]);
+        }
+        return len;
+    }
+    while (done < len)
+    {
+        chunk = (uint16_t)(len - done);
+        if (chunk > LOG_TEXT_MAX)
+        {
+            chunk = LOG_TEXT_MAX;
+        }
+        if (!LOG_Reserve((uint16_t)(4U + chunk), &pos, &seq))
+        {
+            break;
+        }
+        rec[0] = LOG_SYNC_BYTE;
+        rec[1] = LOG_REC_TEXT;
+        rec[2] = (uint8_t)chunk;
+        rec[3] = seq;
+        memcpy(&rec[4], text + done, chunk);
+        LOG_Copy(pos, rec, (uint16_t)(4U + chunk));
+        LOG_Commit();
+        done = (uint16_t)(done + chunk);
+    }
+    return done;
+}
+
+/**
+ * @brief 异常处理中调用:停止DMA,把已提交的记录轮询发完,之后printf改为轮询发送
+ */
+void LOG_Panic(void)
+{
+    uint16_t tail;
+
+    if (!log_running)
+    {
+        return;
+    }
+    log_running = 0;
+
+    tail = log_tail;
+    if (log_dma_busy)
+    {
+        /* 停止DMA,从实际发到的位置继续 */
+        CLEAR_BIT(USART1->CR3, USART_CR3_DMAT);
+        __HAL_DMA_DISABLE(&hdma_usart1_tx);
+        tail = (uint16_t)(tail + log_dma_len - __HAL_DMA_GET_COUNTER(&hdma_usart1_tx));
+    }
+    while (tail != log_commit)
+    {
+        LOG_PollSend(log_ring[tail & LOG_RING_MASK]);
+        tail++;
+    }
+    log_tail = tail;
+    while((USART1->ISR & USART_ISR_TC) == 0);
+}
+
+/**
+ * @brief USART1 DMA发送完成回调,由HAL_UART_TxCpltCallback调用
+ */
+void LOG_TxCpltCallback(void)
+{
+    log_tail = (uint16_t)(log_tail + log_dma_len);
+    log_stats.bytes_sent += log_dma_len;
+    log_dma_len = 0U;
+    log_dma_busy = 0U;
+    LOG_Kick();
+}
+
+/**
+ * @brief USART1 DMA发送出错回调,跳过已发送部分后重新启动
+ */
+void LOG_TxErrorCallback(void)
+{
+    uint16_t sent = (uint16_t)(log_dma_len - __HAL_DMA_GET_COUNTER(&hdma_usart1_tx));
+
+    log_tail = (uint16_t)(log_tail + sent);
+    log_stats.bytes_sent += sent;
+    log_dma_len = 0U;
+    log_dma_busy = 0U;
+    LOG_Kick();
+}
+
+void LOG_GetStats(LOG_Stats_t *stats)
+{
+    *stats = log_stats;
+}
+
+uint8_t LOG_IsRunning(void)
+{
+    return log_running;
+}
+
+/* 环形缓冲区剩余空间,大量输出的调用者(调试shell)据此等待,避免记录被丢弃 */
+uint16_t LOG_GetFree(void)
+{
+    return (uint16_t)(LOG_RING_SIZE - (uint16_t)((uint16_t)log_state - log_tail));
+}
+
+// DMA中断服务函数
+void DMA2_Stream7_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdma_usart1_tx);
+}
+
+#else /* !LOG_ENABLE */
+
+void LOG_Init(void)
+{
+}
+
+void LOG_Write(uint32_t token, uint32_t nargs, uint32_t a0, uint32_t a1, uint32_t a2,
+               uint32_t a3, uint32_t a4, uint32_t a5)
+{
+}
+
+void LOG_Bytes(uint8_t type, uint32_t token, const uint8_t *data, uint16_t len)
+{
+}
+
+void LOG_Capture(uint8_t chan, uint8_t ctx, const uint8_t *data, uint16_t len)
+{
+}
+
+void LOG_SetCapture(uint32_t mask)
+{
+}
+
+uint32_t LOG_GetCapture(void)
+{
+    return 0;
+}
+
+int LOG_PutChar(int ch)
+{
+    LOG_PollSend((uint8_t)ch);
+    return ch;
+}
+
+uint16_t LOG_Text(const char *text, uint16_t len)
+{
+    uint16_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        LOG_PollSend((uint8_t)text[i]);
+    }
+    return len;
+}
+
+void LOG_Panic(void)
+{
+}
+
+void LOG_TxCpltCallback(void)
+{
+}
+
+void LOG_TxErrorCallback(void)
+{
+}
+
+void LOG_GetStats(LOG_Stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+uint8_t LOG_IsRunning(void)
+{
+    return 0;
+}
+
+uint16_t LOG_GetFree(void)
+{
+    return 0xFFFF;
+}
+
+#endif /* LOG_ENABLE */
+
+/**
+ * @brief LOG_ENABLE为0时LOG_HEX/LOG_STR直接打印
+ */
+void LOG_PrintBytes(uint8_t type, const char *label, const uint8_t *data, uint16_t len)
+{
+    uint16_t i;
+
+    printf("%s: ", label);
+    for(i = 0; i < len; i++)
+    {
+        if (type == LOG_REC_STR)
+        {
+            printf("%c", data[i]);
+        }
+        else
+        {
+            printf("%02X ", data[i]);
+        }
+    }
+    printf("\r\n");
+}
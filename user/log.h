@@ -0,0 +1,163 @@
+/**
+  ******************************************************************************
+  * @file    log.h
+  * @author  cyytx
+  * @brief   延迟二进制日志模块的头文件,日志以二进制记录写入无锁环形缓冲区,
+  *          由USART1 TX DMA在后台发送,主机端用tools/log_decode.py还原文本,
+  *          按模块在编译期选择日志等级,格式字符串以token代替
+  ******************************************************************************
+  */
+#ifndef __LOG_H
+#define __LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+#include "main.h"
+#include "hard_enable_ctrl.h"
+
+/*
+记录格式(小端):
+  sync(1byte,0xA5) + type(1byte) + len(1byte,负载长度) + seq(1byte)
+  + 时间戳(4byte,us) + 负载
+  LOG_REC_FMT : 负载 = 格式字符串token(4byte) + 参数(4byte * n)
+  LOG_REC_HEX : 负载 = 标签token(4byte) + 原始字节,主机端以十六进制显示
+  LOG_REC_STR : 负载 = 标签token(4byte) + RAM中的字符串,主机端以文本显示
+  LOG_REC_TEXT: 负载 = printf或调试shell输出的字符(没有时间戳,头部只有4字节)
+  LOG_REC_CAP : 负载 = 通道(1byte) + 上下文(1byte) + 标志(1byte) + 保留(1byte) + 模块串口收到的一帧,
+                主机端转成回放文件给tools/host/replay使用,见LOG_Capture
+seq每次写日志都会加1(包括因缓冲区满而丢弃的),主机端据此统计丢包。
+token是格式字符串的编译期哈希(见log_token.h),字符串本身不进flash,
+由tools/log_dict.py从源码中提取出字典,tools/log_decode.py用字典还原文本。
+*/
+#define LOG_SYNC_BYTE           0xA5
+#define LOG_REC_FMT             0x01
+#define LOG_REC_HEX             0x02
+#define LOG_REC_TEXT            0x03
+#define LOG_REC_STR             0x04
+#define LOG_REC_CAP             0x05
+
+/* 抓包通道,LOG_SetCapture的参数是通道位掩码(1 << LOG_CAP_xxx) */
+#define LOG_CAP_FP              1       /* 指纹模块(UART4),上下文为应答对应的命令FP_MsgType_t */
+#define LOG_CAP_FACE            2       /* 人脸模块(UART5) */
+#define LOG_CAP_BLE             3       /* 蓝牙模块(USART6)透传数据 */
+#define LOG_CAP_FLAG_CONT       0x01    /* 标志:接上一条记录(一帧超过LOG_HEX_MAX时拆分) */
+
+#define LOG_RING_SIZE           8192    /* 环形缓冲区大小,必须是2的幂且不超过32768 */
+#define LOG_MAX_ARGS            6       /* 每条日志最多参数个数 */
+#define LOG_HEX_MAX             48      /* 每条HEX/STR记录最多字节数,超出自动拆分 */
+#define LOG_TEXT_MAX            64      /* 每条TEXT记录最多字符数 */
+
+/* 日志等级,数值越大越详细 */
+#define LOG_LEVEL_NONE          0
+#define LOG_LEVEL_ERR           1
+#define LOG_LEVEL_WARN          2
+#define LOG_LEVEL_INFO          3
+#define LOG_LEVEL_DEBUG         4
+
+#include "log_config.h"
+#include "log_token.h"
+
+/* 统计信息 */
+typedef struct {
+    uint32_t written;       /* 成功写入的记录数 */
+    uint32_t dropped;       /* 缓冲区满而丢弃的记录数 */
+    uint32_t bytes_sent;    /* DMA已发送的字节数 */
+    uint32_t dma_started;   /* 启动DMA的次数 */
+    uint16_t max_used;      /* 环形缓冲区最大占用 */
+} LOG_Stats_t;
+
+/* 参数统一转成32位,%s只能是flash中的常量字符串(主机端用axf文件解析) */
+#define LOG_U32(a)              ((uint32_t)(uintptr_t)(a))
+
+/* 计算可变参数个数(0~6) */
+#define LOG_CAT_(a, b)          a##b
+#define LOG_CAT(a, b)           LOG_CAT_(a, b)
+#define LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define LOG_NARGS(...)          LOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+
+#define LOG_ARGS_0()                    0, 0, 0, 0, 0, 0, 0
+#define LOG_ARGS_1(a)                   1, LOG_U32(a), 0, 0, 0, 0, 0
+#define LOG_ARGS_2(a, b)                2, LOG_U32(a), LOG_U32(b), 0, 0, 0, 0
+#define LOG_ARGS_3(a, b, c)             3, LOG_U32(a), LOG_U32(b), LOG_U32(c), 0, 0, 0
+#define LOG_ARGS_4(a, b, c, d)          4, LOG_U32(a), LOG_U32(b), LOG_U32(c), LOG_U32(d), 0, 0
+#define LOG_ARGS_5(a, b, c, d, e)       5, LOG_U32(a), LOG_U32(b), LOG_U32(c), LOG_U32(d), LOG_U32(e), 0
+#define LOG_ARGS_6(a, b, c, d, e, f)    6, LOG_U32(a), LOG_U32(b), LOG_U32(c), LOG_U32(d), LOG_U32(e), LOG_U32(f)
+
+/*
+模块等级:源文件中定义 #define LOG_MODULE FP ,等级取log_config.h中的LOG_LEVEL_FP,
+没有定义LOG_MODULE的源文件使用LOG_LEVEL_DEFAULT。
+等级判断是常量表达式,关闭的日志连同参数计算一起被编译器删除。
+*/
+#define LOG_LEVEL_LOG_MODULE    LOG_LEVEL_DEFAULT
+#define LOG_LEVEL_OF(m)         LOG_CAT(LOG_LEVEL_, m)
+#define LOG_ON(level)           (LOG_LEVEL_OF(LOG_MODULE) >= (level))
+
+#if LOG_ENABLE
+
+#define LOG_AT(level, fmt, ...) do {                                                   \
+        if (LOG_ON(level)) {                                                           \
+            static const uint32_t log_tok_ = LOG_TOKEN(fmt);                           \
+            LOG_Write(log_tok_, LOG_CAT(LOG_ARGS_, LOG_NARGS(__VA_ARGS__))(__VA_ARGS__)); \
+        }                                                                              \
+    } while (0)
+
+#define LOG_BYTES_AT(level, type, label, data, len) do {                               \
+        if (LOG_ON(level)) {                                                           \
+            static const uint32_t log_tok_ = LOG_TOKEN(label);                         \
+            LOG_Bytes((type), log_tok_, (const uint8_t *)(data), (len));               \
+        }                                                                              \
+    } while (0)
+
+#else /* !LOG_ENABLE */
+
+#define LOG_AT(level, fmt, ...) do {                                                   \
+        if (LOG_ON(level)) {                                                           \
+            printf((fmt), ##__VA_ARGS__);                                              \
+        }                                                                              \
+    } while (0)
+
+#define LOG_BYTES_AT(level, type, label, data, len) do {                               \
+        if (LOG_ON(level)) {                                                           \
+            LOG_PrintBytes((type), (label), (const uint8_t *)(data), (len));           \
+        }                                                                              \
+    } while (0)
+
+#endif /* LOG_ENABLE */
+
+/* 不做格式化,只记录token和参数,任务和中断中都可以调用,参数只支持整数/字符/常量字符串 */
+#define LOG_ERR(fmt, ...)       LOG_AT(LOG_LEVEL_ERR, fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...)      LOG_AT(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...)      LOG_AT(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...)     LOG_AT(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+
+/* 原始字节的十六进制转储(调试等级) */
+#define LOG_HEX(label, data, len)   LOG_BYTES_AT(LOG_LEVEL_DEBUG, LOG_REC_HEX, label, data, len)
+/* RAM中的字符串(信息等级),例如模块返回的AT响应 */
+#define LOG_STR(label, str)         LOG_BYTES_AT(LOG_LEVEL_INFO, LOG_REC_STR, label, str, (uint16_t)strlen((const char *)(str)))
+
+void LOG_Init(void);
+void LOG_Write(uint32_t token, uint32_t nargs, uint32_t a0, uint32_t a1, uint32_t a2,
+               uint32_t a3, uint32_t a4, uint32_t a5);
+void LOG_Bytes(uint8_t type, uint32_t token, const uint8_t *data, uint16_t len);
+void LOG_PrintBytes(uint8_t type, const char *label, const uint8_t *data, uint16_t len);
+void LOG_Capture(uint8_t chan, uint8_t ctx, const uint8_t *data, uint16_t len);
+void LOG_SetCapture(uint32_t mask);
+uint32_t LOG_GetCapture(void);
+int  LOG_PutChar(int ch);
+uint16_t LOG_Text(const char *text, uint16_t len);
+void LOG_Panic(void);
+void LOG_TxCpltCallback(void);
+void LOG_TxErrorCallback(void);
+void LOG_GetStats(LOG_Stats_t *stats);
+uint32_t LOG_GetTimeUs(void);
+uint8_t LOG_IsRunning(void);
+uint16_t LOG_GetFree(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOG_H */
@@ -0,0 +1,30 @@
+/**
+  ******************************************************************************
+  * @file    log_config.h
+  * @author  cyytx
+  * @brief   各模块的编译期日志等级,低于该等级的日志调用在编译时被删除
+  ******************************************************************************
+  */
+#ifndef __LOG_CONFIG_H
+#define __LOG_CONFIG_H
+
+/*
+可选等级: LOG_LEVEL_NONE / LOG_LEVEL_ERR / LOG_LEVEL_WARN / LOG_LEVEL_INFO / LOG_LEVEL_DEBUG
+源文件中用 #define LOG_MODULE XXX 指定模块,对应这里的 LOG_LEVEL_XXX。
+LOG_HEX(收发帧的十六进制转储)是DEBUG等级,需要看通信数据时把对应模块改为LOG_LEVEL_DEBUG。
+*/
+#define LOG_LEVEL_DEFAULT       LOG_LEVEL_INFO  /* 没有定义LOG_MODULE的源文件 */
+#define LOG_LEVEL_FP            LOG_LEVEL_INFO  /* 指纹模块 */
+#define LOG_LEVEL_FACE          LOG_LEVEL_INFO  /* 人脸识别模块 */
+#define LOG_LEVEL_BLE           LOG_LEVEL_INFO  /* 蓝牙模块 */
+#define LOG_LEVEL_NFC           LOG_LEVEL_INFO  /* NFC模块 */
+#define LOG_LEVEL_SDCARD        LOG_LEVEL_INFO  /* SD卡 */
+#define LOG_LEVEL_CRED          LOG_LEVEL_INFO  /* 凭据库 */
+#define LOG_LEVEL_FSTORE        LOG_LEVEL_INFO  /* Flash记录存储 */
+#define LOG_LEVEL_AUTH          LOG_LEVEL_INFO  /* 开锁授权 */
+#define LOG_LEVEL_AUDIT         LOG_LEVEL_INFO  /* SD卡审计日志 */
+#define LOG_LEVEL_BIO           LOG_LEVEL_INFO  /* 人脸、指纹识别协调 */
+#define LOG_LEVEL_LCD           LOG_LEVEL_WARN  /* LCD显示 */
+#define LOG_LEVEL_CAMERA        LOG_LEVEL_WARN  /* 摄像头 */
+
+#endif /* __LOG_CONFIG_H */
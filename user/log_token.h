@@ -0,0 +1,108 @@
+/**
+  ******************************************************************************
+  * @file    log_token.h
+  * @author  cyytx
+  * @brief   日志格式字符串的编译期哈希(token),主机端tools/log_dict.py用同样的算法生成字典
+  ******************************************************************************
+  */
+#ifndef __LOG_TOKEN_H
+#define __LOG_TOKEN_H
+
+#include <stdint.h>
+
+/*
+算法(65599哈希,固定长度):
+  hash = 字符串长度
+  对前LOG_TOKEN_MAX_CHARS个字符: hash += c[i] * 65599^(i+1)   (mod 2^32)
+系数已经预先算好。宏只用到sizeof和字符串下标,用作static const变量的初始值时
+编译器必须在编译期算出结果,所以字符串本身不会进入flash。
+超过LOG_TOKEN_MAX_CHARS的部分不参与计算,冲突由tools/log_dict.py检查。
+*/
+#define LOG_TOKEN_MAX_CHARS     80
+
+#define LOG_TC(s, i) \
+    ((uint32_t)(i) < sizeof(s) - 1U ? (uint32_t)(uint8_t)(s)[(uint32_t)(i) < sizeof(s) ? (i) : 0] : 0U)
+
+#define LOG_TOKEN(s) ((uint32_t)((uint32_t)(sizeof(s) - 1U) + \
+    LOG_TC(s, 0) * 0x0001003FUL + \
+    LOG_TC(s, 1) * 0x007E0F81UL + \
+    LOG_TC(s, 2) * 0x2E86D0BFUL + \
+    LOG_TC(s, 3) * 0x43EC5F01UL + \
+    LOG_TC(s, 4) * 0x162C613FUL + \
+    LOG_TC(s, 5) * 0xD62AEE81UL + \
+    LOG_TC(s, 6) * 0xA311B1BFUL + \
+    LOG_TC(s, 7) * 0xD319BE01UL + \
+    LOG_TC(s, 8) * 0xB156C23FUL + \
+    LOG_TC(s, 9) * 0x6698CD81UL + \
+    LOG_TC(s, 10) * 0x0D1B92BFUL + \
+    LOG_TC(s, 11) * 0xCC881D01UL + \
+    LOG_TC(s, 12) * 0x7280233FUL + \
+    LOG_TC(s, 13) * 0x50C7AC81UL + \
+    LOG_TC(s, 14) * 0x8DA473BFUL + \
+    LOG_TC(s, 15) * 0x4F377C01UL + \
+    LOG_TC(s, 16) * 0xFAA8843FUL + \
+    LOG_TC(s, 17) * 0x33B78B81UL + \
+    LOG_TC(s, 18) * 0x45AC54BFUL + \
+    LOG_TC(s, 19) * 0x7A27DB01UL + \
+    LOG_TC(s, 20) * 0xEACFE53FUL + \
+    LOG_TC(s, 21) * 0xAE686A81UL + \
+    LOG_TC(s, 22) * 0x563335BFUL + \
+    LOG_TC(s, 23) * 0x6C593A01UL + \
+    LOG_TC(s, 24) * 0xE3F6463FUL + \
+    LOG_TC(s, 25) * 0x5FDA4981UL + \
+    LOG_TC(s, 26) * 0xE03916BFUL + \
+    LOG_TC(s, 27) * 0x44CB9901UL + \
+    LOG_TC(s, 28) * 0x871BA73FUL + \
+    LOG_TC(s, 29) * 0xE70D2881UL + \
+    LOG_TC(s, 30) * 0x04BDF7BFUL + \
+    LOG_TC(s, 31) * 0x227EF801UL + \
+    LOG_TC(s, 32) * 0x7540083FUL + \
+    LOG_TC(s, 33) * 0xE3010781UL + \
+    LOG_TC(s, 34) * 0xE4C1D8BFUL + \
+    LOG_TC(s, 35) * 0x24735701UL + \
+    LOG_TC(s, 36) * 0x4F63693FUL + \
+    LOG_TC(s, 37) * 0xF2B5E681UL + \
+    LOG_TC(s, 38) * 0xA144B9BFUL + \
+    LOG_TC(s, 39) * 0x69A8B601UL + \
+    LOG_TC(s, 40) * 0xB685CA3FUL + \
+    LOG_TC(s, 41) * 0xB52BC581UL + \
+    LOG_TC(s, 42) * 0x5B469ABFUL + \
+    LOG_TC(s, 43) * 0x111F1501UL + \
+    LOG_TC(s, 44) * 0x4BA72B3FUL + \
+    LOG_TC(s, 45) * 0xC962A481UL + \
+    LOG_TC(s, 46) * 0x33C77BBFUL + \
+    LOG_TC(s, 47) * 0x39D67401UL + \
+    LOG_TC(s, 48) * 0xAFC78C3FUL + \
+    LOG_TC(s, 49) * 0xCE5A8381UL + \
+    LOG_TC(s, 50) * 0x4BC75CBFUL + \
+    LOG_TC(s, 51) * 0x02CED301UL + \
+    LOG_TC(s, 52) * 0x83E6ED3FUL + \
+    LOG_TC(s, 53) * 0x63136281UL + \
+    LOG_TC(s, 54) * 0xC4463DBFUL + \
+    LOG_TC(s, 55) * 0x8B083201UL + \
+    LOG_TC(s, 56) * 0x69054E3FUL + \
+    LOG_TC(s, 57) * 0x268D4181UL + \
+    LOG_TC(s, 58) * 0xBE441EBFUL + \
+    LOG_TC(s, 59) * 0xF1829101UL + \
+    LOG_TC(s, 60) * 0x0022AF3FUL + \
+    LOG_TC(s, 61) * 0xB7C82081UL + \
+    LOG_TC(s, 62) * 0x5AC0FFBFUL + \
+    LOG_TC(s, 63) * 0x553DF001UL + \
+    LOG_TC(s, 64) * 0xEA3F103FUL + \
+    LOG_TC(s, 65) * 0xB5C3FF81UL + \
+    LOG_TC(s, 66) * 0xBABCE0BFUL + \
+    LOG_TC(s, 67) * 0xD53A4F01UL + \
+    LOG_TC(s, 68) * 0xC85A713FUL + \
+    LOG_TC(s, 69) * 0xBF80DE81UL + \
+    LOG_TC(s, 70) * 0xFF37C1BFUL + \
+    LOG_TC(s, 71) * 0x9077AE01UL + \
+    LOG_TC(s, 72) * 0x3B74D23FUL + \
+    LOG_TC(s, 73) * 0x73FEBD81UL + \
+    LOG_TC(s, 74) * 0x4931A2BFUL + \
+    LOG_TC(s, 75) * 0xA5F60D01UL + \
+    LOG_TC(s, 76) * 0xE48E333FUL + \
+    LOG_TC(s, 77) * 0x723D9C81UL + \
+    LOG_TC(s, 78) * 0xB9AA83BFUL + \
+    LOG_TC(s, 79) * 0x34B56C01UL))
+
+#endif /* __LOG_TOKEN_H */
@@ -5,6 +5,7 @@
   * @author  cyytx
   * @brief   NFC模块的源文件,实现NFC的初始化、读写等功能，因为cs pin连接到的是硬件spi_nss pin ，使用硬件spi 时
   * ，各种方法试过，cs pin在发送时就是不收控制，在发送过程中突然拉高又拉低，导致错误，所以使用，使用纯软件方法实现。
+  * 软件SPI传输层在rc522_spi.c中,本文件是RC522命令和卡片协议。
   * 另外板子上是使用单排母口排针连接，导致接触有点不良，在初始化和读卡时要抬一下尾部，否则会读不到卡。
   ******************************************************************************
   */
@@ -12,152 +13,77 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "nfc.h"
+#include "rc522_spi.h"
+#include "iso14443.h"
 #include "delay.h"
 #include "priorities.h"
-#include "sg90.h"
+#include "auth.h"
+#include "cred.h"
+#include "rng.h"
+#include "log.h"
 
-#if NFC_ENABLE
-
-static SPI_HandleTypeDef hspi5;  // NFC模块SPI句柄
-
-
-//通过控制寄存器直接控制  
-/**
- * SPI5 GPIO Configuration
- *  PI10     ------> NFC_RESET
- *  PF6     ------> SPI5_NSS
- *  PF7     ------> SPI5_SCK
- *  PF8     ------> SPI5_MISO
- *  PF9     ------> SPI5_MOSI
- */
-// #define RC522_CS_Enable()   (GPIOF->BSRR = (uint32_t)GPIO_PIN_6 << 16)
-// #define RC522_CS_Disable()  (GPIOF->BSRR = GPIO_PIN_6)
-// #define RC522_Reset_Enable()  (GPIOI->BSRR = (uint32_t)GPIO_PIN_10 << 16)
-// #define RC522_Reset_Disable()  (GPIOI->BSRR = GPIO_PIN_10)
-
-// //使用直接控制寄存器的方法
-// #define RC522_SCK_0()   (GPIOF->BSRR = (uint32_t)GPIO_PIN_7 << 16)
-// #define RC522_SCK_1()   (GPIOF->BSRR = GPIO_PIN_7)
-
-// #define RC522_MOSI_0()   (GPIOF->BSRR = (uint32_t)GPIO_PIN_9 << 16)
-// #define RC522_MOSI_1()   (GPIOF->BSRR = GPIO_PIN_9)
-
-// #define RC522_MISO_GET() ((GPIOF->IDR & GPIO_PIN_8)?1:0)
-
-#define          RC522_Reset_Enable()      HAL_GPIO_WritePin(GPIOI, GPIO_PIN_10, GPIO_PIN_RESET)  // 复位使能
-#define          RC522_Reset_Disable()     HAL_GPIO_WritePin(GPIOI, GPIO_PIN_10, GPIO_PIN_SET)    // 复位禁用
-#define          RC522_CS_Enable()         HAL_GPIO_WritePin(GPIOF, GPIO_PIN_6, GPIO_PIN_RESET)  // 片选使能
-#define          RC522_CS_Disable()        HAL_GPIO_WritePin(GPIOF, GPIO_PIN_6, GPIO_PIN_SET)     // 片选禁用
+#define LOG_MODULE NFC    /* 日志模块名,等级见log_config.h */
 
-#define RC522_SCK_0()          HAL_GPIO_WritePin(GPIOF, GPIO_PIN_7, GPIO_PIN_RESET)
-#define RC522_SCK_1()          HAL_GPIO_WritePin(GPIOF, GPIO_PIN_7, GPIO_PIN_SET)
-
-#define RC522_MOSI_0()         HAL_GPIO_WritePin(GPIOF, GPIO_PIN_9, GPIO_PIN_RESET)
-#define RC522_MOSI_1()         HAL_GPIO_WritePin(GPIOF, GPIO_PIN_9, GPIO_PIN_SET)
-
-#define RC522_MISO_GET()       HAL_GPIO_ReadPin(GPIOF, GPIO_PIN_8)
+#if NFC_ENABLE
 
+static TaskHandle_t nfcTaskHandle = NULL;  // 任务句柄
+static uint32_t nfc_sleep_us = 0;          // 等待RC522时任务阻塞的累计时间(us),只在NFC任务中访问
 
- /**
-  * @brief  向RC522发送1 Byte 数据
-  * @param  byte，要发送的数据
-  * @retval RC522返回的数据
-  */
-void SPI_RC522_SendByte ( uint8_t byte )
+#if NFC_IRQ_ENABLE
+/* RC522的IRQ引脚:下降沿外部中断,IRQ输出改为推挽(复位后是开漏) */
+static void NFC_IrqInit(void)
 {
-  uint8_t counter;
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
 
-  for(counter=0;counter<8;counter++)
-  {     
-    if ( byte & 0x80 )
-      RC522_MOSI_1 ();
-    else 
-      RC522_MOSI_0 ();
+    GPIO_InitStruct.Pin = NFC_IRQ_Pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;   // ComIEnReg的IRqInv置位,低电平有效
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    HAL_GPIO_Init(NFC_IRQ_GPIO_Port, &GPIO_InitStruct);
 
-    RC522_SCK_0 ();
-    RC522_SCK_1();
-    byte <<= 1; 
-  } 	
-}
+    WriteRawRC(DivlEnReg, 0x80);                   // IRQPushPull
 
+    HAL_NVIC_SetPriority(EXTI15_10_IRQn, NFC_IRQ_PRIORITY_EXTI, 0);
+    HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+}
 
 /**
-  * @brief  从RC522发送1 Byte 数据
-  * @param  无
-  * @retval RC522返回的数据
+  * @brief  EXTI15_10 中断处理函数 (RC522 IRQ -> PF10),唤醒等待命令完成的NFC任务
   */
-uint8_t SPI_RC522_ReadByte ( void )
+void EXTI15_10_IRQHandler(void)
 {
-  uint8_t counter;
-  uint8_t SPI_Data;
-
-  for(counter=0;counter<8;counter++)
-  {
-    SPI_Data <<= 1;
-    RC522_SCK_0 ();
+    BaseType_t woken = pdFALSE;
 
-    if ( RC522_MISO_GET() == 1)
-     SPI_Data |= 0x01;
-
-    RC522_SCK_1 ();
-  }
-  return SPI_Data;
-	
-}
-
-
-
-void NFC_GPIO_Init(void)
-{
-        /**SPI5 GPIO Configuration
- *  PI10     ------> NFC_RESET
-    PF6     ------> SPI5_NSS
-    PF7     ------> SPI5_SCK
-    PF8     ------> SPI5_MISO
-    PF9     ------> SPI5_MOSI
-    */
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
-    __HAL_RCC_GPIOI_CLK_ENABLE();//RESET引脚
-    __HAL_RCC_GPIOF_CLK_ENABLE();
-    
-
-    // 配置NFC复位引脚
-    HAL_GPIO_WritePin(GPIOI, GPIO_PIN_10, GPIO_PIN_SET);
-
-      /*Configure GPIO pins : BEEP_Pin NFC_RESET_Pin */
-    GPIO_InitStruct.Pin = GPIO_PIN_10;
-    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
-    HAL_GPIO_Init(GPIOI, &GPIO_InitStruct);
-
-//输出
-    GPIO_InitStruct.Pin = GPIO_PIN_6|GPIO_PIN_7|GPIO_PIN_9;
-    HAL_GPIO_Init(GPIOF, &GPIO_InitStruct);
-
-//输入
-    GPIO_InitStruct.Pin = GPIO_PIN_8;
-    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
-    HAL_GPIO_Init(GPIOF, &GPIO_InitStruct);
+    if(__HAL_GPIO_EXTI_GET_IT(NFC_IRQ_Pin) != RESET)
+    {
+        __HAL_GPIO_EXTI_CLEAR_IT(NFC_IRQ_Pin);
+        if(nfcTaskHandle != NULL)
+        {
+            vTaskNotifyGiveFromISR(nfcTaskHandle, &woken);
+        }
+    }
+    portYIELD_FROM_ISR(woken);
 }
+#endif
 
 void NFC_Init(void)
 {
     // 初始化NFC模块的GPIO
-    NFC_GPIO_Init();
+    RC522_SPI_Init();
     
     // 复位RC522
     PcdReset();
+#if NFC_IRQ_ENABLE
+    NFC_IrqInit();
+#endif
     
     // 设置定时器和RC522的工作模式
     M500PcdConfigISOType(0x0A);
     
-    // 天线开启
-    PcdAntennaOn();
+    // 天线由NFC任务按寻卡调度开关
+    PcdAntennaOff();
     
-    printf("NFC int success\r\n");
+    LOG_INFO("NFC int success\r\n");
 }
 
 
@@ -168,19 +94,14 @@ void NFC_Init(void)
  * 调用  ：外部调用              */
 void PcdReset ( void )
 {
-    RC522_Reset_Disable();
-    delay_us ( 1 );
-    RC522_Reset_Enable();
-    delay_us ( 1 );
-    RC522_Reset_Disable();
-    delay_us ( 1 );
+    RC522_SPI_HardReset();
     WriteRawRC ( CommandReg, 0x0f );
 
     while ( ReadRawRC ( CommandReg ) & 0x10 );
 	
     delay_us ( 1 );
     WriteRawRC ( ModeReg, 0x3D );                //定义发送和接收常用模式 和Mifare卡通讯，CRC初始值0x6363
-    WriteRawRC ( TReloadRegL, 30 );              //16位定时器低位    
+    WriteRawRC ( TReloadRegL, NFC_TIMER_RELOAD );  //16位定时器低位    
     WriteRawRC ( TReloadRegH, 0 );			     //16位定时器高位
     WriteRawRC ( TModeReg, 0x8D );				 //定义内部定时器的设置
     WriteRawRC ( TPrescalerReg, 0x3E );			 //设置定时器分频系数
@@ -188,44 +109,6 @@ void PcdReset ( void )
 }
 
 
-/* 函数名：ReadRawRC
- * 描述  ：读RC522寄存器
- * 输入  ：ucAddress，寄存器地址
- * 返回  : 寄存器的当前值
- * 调用  ：内部调用                 */
-uint8_t ReadRawRC ( uint8_t ucAddress )
-{
-	uint8_t ucAddr, ucReturn;
-	ucAddr = ( ( ucAddress << 1 ) & 0x7E ) | 0x80;      
-
-	RC522_CS_Enable();
-	SPI_RC522_SendByte ( ucAddr );
-	ucReturn = SPI_RC522_ReadByte ();
-	RC522_CS_Disable();
-	return ucReturn;
-}
-
-
- /* 函数名：WriteRawRC
- * 描述  ：写RC522寄存器
- * 输入  ：ucAddress，寄存器地址  、 ucValue，写入寄存器的值
- * 返回  : 无
- * 调用  ：内部调用   */
-void WriteRawRC ( uint8_t ucAddress, uint8_t ucValue )
-{  
-	uint8_t ucAddr;
-	ucAddr = ( ucAddress << 1 ) & 0x7E; 
-    //uint8_t getValue[2];
-    
-	
-	RC522_CS_Enable();	
-	SPI_RC522_SendByte ( ucAddr );
-    SPI_RC522_SendByte ( ucValue );
-    //delay_us(10);
-    //printf("%02X, %02X, %02X, %02X\r\n", ucAddr, ucValue,getValue[0], getValue[1]);
-	RC522_CS_Disable();	
-}
-
 /* 函数名：M500PcdConfigISOType
  * 描述  ：设置RC522的工作方式
  * 输入  ：ucType，工作方式
@@ -240,7 +123,7 @@ void M500PcdConfigISOType ( uint8_t ucType )
     WriteRawRC ( ModeReg, 0x3D );//3F	
 		WriteRawRC ( RxSelReg, 0x86 );//84
 		WriteRawRC ( RFCfgReg, 0x7F );   //4F
-		WriteRawRC ( TReloadRegL, 30 );//tmoLength);// TReloadVal = 'h6a =tmoLength(dec) 
+		WriteRawRC ( TReloadRegL, NFC_TIMER_RELOAD );//tmoLength);// TReloadVal = 'h6a =tmoLength(dec) 
 		WriteRawRC ( TReloadRegH, 0 );
 		WriteRawRC ( TModeReg, 0x8D );
 		WriteRawRC ( TPrescalerReg, 0x3E );
@@ -308,10 +191,41 @@ void PcdAntennaOff ( void )
 
 void ShowID(uint16_t x,uint16_t y, uint8_t *p, uint16_t charColor, uint16_t bkColor)  //显示卡的卡号，以十六进制显示
 {
-    uint8_t num[9];
+    LOG_INFO("ID>>>%02X%02X%02X%02X\r\n", p[0], p[1], p[2], p[3]);
 
-    printf("ID>>>%s\r\n", num);
+}
+
+/* 等待RC522命令完成(ComIrqReg中ucWaitFor或定时器中断位置位),返回最后读到的ComIrqReg。
+ * 没有卡时由RC522的定时器(发送结束后自动启动)结束等待,timeout_us只是保护;
+ * 有IRQ线时任务阻塞到中断通知,没有时先查询NFC_COM_SPIN_US,之后每个tick查询一次,
+ * 等待时间和CPU主频、SPI速度无关 */
+static uint8_t NFC_WaitCommand(uint8_t ucWaitFor, uint32_t timeout_us)
+{
+    uint32_t start = LOG_GetTimeUs();
+    uint32_t elapsed, t;
+    uint8_t irq;
 
+    for (;;)
+    {
+        irq = ReadRawRC(ComIrqReg);
+        elapsed = LOG_GetTimeUs() - start;
+        if ((irq & (ucWaitFor | 0x01)) || elapsed >= timeout_us)
+        {
+            return irq;
+        }
+#if NFC_IRQ_ENABLE
+        t = LOG_GetTimeUs();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((timeout_us - elapsed) / 1000U) + 1U);
+        nfc_sleep_us += LOG_GetTimeUs() - t;
+#else
+        if (elapsed >= NFC_COM_SPIN_US)
+        {
+            t = LOG_GetTimeUs();
+            vTaskDelay(1);
+            nfc_sleep_us += LOG_GetTimeUs() - t;
+        }
+#endif
+    }
 }
 
 /* 函数名：PcdComMF522
@@ -331,17 +245,16 @@ char PcdComMF522 ( uint8_t ucCommand, uint8_t * pInData, uint8_t ucInLenByte, ui
     uint8_t ucWaitFor = 0x00;
     uint8_t ucLastBits;
     uint8_t ucN;
-    uint32_t ul;
 
     switch ( ucCommand )
     {
        case PCD_AUTHENT:		//Mifare认证
-          ucIrqEn   = 0x12;		//允许错误中断请求ErrIEn  允许空闲中断IdleIEn
+          ucIrqEn   = 0x11;		//允许空闲中断IdleIEn 定时器中断TimerIEn
           ucWaitFor = 0x10;		//认证寻卡等待时候 查询空闲中断标志位
           break;
 			 
        case PCD_TRANSCEIVE:		//接收发送 发送接收
-          ucIrqEn   = 0x77;		//允许TxIEn RxIEn IdleIEn LoAlertIEn ErrIEn TimerIEn
+          ucIrqEn   = 0x31;		//允许RxIEn IdleIEn TimerIEn,IRQ引脚只在等待的事件上变化,错误从ErrorReg读
           ucWaitFor = 0x30;		//寻卡等待时候 查询接收中断标志位与 空闲中断标志位
           break;
 			 
@@ -355,26 +268,22 @@ char PcdComMF522 ( uint8_t ucCommand, uint8_t * pInData, uint8_t ucInLenByte, ui
     WriteRawRC ( CommandReg, PCD_IDLE );		//写空闲命令
     SetBitMask ( FIFOLevelReg, 0x80 );			//置位FlushBuffer清除内部FIFO的读和写指针以及ErrReg的BufferOvfl标志位被清除
     
-    for ( ul = 0; ul < ucInLenByte; ul ++ )
-		WriteRawRC ( FIFODataReg, pInData [ ul ] );    		//写数据进FIFOdata
+    RC522_WriteFifo ( pInData, ucInLenByte );    		//写数据进FIFOdata,一次片选
 			
+#if NFC_IRQ_ENABLE
+    ulTaskNotifyTake ( pdTRUE, 0 );							//丢弃上一条命令残留的中断通知
+#endif
     WriteRawRC ( CommandReg, ucCommand );					//写命令
    
     
     if ( ucCommand == PCD_TRANSCEIVE )
 			SetBitMask(BitFramingReg,0x80);  				//StartSend置位启动数据发送 该位与收发命令使用时才有效
     
-    ul = 1000;//根据时钟频率调整，操作M1卡最大等待时间25ms
-		
-    do 														//认证 与寻卡等待时间	
-    {
-         ucN = ReadRawRC ( ComIrqReg );							//查询事件中断
-         ul --;
-    } while ( ( ul != 0 ) && ( ! ( ucN & 0x01 ) ) && ( ! ( ucN & ucWaitFor ) ) );		//退出条件i=0,定时器中断，与写空闲命令
+    ucN = NFC_WaitCommand ( ucWaitFor, NFC_COM_TIMEOUT_US );					//认证 与寻卡等待,退出条件超时,定时器中断，与写空闲命令
 		
     ClearBitMask ( BitFramingReg, 0x80 );					//清理允许StartSend位
 		
-    if ( ul != 0 )
+    if ( ( ucN & 0x01 ) || ( ucN & ucWaitFor ) )
     {
 		if ( ! (( ReadRawRC ( ErrorReg ) & 0x1B )) )			//读错误标志寄存器BufferOfI CollErr ParityErr ProtocolErr
 		{
@@ -400,8 +309,7 @@ char PcdComMF522 ( uint8_t ucCommand, uint8_t * pInData, uint8_t ucInLenByte, ui
 				if ( ucN > MAXRLEN )
 					ucN = MAXRLEN;   
 				
-				for ( ul = 0; ul < ucN; ul ++ )
-				  pOutData [ ul ] = ReadRawRC ( FIFODataReg );   
+				RC522_ReadFifo ( pOutData, ucN );   			//一次片选读出FIFO
 			}		
         }
 			else
@@ -415,6 +323,73 @@ char PcdComMF522 ( uint8_t ucCommand, uint8_t * pInData, uint8_t ucInLenByte, ui
 }
 
 
+/* 函数名：PcdTransceive
+ * 描述  ：通用收发,协议层(iso14443.c)使用,原来的MIFARE Classic函数仍用PcdComMF522
+ * 输入  ：pTx，发送帧:块头和数据分两段写入FIFO,数据不用拼接到块头后面
+ *         pRx，接收帧:前hdr_len字节放到hdr,其余直接读到data(最多max字节),len返回数据长度
+ *         ucFraming，BitFramingReg:RxAlign[6:4]、TxLastBits[2:0],防冲突时使用,其他为0
+ *         ucCrc，NFC_CRC_TX/NFC_CRC_RX:由RC522硬件添加、校验CRC_A,不用CalulateCRC往返
+ *         usTimer，RC522定时器重装值(NFC_TIMER_US一个计数),即等待卡片应答的时间
+ * 返回  : MI_OK;MI_NOTAGERR没有应答;MI_COLLERR有冲突(数据已读出,位置见CollReg);MI_ERR
+ * 调用  ：外部调用              */
+char PcdTransceive ( const NFC_Frame_t * pTx, NFC_Frame_t * pRx, uint8_t ucFraming, uint8_t ucCrc, uint16_t usTimer )
+{
+    char cStatus;
+    uint8_t ucIrq, ucErr, ucN, ucHdr;
+
+    WriteRawRC ( TxModeReg, ( ucCrc & NFC_CRC_TX ) ? 0x80 : 0x00 );	//TxCRCEn
+    WriteRawRC ( RxModeReg, ( ucCrc & NFC_CRC_RX ) ? 0x80 : 0x00 );	//RxCRCEn
+    WriteRawRC ( TReloadRegH, ( uint8_t ) ( usTimer >> 8 ) );
+    WriteRawRC ( TReloadRegL, ( uint8_t ) usTimer );
+    WriteRawRC ( ComIEnReg, 0x80 | 0x31 );		//IRQ引脚只反映RxIRq IdleIRq TimerIRq
+    WriteRawRC ( ComIrqReg, 0x7F );				//清除所有中断标志
+    WriteRawRC ( CommandReg, PCD_IDLE );
+    WriteRawRC ( FIFOLevelReg, 0x80 );			//FlushBuffer
+    RC522_WriteFifo ( pTx->hdr, pTx->hdr_len );
+    RC522_WriteFifo ( pTx->data, pTx->len );
+    WriteRawRC ( BitFramingReg, ucFraming );
+#if NFC_IRQ_ENABLE
+    ulTaskNotifyTake ( pdTRUE, 0 );
+#endif
+    WriteRawRC ( CommandReg, PCD_TRANSCEIVE );
+    WriteRawRC ( BitFramingReg, ucFraming | 0x80 );	//StartSend
+
+    ucIrq = NFC_WaitCommand ( 0x30, ( uint32_t ) usTimer * NFC_TIMER_US + NFC_COM_TIMEOUT_US );
+    pRx->len = 0;
+    if ( ! ( ucIrq & 0x30 ) )
+    {
+        cStatus = ( ucIrq & 0x01 ) ? MI_NOTAGERR : MI_ERR;
+    }
+    else
+    {
+        ucErr = ReadRawRC ( ErrorReg );
+        ucN = ReadRawRC ( FIFOLevelReg ) & 0x7F;
+        ucHdr = ucN < pRx->hdr_len ? ucN : pRx->hdr_len;
+        if ( ( ucErr & 0x13 ) || ( ( ucCrc & NFC_CRC_RX ) && ( ucErr & 0x04 ) ) || ucN - ucHdr > pRx->max )
+        {
+            cStatus = MI_ERR;				//BufferOvfl ParityErr ProtocolErr CRCErr,或者缓冲区不够
+        }
+        else
+        {
+            cStatus = ( ucErr & 0x08 ) ? MI_COLLERR : MI_OK;
+            RC522_ReadFifo ( pRx->hdr, ucHdr );
+            RC522_ReadFifo ( pRx->data, ucN - ucHdr );
+            pRx->len = ucN - ucHdr;
+            if ( ucHdr < pRx->hdr_len )
+                cStatus = MI_ERR;			//应答比块头还短
+        }
+    }
+
+    SetBitMask ( ControlReg, 0x80 );           // stop timer now
+    WriteRawRC ( CommandReg, PCD_IDLE );
+    WriteRawRC ( BitFramingReg, 0x00 );
+    WriteRawRC ( TxModeReg, 0x00 );
+    WriteRawRC ( RxModeReg, 0x00 );
+    WriteRawRC ( TReloadRegH, 0 );
+    WriteRawRC ( TReloadRegL, NFC_TIMER_RELOAD );
+    return cStatus;
+}
+
 /* 函数名：PcdRequest
  * 描述  ：寻卡
  * 输入  ：ucReq_code，寻卡方式
@@ -436,8 +411,7 @@ char PcdRequest ( uint8_t ucReq_code, uint8_t * pTagType )
     uint32_t ulLen;
 
     ClearBitMask ( Status2Reg, 0x08 );	//清理指示MIFARECyptol单元接通以及所有卡的数据通信被加密的情况
-    WriteRawRC ( BitFramingReg, 0x07 );	//	发送的最后一个字节的 七位
-    SetBitMask ( TxControlReg, 0x03 );	//TX1,TX2管脚的输出信号传递经发送调制的13.56的能量载波信号
+    WriteRawRC ( BitFramingReg, 0x07 );	//	发送的最后一个字节的 七位,天线由调用者打开(NFC_FieldOn)
 
     ucComMF522Buf [ 0 ] = ucReq_code;		//存入 卡片命令字
 
@@ -449,7 +423,14 @@ char PcdRequest ( uint8_t ucReq_code, uint8_t * pTagType )
        * ( pTagType + 1 ) = ucComMF522Buf [ 1 ];
     }
      
-    else
+    else if ( cStatus == MI_ERR && ( ReadRawRC ( ErrorReg ) & 0x1B ) == 0x08 )
+    {
+       //只有位冲突:多张卡的ATQA不同,ISO14443-3允许,由防冲突区分卡片。出错时FIFO没有读出
+       RC522_ReadFifo ( pTagType, 2 );
+       cStatus = MI_OK;
+    }
+
+    else if ( cStatus != MI_NOTAGERR )	//没有应答时返回MI_NOTAGERR,寻卡调度据此区分有没有信号
      cStatus = MI_ERR;
 
     return cStatus;
@@ -543,8 +524,7 @@ void CalulateCRC ( uint8_t * pIndata, uint8_t ucLen, uint8_t * pOutData )
     WriteRawRC(CommandReg,PCD_IDLE);
     SetBitMask(FIFOLevelReg,0x80);
     
-    for ( uc = 0; uc < ucLen; uc ++)
-        WriteRawRC ( FIFODataReg, * ( pIndata + uc ) );   
+    RC522_WriteFifo ( pIndata, ucLen );
 
     WriteRawRC ( CommandReg, PCD_CALCCRC );
     uc = 0xFF;
@@ -582,7 +562,7 @@ char PcdAuthState ( uint8_t ucAuth_mode, uint8_t ucAddr, uint8_t * pKey, uint8_t
     for ( uc = 0; uc < 6; uc ++ )
         ucComMF522Buf [ uc + 2 ] = * ( pKey + uc );   
     
-    for ( uc = 0; uc < 6; uc ++ )
+    for ( uc = 0; uc < 4; uc ++ )   // 认证只用UID的前4字节,多读会越界
         ucComMF522Buf [ uc + 8 ] = * ( pSnr + uc );   
 
     cStatus = PcdComMF522 ( PCD_AUTHENT, ucComMF522Buf, 12, ucComMF522Buf, & ulLen );
@@ -692,162 +672,613 @@ char PcdHalt( void )
 
 
 
-static TaskHandle_t nfcTaskHandle = NULL;  // 任务句柄
-static uint8_t write_nfc_key_flag = 0;
-static uint8_t my_nfc_key[6] = {0x12, 0x34, 0x56, 0x78, 0x90, 0xAB};//自定义卡密钥
-static uint8_t my_nfc_data[16] = {0x12, 0x34, 0x56, 0x78, 0x90, 0xAB, 0xCD, 0xEF, 0x12,\
- 0x34, 0x56, 0x78, 0x90, 0xAB, 0xCD, 0xEF};//自定义卡数据
+static volatile int32_t nfc_enroll_user = NFC_ENROLL_NONE;  // 等待登记下一张卡的用户
+static NFC_PollStats_t nfc_poll_stats = {0, 0, 0, 0xFFFFFFFF, 0, 0, 0, 0, 0};  // 寻卡耗时统计
+/* 寻卡调度状态 */
+#define NFC_POLL_IDLE           0       // 没有卡,按idle_ms寻卡
+#define NFC_POLL_FAST           1       // 有信号或卡片刚移走,按fast_ms寻卡
+#define NFC_POLL_REMOVE         2       // 卡片处理完,按fast_ms检查是否移走
+
+static NFC_PollPolicy_t nfc_policy = {NFC_POLL_IDLE_MS, NFC_POLL_FAST_MS, NFC_POLL_HOLD_MS, NFC_POLL_SETTLE_MS};
+static uint32_t nfc_field_on_us = 0;        // 天线打开的时间
+static uint32_t nfc_field_rem_us = 0;       // 天线打开时间累计到rf_on_ms后剩下的不足1ms的部分
+static TickType_t nfc_start_tick = 0;       // 开始统计天线占空比的时间
+/* 基准测试请求,由NFC任务在两次寻卡之间执行,避免和正在进行的读卡操作冲突 */
+static volatile uint16_t nfc_bench_count = 0;
+static volatile uint8_t nfc_bench_ops = 0;      // 1: 协议操作基准测试,0: 寻卡基准测试
+static TaskHandle_t nfc_bench_requester = NULL;
+static NFC_PollStats_t nfc_bench_result;
+static NFC_OpStats_t nfc_bench_ops_result[RC522_SPI_MODE_NUM][NFC_OP_NUM];
+
+#define NFC_BENCH_TIMEOUT       5000    // 等待基准测试完成的时间(ms)
+
+static const uint8_t nfc_default_key[CRED_NFC_KEY_SIZE] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};  // 出厂密钥
+/* 尾块的访问控制位,保持出厂设置:密钥A可读写数据块和尾块 */
+static const uint8_t nfc_access_bits[4] = {0xFF, 0x07, 0x80, 0x69};
+
+/**
+ * @brief 登记下一张出示的卡:写入随机令牌,扇区密钥改为该卡的分散密钥,并加入凭据库
+ * @param user 卡片所属用户
+ */
+void NFC_EnrollCard(uint16_t user)
+{
+    nfc_enroll_user = user;
+}
 
 void NFC_Write_Key_Data(void)
 {
-    write_nfc_key_flag = 1;
+    NFC_EnrollCard(CRED_ADMIN_USER);
 }
 
-void NFC_Task(void *argument)
+//打开天线,等卡片上电
+static void NFC_FieldOn(uint8_t settle_ms)
 {
-    // 声明变量 
-    char cStr[30], tStr[30];
-    uint8_t ucArray_ID[4];             // 存放IC卡的类型和UID
-    uint8_t ucStatusReturn;            // 返回状态
-    uint8_t snr;                       // 扇区号
-    uint8_t buf[16];                   // 数据缓冲区
-    uint8_t checkFailFlag = 0;
-    uint8_t DefaultKey[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};  // 默认密钥
-    
-    
-    while(1)
+    nfc_field_on_us = LOG_GetTimeUs();
+    PcdAntennaOn();
+    vTaskDelay(pdMS_TO_TICKS(settle_ms));
+}
+
+//关闭天线,累计天线打开的时间
+static void NFC_FieldOff(void)
+{
+    uint32_t us;
+
+    PcdAntennaOff();
+    us = nfc_field_rem_us + (LOG_GetTimeUs() - nfc_field_on_us);
+    nfc_poll_stats.rf_on_ms += us / 1000U;
+    nfc_field_rem_us = us % 1000U;
+}
+
+//累计一次寻卡耗时
+static void NFC_PollStatsAdd(NFC_PollStats_t *stats, uint32_t us, uint32_t cpu_us, uint8_t found)
+{
+    stats->polls++;
+    stats->cpu_us += cpu_us;
+    if (found)
     {
-        // 寻卡操作 - 请求所有卡片
-        ucStatusReturn = PcdRequest(PICC_REQALL, ucArray_ID);
-        
-        if(ucStatusReturn == MI_OK)
+        stats->found++;
+    }
+    stats->last_us = us;
+    stats->total_us += us;
+    if (us < stats->min_us)
+    {
+        stats->min_us = us;
+    }
+    if (us > stats->max_us)
+    {
+        stats->max_us = us;
+    }
+}
+
+//带耗时统计的寻卡,天线已经打开
+static char NFC_PollRequest(NFC_PollStats_t *stats, uint8_t *pTagType)
+{
+    uint32_t start = LOG_GetTimeUs();
+    uint32_t sleep = nfc_sleep_us;
+    uint32_t us;
+    char status;
+
+    // 卡片收到WUPA后约100us应答,用短超时,没有卡时天线早点关
+    WriteRawRC(TReloadRegL, NFC_PRESENCE_RELOAD);
+    status = PcdRequest(PICC_REQALL, pTagType);
+    WriteRawRC(TReloadRegL, NFC_TIMER_RELOAD);
+    us = LOG_GetTimeUs() - start;
+
+    NFC_PollStatsAdd(stats, us, us - (nfc_sleep_us - sleep), status == MI_OK);
+    return status;
+}
+
+//累计一次协议操作的周期数
+static char NFC_OpStatsAdd(NFC_OpStats_t *stats, uint32_t start, char status)
+{
+    uint32_t cycles = DWT->CYCCNT - start;
+
+    stats->runs++;
+    if (status == MI_OK)
+    {
+        stats->ok++;
+    }
+    stats->total_cycles += cycles;
+    if (cycles > stats->max_cycles)
+    {
+        stats->max_cycles = cycles;
+    }
+    return status;
+}
+
+//一种传输方式下的一轮协议操作:寻卡、防冲突、选卡认证后读令牌块,最后让卡休眠,下一轮重新寻卡
+static void NFC_BenchOpsOnce(NFC_OpStats_t *stats)
+{
+    CRED_Entry_t entry;
+    uint8_t uid[NFC_UID_SIZE];
+    uint8_t key[CRED_NFC_KEY_SIZE];
+    uint8_t buf[MAXRLEN];
+    uint32_t start;
+
+    start = DWT->CYCCNT;
+    if (NFC_OpStatsAdd(&stats[NFC_OP_REQUEST], start, PcdRequest(PICC_REQALL, buf)) != MI_OK)
+    {
+        return;
+    }
+    start = DWT->CYCCNT;
+    if (NFC_OpStatsAdd(&stats[NFC_OP_ANTICOLL], start, PcdAnticoll(uid)) != MI_OK ||
+        PcdSelect(uid) != MI_OK)
+    {
+        return;
+    }
+    // 登记过的卡用分散密钥,其他卡用出厂密钥
+    if (CRED_Find(CRED_TYPE_NFC_UID, uid, NFC_UID_SIZE, &entry) != CRED_NONE)
+    {
+        CRED_NfcKey(uid, NFC_UID_SIZE, NFC_SECTOR, key);
+    }
+    else
+    {
+        memcpy(key, nfc_default_key, sizeof(key));
+    }
+    if (PcdAuthState(KEYA, NFC_TRAILER_BLOCK, key, uid) == MI_OK)
+    {
+        start = DWT->CYCCNT;
+        NFC_OpStatsAdd(&stats[NFC_OP_READ], start, PcdRead(NFC_TOKEN_BLOCK, buf));
+    }
+    PcdHalt();
+}
+
+//执行shell请求的基准测试:连续寻卡count次,或者两种传输方式下各执行count轮协议操作
+static void NFC_RunBench(void)
+{
+    NFC_PollStats_t result = {0, 0, 0, 0xFFFFFFFF, 0, 0, 0, 0, 0};
+    RC522_SpiMode_t mode;
+    uint8_t tag[4];
+    uint16_t i;
+
+    NFC_FieldOn(nfc_policy.settle_ms);
+    if (nfc_bench_ops)
+    {
+        memset(nfc_bench_ops_result, 0, sizeof(nfc_bench_ops_result));
+        for (mode = RC522_SPI_HAL; mode < RC522_SPI_MODE_NUM; mode++)
         {
-            // 成功读取到卡片
-            sprintf(tStr, "Card type: %02X%02X",
-                    ucArray_ID[0],
-                    ucArray_ID[1]);
-            printf("%s\r\n", tStr);
-
-            // 防冲撞操作 - 获取卡片序列号
-            ucStatusReturn = PcdAnticoll(ucArray_ID);
-            if(ucStatusReturn == MI_OK)
+            RC522_SPI_SetMode(mode);
+            for (i = 0; i < nfc_bench_count; i++)
             {
-                sprintf(cStr, "Card ID: %02X%02X%02X%02X",
-                        ucArray_ID[0],
-                        ucArray_ID[1],
-                        ucArray_ID[2],
-                        ucArray_ID[3]);
-                printf("%s\r\n", cStr);
-                
-                // 选择卡片
-                ucStatusReturn = PcdSelect(ucArray_ID);
-                if(ucStatusReturn == MI_OK)
-                {
-                    printf("Card selection successful\r\n");
-                    
-                    // 选择扇区1进行操作
-                    snr = 1;  
-                    
-                    // 验证扇区密码 - 使用密钥A验证，密钥位于每个扇区的第3块
-                    // 如果验证了密钥A，且密钥A被配置为允许读取和写入，则可以对数据块进行读写操作。
-                    // 如果验证了密钥B，且密钥B被配置为只允许读取，则只能读取数据，不能写入
-                    ucStatusReturn = PcdAuthState(KEYA, (snr*4+3), DefaultKey, ucArray_ID);
-                    if(ucStatusReturn == MI_OK)
-                    {
-                        printf("NFC authentication successful\r\n");
-
-                        
-                        // 读取数据 - 读取扇区1的第0块数据
-                        ucStatusReturn = PcdRead((snr*4+0), buf);
-                        
-                        if(ucStatusReturn == MI_OK)
-                        {
-                            printf("Read card successful! Data: ");
-                            for(int i = 0; i < 16; i++)
-                            {
-                                if(buf[i] != my_nfc_data[i])
-                                {
-                                    checkFailFlag = 1;
-                                }
-                                printf("%02X ", buf[i]);
-                            }
-                            printf("\r\n");
-                            if(checkFailFlag == 0)
-                            {
-                                SendLockCommand(1);
-                            } else
-                            {
-                                printf("NFC open door data check failed\r\n");
-                            }
-                            checkFailFlag = 0;
-                            
-
-                            if(write_nfc_key_flag == 1)//用于写数据
-                            {
-                                // //修改密钥A
-                                // // 读取尾块
-                                // ucStatusReturn = PcdRead((snr*4+3), tailBlock);
-                                // if (ucStatusReturn != MI_OK) { return; }
-
-                                // // 修改密钥A和密钥B，保留访问控制位
-                                // memcpy(tailBlock, my_nfc_key, 6);      // 替换密钥A
-                                // memcpy(tailBlock+10, my_nfc_key, 6);  // 替换密钥B
-
-                                //     // 写回尾块
-                                // ucStatusReturn = PcdWrite((snr*4+3), tailBlock);
-                                // if(ucStatusReturn == MI_OK)
-                                // {
-                                //     printf("Write key successful!\r\n");
-                                    
-                                // }
-                                // else
-                                // {
-                                //     printf("Write key failed, error code: %d\r\n", ucStatusReturn);
-                                // }   
-                                
-                                // 修改buf中的数据
-                                ucStatusReturn = PcdWrite((snr*4+0), my_nfc_data);
-                                if(ucStatusReturn == MI_OK)
-                                {
-                                    printf("Write card successful!\r\n");
-                                }
-                                else
-                                {
-                                    printf("Write card failed, error code: %d\r\n", ucStatusReturn);
-                                }
-                                write_nfc_key_flag = 0;
-                            }
-                            
-                            // 等待卡片被移除
-                            while(PcdRequest(PICC_REQALL, ucArray_ID) == MI_OK)
-                            {
-                                vTaskDelay(100);  // 等待一段时间再检查
-                            }
-                            printf("Card removed\r\n");
-                        }
-                        else
-                        {
-                            printf("Read card failed, error code: %d\r\n", ucStatusReturn);
-                        }
-                    }
-                    else
-                    {
-                        printf("Key authentication failed, error code: %d\r\n", ucStatusReturn);
-                    }
-                }
-                else
-                {
-                    printf("Card selection failed, error code: %d\r\n", ucStatusReturn);
-                }
+                NFC_BenchOpsOnce(nfc_bench_ops_result[mode]);
             }
-            else
+        }
+        RC522_SPI_SetMode(RC522_SPI_FAST);
+    }
+    else
+    {
+        for (i = 0; i < nfc_bench_count; i++)
+        {
+            NFC_PollRequest(&result, tag);
+        }
+        nfc_bench_result = result;
+    }
+    NFC_FieldOff();
+    nfc_bench_count = 0;
+    xTaskNotifyGive(nfc_bench_requester);
+}
+
+//请求NFC任务执行基准测试并等待结果
+static int NFC_BenchWait(uint16_t count, uint8_t ops)
+{
+    if (nfcTaskHandle == NULL || count == 0)
+    {
+        return -1;
+    }
+    nfc_bench_requester = xTaskGetCurrentTaskHandle();
+    nfc_bench_ops = ops;
+    nfc_bench_count = count;
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NFC_BENCH_TIMEOUT)) == 0)
+    {
+        nfc_bench_count = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 设置寻卡调度参数,下一次寻卡生效
+ * @return 0: 成功; -1: 参数不合理
+ */
+int NFC_SetPolicy(const NFC_PollPolicy_t *policy)
+{
+    if (policy->idle_ms == 0 || policy->fast_ms == 0 || policy->fast_ms > policy->idle_ms)
+    {
+        return -1;
+    }
+    taskENTER_CRITICAL();
+    nfc_policy = *policy;
+    taskEXIT_CRITICAL();
+    return 0;
+}
+
+void NFC_GetPolicy(NFC_PollPolicy_t *policy)
+{
+    taskENTER_CRITICAL();
+    *policy = nfc_policy;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief 获取NFC任务寻卡耗时统计
+ */
+void NFC_GetPollStats(NFC_PollStats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = nfc_poll_stats;
+    taskEXIT_CRITICAL();
+    stats->up_ms = (xTaskGetTickCount() - nfc_start_tick) * portTICK_PERIOD_MS;
+}
+
+/**
+ * @brief 寻卡耗时基准测试,由NFC任务执行,调用者阻塞等待结果
+ * @param count 连续寻卡次数
+ * @param result 返回统计结果
+ * @return 0: 成功; -1: 超时(NFC任务没有运行)
+ */
+int NFC_Bench(uint16_t count, NFC_PollStats_t *result)
+{
+    if (NFC_BenchWait(count, 0) != 0)
+    {
+        return -1;
+    }
+    *result = nfc_bench_result;
+    return 0;
+}
+
+/**
+ * @brief 寻卡、防冲突、读块的周期数基准测试,原来的HAL传输和BSRR快速传输各执行count轮,
+ *        由NFC任务执行,读卡器上要放一张卡,调用者阻塞等待结果
+ * @param count 每种传输方式的轮数
+ * @param result 返回统计结果,按传输方式和操作索引
+ * @return 0: 成功; -1: 超时(NFC任务没有运行)
+ */
+int NFC_BenchOps(uint16_t count, NFC_OpStats_t result[RC522_SPI_MODE_NUM][NFC_OP_NUM])
+{
+    if (NFC_BenchWait(count, 1) != 0)
+    {
+        return -1;
+    }
+    memcpy(result, nfc_bench_ops_result, sizeof(nfc_bench_ops_result));
+    return 0;
+}
+
+//认证失败后卡片不再响应,重新寻卡并选择同一张卡
+static char NFC_Reselect(const ISO14443_Card_t *card)
+{
+    ISO14443_Card_t again;
+    uint8_t tag[2];
+
+    if (PcdRequest(PICC_REQALL, tag) != MI_OK || ISO14443_Select(&again) != MI_OK ||
+        again.uid_len != card->uid_len || memcmp(again.uid, card->uid, card->uid_len) != 0)
+    {
+        return MI_ERR;
+    }
+    return MI_OK;
+}
+
+//Classic卡认证用UID的最后4字节(7字节UID为CL2)
+#define NFC_AUTH_UID(card)      ((card)->uid + (card)->uid_len - 4)
+
+//读ISO14443-4卡的令牌:选择应用,SELECT的应答正好是令牌时直接使用(手机应用),否则再读文件(DESFire)。
+//之后天线关闭,不用DESELECT
+static char NFC_ReadAppToken(ISO14443_Card_t *card, uint8_t *token)
+{
+    static const uint8_t select[] = {0x00, 0xA4, 0x04, 0x00, NFC_APP_AID_SIZE, NFC_APP_AID, 0x00};
+    static const uint8_t read[] = {0x00, 0xB0, 0x80 | NFC_APP_TOKEN_SFI, 0x00, CRED_TOKEN_SIZE};
+    uint8_t resp[ISO14443_INF_MAX];
+    uint16_t len;
+
+    if (ISO14443_Rats(card) != MI_OK ||
+        ISO14443_Exchange(card, select, sizeof(select), resp, sizeof(resp), &len) != MI_OK ||
+        len < 2 || resp[len - 2] != 0x90 || resp[len - 1] != 0x00)
+    {
+        return MI_ERR;
+    }
+    if (len != CRED_TOKEN_SIZE + 2 &&
+        (ISO14443_Exchange(card, read, sizeof(read), resp, sizeof(resp), &len) != MI_OK ||
+         len != CRED_TOKEN_SIZE + 2 || resp[CRED_TOKEN_SIZE] != 0x90 || resp[CRED_TOKEN_SIZE + 1] != 0x00))
+    {
+        return MI_ERR;
+    }
+    memcpy(token, resp, CRED_TOKEN_SIZE);
+    return MI_OK;
+}
+
+//读登记过的卡的令牌:Classic用分散密钥认证后读块,NTAG用分散密码PWD_AUTH后FAST_READ,
+//ISO14443-4卡读应用文件,都是一到两次交换
+static char NFC_ReadToken(ISO14443_Card_t *card, uint8_t *token)
+{
+    uint8_t key[CRED_NFC_KEY_SIZE];
+
+    switch (ISO14443_Type(card))
+    {
+        case ISO14443_CARD_CLASSIC:
+            CRED_NfcKey(card->uid, card->uid_len, NFC_SECTOR, key);
+            if (PcdAuthState(KEYA, NFC_TRAILER_BLOCK, key, NFC_AUTH_UID(card)) != MI_OK)
             {
-                printf("Anticollision failed, error code: %d\r\n", ucStatusReturn);
+                return MI_ERR;
             }
+            return PcdRead(NFC_TOKEN_BLOCK, token);
+        case ISO14443_CARD_NTAG:
+            CRED_NfcKey(card->uid, card->uid_len, NFC_NTAG_KEY_SECTOR, key);
+            if (NTAG_PwdAuth(key, key + NTAG_PWD_SIZE) != MI_OK)
+            {
+                return MI_ERR;
+            }
+            return NTAG_FastRead(NFC_NTAG_TOKEN_PAGE,
+                                 NFC_NTAG_TOKEN_PAGE + CRED_TOKEN_SIZE / NTAG_PAGE_SIZE - 1, token);
+        case ISO14443_CARD_ISO4:
+            return NFC_ReadAppToken(card, token);
+        default:
+            return MI_ERR;
+    }
+}
+
+//判定卡片所属用户:先按UID查凭据库,没登记的卡不做射频认证,判定时间与登记的卡数无关
+static int NFC_CheckCard(ISO14443_Card_t *card)
+{
+    CRED_Entry_t entry;
+    uint8_t buf[16];
+    int user;
+
+    if (CRED_Find(CRED_TYPE_NFC_UID, card->uid, card->uid_len, &entry) != CRED_NONE)
+    {
+        user = CRED_CheckNfcToken(&entry, NULL);
+        if (user != CRED_NONE)
+        {
+            return user;    // 只登记了UID的卡
         }
+        if (NFC_ReadToken(card, buf) != MI_OK)
+        {
+            LOG_ERR("NFC card key or read failed\r\n");
+            return CRED_NONE;
+        }
+        return CRED_CheckNfcToken(&entry, buf);
+    }
+    // 手机模拟卡的UID每次随机,按应用中的令牌查凭据
+    if (ISO14443_Type(card) == ISO14443_CARD_ISO4)
+    {
+        if (NFC_ReadAppToken(card, buf) != MI_OK)
+        {
+            LOG_ERR("NFC app token read failed\r\n");
+            return CRED_NONE;
+        }
+        return CRED_MatchNfc(card->uid, card->uid_len, buf);
+    }
+    // 兼容旧卡:出厂密钥、所有卡写同一个令牌
+    if (ISO14443_Type(card) == ISO14443_CARD_CLASSIC && CRED_Count(CRED_TYPE_NFC_TOKEN) > 0 &&
+        PcdAuthState(KEYA, NFC_TRAILER_BLOCK, (uint8_t *)nfc_default_key, NFC_AUTH_UID(card)) == MI_OK &&
+        PcdRead(NFC_TOKEN_BLOCK, buf) == MI_OK)
+    {
+        LOG_HEX("Read card successful! Data", buf, 16);
+        return CRED_MatchNfc(card->uid, card->uid_len, buf);
+    }
+    return CRED_NONE;
+}
 
-        // 添加适当的延时，避免过于频繁的读卡操作
-        vTaskDelay(200);
+//登记Classic卡:新卡用出厂密钥认证,重新登记的卡用它的分散密钥
+static char NFC_EnrollClassic(ISO14443_Card_t *card, uint8_t *token)
+{
+    uint8_t key[CRED_NFC_KEY_SIZE];
+    uint8_t trailer[16];
+    char status;
+
+    CRED_NfcKey(card->uid, card->uid_len, NFC_SECTOR, key);
+    status = PcdAuthState(KEYA, NFC_TRAILER_BLOCK, (uint8_t *)nfc_default_key, NFC_AUTH_UID(card));
+    if (status != MI_OK && NFC_Reselect(card) == MI_OK)
+    {
+        status = PcdAuthState(KEYA, NFC_TRAILER_BLOCK, key, NFC_AUTH_UID(card));
+    }
+    if (status == MI_OK)
+    {
+        status = PcdWrite(NFC_TOKEN_BLOCK, token);
+    }
+    if (status == MI_OK)
+    {
+        memcpy(trailer, key, CRED_NFC_KEY_SIZE);                        // 密钥A
+        memcpy(trailer + CRED_NFC_KEY_SIZE, nfc_access_bits, sizeof(nfc_access_bits));
+        memcpy(trailer + 10, key, CRED_NFC_KEY_SIZE);                   // 密钥B
+        status = PcdWrite(NFC_TRAILER_BLOCK, trailer);
+    }
+    return status;
+}
+
+//登记NTAG:写令牌,设置分散密码和PACK,最后打开保护(令牌页开始读写都要认证)。
+//配置页读不出说明已经设置过密码,重新选卡后用分散密码认证
+static char NFC_EnrollNtag(ISO14443_Card_t *card, const uint8_t *token)
+{
+    uint8_t version[NTAG_VERSION_SIZE];
+    uint8_t key[CRED_NFC_KEY_SIZE];
+    uint8_t cfg0[NTAG_PAGE_SIZE];
+    uint8_t page[NTAG_PAGE_SIZE];
+    uint8_t cfg, i, fresh;
+
+    if (NTAG_GetVersion(version) != MI_OK || (cfg = NTAG_ConfigPage(version)) == 0)
+    {
+        return MI_ERR;
+    }
+    CRED_NfcKey(card->uid, card->uid_len, NFC_NTAG_KEY_SECTOR, key);
+    fresh = NTAG_FastRead(cfg, cfg, cfg0) == MI_OK;
+    if (!fresh && (NFC_Reselect(card) != MI_OK || NTAG_PwdAuth(key, key + NTAG_PWD_SIZE) != MI_OK))
+    {
+        return MI_ERR;
+    }
+    for (i = 0; i < CRED_TOKEN_SIZE / NTAG_PAGE_SIZE; i++)
+    {
+        if (NTAG_Write(NFC_NTAG_TOKEN_PAGE + i, token + i * NTAG_PAGE_SIZE) != MI_OK)
+        {
+            return MI_ERR;
+        }
+    }
+    memset(page, 0, sizeof(page));
+    memcpy(page, key + NTAG_PWD_SIZE, NTAG_PACK_SIZE);
+    if (NTAG_Write(cfg + 2, key) != MI_OK || NTAG_Write(cfg + 3, page) != MI_OK)   // PWD、PACK
+    {
+        return MI_ERR;
+    }
+    if (fresh)
+    {
+        memset(page, 0, sizeof(page));
+        page[0] = NTAG_ACCESS_PROT;                                         // CFG1
+        cfg0[NTAG_AUTH0_OFFSET] = NFC_NTAG_TOKEN_PAGE;
+        if (NTAG_Write(cfg + 1, page) != MI_OK || NTAG_Write(cfg, cfg0) != MI_OK)
+        {
+            return MI_ERR;
+        }
+    }
+    return MI_OK;
+}
+
+//登记卡片:Classic和NTAG写入随机令牌后按UID登记;ISO14443-4卡的令牌由发卡或手机应用写入,按令牌登记
+static char NFC_Enroll(ISO14443_Card_t *card, uint16_t user)
+{
+    uint8_t token[CRED_TOKEN_SIZE];
+    char status;
+
+    switch (ISO14443_Type(card))
+    {
+        case ISO14443_CARD_ISO4:
+            if (NFC_ReadAppToken(card, token) != MI_OK)
+            {
+                return MI_ERR;
+            }
+            CRED_Remove(CRED_TYPE_NFC_TOKEN, token, CRED_KEY_SIZE);
+            return CRED_Add(CRED_TYPE_NFC_TOKEN, user, token, CRED_KEY_SIZE, token) == 0 ? MI_OK : MI_ERR;
+        case ISO14443_CARD_CLASSIC:
+        case ISO14443_CARD_NTAG:
+            if (RNG_Read(token, sizeof(token)) != 0)
+            {
+                return MI_ERR;
+            }
+            status = ISO14443_Type(card) == ISO14443_CARD_CLASSIC ? NFC_EnrollClassic(card, token) :
+                                                                     NFC_EnrollNtag(card, token);
+            break;
+        default:
+            return MI_ERR;
+    }
+    if (status != MI_OK)
+    {
+        return status;
+    }
+    CRED_Remove(CRED_TYPE_NFC_UID, card->uid, card->uid_len);     // 重新登记时替换旧令牌
+    return CRED_Add(CRED_TYPE_NFC_UID, user, card->uid, card->uid_len, token) == 0 ? MI_OK : MI_ERR;
+}
+
+//处理寻到的卡片:级联防冲突、选卡,然后登记或者验证,返回MI_OK表示选中了卡片(之后等它移走)
+static char NFC_HandleCard(uint32_t card_us)
+{
+    ISO14443_Card_t card;              // 卡片UID和SAK
+    char ucStatusReturn;               // 返回状态
+    int32_t enroll;                    // 等待登记的用户
+    int user;                          // 卡片所属用户
+
+    // 防冲撞并选择卡片,7/10字节UID逐级选择
+    ucStatusReturn = ISO14443_Select(&card);
+    if(ucStatusReturn != MI_OK)
+    {
+        LOG_ERR("Card selection failed, error code: %d\r\n", ucStatusReturn);
+        return ucStatusReturn;
+    }
+    LOG_INFO("Card SAK: %02X, UID length: %d\r\n", card.sak, card.uid_len);
+    LOG_HEX("Card UID", card.uid, card.uid_len);
+
+    enroll = nfc_enroll_user;
+    if(enroll != NFC_ENROLL_NONE)
+    {
+        nfc_enroll_user = NFC_ENROLL_NONE;
+        ucStatusReturn = NFC_Enroll(&card, (uint16_t)enroll);
+        if(ucStatusReturn == MI_OK)
+        {
+            LOG_INFO("NFC card enrolled for user %d\r\n", enroll);
+        }
+        else
+        {
+            LOG_ERR("Write card failed, error code: %d\r\n", ucStatusReturn);
+        }
+    }
+    else if(!AUTH_Allow(AUTH_SRC_NFC))
+    {
+        // 锁定期间不做卡片认证,只等卡片移走
+    }
+    else
+    {
+        user = NFC_CheckCard(&card);
+        if(user != CRED_NONE)
+        {
+            LOG_INFO("NFC card of user %d\r\n", user);
+        }
+        else
+        {
+            LOG_ERR("NFC open door data check failed\r\n");
+        }
+        AUTH_Request(AUTH_SRC_NFC, user, card_us);
+    }
+    return MI_OK;
+}
+
+/* 寻卡调度:
+ * 1.每次寻卡只短暂打开天线:开天线,等卡片上电settle_ms,发一次WUPA(短超时),没有卡就关天线;
+ * 2.没有卡时按idle_ms寻卡;收到不完整的应答(冲突、耦合弱)时切到fast_ms,保持hold_ms;
+ * 3.寻到卡后天线保持打开,完成防冲突、选卡和认证,之后按fast_ms检查卡片是否移走,
+ *   每次检查都重新上电,卡片会重新应答WUPA;移走后快速寻卡hold_ms,方便再次出示 */
+static uint8_t nfc_state = NFC_POLL_IDLE;
+static TickType_t nfc_fast_until = 0;
+
+/**
+ * @brief 执行一次寻卡调度(开天线、寻卡、处理卡片、关天线)
+ * @return 到下一次寻卡的间隔(ms)。NFC任务循环调用,主机上的仿真(tools/host/nfc_sim.c)也直接调用
+ */
+uint32_t NFC_PollOnce(void)
+{
+    uint8_t tag[2];                    // 卡片类型
+    char status;
+    uint32_t card_us;                  // 开始寻到卡的时间,作为出示卡片的时间
+    NFC_PollPolicy_t policy = nfc_policy;
+
+    card_us = LOG_GetTimeUs();
+    NFC_FieldOn(policy.settle_ms);
+    status = NFC_PollRequest(&nfc_poll_stats, tag);
+    if(nfc_state == NFC_POLL_REMOVE)
+    {
+        if(status == MI_NOTAGERR)
+        {
+            LOG_INFO("Card removed\r\n");
+            nfc_state = NFC_POLL_FAST;
+            nfc_fast_until = xTaskGetTickCount() + pdMS_TO_TICKS(policy.hold_ms);
+        }
+    }
+    else if(status == MI_OK)
+    {
+        LOG_DEBUG("Card type: %02X%02X\r\n", tag[0], tag[1]);
+        nfc_state = NFC_HandleCard(card_us) == MI_OK ? NFC_POLL_REMOVE : NFC_POLL_FAST;
+        nfc_fast_until = xTaskGetTickCount() + pdMS_TO_TICKS(policy.hold_ms);
+    }
+    else if(status != MI_NOTAGERR)
+    {
+        // 有应答但不完整,可能卡片正在靠近
+        nfc_state = NFC_POLL_FAST;
+        nfc_fast_until = xTaskGetTickCount() + pdMS_TO_TICKS(policy.hold_ms);
+    }
+    NFC_FieldOff();
+
+    if(nfc_state == NFC_POLL_FAST && (int32_t)(xTaskGetTickCount() - nfc_fast_until) >= 0)
+    {
+        nfc_state = NFC_POLL_IDLE;
+    }
+    return nfc_state == NFC_POLL_IDLE ? policy.idle_ms : policy.fast_ms;
+}
+
+void NFC_Task(void *argument)
+{
+    nfc_start_tick = xTaskGetTickCount();
+    while(1)
+    {
+        if(nfc_bench_count != 0)
+        {
+            NFC_RunBench();
+        }
+        vTaskDelay(pdMS_TO_TICKS(NFC_PollOnce()));
     }
 }
 
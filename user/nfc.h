@@ -16,6 +16,7 @@ extern "C" {
 
 #include "main.h"
 #include "hard_enable_ctrl.h"
+#include "rc522_spi.h"
 
 #if NFC_ENABLE
 
@@ -37,6 +38,7 @@ extern "C" {
 #define PICC_REQALL           0x52               //寻天线区内全部卡
 #define PICC_ANTICOLL1        0x93               //防冲撞
 #define PICC_ANTICOLL2        0x95               //防冲撞
+#define PICC_ANTICOLL3        0x97               //防冲撞(第三级)
 #define PICC_AUTHENT1A        0x60               //验证A密钥
 #define PICC_AUTHENT1B        0x61               //验证B密钥
 #define PICC_READ             0x30               //读块
@@ -49,6 +51,15 @@ extern "C" {
 
 #define DEF_FIFO_LENGTH       64                 //FIFO size=64byte
 #define MAXRLEN  18
+#define NFC_COM_TIMEOUT_US    25000              //和卡片通讯的最长等待时间,操作M1卡最长25ms
+#define NFC_TIMER_RELOAD      30                 //RC522定时器重装值,约0.5ms一个计数,15ms超时
+#define NFC_TIMER_US          500                //RC522定时器一个计数的时间(us)
+#define NFC_PRESENCE_RELOAD   2                  //检测有没有卡时的重装值,1ms超时
+#define NFC_COM_SPIN_US       300                //没有IRQ线时先查询的时间,覆盖寻卡应答,之后每个tick查询一次
+
+/* RC522的IRQ引脚(低电平有效,推挽输出),NFC_IRQ_ENABLE为1时使用 */
+#define NFC_IRQ_Pin           GPIO_PIN_10
+#define NFC_IRQ_GPIO_Port     GPIOF
 
 //MF522寄存器定义
 
@@ -125,6 +136,7 @@ extern "C" {
 #define 	MI_OK                 0x26
 #define 	MI_NOTAGERR           0xcc
 #define 	MI_ERR                0xbb
+#define 	MI_COLLERR            0xdd               //防冲突时有位冲突
 
 //和MF522通讯时返回的错误代码
 #define	    SHAQU1                0X01
@@ -157,8 +169,6 @@ extern "C" {
 void RC522_Test(void);
 void RC522_Read_ID_Once();
 //uint8_t       SPI_RC522_SendByte         ( uint8_t byte);
-uint8_t       ReadRawRC                  ( uint8_t ucAddress );
-void     WriteRawRC                 ( uint8_t ucAddress, uint8_t ucValue );
 void 		 SPI2_Init									( void );
 void 		 RC522_GPIO_Init(void);
 void     RC522_Handel               ( void );
@@ -178,17 +188,95 @@ char     PcdWrite                   ( uint8_t ucAddr, uint8_t * pData );
 char     PcdRead                    ( uint8_t ucAddr, uint8_t * pData );
 void     ShowID                     ( uint16_t x,uint16_t y, uint8_t *p, uint16_t charColor, uint16_t bkColor);	 //显示卡的卡号，以十六进制显示
 char             PcdHalt            ( void );           //命令卡片进入休眠状态
+
+/* PcdTransceive的收发帧:块头(PCB等)和数据分开,数据直接用调用者的缓冲区,组帧和分块接收都不用拷贝 */
+typedef struct {
+    uint8_t  hdr[2];        /* 块头 */
+    uint8_t  hdr_len;       /* 块头长度,0~2 */
+    uint8_t *data;          /* 数据 */
+    uint8_t  len;           /* 发送:数据长度;接收:收到的数据长度 */
+    uint8_t  max;           /* 接收:data缓冲区大小 */
+} NFC_Frame_t;
+
+#define NFC_CRC_TX            0x01               /* 发送时硬件添加CRC_A */
+#define NFC_CRC_RX            0x02               /* 接收时硬件校验并去掉CRC_A */
+#define NFC_CRC_BOTH          (NFC_CRC_TX | NFC_CRC_RX)
+
+char             PcdTransceive      ( const NFC_Frame_t * pTx, NFC_Frame_t * pRx, uint8_t ucFraming, uint8_t ucCrc, uint16_t usTimer );
 void             CalulateCRC                ( uint8_t * pIndata, uint8_t ucLen, uint8_t * pOutData );
 
 
 
 
 
+/* 开锁卡片:扇区1的第0块存令牌,尾块存该卡的分散密钥(CRED_NfcKey) */
+#define NFC_UID_SIZE            4       /* 单重UID长度,基准测试的PcdAnticoll使用 */
+#define NFC_SECTOR              1
+#define NFC_TOKEN_BLOCK         (NFC_SECTOR * 4 + 0)
+#define NFC_TRAILER_BLOCK       (NFC_SECTOR * 4 + 3)
+/* NTAG21x:第4~7页存令牌,从令牌页开始读写都要PWD_AUTH,密码和PACK由UID分散 */
+#define NFC_NTAG_TOKEN_PAGE     4
+#define NFC_NTAG_KEY_SECTOR     0x80    /* 分散密码时代替扇区号,和Classic的扇区密钥区分 */
+/* ISO14443-4卡(DESFire、手机模拟卡):按AID选择应用,应用的文件中存令牌。
+ * 手机应用可以直接在SELECT的应答中返回令牌,少一次交换。手机的UID每次随机,按令牌登记 */
+#define NFC_APP_AID             0xF0, 0x53, 0x4C, 0x4B, 0x45, 0x59     /* F0 "SLKEY",私有AID */
+#define NFC_APP_AID_SIZE        6
+#define NFC_APP_TOKEN_SFI       0x01    /* 存令牌的文件(短文件标识符) */
+#define NFC_ENROLL_NONE         (-1)    /* 没有等待登记的卡 */
+
+/* 寻卡耗时统计,调试shell的stats/bench命令使用 */
+typedef struct {
+    uint32_t polls;         /* 寻卡次数 */
+    uint32_t found;         /* 寻到卡的次数 */
+    uint32_t last_us;       /* 最近一次寻卡耗时(us) */
+    uint32_t min_us;        /* 最短耗时(us) */
+    uint32_t max_us;        /* 最长耗时(us) */
+    uint32_t total_us;      /* 累计耗时(us),除以polls为平均值 */
+    uint32_t cpu_us;        /* 累计占用CPU的时间(us),不含等待RC522时任务阻塞的时间 */
+    uint32_t rf_on_ms;      /* 天线累计打开时间(ms) */
+    uint32_t up_ms;         /* NFC任务运行时间(ms),rf_on_ms/up_ms为天线占空比 */
+} NFC_PollStats_t;
+
+/* 寻卡调度参数,默认没有卡时的寻卡间隔和原来一样,出示卡片的延时不变 */
+#define NFC_POLL_IDLE_MS        200     /* 没有卡时的寻卡间隔 */
+#define NFC_POLL_FAST_MS        50      /* 有信号、卡片刚移走时的寻卡间隔,也是检查卡片移走的间隔 */
+#define NFC_POLL_HOLD_MS        2000    /* 快速寻卡保持时间 */
+#define NFC_POLL_SETTLE_MS      5       /* 打开天线后等卡片上电的时间(ISO14443-3要求至少5ms) */
+
+typedef struct {
+    uint16_t idle_ms;
+    uint16_t fast_ms;
+    uint16_t hold_ms;
+    uint8_t  settle_ms;
+} NFC_PollPolicy_t;
+
+/* 协议操作耗时基准测试(DWT周期数),调试shell的bench rc522命令使用 */
+typedef enum {
+    NFC_OP_REQUEST = 0,     /* PcdRequest */
+    NFC_OP_ANTICOLL,        /* PcdAnticoll */
+    NFC_OP_READ,            /* PcdRead,认证之后 */
+    NFC_OP_NUM
+} NFC_Op_t;
+
+typedef struct {
+    uint32_t runs;          /* 执行次数 */
+    uint32_t ok;            /* 成功次数 */
+    uint32_t total_cycles;  /* 累计周期数,除以runs为平均值 */
+    uint32_t max_cycles;    /* 最长周期数 */
+} NFC_OpStats_t;
+
 /* NFC相关函数声明 */
 void NFC_Init(void);
 void NFC_ReadCard(void);
 void NFC_WriteCard(uint8_t* data, uint16_t size);
 void NFC_CreateTask(void);
+uint32_t NFC_PollOnce(void);
+void NFC_GetPollStats(NFC_PollStats_t *stats);
+void NFC_EnrollCard(uint16_t user);
+int  NFC_Bench(uint16_t count, NFC_PollStats_t *result);
+int  NFC_SetPolicy(const NFC_PollPolicy_t *policy);
+void NFC_GetPolicy(NFC_PollPolicy_t *policy);
+int  NFC_BenchOps(uint16_t count, NFC_OpStats_t result[RC522_SPI_MODE_NUM][NFC_OP_NUM]);
 #endif /* NFC_ENABLE */
 
 #ifdef __cplusplus
@@ -4,6 +4,9 @@
 #include "lcd_init.h"
 #include "lcd.h"
 #include "priorities.h"
+#include "log.h"
+
+#define LOG_MODULE CAMERA    /* 日志模块名,等级见log_config.h */
 
 	
 DCMI_HandleTypeDef  DCMI_Handler;           //DCMI句柄
@@ -226,12 +229,11 @@ void DCMI_IRQHandler(void)
     //如果不是帧中断则打印
     if((isr & DCMI_MIS_FRAME_MIS ) == 0)
     {
-        printf("DCMI ISR: 0x%x ", isr);
-        if(isr & DCMI_MIS_OVR_MIS) printf("OVR ");
-        if(isr & DCMI_MIS_ERR_MIS) printf("ERR ");
-        if(isr & DCMI_MIS_VSYNC_MIS) printf("VSYNC ");
-        if(isr & DCMI_MIS_LINE_MIS) printf("LINE ");
-        printf("\r\n");
+        LOG_WARN("DCMI ISR: 0x%x OVR:%d ERR:%d VSYNC:%d LINE:%d\r\n", isr,
+                 (isr & DCMI_MIS_OVR_MIS) != 0,
+                 (isr & DCMI_MIS_ERR_MIS) != 0,
+                 (isr & DCMI_MIS_VSYNC_MIS) != 0,
+                 (isr & DCMI_MIS_LINE_MIS) != 0);
     }
     
     HAL_DCMI_IRQHandler(&DCMI_Handler);
@@ -253,7 +255,7 @@ void HAL_DCMI_FrameEventCallback(DCMI_HandleTypeDef *hdcmi)
 
 void HAL_DCMI_ErrorCallback(DCMI_HandleTypeDef *hdcmi)
 {
-    printf("DCMI Error: 0x%x\r\n", hdcmi->ErrorCode);
+    LOG_ERR("DCMI Error: 0x%x\r\n", hdcmi->ErrorCode);
 }
 
 //DMA2数据流1中断服务函数
@@ -0,0 +1,462 @@
+/**
+  ******************************************************************************
+  * @file    p256.c
+  * @author  cyytx
+  * @brief   NIST P-256 ECDSA签名验证的源文件(FIPS 186-4、SEC 1)
+  *          1.域元素、标量是8个32位字(小端字序),模p、模n的乘法都用Montgomery乘法(CIOS),
+  *            内循环是UMLAL乘加,没有除法;加减、约简用掩码选择,不按数据分支;
+  *          2.点用Jacobian坐标(a=-3的倍点公式),G、Q和G+Q预先转成仿射坐标,用混合加法;
+  *          3.u1*G+u2*Q用Shamir方法同时计算:256次倍点,每一位最多一次加法;
+  *            最后比较X和r*Z^2,不需要求逆;模n的逆用费马小定理(指数n-2)。
+  *          验证只处理公开数据(公钥、签名、摘要),点运算按标量的位分支不泄露秘密;
+  *          门锁上没有私钥运算。
+  *          工程默认-O0编译,本文件在工程中单独设置为-O2(见smart_lock.uvprojx)。
+  ******************************************************************************
+  */
+#include <string.h>
+#include "p256.h"
+
+#define P256_WORDS      8
+
+typedef struct {
+    uint32_t x[P256_WORDS];
+    uint32_t y[P256_WORDS];
+    uint32_t z[P256_WORDS];             /* z为0表示无穷远点 */
+} P256_Point_t;
+
+/* 域的模p和群的阶n */
+static const uint32_t P256_P[P256_WORDS] = {
+    0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0x00000000, 0x00000000, 0x00000000, 0x00000001, 0xFFFFFFFF,
+};
+static const uint32_t P256_N[P256_WORDS] = {
+    0xFC632551, 0xF3B9CAC2, 0xA7179E84, 0xBCE6FAAD, 0xFFFFFFFF, 0xFFFFFFFF, 0x00000000, 0xFFFFFFFF,
+};
+#define P256_P0INV      0x00000001U     /* -p^-1 mod 2^32 */
+#define P256_N0INV      0xEE00BC4FU     /* -n^-1 mod 2^32 */
+
+/* R^2 mod p、R^2 mod n(R=2^256),用于转入Montgomery形式 */
+static const uint32_t P256_R2P[P256_WORDS] = {
+    0x00000003, 0x00000000, 0xFFFFFFFF, 0xFFFFFFFB, 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFD, 0x00000004,
+};
+static const uint32_t P256_R2N[P256_WORDS] = {
+    0xBE79EEA2, 0x83244C95, 0x49BD6FA6, 0x4699799C, 0x2B6BEC59, 0x2845B239, 0xF3D95620, 0x66E12D94,
+};
+
+/* 模n的Montgomery形式的1(R mod n) */
+static const uint32_t P256_ONE_N[P256_WORDS] = {
+    0x039CDAAF, 0x0C46353D, 0x58E8617B, 0x43190552, 0x00000000, 0x00000000, 0xFFFFFFFF, 0x00000000,
+};
+/* p - n,r小于它时r+n < p */
+static const uint32_t P256_P_N[P256_WORDS] = {
+    0x039CDAAE, 0x0C46353D, 0x58E8617B, 0x43190553, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+};
+
+/* 以下是Montgomery形式(乘以R mod p):1、曲线参数b、基点G */
+static const uint32_t P256_ONE[P256_WORDS] = {
+    0x00000001, 0x00000000, 0x00000000, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFE, 0x00000000,
+};
+static const uint32_t P256_B[P256_WORDS] = {
+    0x29C4BDDF, 0xD89CDF62, 0x78843090, 0xACF005CD, 0xF7212ED6, 0xE5A220AB, 0x04874834, 0xDC30061D,
+};
+static const uint32_t P256_GX[P256_WORDS] = {
+    0x18A9143C, 0x79E730D4, 0x5FEDB601, 0x75BA95FC, 0x77622510, 0x79FB732B, 0xA53755C6, 0x18905F76,
+};
+static const uint32_t P256_GY[P256_WORDS] = {
+    0xCE95560A, 0xDDF25357, 0xBA19E45C, 0x8B4AB8E4, 0xDD21F325, 0xD2E88688, 0x25885D85, 0x8571FF18,
+};
+
+/* 32字节大端转为小端字序 */
+static void P256_Load(uint32_t *r, const uint8_t *p)
+{
+    uint32_t i;
+
+    for (i = 0; i < P256_WORDS; i++)
+    {
+        const uint8_t *q = p + 4U * (P256_WORDS - 1U - i);
+
+        r[i] = ((uint32_t)q[0] << 24) | ((uint32_t)q[1] << 16) | ((uint32_t)q[2] << 8) | (uint32_t)q[3];
+    }
+}
+
+static int P256_IsZero(const uint32_t *a)
+{
+    uint32_t i, acc = 0;
+
+    for (i = 0; i < P256_WORDS; i++)
+    {
+        acc |= a[i];
+    }
+    return acc == 0;
+}
+
+static int P256_Equal(const uint32_t *a, const uint32_t *b)
+{
+    uint32_t i, acc = 0;
+
+    for (i = 0; i < P256_WORDS; i++)
+    {
+        acc |= a[i] ^ b[i];
+    }
+    return acc == 0;
+}
+
+/* r = a - b,返回借位(0或1) */
+static uint32_t P256_SubRaw(uint32_t *r, const uint32_t *a, const uint32_t *b)
+{
+    uint64_t t;
+    uint32_t i, borrow = 0;
+
+    for (i = 0; i < P256_WORDS; i++)
+    {
+        t = (uint64_t)a[i] - b[i] - borrow;
+        r[i] = (uint32_t)t;
+        borrow = (uint32_t)(t >> 32) & 1U;
+    }
+    return borrow;
+}
+
+/* a < m */
+static int P256_Less(const uint32_t *a, const uint32_t *m)
+{
+    uint32_t t[P256_WORDS];
+
+    return P256_SubRaw(t, a, m);
+}
+
+/* 把进位c和r组成的数约简到[0, m):r>=m时减去m,用掩码选择 */
+static void P256_Reduce(uint32_t *r, uint32_t c, const uint32_t *m)
+{
+    uint32_t t[P256_WORDS];
+    uint32_t i, borrow, mask;
+
+    borrow = P256_SubRaw(t, r, m);
+    mask = 0U - (uint32_t)((c | (borrow ^ 1U)) & 1U);   /* 有进位或者没有借位时取t */
+    for (i = 0; i < P256_WORDS; i++)
+    {
+        r[i] = (t[i] & mask) | (r[i] & ~mask);
+    }
+}
+
+/* r = a + b mod m */
+static void P256_ModAdd(uint32_t *r, const uint32_t *a, const uint32_t *b, const uint32_t *m)
+{
+    uint64_t t = 0;
+    uint32_t i;
+
+    for (i = 0; i < P256_WORDS; i++)
+    {
+        t = (uint64_t)a[i] + b[i] + (t >> 32);
+        r[i] = (uint32_t)t;
+    }
+    P256_Reduce(r, (uint32_t)(t >> 32), m);
+}
+
+/* r = a - b mod m,借位时加回m */
+static void P256_ModSub(uint32_t *r, const uint32_t *a, const uint32_t *b, const uint32_t *m)
+{
+    uint64_t t = 0;
+    uint32_t i, mask;
+
+    mask = 0U - P256_SubRaw(r, a, b);
+    for (i = 0; i < P256_WORDS; i++)
+    {
+        t = (uint64_t)r[i] + (m[i] & mask) + (t >> 32);
+        r[i] = (uint32_t)t;
+    }
+}
+
+/* Montgomery乘法 r = a*b*R^-1 mod m,a、b < m,r可以和a、b相同 */
+static void P256_MontMul(uint32_t *r, const uint32_t *a, const uint32_t *b, const uint32_t *m, uint32_t m0inv)
+{
+    uint32_t t[P256_WORDS + 2];
+    uint64_t c;
+    uint32_t i, j, q;
+
+    memset(t, 0, sizeof(t));
+    for (i = 0; i < P256_WORDS; i++)
+    {
+        // t += a*b[i]
+        c = 0;
+        for (j = 0; j < P256_WORDS; j++)
+        {
+            c = (uint64_t)a[j] * b[i] + t[j] + (c >> 32);
+            t[j] = (uint32_t)c;
+        }
+        c = (uint64_t)t[P256_WORDS] + (c >> 32);
+        t[P256_WORDS] = (uint32_t)c;
+        t[P256_WORDS + 1] = (uint32_t)(c >> 32);
+
+        // t = (t + q*m) / 2^32,q使最低字为0
+        q = t[0] * m0inv;
+        c = (uint64_t)q * m[0] + t[0];
+        for (j = 1; j < P256_WORDS; j++)
+        {
+            c = (uint64_t)q * m[j] + t[j] + (c >> 32);
+            t[j - 1] = (uint32_t)c;
+        }
+        c = (uint64_t)t[P256_WORDS] + (c >> 32);
+        t[P256_WORDS - 1] = (uint32_t)c;
+        t[P256_WORDS] = t[P256_WORDS + 1] + (uint32_t)(c >> 32);
+    }
+    memcpy(r, t, P256_WORDS * sizeof(uint32_t));
+    P256_Reduce(r, t[P256_WORDS], m);
+}
+
+/* 模p的乘法、平方,Montgomery形式 */
+#define FMUL(r, a, b)   P256_MontMul(r, a, b, P256_P, P256_P0INV)
+#define FSQR(r, a)      P256_MontMul(r, a, a, P256_P, P256_P0INV)
+#define FADD(r, a, b)   P256_ModAdd(r, a, b, P256_P)
+#define FSUB(r, a, b)   P256_ModSub(r, a, b, P256_P)
+
+/* r = a^(m-2) mod m(费马小定理求逆),a是Montgomery形式,one是m的Montgomery形式的1 */
+static void P256_ModInv(uint32_t *r, const uint32_t *a, const uint32_t *m, uint32_t m0inv, const uint32_t *one)
+{
+    uint32_t e[P256_WORDS], t[P256_WORDS];
+    static const uint32_t two[P256_WORDS] = {2};
+    int i;
+
+    P256_SubRaw(e, m, two);
+    memcpy(t, one, sizeof(t));
+    for (i = 255; i >= 0; i--)
+    {
+        P256_MontMul(t, t, t, m, m0inv);
+        if ((e[i >> 5] >> (i & 31)) & 1U)
+        {
+            P256_MontMul(t, t, a, m, m0inv);
+        }
+    }
+    memcpy(r, t, sizeof(t));
+}
+
+/* 倍点,Jacobian坐标,a=-3(dbl-2001-b),r可以和p相同 */
+static void P256_Double(P256_Point_t *r, const P256_Point_t *p)
+{
+    uint32_t delta[P256_WORDS], gamma[P256_WORDS], beta[P256_WORDS], alpha[P256_WORDS], t[P256_WORDS];
+
+    if (P256_IsZero(p->z) || P256_IsZero(p->y))
+    {
+        memset(r->z, 0, sizeof(r->z));
+        return;
+    }
+    FSQR(delta, p->z);
+    FSQR(gamma, p->y);
+    FMUL(beta, p->x, gamma);
+    // alpha = 3*(X-delta)*(X+delta)
+    FSUB(t, p->x, delta);
+    FADD(alpha, p->x, delta);
+    FMUL(alpha, alpha, t);
+    FADD(t, alpha, alpha);
+    FADD(alpha, alpha, t);
+    // Z3 = (Y+Z)^2 - gamma - delta
+    FADD(t, p->y, p->z);
+    FSQR(t, t);
+    FSUB(t, t, gamma);
+    FSUB(r->z, t, delta);
+    // X3 = alpha^2 - 8*beta
+    FADD(beta, beta, beta);
+    FADD(beta, beta, beta);         /* 4*beta */
+    FSQR(t, alpha);
+    FSUB(t, t, beta);
+    FSUB(r->x, t, beta);
+    // Y3 = alpha*(4*beta - X3) - 8*gamma^2
+    FSUB(beta, beta, r->x);
+    FMUL(beta, alpha, beta);
+    FSQR(gamma, gamma);
+    FADD(gamma, gamma, gamma);
+    FADD(gamma, gamma, gamma);
+    FADD(gamma, gamma, gamma);
+    FSUB(r->y, beta, gamma);
+}
+
+/* 混合加法r = p + (x2, y2),后者是仿射坐标(madd-2007-bl),r可以和p相同 */
+static void P256_AddAffine(P256_Point_t *r, const P256_Point_t *p, const uint32_t *x2, const uint32_t *y2)
+{
+    uint32_t z1z1[P256_WORDS], u2[P256_WORDS], s2[P256_WORDS], h[P256_WORDS], hh[P256_WORDS];
+    uint32_t i4[P256_WORDS], j[P256_WORDS], rr[P256_WORDS], v[P256_WORDS];
+
+    if (P256_IsZero(p->z))
+    {
+        memcpy(r->x, x2, sizeof(r->x));
+        memcpy(r->y, y2, sizeof(r->y));
+        memcpy(r->z, P256_ONE, sizeof(r->z));
+        return;
+    }
+    FSQR(z1z1, p->z);
+    FMUL(u2, x2, z1z1);
+    FMUL(s2, y2, p->z);
+    FMUL(s2, s2, z1z1);
+    FSUB(h, u2, p->x);
+    FSUB(rr, s2, p->y);
+    if (P256_IsZero(h))
+    {
+        // 同一个点时倍点,互为相反数时结果是无穷远点
+        if (P256_IsZero(rr))
+        {
+            P256_Double(r, p);
+        }
+        else
+        {
+            memset(r->z, 0, sizeof(r->z));
+        }
+        return;
+    }
+    FADD(rr, rr, rr);
+    FSQR(hh, h);
+    FADD(i4, hh, hh);
+    FADD(i4, i4, i4);
+    FMUL(j, h, i4);
+    FMUL(v, p->x, i4);
+    // Z3 = (Z1+H)^2 - Z1Z1 - HH,先算,后面会改写p
+    FADD(u2, p->z, h);
+    FSQR(u2, u2);
+    FSUB(u2, u2, z1z1);
+    FSUB(r->z, u2, hh);
+    // Y1*J在改写X之前算
+    FMUL(s2, p->y, j);
+    FADD(s2, s2, s2);
+    // X3 = r^2 - J - 2*V
+    FSQR(u2, rr);
+    FSUB(u2, u2, j);
+    FSUB(u2, u2, v);
+    FSUB(r->x, u2, v);
+    // Y3 = r*(V - X3) - 2*Y1*J
+    FSUB(v, v, r->x);
+    FMUL(v, rr, v);
+    FSUB(r->y, v, s2);
+}
+
+/* Jacobian坐标转仿射坐标,p不能是无穷远点 */
+static void P256_ToAffine(uint32_t *x, uint32_t *y, const P256_Point_t *p)
+{
+    uint32_t zi[P256_WORDS], zi2[P256_WORDS];
+
+    P256_ModInv(zi, p->z, P256_P, P256_P0INV, P256_ONE);
+    FSQR(zi2, zi);
+    FMUL(x, p->x, zi2);
+    FMUL(zi2, zi2, zi);
+    FMUL(y, p->y, zi2);
+}
+
+/* 公钥转为Montgomery形式的坐标,检查坐标小于p并且在曲线y^2 = x^3 - 3x + b上 */
+static int P256_LoadPublic(uint32_t *x, uint32_t *y, const uint8_t *pub)
+{
+    uint32_t l[P256_WORDS], r[P256_WORDS];
+
+    P256_Load(x, pub);
+    P256_Load(y, pub + P256_BYTES);
+    if (!P256_Less(x, P256_P) || !P256_Less(y, P256_P))
+    {
+        return -1;
+    }
+    FMUL(x, x, P256_R2P);
+    FMUL(y, y, P256_R2P);
+    FSQR(l, y);
+    FSQR(r, x);
+    FMUL(r, r, x);
+    FSUB(r, r, x);
+    FSUB(r, r, x);
+    FSUB(r, r, x);
+    FADD(r, r, P256_B);
+    return P256_Equal(l, r) ? 0 : -1;
+}
+
+/**
+ * @brief 检查公钥是曲线上的有效点,登记手机钥匙时调用
+ * @param pub 公钥X|Y,各32字节大端
+ * @return 0: 有效; -1: 无效
+ */
+int P256_CheckPublic(const uint8_t *pub)
+{
+    uint32_t x[P256_WORDS], y[P256_WORDS];
+
+    return P256_LoadPublic(x, y, pub);
+}
+
+/**
+ * @brief ECDSA签名验证
+ * @param pub 公钥X|Y,各32字节大端
+ * @param hash 消息的SHA-256摘要,32字节
+ * @param sig 签名r|s,各32字节大端
+ * @return 0: 签名有效; -1: 无效
+ */
+int P256_Verify(const uint8_t *pub, const uint8_t *hash, const uint8_t *sig)
+{
+    uint32_t qx[P256_WORDS], qy[P256_WORDS], sx[P256_WORDS], sy[P256_WORDS];
+    uint32_t r[P256_WORDS], s[P256_WORDS], e[P256_WORDS], w[P256_WORDS];
+    uint32_t u1[P256_WORDS], u2[P256_WORDS], t[P256_WORDS];
+    P256_Point_t acc;
+    uint32_t b1, b2;
+    int i;
+
+    P256_Load(r, sig);
+    P256_Load(s, sig + P256_BYTES);
+    if (P256_IsZero(r) || P256_IsZero(s) || !P256_Less(r, P256_N) || !P256_Less(s, P256_N))
+    {
+        return -1;
+    }
+    if (P256_LoadPublic(qx, qy, pub) != 0)
+    {
+        return -1;
+    }
+
+    // w = s^-1 mod n(Montgomery形式),u1 = e*w,u2 = r*w(普通形式)
+    P256_Load(e, hash);
+    P256_Reduce(e, 0, P256_N);
+    P256_MontMul(w, s, P256_R2N, P256_N, P256_N0INV);
+    P256_ModInv(w, w, P256_N, P256_N0INV, P256_ONE_N);
+    P256_MontMul(u1, e, w, P256_N, P256_N0INV);
+    P256_MontMul(u2, r, w, P256_N, P256_N0INV);
+
+    // 预先算G+Q的仿射坐标
+    memcpy(acc.x, P256_GX, sizeof(acc.x));
+    memcpy(acc.y, P256_GY, sizeof(acc.y));
+    memcpy(acc.z, P256_ONE, sizeof(acc.z));
+    P256_AddAffine(&acc, &acc, qx, qy);
+    if (P256_IsZero(acc.z))
+    {
+        return -1;      /* Q = -G,私钥为n-1,不接受 */
+    }
+    P256_ToAffine(sx, sy, &acc);
+
+    // Shamir:从最高位开始,每位倍点,按(u1, u2)的两位加G、Q或G+Q
+    memset(&acc, 0, sizeof(acc));
+    for (i = 255; i >= 0; i--)
+    {
+        P256_Double(&acc, &acc);
+        b1 = (u1[i >> 5] >> (i & 31)) & 1U;
+        b2 = (u2[i >> 5] >> (i & 31)) & 1U;
+        if (b1 && b2)
+        {
+            P256_AddAffine(&acc, &acc, sx, sy);
+        }
+        else if (b1)
+        {
+            P256_AddAffine(&acc, &acc, P256_GX, P256_GY);
+        }
+        else if (b2)
+        {
+            P256_AddAffine(&acc, &acc, qx, qy);
+        }
+    }
+    if (P256_IsZero(acc.z))
+    {
+        return -1;
+    }
+
+    // 仿射x = X/Z^2,x mod n == r 等价于 X == r*Z^2 或 X == (r+n)*Z^2(r+n < p时)
+    FSQR(t, acc.z);
+    FMUL(w, r, P256_R2P);
+    FMUL(w, w, t);
+    if (P256_Equal(w, acc.x))
+    {
+        return 0;
+    }
+    if (!P256_Less(r, P256_P_N))
+    {
+        return -1;      /* r+n不小于p,不可能是x坐标 */
+    }
+    P256_ModAdd(e, r, P256_N, P256_P);
+    FMUL(w, e, P256_R2P);
+    FMUL(w, w, t);
+    return P256_Equal(w, acc.x) ? 0 : -1;
+}
@@ -0,0 +1,30 @@
+/**
+  ******************************************************************************
+  * @file    p256.h
+  * @author  cyytx
+  * @brief   NIST P-256(secp256r1)ECDSA签名验证的头文件,
+  *          用于蓝牙手机钥匙:门锁发随机数,手机用登记的私钥签名,门锁用公钥验证
+  ******************************************************************************
+  */
+
+#ifndef __P256_H
+#define __P256_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define P256_BYTES              32      /* 坐标、标量的长度 */
+#define P256_PUB_SIZE           64      /* 公钥X|Y,大端,不含0x04前缀 */
+#define P256_SIG_SIZE           64      /* 签名r|s,大端 */
+
+int P256_CheckPublic(const uint8_t *pub);
+int P256_Verify(const uint8_t *pub, const uint8_t *hash, const uint8_t *sig);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __P256_H */
@@ -19,13 +19,18 @@ stm32f7 中断优先级只有0-15总共十六个等级，
 */
 #define BLE_IRQ_PRIORITY_USART6             7    /* 蓝牙串口中断优先级 */
 #define KEY_IRQ_PRIORITY_EXTI               6    /* 外部中断优先级（键盘） */
+#define KEY_IRQ_PRIORITY_TIM7               6    /* 键盘扫描定时器中断优先级,和键盘外部中断相同 */
 #define SG90_IRQ_PRIORITY_TIM2              6    /* 定时器2中断优先级（舵机） */
 #define LCD_IRQ_PRIORITY_DMA_SPI2           7    /* LCD DMA中断优先级 */
 #define OV2640_IRQ_PRIORITY_DCMI            7    /* DCMI中断优先级（摄像头） */
 #define OV2640_IRQ_PRIORITY_DMA_DCMI        7    /* DCMI中断优先级（摄像头） */
 #define FINGERPRINT_IRQ_PRIORITY_USART4     7    /* 指纹串口中断优先级 */
 #define FINGERPRINT_IRQ_PRIORITY_EXTI       6    /* 指纹外部中断优先级 */
+#define NFC_IRQ_PRIORITY_EXTI               6    /* NFC外部中断优先级（RC522 IRQ） */
 #define FACE_IRQ_PRIORITY_USART5            7    /* 人脸串口中断优先级 */
+#define LOG_IRQ_PRIORITY_DMA_USART1         8    /* 日志DMA中断优先级（USART1 TX） */
+#define LOG_IRQ_PRIORITY_USART1             8    /* 日志串口中断优先级（USART1） */
+#define SHELL_IRQ_PRIORITY_DMA_USART1_RX    8    /* 调试shell接收DMA中断优先级（USART1 RX） */
 
 /**
  * @注意：FreeRTOS任务优先级规则
@@ -42,22 +47,28 @@ stm32f7 中断优先级只有0-15总共十六个等级，
 
 #define TASK_PRIORITY_LED               1    /* LED任务优先级,仅大于IDLE任务优先级，永远显示是否卡死 */
 #define TASK_PRIORITY_SG90              20    /* 舵机控制任务优先级，控制门锁的，优先级要高 */
+#define TASK_PRIORITY_AUTH              19    /* 开锁授权任务优先级,高于各开锁方式的任务,低于舵机任务 */
 #define TASK_PRIORITY_KEYBOARD          18    /* 按键任务优先级 */
 #define TASK_PRIORITY_DISPLAY           17    /* 显示任务优先级 */
 #define TASK_PRIORITY_NFC               14    /* NFC任务优先级 */
 #define TASK_PRIORITY_FINGERPRINT       18    /* 指纹识别任务优先级 */
 #define TASK_PRIORITY_BLE               15    /* 蓝牙任务优先级 */
 #define TASK_PRIORITY_FACE              16    /* 人脸识别任务优先级 */
+#define TASK_PRIORITY_SHELL             2    /* 调试shell任务优先级,低于所有业务任务,不影响开锁 */
+#define TASK_PRIORITY_AUDIT             3    /* 审计日志任务优先级,写SD卡不影响开锁,高于shell */
 
 
 
 /* 任务堆栈大小定义，不能小于configMINIMAL_STACK_SIZE定义的值 目前为128*/
 #define STACK_SIZE_LED                  128  /* LED任务堆栈（512字节） */
-#define STACK_SIZE_SG90                 512  /* 舵机控制任务堆栈（512字节） */
-#define STACK_SIZE_KEYBOARD             512  /* 键盘任务堆栈（512字节） */
+#define STACK_SIZE_SG90                 2048 /* 舵机控制任务堆栈（2048字节,osThreadNew按字节）,运动曲线、日志格式化和写备份寄存器/Flash都在栈上,余量用shell的ps看 */
+#define STACK_SIZE_AUTH                 512  /* 开锁授权任务堆栈（512字） */
+#define STACK_SIZE_KEYBOARD             2048 /* 键盘任务堆栈（2048字节,osThreadNew按字节）,验证密码的PBKDF2/TOTP约1.3KB在栈上 */
 #define STACK_SIZE_DISPLAY              512  /* 显示任务堆栈（512字节） */
 #define STACK_SIZE_NFC                  512  /* NFC任务堆栈（512字节） */
 #define STACK_SIZE_FINGERPRINT          512  /* 指纹识别任务堆栈（512字节） */
-#define STACK_SIZE_BLE                  512  /* 蓝牙任务堆栈（512字节） */
+#define STACK_SIZE_BLE                  768  /* 蓝牙任务堆栈（768字）,P-256验签约1KB在栈上 */
+#define STACK_SIZE_SHELL                512  /* 调试shell任务堆栈（512字节） */
+#define STACK_SIZE_AUDIT                768  /* 审计日志任务堆栈（768字）,FatFs长文件名缓冲区在栈上 */
 
 #endif /* __PRIORITIES_H */
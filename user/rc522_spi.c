@@ -0,0 +1,283 @@
+/**
+  ******************************************************************************
+  * @file    rc522_spi.c
+  * @author  cyytx
+  * @brief   RC522的软件SPI传输层。CS接在硬件SPI5_NSS上,硬件SPI时片选不受控制(见nfc.c),
+  *          所以用GPIO模拟SPI(模式0,高位在前):
+  *          1.直接写BSRR、读IDR,SCK下降沿和MOSI在同一次BSRR写入中改变;
+  *          2.半个SCK周期用DWT周期计数器定时,按绝对时刻等待,时序和编译优化等级、
+  *            主频无关,总线等待只会拉长周期,不会让SCK超过RC522_SPI_HZ;
+  *          3.FIFO连续读写利用RC522的地址重复模式,在一次片选内完成:
+  *            读时MOSI重复发FIFODataReg的地址,最后发0,MISO依次返回数据;
+  *            写时发一次地址,后面的字节都写入同一个寄存器。
+  *          原来每个边沿调用HAL_GPIO_WritePin的实现保留为RC522_SPI_HAL方式,
+  *          shell的bench rc522命令用它对比寻卡、防冲突、读块的周期数。
+  ******************************************************************************
+  */
+#include "rc522_spi.h"
+#include "nfc.h"
+#include "delay.h"
+
+#if NFC_ENABLE
+
+/**
+ *  PI10    ------> NFC_RESET
+ *  PF6     ------> SPI5_NSS(片选)
+ *  PF7     ------> SPI5_SCK
+ *  PF8     ------> SPI5_MISO
+ *  PF9     ------> SPI5_MOSI
+ */
+#define RC522_PORT              GPIOF
+#define RC522_CS_PIN            GPIO_PIN_6
+#define RC522_SCK_PIN           GPIO_PIN_7
+#define RC522_MISO_PIN          GPIO_PIN_8
+#define RC522_MOSI_PIN          GPIO_PIN_9
+#define RC522_RST_PORT          GPIOI
+#define RC522_RST_PIN           GPIO_PIN_10
+
+/* BSRR低16位置位,高16位复位 */
+#define RC522_SET(pin)          ((uint32_t)(pin))
+#define RC522_RESET(pin)        ((uint32_t)(pin) << 16)
+
+#define RC522_ADDR_READ(a)      ((uint8_t)((((a) << 1) & 0x7E) | 0x80))
+#define RC522_ADDR_WRITE(a)     ((uint8_t)(((a) << 1) & 0x7E))
+
+static RC522_SpiMode_t rc522_mode = RC522_SPI_FAST;
+static uint32_t rc522_half_cycles;      // 半个SCK周期的CPU周期数
+
+/* 等到DWT计数到达t */
+#define RC522_WAIT_UNTIL(t)     while ((int32_t)(DWT->CYCCNT - (t)) < 0) {}
+
+/* 全双工传输一个字节:SCK低电平时改变MOSI,高电平前采样MISO,结束时SCK为高(和原来的实现一致) */
+static uint8_t RC522_Xfer(uint8_t out)
+{
+    uint32_t t = DWT->CYCCNT;
+    uint32_t half = rc522_half_cycles;
+    uint8_t in = 0;
+    uint8_t bit;
+
+    for (bit = 0x80; bit != 0; bit >>= 1)
+    {
+        RC522_PORT->BSRR = RC522_RESET(RC522_SCK_PIN) |
+                           ((out & bit) ? RC522_SET(RC522_MOSI_PIN) : RC522_RESET(RC522_MOSI_PIN));
+        t += half;
+        RC522_WAIT_UNTIL(t);
+        in <<= 1;
+        if (RC522_PORT->IDR & RC522_MISO_PIN)
+        {
+            in |= 1;
+        }
+        RC522_PORT->BSRR = RC522_SET(RC522_SCK_PIN);
+        t += half;
+        RC522_WAIT_UNTIL(t);
+    }
+    return in;
+}
+
+/* 原来的实现:每个边沿一次HAL调用 */
+static void RC522_HalSendByte(uint8_t byte)
+{
+    uint8_t counter;
+
+    for (counter = 0; counter < 8; counter++)
+    {
+        HAL_GPIO_WritePin(RC522_PORT, RC522_MOSI_PIN, (byte & 0x80) ? GPIO_PIN_SET : GPIO_PIN_RESET);
+        HAL_GPIO_WritePin(RC522_PORT, RC522_SCK_PIN, GPIO_PIN_RESET);
+        HAL_GPIO_WritePin(RC522_PORT, RC522_SCK_PIN, GPIO_PIN_SET);
+        byte <<= 1;
+    }
+}
+
+static uint8_t RC522_HalReadByte(void)
+{
+    uint8_t counter;
+    uint8_t data = 0;
+
+    for (counter = 0; counter < 8; counter++)
+    {
+        data <<= 1;
+        HAL_GPIO_WritePin(RC522_PORT, RC522_SCK_PIN, GPIO_PIN_RESET);
+        if (HAL_GPIO_ReadPin(RC522_PORT, RC522_MISO_PIN) == GPIO_PIN_SET)
+        {
+            data |= 0x01;
+        }
+        HAL_GPIO_WritePin(RC522_PORT, RC522_SCK_PIN, GPIO_PIN_SET);
+    }
+    return data;
+}
+
+static uint8_t RC522_HalRead(uint8_t addr)
+{
+    uint8_t data;
+
+    HAL_GPIO_WritePin(RC522_PORT, RC522_CS_PIN, GPIO_PIN_RESET);
+    RC522_HalSendByte(RC522_ADDR_READ(addr));
+    data = RC522_HalReadByte();
+    HAL_GPIO_WritePin(RC522_PORT, RC522_CS_PIN, GPIO_PIN_SET);
+    return data;
+}
+
+static void RC522_HalWrite(uint8_t addr, uint8_t value)
+{
+    HAL_GPIO_WritePin(RC522_PORT, RC522_CS_PIN, GPIO_PIN_RESET);
+    RC522_HalSendByte(RC522_ADDR_WRITE(addr));
+    RC522_HalSendByte(value);
+    HAL_GPIO_WritePin(RC522_PORT, RC522_CS_PIN, GPIO_PIN_SET);
+}
+
+/**
+ * @brief 初始化RC522的GPIO和DWT周期计数器
+ */
+void RC522_SPI_Init(void)
+{
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+    __HAL_RCC_GPIOI_CLK_ENABLE();
+    __HAL_RCC_GPIOF_CLK_ENABLE();
+
+    HAL_GPIO_WritePin(RC522_RST_PORT, RC522_RST_PIN, GPIO_PIN_SET);
+    HAL_GPIO_WritePin(RC522_PORT, RC522_CS_PIN | RC522_SCK_PIN, GPIO_PIN_SET);
+
+    GPIO_InitStruct.Pin = RC522_RST_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    HAL_GPIO_Init(RC522_RST_PORT, &GPIO_InitStruct);
+
+    GPIO_InitStruct.Pin = RC522_CS_PIN | RC522_SCK_PIN | RC522_MOSI_PIN;
+    HAL_GPIO_Init(RC522_PORT, &GPIO_InitStruct);
+
+    GPIO_InitStruct.Pin = RC522_MISO_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+    HAL_GPIO_Init(RC522_PORT, &GPIO_InitStruct);
+
+    // 打开DWT周期计数器,M7要先解锁DWT
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    rc522_half_cycles = (SystemCoreClock + 2U * RC522_SPI_HZ - 1U) / (2U * RC522_SPI_HZ);
+}
+
+/**
+ * @brief 硬件复位RC522(NRSTPD引脚)
+ */
+void RC522_SPI_HardReset(void)
+{
+    RC522_RST_PORT->BSRR = RC522_SET(RC522_RST_PIN);
+    delay_us(1);
+    RC522_RST_PORT->BSRR = RC522_RESET(RC522_RST_PIN);
+    delay_us(1);
+    RC522_RST_PORT->BSRR = RC522_SET(RC522_RST_PIN);
+    delay_us(1);
+}
+
+/**
+ * @brief 切换传输方式,只在NFC任务中调用(基准测试)
+ */
+void RC522_SPI_SetMode(RC522_SpiMode_t mode)
+{
+    rc522_mode = mode < RC522_SPI_MODE_NUM ? mode : RC522_SPI_FAST;
+}
+
+RC522_SpiMode_t RC522_SPI_GetMode(void)
+{
+    return rc522_mode;
+}
+
+/* 函数名：ReadRawRC
+ * 描述  ：读RC522寄存器
+ * 输入  ：ucAddress，寄存器地址
+ * 返回  : 寄存器的当前值
+ * 调用  ：内部调用                 */
+uint8_t ReadRawRC(uint8_t ucAddress)
+{
+    uint8_t data;
+
+    if (rc522_mode != RC522_SPI_FAST)
+    {
+        return RC522_HalRead(ucAddress);
+    }
+    RC522_PORT->BSRR = RC522_RESET(RC522_CS_PIN);
+    RC522_Xfer(RC522_ADDR_READ(ucAddress));
+    data = RC522_Xfer(0x00);
+    RC522_PORT->BSRR = RC522_SET(RC522_CS_PIN);
+    return data;
+}
+
+/* 函数名：WriteRawRC
+ * 描述  ：写RC522寄存器
+ * 输入  ：ucAddress，寄存器地址  、 ucValue，写入寄存器的值
+ * 返回  : 无
+ * 调用  ：内部调用   */
+void WriteRawRC(uint8_t ucAddress, uint8_t ucValue)
+{
+    if (rc522_mode != RC522_SPI_FAST)
+    {
+        RC522_HalWrite(ucAddress, ucValue);
+        return;
+    }
+    RC522_PORT->BSRR = RC522_RESET(RC522_CS_PIN);
+    RC522_Xfer(RC522_ADDR_WRITE(ucAddress));
+    RC522_Xfer(ucValue);
+    RC522_PORT->BSRR = RC522_SET(RC522_CS_PIN);
+}
+
+/**
+ * @brief 从FIFO连续读len个字节,一次片选
+ */
+void RC522_ReadFifo(uint8_t *data, uint8_t len)
+{
+    uint8_t i;
+
+    if (len == 0)
+    {
+        return;
+    }
+    if (rc522_mode != RC522_SPI_FAST)
+    {
+        for (i = 0; i < len; i++)
+        {
+            data[i] = RC522_HalRead(FIFODataReg);
+        }
+        return;
+    }
+    RC522_PORT->BSRR = RC522_RESET(RC522_CS_PIN);
+    RC522_Xfer(RC522_ADDR_READ(FIFODataReg));
+    for (i = 0; i < len - 1U; i++)
+    {
+        data[i] = RC522_Xfer(RC522_ADDR_READ(FIFODataReg));    // 重复发地址,返回上一个地址的数据
+    }
+    data[i] = RC522_Xfer(0x00);                                 // 最后发0结束读
+    RC522_PORT->BSRR = RC522_SET(RC522_CS_PIN);
+}
+
+/**
+ * @brief 向FIFO连续写len个字节,一次片选
+ */
+void RC522_WriteFifo(const uint8_t *data, uint8_t len)
+{
+    uint8_t i;
+
+    if (len == 0)
+    {
+        return;
+    }
+    if (rc522_mode != RC522_SPI_FAST)
+    {
+        for (i = 0; i < len; i++)
+        {
+            RC522_HalWrite(FIFODataReg, data[i]);
+        }
+        return;
+    }
+    RC522_PORT->BSRR = RC522_RESET(RC522_CS_PIN);
+    RC522_Xfer(RC522_ADDR_WRITE(FIFODataReg));
+    for (i = 0; i < len; i++)
+    {
+        RC522_Xfer(data[i]);
+    }
+    RC522_PORT->BSRR = RC522_SET(RC522_CS_PIN);
+}
+
+#endif /* NFC_ENABLE */
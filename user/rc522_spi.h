@@ -0,0 +1,47 @@
+/**
+  ******************************************************************************
+  * @file    rc522_spi.h
+  * @author  cyytx
+  * @brief   RC522的软件SPI传输层头文件:寄存器读写和FIFO连续读写,
+  *          协议层(寻卡、认证、读写块)在nfc.c中
+  ******************************************************************************
+  */
+
+#ifndef __RC522_SPI_H
+#define __RC522_SPI_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+#include "hard_enable_ctrl.h"
+
+#if NFC_ENABLE
+
+/* SCK频率,RC522最高10MHz,排针接触不好,留一半余量 */
+#define RC522_SPI_HZ            5000000U
+
+/* 传输方式,基准测试对比用 */
+typedef enum {
+    RC522_SPI_HAL = 0,      /* 每个边沿调用HAL_GPIO_WritePin,FIFO每字节一次片选(原来的实现) */
+    RC522_SPI_FAST,         /* BSRR/IDR直接访问,DWT定时,FIFO在一次片选内连续读写 */
+    RC522_SPI_MODE_NUM
+} RC522_SpiMode_t;
+
+void    RC522_SPI_Init(void);
+void    RC522_SPI_HardReset(void);
+void    RC522_SPI_SetMode(RC522_SpiMode_t mode);
+RC522_SpiMode_t RC522_SPI_GetMode(void);
+uint8_t ReadRawRC(uint8_t ucAddress);
+void    WriteRawRC(uint8_t ucAddress, uint8_t ucValue);
+void    RC522_ReadFifo(uint8_t *data, uint8_t len);
+void    RC522_WriteFifo(const uint8_t *data, uint8_t len);
+
+#endif /* NFC_ENABLE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RC522_SPI_H */
@@ -0,0 +1,53 @@
+/**
+  ******************************************************************************
+  * @file    rng.c
+  * @author  cyytx
+  * @brief   硬件随机数发生器(RNG)的源文件
+  *          HAL的RNG驱动没有打开,直接操作寄存器;RNG时钟是PLLQ输出的48MHz
+  *          (RCC_DCKCFGR2.CK48MSEL复位值),SystemClock_Config中已配置。
+  ******************************************************************************
+  */
+#include <string.h>
+#include "main.h"
+#include "rng.h"
+#include "log.h"
+
+/**
+  * @brief  读随机数
+  * @param  buf: 输出缓冲区
+  * @param  len: 字节数
+  * @retval 0: 成功; -1: RNG没有输出(时钟没有配置或种子错误一直存在)
+  */
+int RNG_Read(void *buf, uint32_t len)
+{
+    uint8_t *p = (uint8_t *)buf;
+    uint32_t value, n, tick;
+
+    __HAL_RCC_RNG_CLK_ENABLE();
+    RNG->CR |= RNG_CR_RNGEN;
+    while (len > 0U)
+    {
+        tick = HAL_GetTick();
+        while ((RNG->SR & RNG_SR_DRDY) == 0U)
+        {
+            if (RNG->SR & RNG_SR_SECS)
+            {
+                // 种子错误:清除标志,重新启动RNG
+                RNG->SR &= ~RNG_SR_SEIS;
+                RNG->CR &= ~RNG_CR_RNGEN;
+                RNG->CR |= RNG_CR_RNGEN;
+            }
+            if (HAL_GetTick() - tick > RNG_TIMEOUT)
+            {
+                LOG_ERR("RNG timeout, SR %02X\r\n", RNG->SR);
+                return -1;
+            }
+        }
+        value = RNG->DR;
+        n = len < 4U ? len : 4U;
+        memcpy(p, &value, n);
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
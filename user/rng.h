@@ -0,0 +1,26 @@
+/**
+  ******************************************************************************
+  * @file    rng.h
+  * @author  cyytx
+  * @brief   硬件随机数发生器(RNG)的头文件,生成密钥、卡令牌等
+  ******************************************************************************
+  */
+
+#ifndef __RNG_H
+#define __RNG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define RNG_TIMEOUT             10      /* 等待一个随机数的超时时间(ms) */
+
+int RNG_Read(void *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RNG_H */
@@ -0,0 +1,252 @@
+/**
+  ******************************************************************************
+  * @file    rtc.c
+  * @author  cyytx
+  * @brief   RTC模块的源文件,RTC时钟初始化、日历和备份寄存器读写
+  *          日历用Unix时间(UTC秒)读写,HAL的RTC驱动没有打开,直接操作寄存器
+  ******************************************************************************
+  */
+
+#include "rtc.h"
+#include "log.h"
+
+#define RTC_SECONDS_PER_DAY     86400U
+
+/* 1970-01-01起的天数,公历转换(400年一个周期,3月作为一年的开始,闰日在年末) */
+static uint32_t RTC_DaysFromCivil(uint32_t y, uint32_t m, uint32_t d)
+{
+    uint32_t era, yoe, doy, doe;
+
+    y -= (m <= 2U);
+    era = y / 400U;
+    yoe = y - era * 400U;
+    doy = (153U * (m > 2U ? m - 3U : m + 9U) + 2U) / 5U + d - 1U;
+    doe = yoe * 365U + yoe / 4U - yoe / 100U + doy;
+    return era * 146097U + doe - 719468U;
+}
+
+/**
+  * @brief  Unix时间转换为日期时间(UTC)
+  * @param  unix_time: 1970-01-01 00:00:00起的秒数
+  * @param  dt: 输出的日期时间
+  */
+void RTC_UnixToDate(uint32_t unix_time, RTC_DateTime_t *dt)
+{
+    uint32_t days = unix_time / RTC_SECONDS_PER_DAY;
+    uint32_t secs = unix_time % RTC_SECONDS_PER_DAY;
+    uint32_t z = days + 719468U;
+    uint32_t era = z / 146097U;
+    uint32_t doe = z - era * 146097U;
+    uint32_t yoe = (doe - doe / 1460U + doe / 36524U - doe / 146096U) / 365U;
+    uint32_t doy = doe - (365U * yoe + yoe / 4U - yoe / 100U);
+    uint32_t mp = (5U * doy + 2U) / 153U;
+    uint32_t m = mp < 10U ? mp + 3U : mp - 9U;
+
+    dt->year = (uint16_t)(yoe + era * 400U + (m <= 2U));
+    dt->month = (uint8_t)m;
+    dt->day = (uint8_t)(doy - (153U * mp + 2U) / 5U + 1U);
+    dt->hour = (uint8_t)(secs / 3600U);
+    dt->minute = (uint8_t)(secs / 60U % 60U);
+    dt->second = (uint8_t)(secs % 60U);
+    dt->weekday = (uint8_t)((days + 3U) % 7U + 1U);     // 1970-01-01是星期四
+}
+
+#if RTC_ENABLE
+
+static uint32_t RTC_ToBcd(uint32_t v)
+{
+    return ((v / 10U) << 4) | (v % 10U);
+}
+
+static uint32_t RTC_FromBcd(uint32_t v)
+{
+    return (v >> 4) * 10U + (v & 0x0FU);
+}
+
+/* 等待ISR中的标志置位,超时返回-1 */
+static int RTC_WaitFlag(uint32_t flag)
+{
+    uint32_t tick = HAL_GetTick();
+
+    while ((RTC->ISR & flag) == 0U)
+    {
+        if (HAL_GetTick() - tick > RTC_INIT_TIMEOUT)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+  * @brief  初始化RTC时钟和备份域访问
+  *
+  * 备份域(RTC和备份寄存器)由VBAT供电,上次配置好后复位不会丢失,
+  * 这时只打开写访问,不能再改时钟源(改RTCSEL要复位备份域,备份寄存器会被清零)。
+  * 第一次上电(或电池掉电后)才配置时钟源:优先用外部32.768kHz晶振LSE,起振失败改用LSI。
+  */
+void RTC_Init(void)
+{
+    uint32_t tick;
+
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+
+    if (RCC->BDCR & RCC_BDCR_RTCEN)
+    {
+        // LSI不在备份域,复位后要重新打开
+        if ((RCC->BDCR & RCC_BDCR_RTCSEL) == RCC_RTCCLKSOURCE_LSI)
+        {
+            __HAL_RCC_LSI_ENABLE();
+            while (__HAL_RCC_GET_FLAG(RCC_FLAG_LSIRDY) == RESET);
+        }
+        // 复位后日历影子寄存器要等一次同步才是当前时间
+        RTC_WaitFlag(RTC_ISR_RSF);
+        return;
+    }
+
+    __HAL_RCC_LSE_CONFIG(RCC_LSE_ON);
+    tick = HAL_GetTick();
+    while (__HAL_RCC_GET_FLAG(RCC_FLAG_LSERDY) == RESET)
+    {
+        if (HAL_GetTick() - tick > RTC_LSE_TIMEOUT)
+        {
+            break;
+        }
+    }
+
+    if (__HAL_RCC_GET_FLAG(RCC_FLAG_LSERDY) != RESET)
+    {
+        __HAL_RCC_RTC_CONFIG(RCC_RTCCLKSOURCE_LSE);
+        printf("RTC clock: LSE\r\n");
+    }
+    else
+    {
+        __HAL_RCC_LSE_CONFIG(RCC_LSE_OFF);
+        __HAL_RCC_LSI_ENABLE();
+        while (__HAL_RCC_GET_FLAG(RCC_FLAG_LSIRDY) == RESET);
+        __HAL_RCC_RTC_CONFIG(RCC_RTCCLKSOURCE_LSI);
+        LOG_ERR("LSE not start, RTC clock: LSI\r\n");
+    }
+    __HAL_RCC_RTC_ENABLE();
+}
+
+/**
+  * @brief  读备份寄存器
+  * @param  index: 寄存器编号,见rtc.h中的RTC_BKP_xxx
+  * @retval 寄存器值,备份域复位后为0
+  */
+uint32_t RTC_BkpRead(uint32_t index)
+{
+    if (index >= RTC_BKP_NUM)
+    {
+        return 0;
+    }
+    return (&RTC->BKP0R)[index];
+}
+
+/**
+  * @brief  写备份寄存器
+  * @param  index: 寄存器编号,见rtc.h中的RTC_BKP_xxx
+  * @param  value: 写入的值
+  */
+void RTC_BkpWrite(uint32_t index, uint32_t value)
+{
+    if (index >= RTC_BKP_NUM)
+    {
+        return;
+    }
+    (&RTC->BKP0R)[index] = value;
+}
+
+/**
+  * @brief  设置日历
+  * @param  unix_time: Unix时间(UTC秒),范围RTC_UNIX_MIN~RTC_UNIX_MAX
+  * @retval 0: 成功; -1: 时间超出范围或RTC没有响应
+  */
+int RTC_SetTime(uint32_t unix_time)
+{
+    RTC_DateTime_t dt;
+    uint32_t sync;
+    int ret = -1;
+
+    if (unix_time < RTC_UNIX_MIN || unix_time > RTC_UNIX_MAX || (RCC->BDCR & RCC_BDCR_RTCEN) == 0U)
+    {
+        return -1;
+    }
+    RTC_UnixToDate(unix_time, &dt);
+    // 1Hz日历时钟 = RTCCLK / (PREDIV_A + 1) / (PREDIV_S + 1),LSE 32768Hz,LSI约32kHz
+    sync = ((RCC->BDCR & RCC_BDCR_RTCSEL) == RCC_RTCCLKSOURCE_LSI) ? 249U : 255U;
+
+    RTC->WPR = 0xCAU;   // 解除写保护
+    RTC->WPR = 0x53U;
+    RTC->ISR |= RTC_ISR_INIT;
+    if (RTC_WaitFlag(RTC_ISR_INITF) == 0)
+    {
+        RTC->PRER = sync;                                   // 先写同步分频,再写异步分频
+        RTC->PRER = (127U << RTC_PRER_PREDIV_A_Pos) | sync;
+        RTC->TR = (RTC_ToBcd(dt.hour) << 16) | (RTC_ToBcd(dt.minute) << 8) | RTC_ToBcd(dt.second);
+        RTC->DR = (RTC_ToBcd(dt.year % 100U) << 16) | ((uint32_t)dt.weekday << 13) |
+                  (RTC_ToBcd(dt.month) << 8) | RTC_ToBcd(dt.day);
+        RTC->CR &= ~(RTC_CR_FMT | RTC_CR_BYPSHAD);          // 24小时制,读影子寄存器
+        RTC->ISR &= ~(RTC_ISR_INIT | RTC_ISR_RSF);
+        ret = RTC_WaitFlag(RTC_ISR_RSF);                    // 等新时间同步到影子寄存器
+    }
+    else
+    {
+        RTC->ISR &= ~RTC_ISR_INIT;
+    }
+    RTC->WPR = 0xFFU;   // 恢复写保护
+    if (ret != 0)
+    {
+        LOG_ERR("RTC set time failed\r\n");
+    }
+    return ret;
+}
+
+/**
+  * @brief  读日历
+  * @retval Unix时间(UTC秒),日历没有设置过(备份域复位后)时返回0
+  */
+uint32_t RTC_GetTime(void)
+{
+    uint32_t tr, dr, days;
+
+    if ((RCC->BDCR & RCC_BDCR_RTCEN) == 0U || (RTC->ISR & RTC_ISR_INITS) == 0U)
+    {
+        return 0;
+    }
+    tr = RTC->TR;   // 读TR锁住DR的影子寄存器,读DR后解锁,两者是同一时刻的值
+    dr = RTC->DR;
+    days = RTC_DaysFromCivil(2000U + RTC_FromBcd((dr >> 16) & 0xFFU),
+                             RTC_FromBcd((dr >> 8) & 0x1FU), RTC_FromBcd(dr & 0x3FU));
+    return days * RTC_SECONDS_PER_DAY + RTC_FromBcd((tr >> 16) & 0x3FU) * 3600U +
+           RTC_FromBcd((tr >> 8) & 0x7FU) * 60U + RTC_FromBcd(tr & 0x7FU);
+}
+
+#else /* !RTC_ENABLE */
+
+void RTC_Init(void)
+{
+}
+
+uint32_t RTC_BkpRead(uint32_t index)
+{
+    return 0;
+}
+
+void RTC_BkpWrite(uint32_t index, uint32_t value)
+{
+}
+
+int RTC_SetTime(uint32_t unix_time)
+{
+    return -1;
+}
+
+uint32_t RTC_GetTime(void)
+{
+    return 0;
+}
+
+#endif /* RTC_ENABLE */
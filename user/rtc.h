@@ -0,0 +1,59 @@
+/**
+  ******************************************************************************
+  * @file    rtc.h
+  * @author  cyytx
+  * @brief   RTC模块的头文件,RTC时钟(LSE 32.768kHz)初始化、日历和备份寄存器读写,
+  *          备份寄存器和日历由VBAT供电,复位和掉电(有电池时)都不会丢失
+  ******************************************************************************
+  */
+
+#ifndef __RTC_H
+#define __RTC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+#include "hard_enable_ctrl.h"
+
+/*
+备份寄存器分配(RTC_BKP0R~RTC_BKP31R,共32个,每个32位),
+新增使用者在这里登记,不要在各模块里直接写编号
+*/
+#define RTC_BKP_FP_BAUD             0   /* 指纹模块协商后的波特率 */
+#define RTC_BKP_FACE_BAUD           1   /* 人脸模块协商后的波特率 */
+#define RTC_BKP_AUTH_LIMIT          2   /* 开锁限流,2~13,每种开锁方式2个(状态、锁定结束时间),见auth.c */
+#define RTC_BKP_LOCK_STATE          14  /* 门锁状态,14~16(状态和最后的命令、自动关锁时间、CRC),见sg90.c */
+#define RTC_BKP_NUM                 32
+
+#define RTC_LSE_TIMEOUT             2000    /* LSE起振超时时间(ms),超时改用LSI */
+#define RTC_INIT_TIMEOUT            10      /* 进入初始化模式/影子寄存器同步的超时时间(ms) */
+
+/* 日历范围:RTC年份只有两位(2000~2099),年份为0时认为日历没有设置,所以从2001年开始 */
+#define RTC_UNIX_MIN                978307200U      /* 2001-01-01 00:00:00 UTC */
+#define RTC_UNIX_MAX                4102444799U     /* 2099-12-31 23:59:59 UTC */
+
+/* 日期时间(UTC) */
+typedef struct {
+    uint16_t year;      /* 2001~2099 */
+    uint8_t month;      /* 1~12 */
+    uint8_t day;        /* 1~31 */
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+    uint8_t weekday;    /* 1~7,星期一~星期日 */
+} RTC_DateTime_t;
+
+void RTC_Init(void);
+uint32_t RTC_BkpRead(uint32_t index);
+void RTC_BkpWrite(uint32_t index, uint32_t value);
+int RTC_SetTime(uint32_t unix_time);
+uint32_t RTC_GetTime(void);
+void RTC_UnixToDate(uint32_t unix_time, RTC_DateTime_t *dt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RTC_H */
@@ -3,6 +3,9 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "delay.h"
+#include "log.h"
+
+#define LOG_MODULE SDCARD    /* 日志模块名,等级见log_config.h */
 
 #if SDCARD_ENABLE
 
@@ -29,40 +32,37 @@ void SDCARD_ShowInfo(SD_HandleTypeDef *hsd)
     HAL_SD_GetCardInfo(hsd, &cardInfo);
     
     // Print card type
-    printf("Card Type: ");
     switch(cardInfo.CardType)
     {
         case CARD_SDSC:
             if(hsd->SdCard.CardVersion == 0x00) // V1.1 in old library
-                printf("SDSC V1.1\r\n");
+                LOG_INFO("Card Type: SDSC V1.1\r\n");
             else // V2.0 in old library
-                printf("SDSC V2.0\r\n");
+                LOG_INFO("Card Type: SDSC V2.0\r\n");
             break;
         case CARD_SDHC_SDXC:
-            printf("SDHC/SDXC V2.0\r\n");
+            LOG_INFO("Card Type: SDHC/SDXC V2.0\r\n");
             break;
         default:
-            printf("Unknown Type\r\n");
+            LOG_INFO("Card Type: Unknown Type\r\n");
             break;
     }
     
     // Print relative card address
-    printf("Card Relative Address: %d\r\n", cardInfo.RelCardAdd);
+    LOG_INFO("Card Relative Address: %d\r\n", cardInfo.RelCardAdd);
     
     // Calculate and print capacity (MB)
     uint32_t capacity = (uint32_t)((cardInfo.LogBlockNbr * (uint64_t)cardInfo.LogBlockSize) >> 20);
-    printf("Card Capacity: %u MB\r\n", capacity);
+    LOG_INFO("Card Capacity: %u MB\r\n", capacity);
     
     // Print block size
-    printf("Block Size: %u bytes\r\n", cardInfo.BlockSize);
+    LOG_INFO("Block Size: %u bytes\r\n", cardInfo.BlockSize);
     
     // Print logical block number
-    printf("Logical Block Count: %u\r\n", cardInfo.LogBlockNbr);
+    LOG_INFO("Logical Block Count: %u\r\n", cardInfo.LogBlockNbr);
     
     // Print card class information
-    printf("Card Class: %02X\r\n", cardInfo.Class);
-    
-    printf("\r\n");
+    LOG_INFO("Card Class: %02X\r\n", cardInfo.Class);
 }
 
 
@@ -132,7 +132,7 @@ void SDCARD1_Init(void)
    // HAL_SD_GetCardCSD，它会在初始化中一步步调用到
     if (HAL_SD_Init(&hsd1) != HAL_OK)
     {
-        printf("HAL_SD_Init failed\r\n");
+        LOG_ERR("HAL_SD_Init failed\r\n");
         Error_Handler();
     }
 
@@ -146,16 +146,16 @@ void SDCARD1_Init(void)
     errorstate = HAL_SD_ConfigWideBusOperation(&hsd1, SDMMC_BUS_WIDE_4B);
     if(errorstate != HAL_OK)
     {
-        printf("HAL_SD_ConfigWideBusOperation failed,errorstate:%d\r\n",errorstate);
+        LOG_ERR("HAL_SD_ConfigWideBusOperation failed,errorstate:%d\r\n",errorstate);
         //Error_Handler();
     }else{
-        printf("HAL_SD_ConfigWideBusOperation success\r\n");
+        LOG_INFO("HAL_SD_ConfigWideBusOperation success\r\n");
     }
     HAL_SD_CardStateTypeDef cardState = HAL_SD_GetCardState(&hsd1);
-    printf("cardState: %d\r\n", cardState);
+    LOG_INFO("cardState: %d\r\n", cardState);
 
     SD_Card_Test_DMA();
-    printf("sd_int_record[0]: %d,sd_int_record[1]: %d,sd_int_record[2]: %d\r\n", sd_int_record[0],sd_int_record[1],sd_int_record[2]);
+    LOG_INFO("sd_int_record[0]: %d,sd_int_record[1]: %d,sd_int_record[2]: %d\r\n", sd_int_record[0],sd_int_record[1],sd_int_record[2]);
 
 }
 
@@ -181,7 +181,7 @@ uint8_t SD_ReadBlocks_DMA(uint8_t *buf, uint64_t sector, uint32_t cnt)
         {
             if((HAL_GetTick() - tickstart) >= SD_TIMEOUT)
             {
-                printf("SD_ReadBlocks_DMA timeout\r\n");
+                LOG_ERR("SD_ReadBlocks_DMA timeout\r\n");
                 return HAL_TIMEOUT;
 
             }
@@ -213,7 +213,7 @@ uint8_t SD_WriteBlocks_DMA(uint8_t *buf, uint64_t sector, uint32_t cnt)
         {
             if((HAL_GetTick() - tickstart) >= SD_TIMEOUT)
             {
-                printf("SD_WriteBlocks_DMA timeout\r\n");   
+                LOG_ERR("SD_WriteBlocks_DMA timeout\r\n");   
                 return HAL_TIMEOUT;
             }
         }
@@ -398,10 +398,10 @@ uint8_t SD_Card_Test_DMA(void)
   sd_status = SD_ReadBlocks_DMA(SDIO_DATA_BUFFER, 10, 1);
   if (sd_status != HAL_OK)
   {
-    printf("Read SD card failed! Error: %d\r\n", (int)sd_status);
+    LOG_ERR("Read SD card failed! Error: %d\r\n", (int)sd_status);
     return -1;
   } else {
-    printf("Read SD card success\r\n");
+    LOG_INFO("Read SD card success\r\n");
   }
   
   // 比较数据
@@ -414,17 +414,16 @@ uint8_t SD_Card_Test_DMA(void)
     //   test_result = 4;
     //   break;
     // }
-    printf("%02X ", SDIO_DATA_BUFFER[i]);
   }
-  printf("\r\n");
+  LOG_HEX("SD block 10", SDIO_DATA_BUFFER, BLOCK_SIZE);
   
   if (test_result == 0)
   {
-    printf("SD card DMA read/write test passed!\r\n");
+    LOG_INFO("SD card DMA read/write test passed!\r\n");
   }
   else
   {
-    printf("SD card DMA read/write test failed!\r\n");
+    LOG_ERR("SD card DMA read/write test failed!\r\n");
   }
   
   return test_result;
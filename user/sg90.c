@@ -7,16 +7,24 @@
   ******************************************************************************
   */
 #include "stdio.h"
+#include <string.h>
+#include <math.h>
 #include "stm32f7xx_hal.h"
 #include "cmsis_os.h"
 #include "timers.h"
 #include "sg90.h"
 #include "key.h" // 添加对keyboard.h的引用以访问LockPassword_t类型
 #include "priorities.h"
+#include "auth.h"
+#include "rtc.h"
+#include "fstore.h"
+#include "log.h"
 
 #ifdef SG90_ENABLE
 
-#define SG90_UNLOCK_TIMEOUT pdMS_TO_TICKS(3000)
+#define SG90_UNLOCK_TIMEOUT_MS  3000
+#define SG90_UNLOCK_TIMEOUT pdMS_TO_TICKS(SG90_UNLOCK_TIMEOUT_MS)
+#define SG90_BENCH_TIMEOUT  5000    // 等待基准测试完成的时间(ms)
 
 /* 私有变量 */
 static TIM_HandleTypeDef sg90_timer;  // 使用定时器2
@@ -55,17 +63,70 @@ void SG90_GPIO_Init(void)
 
  
 
-/*使用定时器中断来作为舵机控制，不过由于设计失误，PG6不能复用为tim channel pwm 输出，所以设计使用在中断中翻转gpio
-输出pwm，sg90 舵机控制为50HZ也就是20ms 高电平占用时间和角度关系如下。
+/*PG6不能复用为定时器通道输出,sg90 舵机控制为50HZ也就是20ms 高电平占用时间和角度关系如下。
 0.5MS-0度；
 1.0MS-45度；
 1.5MS-90度;
 2.0MS-135度；
 2.5MS-180度;
+波形由TIM1触发DMA写GPIOG->BSRR产生(SG90_PWM_DMA):
+1.TIM1计数1MHz,周期20ms;更新事件请求DMA2 Stream5(通道6,TIM1_UP),把置位字写入BSRR,输出高电平;
+  CC4匹配请求DMA2 Stream4(通道6,TIM1_CH4),把复位字写入BSRR,输出低电平,高电平时间等于CCR4,分辨率1us;
+2.置位的DMA为普通模式,传输次数就是周期数,发完自动停止,复位的DMA循环模式,之后只是重复拉低;
+3.CCR4和ARR有预装载,转动中改变脉宽在下一个周期生效,不会产生残缺的脉冲;
+4.整个转动过程不进中断,CPU只在开始和结束时写几个寄存器。
+原来在TIM2中断(100us一次)中翻转GPIO的实现保留为SG90_PWM_ISR方式,只用于shell的bench servo命令
+统计它占用的中断时间。
+DMA2的Stream1/2/3/6/7已经被DCMI、USART1、SDMMC使用,TIM1只有UP和CH4的请求落在空闲的Stream5/4上。
 */
+#define TIM1_FREQ_MHZ 96                // APB2 96MHz,不分频,定时器时钟96MHz
 #define TIM2_FREQ_MHZ 96
 #define TIM2_PERIOD 100
+static TIM_HandleTypeDef htim1;
 static TIM_HandleTypeDef htim2;
+static DMA_HandleTypeDef hdma_sg90_set;     // TIM1_UP: DMA2 Stream5
+static DMA_HandleTypeDef hdma_sg90_reset;   // TIM1_CH4: DMA2 Stream4
+
+/* 预先算好的BSRR字,DMA从这里读 */
+static const uint32_t sg90_bsrr_set = SG90_CTL_Pin;
+static const uint32_t sg90_bsrr_reset = (uint32_t)SG90_CTL_Pin << 16;
+
+static SG90_PwmMode_t sg90_mode = SG90_PWM_DMA;
+static uint16_t sg90_angle = 0;             // 最后设置的角度,上电时认为锁是关着的
+
+/* SG90_PWM_ISR方式的中断统计,不含进出中断的压栈出栈(约24个周期) */
+static volatile uint32_t sg90_irq_count = 0;
+static volatile uint32_t sg90_irq_cycles = 0;
+static volatile uint32_t sg90_irq_max = 0;
+
+static SG90_Motion_t sg90_motion = {SG90_PROFILE_TRAPEZOID, SG90_SPEED_DPS, SG90_ACCEL_DPS2, SG90_SETTLE_MS};
+static SG90_MoveStats_t sg90_move_stats = {0};
+
+/* 门锁状态保存在备份寄存器(rtc.h中RTC_BKP_LOCK_STATE开始的3个),复位后不用转动舵机就知道锁舌在哪。
+ * 状态字:魔数 | 最后的命令<<16 | 来源<<8 | 标志;转动前写一次带MOVING,转到位后再写一次 */
+#define SG90_BKP_MAGIC          0x5C000000U
+#define SG90_BKP_MAGIC_MASK     0xFF000000U
+#define SG90_BKP_OPEN           0x01U
+#define SG90_BKP_MOVING         0x02U       /* 正在转动,复位时锁舌位置不确定 */
+#define SG90_BKP_STATE          RTC_BKP_LOCK_STATE
+#define SG90_BKP_UNTIL          (RTC_BKP_LOCK_STATE + 1U)   /* 自动关锁时间(unix秒),0:日历没有设置 */
+#define SG90_BKP_CRC            (RTC_BKP_LOCK_STATE + 2U)   /* 前两个寄存器的CRC32,写到一半复位时不匹配 */
+
+static uint32_t sg90_relock_until = 0;      // 自动关锁时间(unix秒)
+static SG90_Restore_t sg90_restore = {0};
+
+/* 一次转动的轨迹,位置从0到d(度) */
+typedef struct {
+    uint8_t profile;
+    float d;                // 转动角度
+    float t;                // 轨迹时间(秒)
+    float a;                // 梯形:加速度
+    float vp;               // 梯形:最大速度
+    float ta;               // 梯形:加速时间
+} SG90_Plan_t;
+
+static TaskHandle_t sg90_bench_requester = NULL;
+static SG90_BenchStats_t sg90_bench_result[SG90_PWM_MODE_NUM];
 
 void TIM2_Init(void)
 {
@@ -83,19 +144,110 @@ void TIM2_Init(void)
     HAL_NVIC_EnableIRQ(TIM2_IRQn);         // 启用 TIM2 中断
 }
 
+static void SG90_DmaInit(DMA_HandleTypeDef *hdma, DMA_Stream_TypeDef *stream, uint32_t mode)
+{
+    hdma->Instance = stream;
+    hdma->Init.Channel = DMA_CHANNEL_6;                     // TIM1
+    hdma->Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma->Init.MemInc = DMA_MINC_DISABLE;                   // 每次都写同一个字
+    hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    hdma->Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    hdma->Init.Mode = mode;
+    hdma->Init.Priority = DMA_PRIORITY_HIGH;                // 边沿的延迟就是脉宽误差
+    hdma->Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if (HAL_DMA_Init(hdma) != HAL_OK)
+    {
+        Error_Handler();
+    }
+}
+
+void TIM1_Init(void)
+{
+    __HAL_RCC_TIM1_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    htim1.Instance = TIM1;
+    htim1.Init.Prescaler = TIM1_FREQ_MHZ - 1;         // 1MHz,1us一个计数
+    htim1.Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim1.Init.Period = SG90_PERIOD_US - 1;
+    htim1.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    htim1.Init.RepetitionCounter = 0;
+    htim1.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+    HAL_TIM_Base_Init(&htim1);
+    TIM1->CCMR2 |= TIM_CCMR2_OC4PE;                   // CC4只用来产生DMA请求,不输出,打开预装载
+
+    SG90_DmaInit(&hdma_sg90_set, DMA2_Stream5, DMA_NORMAL);
+    SG90_DmaInit(&hdma_sg90_reset, DMA2_Stream4, DMA_CIRCULAR);
+}
+
 void SG90_Init(void)
 {
     SG90_GPIO_Init();
+    TIM1_Init();
     TIM2_Init();
+
+    // 打开DWT周期计数器,统计中断耗时
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 } 
 
+/**
+ * @brief 停止TIM1和两个DMA,引脚拉低
+ */
+static void SG90_PwmStop(void)
+{
+    TIM1->CR1 &= ~TIM_CR1_CEN;
+    TIM1->DIER &= ~(TIM_DIER_UDE | TIM_DIER_CC4DE);
+    if (hdma_sg90_set.State == HAL_DMA_STATE_BUSY)
+    {
+        HAL_DMA_Abort(&hdma_sg90_set);
+    }
+    if (hdma_sg90_reset.State == HAL_DMA_STATE_BUSY)
+    {
+        HAL_DMA_Abort(&hdma_sg90_reset);
+    }
+    SG90_CTL_GPIO_Port->BSRR = sg90_bsrr_reset;
+}
+
+/**
+ * @brief 输出periods个脉宽为pulse_us的脉冲,第一个脉冲马上开始
+ */
+static void SG90_PwmStart(uint16_t pulse_us, uint16_t periods)
+{
+    SG90_PwmStop();
+    __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_4, pulse_us);
+    HAL_DMA_Start(&hdma_sg90_set, (uint32_t)&sg90_bsrr_set, (uint32_t)&SG90_CTL_GPIO_Port->BSRR, periods);
+    HAL_DMA_Start(&hdma_sg90_reset, (uint32_t)&sg90_bsrr_reset, (uint32_t)&SG90_CTL_GPIO_Port->BSRR, 1);
+    TIM1->EGR = TIM_EGR_UG;                 // 装入ARR和CCR4,这时还没有打开DMA请求
+    TIM1->SR = 0;
+    TIM1->CNT = SG90_PERIOD_US - 1;         // 下一个计数就是更新事件,马上输出第一个高电平
+    TIM1->DIER |= TIM_DIER_UDE | TIM_DIER_CC4DE;
+    TIM1->CR1 |= TIM_CR1_CEN;
+    while (TIM1->CNT == SG90_PERIOD_US - 1) {}  // 等第一个更新事件(1us),之后写的CCR4从下一个周期生效
+}
+
+/**
+ * @brief 转动中改变脉宽,下一个周期生效
+ */
+void SG90_SetPulse(uint16_t pulse_us)
+{
+    if (pulse_us < SG90_PULSE_MIN_US) pulse_us = SG90_PULSE_MIN_US;
+    if (pulse_us > SG90_PULSE_MAX_US) pulse_us = SG90_PULSE_MAX_US;
+    __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_4, pulse_us);
+}
+
 volatile uint32_t high_time = 1500; // 初始高电平时间为 1.5ms (对应 90°)
 volatile uint32_t low_time = 18500; // 初始低电平时间为 18.5ms
 volatile uint32_t counter = 0;      // 计数器
 volatile uint8_t pwm_state = 0;     // 当前 PWM 状态 (0: 低电平, 1: 高电平)
-volatile uint16_t period_count = 0; //周期计数器，一个周期20ms，最大转动为180度，20个周期即400ms够了
+volatile uint16_t period_count = 0; //周期计数器，一个周期20ms，转动SG90_MOVE_PERIODS个周期
 void TIM2_IRQHandler(void)
 {
+    uint32_t start = DWT->CYCCNT;
+    uint32_t cycles;
+
     //HAL_TIM_IRQHandler(&htim2); // 清除中断标志
     
     __HAL_TIM_CLEAR_IT(&htim2, TIM_IT_UPDATE);
@@ -122,22 +274,40 @@ void TIM2_IRQHandler(void)
         }
     }
     
-    if (period_count >= 40) // 20个周期即400ms够了
+    if (period_count >= SG90_MOVE_PERIODS)
     {
         HAL_TIM_Base_Stop_IT(&htim2); // 停止 TIM2 中断
         HAL_GPIO_WritePin(GPIOG, GPIO_PIN_6, GPIO_PIN_RESET);//拉低电平
     }
+
+    cycles = DWT->CYCCNT - start;
+    sg90_irq_count++;
+    sg90_irq_cycles += cycles;
+    if (cycles > sg90_irq_max)
+    {
+        sg90_irq_max = cycles;
+    }
 }
 
-// 设置舵机角度，目前设计定时器中断为100us，90度1ms,9度100us,所以角度只能是9的倍数
+// 设置舵机角度(0~180度),脉宽0.5ms~2.5ms,DMA方式分辨率1us(约0.09度)。
+// SG90_PWM_ISR方式定时器中断为100us,9度100us,角度只能是9的倍数
 void Set_Servo_Angle(uint16_t angle)
 {
+    uint16_t pulse;
+
     printf("Set_Servo_Angle: %d\r\n", angle);
     if (angle > 180) angle = 180;
+    sg90_angle = angle;
 
     // 计算高电平时间 (单位: µs)
-    high_time = 500 + (angle * 2000 / 180); // 0.5ms ~ 2.5ms
-    low_time = 20000 - high_time;           // 低电平时间
+    pulse = SG90_PULSE_MIN_US + (angle * (SG90_PULSE_MAX_US - SG90_PULSE_MIN_US) / 180); // 0.5ms ~ 2.5ms
+    if (sg90_mode == SG90_PWM_DMA)
+    {
+        SG90_PwmStart(pulse, SG90_MOVE_PERIODS);
+        return;
+    }
+    high_time = pulse;
+    low_time = SG90_PERIOD_US - high_time;  // 低电平时间
     counter = 0;
     pwm_state = 0;
     period_count = 0;
@@ -146,6 +316,334 @@ void Set_Servo_Angle(uint16_t angle)
     HAL_GPIO_WritePin(GPIOG, GPIO_PIN_6, GPIO_PIN_SET);//拉高电平
 }
 
+// 按曲线和速度、加速度限制计算轨迹时间
+static void SG90_PlanMove(SG90_Plan_t *p, const SG90_Motion_t *m, float d)
+{
+    float v = (float)m->speed_dps;
+    float a = (float)m->accel_dps2;
+
+    p->profile = m->profile;
+    p->d = d;
+    p->a = a;
+    switch (m->profile)
+    {
+        case SG90_PROFILE_TRAPEZOID:
+            if (d * a >= v * v)
+            {
+                p->vp = v;
+                p->ta = v / a;
+                p->t = d / v + p->ta;
+            }
+            else
+            {
+                p->vp = sqrtf(d * a);       // 距离短,加速到一半就减速
+                p->ta = p->vp / a;
+                p->t = 2.0f * p->ta;
+            }
+            break;
+        case SG90_PROFILE_SCURVE:
+            // 最大速度1.875d/T,最大加速度5.77d/T^2
+            p->t = fmaxf(1.875f * d / v, sqrtf(5.7735f * d / a));
+            break;
+        default:
+            p->t = d / v;
+            break;
+    }
+}
+
+// t秒时转过的角度
+static float SG90_PlanPos(const SG90_Plan_t *p, float t)
+{
+    float u;
+
+    if (t >= p->t)
+    {
+        return p->d;
+    }
+    switch (p->profile)
+    {
+        case SG90_PROFILE_TRAPEZOID:
+            if (t < p->ta)
+            {
+                return 0.5f * p->a * t * t;
+            }
+            if (t > p->t - p->ta)
+            {
+                u = p->t - t;
+                return p->d - 0.5f * p->a * u * u;
+            }
+            return 0.5f * p->a * p->ta * p->ta + p->vp * (t - p->ta);
+        case SG90_PROFILE_SCURVE:
+            u = t / p->t;
+            return p->d * u * u * u * (10.0f + u * (-15.0f + 6.0f * u));
+        default:
+            return p->d;
+    }
+}
+
+static uint16_t SG90_AngleToPulse(float angle)
+{
+    return (uint16_t)(SG90_PULSE_MIN_US + angle * (float)(SG90_PULSE_MAX_US - SG90_PULSE_MIN_US) / 180.0f + 0.5f);
+}
+
+/**
+ * @brief 按转动曲线转到target度,在舵机任务中调用,转完返回:
+ *        1.轨迹按周期采样,n个周期,第k个周期的脉宽是(k+1)T/n时刻的位置,之后保持目标脉宽settle_ms;
+ *        2.第一个脉冲马上输出,后面的脉宽由任务在每个周期中间(vTaskDelayUntil)写入CCR4预装载,
+ *          下一个周期生效,任务晚一点唤醒也不影响波形;
+ *        3.脉冲数写在DMA的传输次数中,输出完自动停止,总时间不超过SG90_MOVE_MAX_MS。
+ * @return 实际驱动时间(ms)
+ */
+static uint32_t SG90_Move(uint16_t target)
+{
+    SG90_Motion_t m;
+    SG90_Plan_t plan;
+    TickType_t last = 0;
+    float from = (float)sg90_angle;
+    float dir;
+    uint32_t start, elapsed, n, settle, max_periods, k;
+
+    if (target > 180) target = 180;
+    SG90_GetMotion(&m);
+    dir = (float)target >= from ? 1.0f : -1.0f;
+    SG90_PlanMove(&plan, &m, fabsf((float)target - from));
+
+    max_periods = SG90_MOVE_MAX_MS * 1000U / SG90_PERIOD_US;
+    settle = (m.settle_ms * 1000U + SG90_PERIOD_US - 1U) / SG90_PERIOD_US;
+    n = (uint32_t)ceilf(plan.t * 1000000.0f / SG90_PERIOD_US);
+    if (n == 0) n = 1;
+    if (n + settle > max_periods)
+    {
+        n = max_periods - settle;           // 压缩轨迹,按时停止
+    }
+
+    start = LOG_GetTimeUs();
+    SG90_PwmStart(SG90_AngleToPulse(from + dir * SG90_PlanPos(&plan, plan.t / n)), (uint16_t)(n + settle));
+    if (n > 1)
+    {
+        SG90_SetPulse(SG90_AngleToPulse(from + dir * SG90_PlanPos(&plan, plan.t * 2 / n)));
+        // 之后在每个周期的中间写下一个周期的脉宽,离更新事件最远
+        vTaskDelay(pdMS_TO_TICKS(SG90_PERIOD_US / 2000U));
+        last = xTaskGetTickCount();
+    }
+    for (k = 2; k < n; k++)
+    {
+        vTaskDelayUntil(&last, pdMS_TO_TICKS(SG90_PERIOD_US / 1000U));
+        SG90_SetPulse(SG90_AngleToPulse(from + dir * SG90_PlanPos(&plan, plan.t * (k + 1) / n)));
+    }
+    sg90_angle = target;
+
+    // 等DMA发完最后一个脉冲
+    elapsed = LOG_GetTimeUs() - start;
+    if (elapsed < (n + settle) * SG90_PERIOD_US)
+    {
+        vTaskDelay(pdMS_TO_TICKS(((n + settle) * SG90_PERIOD_US - elapsed) / 1000U) + 1U);
+    }
+    SG90_PwmStop();
+    elapsed = LOG_GetTimeUs() - start;
+
+    taskENTER_CRITICAL();
+    sg90_move_stats.moves++;
+    sg90_move_stats.from = (uint16_t)from;
+    sg90_move_stats.to = target;
+    sg90_move_stats.profile = m.profile;
+    sg90_move_stats.periods = (uint16_t)(n + settle);
+    sg90_move_stats.plan_ms = (uint32_t)(plan.t * 1000.0f + 0.5f);
+    sg90_move_stats.actual_ms = elapsed / 1000U;
+    taskEXIT_CRITICAL();
+    printf("Servo %u -> %u deg, %u ms\r\n", (unsigned)from, (unsigned)target, (unsigned)(elapsed / 1000U));
+    return elapsed / 1000U;
+}
+
+/**
+ * @brief 设置转动曲线,下一次转动生效
+ * @return 0:成功, -1:参数超出范围
+ */
+int SG90_SetMotion(const SG90_Motion_t *motion)
+{
+    if (motion->profile >= SG90_PROFILE_NUM || motion->speed_dps < 30 || motion->speed_dps > 1000 ||
+        motion->accel_dps2 < 100 || motion->accel_dps2 > 30000 || motion->settle_ms > 500)
+    {
+        return -1;
+    }
+    taskENTER_CRITICAL();
+    sg90_motion = *motion;
+    taskEXIT_CRITICAL();
+    return 0;
+}
+
+void SG90_GetMotion(SG90_Motion_t *motion)
+{
+    taskENTER_CRITICAL();
+    *motion = sg90_motion;
+    taskEXIT_CRITICAL();
+}
+
+void SG90_GetMoveStats(SG90_MoveStats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = sg90_move_stats;
+    taskEXIT_CRITICAL();
+}
+
+// 等转动结束(SG90_MOVE_PERIODS个周期),DMA方式之后关掉TIM1,返回停止用的周期数
+static uint32_t SG90_WaitMove(void)
+{
+    uint32_t start;
+
+    vTaskDelay(pdMS_TO_TICKS(SG90_MOVE_PERIODS * SG90_PERIOD_US / 1000U) + 1U);
+    start = DWT->CYCCNT;
+    if (sg90_mode == SG90_PWM_DMA)
+    {
+        SG90_PwmStop();
+    }
+    return DWT->CYCCNT - start;
+}
+
+// 两种方式各转动一次(保持当前角度,锁舌不动),统计中断次数和周期数
+static void SG90_RunBench(void)
+{
+    SG90_BenchStats_t *r;
+    uint32_t start, us;
+    uint8_t mode;
+
+    for (mode = 0; mode < SG90_PWM_MODE_NUM; mode++)
+    {
+        r = &sg90_bench_result[mode];
+        sg90_mode = (SG90_PwmMode_t)mode;
+        sg90_irq_count = 0;
+        sg90_irq_cycles = 0;
+        sg90_irq_max = 0;
+
+        us = LOG_GetTimeUs();
+        start = DWT->CYCCNT;
+        Set_Servo_Angle(sg90_angle);
+        r->task_cycles = DWT->CYCCNT - start;
+        r->task_cycles += SG90_WaitMove();
+        r->move_us = LOG_GetTimeUs() - us;
+        r->irqs = sg90_irq_count;
+        r->irq_cycles = sg90_irq_cycles;
+        r->irq_max = sg90_irq_max;
+    }
+    sg90_mode = SG90_PWM_DMA;
+}
+
+static uint32_t SG90_BkpCrc(uint32_t state, uint32_t until)
+{
+    uint32_t w[2] = {state, until};
+
+    return FSTORE_Crc32(0, (const uint8_t *)w, sizeof(w));
+}
+
+/* 门锁状态和最后的命令写入备份寄存器,只在舵机任务中调用 */
+static void SG90_StateSave(uint8_t cmd, uint8_t source, uint8_t moving)
+{
+    uint32_t state = SG90_BKP_MAGIC | ((uint32_t)cmd << 16) | ((uint32_t)source << 8) |
+                     (lock_state ? SG90_BKP_OPEN : 0U) | (moving ? SG90_BKP_MOVING : 0U);
+
+    RTC_BkpWrite(SG90_BKP_STATE, state);
+    RTC_BkpWrite(SG90_BKP_UNTIL, sg90_relock_until);
+    RTC_BkpWrite(SG90_BKP_CRC, SG90_BkpCrc(state, sg90_relock_until));
+}
+
+/**
+ * @brief 复位后从备份寄存器恢复门锁状态,只读寄存器不动舵机,在RTC_Init之后尽早调用。
+ *        需要关锁的情况在舵机任务启动后转动,开着的锁按剩余时间自动关锁
+ */
+void SG90_RestoreState(void)
+{
+    uint32_t state = RTC_BkpRead(SG90_BKP_STATE);
+    uint32_t until = RTC_BkpRead(SG90_BKP_UNTIL);
+    uint32_t time, remain;
+    SG90_Restore_t *r = &sg90_restore;
+
+    memset(r, 0, sizeof(*r));
+    if ((state & SG90_BKP_MAGIC_MASK) != SG90_BKP_MAGIC || RTC_BkpRead(SG90_BKP_CRC) != SG90_BkpCrc(state, until))
+    {
+        r->result = SG90_RESTORE_NONE;
+    }
+    else
+    {
+        r->last_cmd = (uint8_t)(state >> 16);
+        r->source = (uint8_t)(state >> 8);
+        if (state & SG90_BKP_MOVING)
+        {
+            r->result = SG90_RESTORE_INTERRUPTED;
+        }
+        else if (!(state & SG90_BKP_OPEN))
+        {
+            r->result = SG90_RESTORE_CLOSED;
+        }
+        else
+        {
+            // 按保存的关锁时间算剩余时间;日历没有设置、被往回调过时重新计时
+            remain = SG90_UNLOCK_TIMEOUT_MS;
+            time = RTC_GetTime();
+            if (until != 0U && time != 0U)
+            {
+                remain = until <= time ? 0U : (until - time) * 1000U;
+                if (remain > SG90_UNLOCK_TIMEOUT_MS)
+                {
+                    remain = SG90_UNLOCK_TIMEOUT_MS;
+                }
+            }
+            r->result = remain ? SG90_RESTORE_OPEN : SG90_RESTORE_EXPIRED;
+            r->remain_ms = remain;
+            sg90_angle = 180;   // 锁舌在开锁位置,关锁时按完整行程规划
+        }
+    }
+    if (r->result == SG90_RESTORE_OPEN)
+    {
+        lock_state = 1;
+        sg90_relock_until = until;
+    }
+    r->restore_us = LOG_GetTimeUs();
+}
+
+/* 按恢复结果处理:开着的锁启动关锁定时器,锁舌位置不确定或已经超时的转到关锁 */
+static void SG90_ApplyRestore(void)
+{
+    static const char *const names[] = {"unknown", "closed", "open", "expired", "interrupted"};
+    const SG90_Restore_t *r = &sg90_restore;
+
+    printf("Lock state after reset: %s (last cmd %u), restored at %u us\r\n", names[r->result],
+           (unsigned)r->last_cmd, (unsigned)r->restore_us);
+    if (r->result == SG90_RESTORE_CLOSED)
+    {
+        return;
+    }
+    if (r->result == SG90_RESTORE_OPEN)
+    {
+        xTimerChangePeriod(SG90_Timer, pdMS_TO_TICKS(r->remain_ms), 0);
+        printf("Relock in %u ms\r\n", (unsigned)r->remain_ms);
+        return;
+    }
+
+    printf("Locking door...\r\n");
+    lock_state = 0;
+    sg90_relock_until = 0;
+    AUTH_DoorLocked();
+    SG90_StateSave(LOCK_CMD_CLOSE, r->source, 1);
+    if (r->result == SG90_RESTORE_EXPIRED)
+    {
+        SG90_Move(0);
+    }
+    else
+    {
+        // 不知道锁舌在哪,按原来的方式一步到位并保持SG90_MOVE_PERIODS个周期
+        Set_Servo_Angle(0);
+        SG90_WaitMove();
+    }
+    SG90_StateSave(LOCK_CMD_CLOSE, r->source, 0);
+}
+
+/**
+ * @brief 获取复位后门锁状态的恢复结果
+ */
+void SG90_GetRestore(SG90_Restore_t *restore)
+{
+    *restore = sg90_restore;
+}
 
 void PG6_SET_HIGH(void)
 {
@@ -162,8 +660,8 @@ void PG6_SET_LOW(void)
 
 void SG90_TimerCallback(TimerHandle_t xTimer)
 {
-    uint8_t command = LOCK_CMD_CLOSE;
-    osMessageQueuePut(sg90QueueHandle, &command, 0, 0);   
+    SG90_Cmd_t cmd = {LOCK_CMD_CLOSE, 0, 0};
+    osMessageQueuePut(sg90QueueHandle, &cmd, 0, 0);   
     printf("SG90_TimerCallback\r\n");
 }
 
@@ -171,31 +669,44 @@ void SG90_TimerCallback(TimerHandle_t xTimer)
 // 舵机任务函数,用于开关锁
 void Sg90ControlTask(void *pvParameters)
 {
-    uint8_t command;
-    uint32_t current_time;
-    //创建一个定时器，并启动
-    SG90_Timer = xTimerCreate("SG90_Timer", SG90_UNLOCK_TIMEOUT, pdFALSE, (void *)0, SG90_TimerCallback);
-    xTimerStart(SG90_Timer, 0);
-    xTimerStop(SG90_Timer, 0);
+    SG90_Cmd_t cmd;
+
+    SG90_ApplyRestore();
     
     while (1)
     {
         // 本身这里的队列应该是做无限等待的，但是因为要做开锁后自动关锁，所以1s后让它跑到后面是否需要关锁
-        if (osMessageQueueGet(sg90QueueHandle, &command, NULL, portMAX_DELAY) == osOK)
+        if (osMessageQueueGet(sg90QueueHandle, &cmd, NULL, portMAX_DELAY) == osOK)
         {
-            if (command == LOCK_CMD_OPEN) // 开锁
+            if (cmd.command == LOCK_CMD_OPEN) // 开锁
             {
+                AUTH_BoltMoving(cmd.source, cmd.capture_us); // 舵机开始转动,统计开锁延时
                 printf("Unlocking door...\r\n");
-                Set_Servo_Angle(180); // 设置舵机角度为180度开锁
-                xTimerReset(SG90_Timer, 0);
-                 lock_state = 1;
-                // unlock_time = osKernelGetTickCount(); // 记录解锁时间
+                xTimerChangePeriod(SG90_Timer, SG90_UNLOCK_TIMEOUT, 0); // 复位恢复时可能改过周期
+                lock_state = 1;
+                sg90_relock_until = RTC_GetTime();
+                if (sg90_relock_until != 0U)
+                {
+                    sg90_relock_until += (SG90_UNLOCK_TIMEOUT_MS + 999U) / 1000U;
+                }
+                SG90_StateSave(cmd.command, cmd.source, 1);
+                SG90_Move(180); // 转到180度开锁
+                SG90_StateSave(cmd.command, cmd.source, 0);
             }
-            else if (command == LOCK_CMD_CLOSE) // 关锁
+            else if (cmd.command == LOCK_CMD_CLOSE) // 关锁
             {
                 printf("Locking door...\r\n");
-                Set_Servo_Angle(0); // 设置舵机角度为0度关锁
                 lock_state = 0;
+                sg90_relock_until = 0;
+                AUTH_DoorLocked();
+                SG90_StateSave(cmd.command, cmd.source, 1);
+                SG90_Move(0); // 转到0度关锁
+                SG90_StateSave(cmd.command, cmd.source, 0);
+            }
+            else if (cmd.command == LOCK_CMD_BENCH)
+            {
+                SG90_RunBench();
+                xTaskNotifyGive(sg90_bench_requester);
             }
         }
         
@@ -206,11 +717,15 @@ void Sg90ControlTask(void *pvParameters)
 void SG90_CreateTask(void)
 {
     // 创建消息队列
-    sg90QueueHandle = osMessageQueueNew(10, sizeof(uint8_t), NULL);
-    //创建定时器，用于开锁后自动关锁
-    
+    sg90QueueHandle = osMessageQueueNew(10, sizeof(SG90_Cmd_t), NULL);
+    //创建定时器，用于开锁后自动关锁,开锁时才启动
+    SG90_Timer = xTimerCreate("SG90_Timer", SG90_UNLOCK_TIMEOUT, pdFALSE, (void *)0, SG90_TimerCallback);
     // 创建舵机控制任务
     sg90TaskHandle = osThreadNew(Sg90ControlTask, NULL, &sg90_attributes);
+    if (sg90QueueHandle == NULL || SG90_Timer == NULL || sg90TaskHandle == NULL)
+    {
+        Error_Handler(); /* 堆不够 */
+    }
 }
 
 // // 添加门锁状态获取函数实现
@@ -220,13 +735,39 @@ uint8_t IsDoorUnlocked(void)
 }
 
 
-// 发送锁定/解锁命令到舵机任务 1-开锁 0-关锁
-void SendLockCommand(uint8_t command)
+// 发送开锁命令到舵机任务,只由授权任务(auth.c)在允许开锁后调用
+void SG90_Unlock(uint8_t source, uint32_t capture_us)
 {
+    SG90_Cmd_t cmd = {LOCK_CMD_OPEN, source, capture_us};
+
     if (sg90QueueHandle != NULL)
     {
-        osMessageQueuePut(sg90QueueHandle, &command, 0, 0);
+        osMessageQueuePut(sg90QueueHandle, &cmd, 0, 0);
+    }
+}
+
+/**
+ * @brief 舵机PWM基准测试,在shell任务中调用,舵机任务执行,等待完成
+ * @param result 每种方式的结果,下标为SG90_PwmMode_t
+ * @return 0:成功, -1:舵机任务没有响应
+ */
+int SG90_Bench(SG90_BenchStats_t result[SG90_PWM_MODE_NUM])
+{
+    SG90_Cmd_t cmd = {LOCK_CMD_BENCH, 0, 0};
+
+    if (sg90QueueHandle == NULL)
+    {
+        return -1;
+    }
+    sg90_bench_requester = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0);
+    if (osMessageQueuePut(sg90QueueHandle, &cmd, 0, 0) != osOK ||
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SG90_BENCH_TIMEOUT)) == 0)
+    {
+        return -1;
     }
+    memcpy(result, sg90_bench_result, sizeof(sg90_bench_result));
+    return 0;
 }
 
 #endif /* SG90_ENABLE */ 
\ No newline at end of file
@@ -21,22 +21,108 @@ extern "C" {
 #define SG90_CTL_Pin GPIO_PIN_6
 #define SG90_CTL_GPIO_Port GPIOG
 
+/* 舵机波形:周期20ms,高电平0.5ms(0度)~2.5ms(180度) */
+#define SG90_PERIOD_US          20000
+#define SG90_PULSE_MIN_US       500
+#define SG90_PULSE_MAX_US       2500
+#define SG90_MOVE_PERIODS       40      /* Set_Servo_Angle(跳变,不规划轨迹)输出的周期数,800ms */
+
+/* 转动曲线,SG90_Move按曲线每个周期(20ms)更新一次脉宽,转到位后停止输出 */
+typedef enum {
+    SG90_PROFILE_STEP = 0,      /* 脉宽一步到位,按speed_dps估计转到位的时间 */
+    SG90_PROFILE_TRAPEZOID,     /* 梯形速度:匀加速、匀速、匀减速,距离短时没有匀速段 */
+    SG90_PROFILE_SCURVE,        /* S曲线:最小加加速度(5次多项式),起停时加速度为0 */
+    SG90_PROFILE_NUM
+} SG90_Profile_t;
+
+#define SG90_SPEED_DPS          300     /* 最大角速度(度/秒),SG90空载约600,带锁舌留一半 */
+#define SG90_ACCEL_DPS2         3000    /* 最大角加速度(度/秒^2) */
+#define SG90_SETTLE_MS          60      /* 轨迹结束后保持目标脉宽的时间,等舵机跟上 */
+#define SG90_MOVE_MAX_MS        2000    /* 一次转动最长的驱动时间,轨迹更长时压缩,堵转时也按时停止 */
+
+typedef struct {
+    uint8_t  profile;       /* SG90_Profile_t */
+    uint16_t speed_dps;
+    uint16_t accel_dps2;
+    uint16_t settle_ms;
+} SG90_Motion_t;
+
+/* 最近一次转动 */
+typedef struct {
+    uint32_t moves;         /* 转动次数 */
+    uint16_t from;          /* 起始角度 */
+    uint16_t to;            /* 目标角度 */
+    uint8_t  profile;
+    uint16_t periods;       /* 输出的脉冲数(含保持) */
+    uint32_t plan_ms;       /* 轨迹时间 */
+    uint32_t actual_ms;     /* 从输出第一个脉冲到停止输出的时间 */
+} SG90_MoveStats_t;
+
 enum LOCK_CMD
 {
     LOCK_CMD_CLOSE = 0,
     LOCK_CMD_OPEN = 1,
+    LOCK_CMD_BENCH = 2,     /* 基准测试,shell的bench servo命令 */
 };
 
+/* PWM产生方式,基准测试对比用 */
+typedef enum {
+    SG90_PWM_ISR = 0,       /* TIM2每100us中断一次翻转GPIO(原来的实现) */
+    SG90_PWM_DMA,           /* TIM1更新/CC4事件触发DMA写BSRR,转动过程中没有中断 */
+    SG90_PWM_MODE_NUM
+} SG90_PwmMode_t;
+
+/* 一次转动的开销 */
+typedef struct {
+    uint32_t irqs;          /* 中断次数 */
+    uint32_t irq_cycles;    /* 中断处理函数累计周期数 */
+    uint32_t irq_max;       /* 最长一次中断的周期数 */
+    uint32_t task_cycles;   /* 舵机任务启动、停止波形的周期数 */
+    uint32_t move_us;       /* 转动时间 */
+} SG90_BenchStats_t;
+
+/* 舵机任务队列中的命令,开锁命令带授权请求的来源和出示凭据时间,用于统计开锁延时 */
+typedef struct
+{
+    uint8_t command;        /* LOCK_CMD_xxx */
+    uint8_t source;         /* AUTH_Source_t */
+    uint32_t capture_us;    /* 出示凭据的时间 */
+} SG90_Cmd_t;
+
 /* 舵机相关函数声明 */
 void SG90_Init(void);
 void SG90_Control(void);
 void Set_Servo_Angle(uint16_t angle);
+void SG90_SetPulse(uint16_t pulse_us);
+int  SG90_SetMotion(const SG90_Motion_t *motion);
+void SG90_GetMotion(SG90_Motion_t *motion);
+void SG90_GetMoveStats(SG90_MoveStats_t *stats);
+/* 复位后门锁状态的恢复结果 */
+typedef enum {
+    SG90_RESTORE_NONE = 0,      /* 备份寄存器里没有有效记录(第一次上电、电池掉电),转到关锁 */
+    SG90_RESTORE_CLOSED,        /* 关着,不转动 */
+    SG90_RESTORE_OPEN,          /* 开着且没到自动关锁时间,不转动,按剩余时间关锁 */
+    SG90_RESTORE_EXPIRED,       /* 开着但已经过了自动关锁时间,转到关锁 */
+    SG90_RESTORE_INTERRUPTED,   /* 转动过程中复位,锁舌位置不确定,转到关锁 */
+} SG90_RestoreResult_t;
+
+typedef struct {
+    uint8_t  result;            /* SG90_RestoreResult_t */
+    uint8_t  last_cmd;          /* 复位前最后一条命令,LOCK_CMD_xxx */
+    uint8_t  source;            /* 最后一次开锁的方式 */
+    uint32_t remain_ms;         /* SG90_RESTORE_OPEN时剩余的自动关锁时间 */
+    uint32_t restore_us;        /* 恢复完成的时间(上电后) */
+} SG90_Restore_t;
+
+int  SG90_Bench(SG90_BenchStats_t result[SG90_PWM_MODE_NUM]);
+void SG90_RestoreState(void);
+void SG90_GetRestore(SG90_Restore_t *restore);
 void PG6_SET_HIGH(void);
 void PG6_SET_LOW(void);
 
 // 添加舵机任务相关函数声明
 void SG90_CreateTask(void);
-void SendLockCommand(uint8_t command);
+void SG90_Unlock(uint8_t source, uint32_t capture_us);
 
 // 添加门锁状态获取函数
 uint8_t IsDoorUnlocked(void);
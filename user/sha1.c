@@ -0,0 +1,220 @@
+/**
+  ******************************************************************************
+  * @file    sha1.c
+  * @author  cyytx
+  * @brief   SHA-1摘要、HMAC-SHA1和HOTP的源文件(FIPS 180-4、RFC 2104、RFC 4226)
+  *          1.压缩函数按字处理:80轮全部展开,每5轮一组,变量轮换由宏参数完成,
+  *            消息扩展只保留16个字的滑动窗口;F1、F3用少一次运算的等价式;
+  *          2.HMAC密钥的内、外层密钥块只压缩一次,中间状态保存在HMAC_SHA1_Key_t中;
+  *          3.HOTP的消息固定是8字节计数器,内层、外层的补位块直接按字填好,
+  *            算一个码正好两次压缩,不经过字节缓冲区和大小端转换。
+  *          工程默认-O0编译,本文件在工程中单独设置为-O2(见smart_lock.uvprojx)。
+  ******************************************************************************
+  */
+#include <string.h>
+#include "sha1.h"
+
+#define ROL(x, n)       (((x) << (n)) | ((x) >> (32U - (n))))
+#define F1(b, c, d)     ((d) ^ ((b) & ((c) ^ (d))))
+#define F2(b, c, d)     ((b) ^ (c) ^ (d))
+#define F3(b, c, d)     (((b) & (c)) | ((d) & ((b) | (c))))
+
+#define K1              0x5A827999U
+#define K2              0x6ED9EBA1U
+#define K3              0x8F1BBCDCU
+#define K4              0xCA62C1D6U
+
+/* 第i轮的消息字:前16轮直接取,之后在16个字的窗口中扩展,i是常数时编译器只留一个分支 */
+#define W(i)            ((i) < 16 ? w[i] :                                                  \
+                         (w[(i) & 15] = ROL(w[((i) - 3) & 15] ^ w[((i) - 8) & 15] ^          \
+                                            w[((i) - 14) & 15] ^ w[(i) & 15], 1)))
+
+/* 一轮:e、b就地更新,其余变量下一轮换位置使用 */
+#define ROUND(a, b, c, d, e, F, k, i) do {                  \
+        (e) += ROL(a, 5) + F(b, c, d) + (k) + W(i);         \
+        (b) = ROL(b, 30);                                   \
+    } while (0)
+
+#define ROUND5(i, F, k) do {                                \
+        ROUND(a, b, c, d, e, F, k, (i) + 0);                \
+        ROUND(e, a, b, c, d, F, k, (i) + 1);                \
+        ROUND(d, e, a, b, c, F, k, (i) + 2);                \
+        ROUND(c, d, e, a, b, F, k, (i) + 3);                \
+        ROUND(b, c, d, e, a, F, k, (i) + 4);                \
+    } while (0)
+
+static const uint32_t SHA1_IV[SHA1_DIGEST_WORDS] = {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0,
+};
+
+/* 大端读写,编译器识别为REV指令 */
+static uint32_t SHA1_Load(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void SHA1_Store(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/* 压缩一个块,w是16个字的消息(会被改写为消息扩展的窗口) */
+static void SHA1_Transform(uint32_t *state, uint32_t *w)
+{
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+    ROUND5(0, F1, K1);
+    ROUND5(5, F1, K1);
+    ROUND5(10, F1, K1);
+    ROUND5(15, F1, K1);
+    ROUND5(20, F2, K2);
+    ROUND5(25, F2, K2);
+    ROUND5(30, F2, K2);
+    ROUND5(35, F2, K2);
+    ROUND5(40, F3, K3);
+    ROUND5(45, F3, K3);
+    ROUND5(50, F3, K3);
+    ROUND5(55, F3, K3);
+    ROUND5(60, F2, K4);
+    ROUND5(65, F2, K4);
+    ROUND5(70, F2, K4);
+    ROUND5(75, F2, K4);
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+}
+
+/* 处理一个64字节的块 */
+static void SHA1_Block(uint32_t *state, const uint8_t *block)
+{
+    uint32_t w[16];
+    uint32_t i;
+
+    for (i = 0; i < 16; i++)
+    {
+        w[i] = SHA1_Load(block + 4 * i);
+    }
+    SHA1_Transform(state, w);
+}
+
+/**
+ * @brief 一次计算整段数据的摘要,只用于HMAC中超过一块的密钥
+ */
+void SHA1(const void *data, uint32_t len, uint8_t *digest)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t state[SHA1_DIGEST_WORDS];
+    uint8_t buf[SHA1_BLOCK_SIZE];
+    uint64_t bits = (uint64_t)len * 8U;
+    uint32_t i, rest;
+
+    memcpy(state, SHA1_IV, sizeof(state));
+    for (rest = len; rest >= SHA1_BLOCK_SIZE; rest -= SHA1_BLOCK_SIZE)
+    {
+        SHA1_Block(state, p);
+        p += SHA1_BLOCK_SIZE;
+    }
+    // 补一个1位,再补0到56字节,最后8字节是消息长度(位,大端)
+    memcpy(buf, p, rest);
+    buf[rest++] = 0x80;
+    if (rest > SHA1_BLOCK_SIZE - 8U)
+    {
+        memset(&buf[rest], 0, SHA1_BLOCK_SIZE - rest);
+        SHA1_Block(state, buf);
+        rest = 0;
+    }
+    memset(&buf[rest], 0, SHA1_BLOCK_SIZE - 8U - rest);
+    SHA1_Store(&buf[SHA1_BLOCK_SIZE - 8U], (uint32_t)(bits >> 32));
+    SHA1_Store(&buf[SHA1_BLOCK_SIZE - 4U], (uint32_t)bits);
+    SHA1_Block(state, buf);
+    for (i = 0; i < SHA1_DIGEST_WORDS; i++)
+    {
+        SHA1_Store(digest + 4 * i, state[i]);
+    }
+}
+
+/**
+ * @brief HMAC密钥预处理:压缩内、外层密钥块,保存两个中间状态
+ * @param key 密钥,超过64字节时先取摘要
+ */
+void HMAC_SHA1_Init(HMAC_SHA1_Key_t *hk, const void *key, uint32_t len)
+{
+    uint8_t pad[SHA1_BLOCK_SIZE];
+    uint32_t w[16];
+    uint32_t k[16];
+    uint32_t i;
+
+    memset(pad, 0, sizeof(pad));
+    if (len > SHA1_BLOCK_SIZE)
+    {
+        SHA1(key, len, pad);
+    }
+    else
+    {
+        memcpy(pad, key, len);
+    }
+    for (i = 0; i < 16; i++)
+    {
+        k[i] = SHA1_Load(pad + 4 * i);
+        w[i] = k[i] ^ 0x36363636U;
+    }
+    memcpy(hk->istate, SHA1_IV, sizeof(hk->istate));
+    SHA1_Transform(hk->istate, w);
+    for (i = 0; i < 16; i++)
+    {
+        w[i] = k[i] ^ 0x5C5C5C5CU;
+    }
+    memcpy(hk->ostate, SHA1_IV, sizeof(hk->ostate));
+    SHA1_Transform(hk->ostate, w);
+    memset(pad, 0, sizeof(pad));
+    memset(k, 0, sizeof(k));
+    memset(w, 0, sizeof(w));
+}
+
+/**
+ * @brief 8字节计数器(大端)的HMAC-SHA1,两次压缩
+ * @param mac 输出5个字,按大端排列即为20字节的MAC
+ */
+void HMAC_SHA1_Counter(const HMAC_SHA1_Key_t *hk, uint64_t counter, uint32_t *mac)
+{
+    uint32_t w[16];
+    uint32_t state[SHA1_DIGEST_WORDS];
+
+    // 内层:密钥块之后是8字节计数器,补位后一块,总长(64+8)*8位
+    w[0] = (uint32_t)(counter >> 32);
+    w[1] = (uint32_t)counter;
+    w[2] = 0x80000000U;
+    memset(&w[3], 0, 12 * sizeof(uint32_t));
+    w[15] = (SHA1_BLOCK_SIZE + 8U) * 8U;
+    memcpy(state, hk->istate, sizeof(state));
+    SHA1_Transform(state, w);
+
+    // 外层:密钥块之后是20字节内层摘要,总长(64+20)*8位
+    memcpy(w, state, sizeof(state));
+    w[5] = 0x80000000U;
+    memset(&w[6], 0, 9 * sizeof(uint32_t));
+    w[15] = (SHA1_BLOCK_SIZE + SHA1_DIGEST_SIZE) * 8U;
+    memcpy(mac, hk->ostate, sizeof(state));
+    SHA1_Transform(mac, w);
+}
+
+/**
+ * @brief HOTP值(RFC 4226动态截取):MAC最后一个字节的低4位作为偏移,取该处4字节的低31位
+ * @return 31位整数,对10^位数取余即为一次性密码
+ */
+uint32_t HOTP_Value(const HMAC_SHA1_Key_t *hk, uint64_t counter)
+{
+    uint32_t mac[SHA1_DIGEST_WORDS];
+    uint32_t off, shift, v;
+
+    HMAC_SHA1_Counter(hk, counter, mac);
+    off = mac[SHA1_DIGEST_WORDS - 1] & 0x0FU;
+    shift = (off & 3U) * 8U;
+    v = mac[off >> 2] << shift;
+    if (shift != 0)
+    {
+        v |= mac[(off >> 2) + 1] >> (32U - shift);
+    }
+    return v & 0x7FFFFFFFU;
+}
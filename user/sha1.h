@@ -0,0 +1,38 @@
+/**
+  ******************************************************************************
+  * @file    sha1.h
+  * @author  cyytx
+  * @brief   SHA-1摘要、HMAC-SHA1和HOTP的头文件,
+  *          用于一次性密码(TOTP,RFC 6238)凭据的验证
+  ******************************************************************************
+  */
+
+#ifndef __SHA1_H
+#define __SHA1_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define SHA1_BLOCK_SIZE         64
+#define SHA1_DIGEST_SIZE        20
+#define SHA1_DIGEST_WORDS       5
+
+/* HMAC密钥:压缩密钥^ipad、密钥^opad之后的两个中间状态,同一密钥算多个消息时只算一次 */
+typedef struct {
+    uint32_t istate[SHA1_DIGEST_WORDS];
+    uint32_t ostate[SHA1_DIGEST_WORDS];
+} HMAC_SHA1_Key_t;
+
+void SHA1(const void *data, uint32_t len, uint8_t *digest);
+void HMAC_SHA1_Init(HMAC_SHA1_Key_t *hk, const void *key, uint32_t len);
+void HMAC_SHA1_Counter(const HMAC_SHA1_Key_t *hk, uint64_t counter, uint32_t *mac);
+uint32_t HOTP_Value(const HMAC_SHA1_Key_t *hk, uint64_t counter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SHA1_H */
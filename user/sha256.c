@@ -0,0 +1,313 @@
+/**
+  ******************************************************************************
+  * @file    sha256.c
+  * @author  cyytx
+  * @brief   SHA-256摘要、HMAC-SHA256和PBKDF2-HMAC-SHA256的源文件(FIPS 180-4、RFC 2104、RFC 8018)
+  *          1.压缩函数按字处理:消息扩展只保留16个字的滑动窗口,轮函数8轮一组展开,
+  *            变量轮换由宏参数完成,不搬运寄存器;Ch、Maj用少一次运算的等价式;
+  *          2.HMAC的内、外层密钥块只压缩一次,中间状态保存在上下文中;
+  *          3.PBKDF2每次迭代的输入固定是32字节,直接按字填好补位后的块,
+  *            每次迭代正好两次压缩,不经过字节缓冲区和大小端转换。
+  *          工程默认-O0编译,本文件在工程中单独设置为-O2(见smart_lock.uvprojx)。
+  ******************************************************************************
+  */
+#include <string.h>
+#include "sha256.h"
+
+#define ROR(x, n)       (((x) >> (n)) | ((x) << (32U - (n))))
+#define S0(x)           (ROR(x, 2) ^ ROR(x, 13) ^ ROR(x, 22))
+#define S1(x)           (ROR(x, 6) ^ ROR(x, 11) ^ ROR(x, 25))
+#define G0(x)           (ROR(x, 7) ^ ROR(x, 18) ^ ((x) >> 3))
+#define G1(x)           (ROR(x, 17) ^ ROR(x, 19) ^ ((x) >> 10))
+#define CH(e, f, g)     ((g) ^ ((e) & ((f) ^ (g))))
+#define MAJ(a, b, c)    (((a) & (b)) | ((c) & ((a) | (b))))
+
+/* 第i轮之后的消息字,w是16个字的滑动窗口 */
+#define W(i)            (w[(i) & 15] += G1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] + G0(w[((i) - 15) & 15]))
+
+/* 一轮:d、h就地更新,其余变量下一轮换位置使用 */
+#define ROUND(a, b, c, d, e, f, g, h, k, x) do {        \
+        uint32_t t_ = (h) + S1(e) + CH(e, f, g) + (k) + (x); \
+        (d) += t_;                                          \
+        (h) = t_ + S0(a) + MAJ(a, b, c);                    \
+    } while (0)
+
+#define ROUND8(i, x) do {                                                   \
+        ROUND(a, b, c, d, e, f, g, h, SHA256_K[(i) + 0], x((i) + 0));       \
+        ROUND(h, a, b, c, d, e, f, g, SHA256_K[(i) + 1], x((i) + 1));       \
+        ROUND(g, h, a, b, c, d, e, f, SHA256_K[(i) + 2], x((i) + 2));       \
+        ROUND(f, g, h, a, b, c, d, e, SHA256_K[(i) + 3], x((i) + 3));       \
+        ROUND(e, f, g, h, a, b, c, d, SHA256_K[(i) + 4], x((i) + 4));       \
+        ROUND(d, e, f, g, h, a, b, c, SHA256_K[(i) + 5], x((i) + 5));       \
+        ROUND(c, d, e, f, g, h, a, b, SHA256_K[(i) + 6], x((i) + 6));       \
+        ROUND(b, c, d, e, f, g, h, a, SHA256_K[(i) + 7], x((i) + 7));       \
+    } while (0)
+
+#define W0(i)           (w[i])
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t SHA256_IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+/* 大端读写,编译器识别为REV指令 */
+static uint32_t SHA256_Load(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void SHA256_Store(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/* 压缩一个块,w是16个字的消息(会被改写为消息扩展的窗口) */
+static void SHA256_Transform(uint32_t *state, uint32_t *w)
+{
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    uint32_t i;
+
+    ROUND8(0, W0);
+    ROUND8(8, W0);
+    for (i = 16; i < 64; i += 16)
+    {
+        ROUND8(i, W);
+        ROUND8(i + 8, W);
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+/* 处理一个64字节的块 */
+static void SHA256_Block(uint32_t *state, const uint8_t *block)
+{
+    uint32_t w[16];
+    uint32_t i;
+
+    for (i = 0; i < 16; i++)
+    {
+        w[i] = SHA256_Load(block + 4 * i);
+    }
+    SHA256_Transform(state, w);
+}
+
+void SHA256_Init(SHA256_Ctx_t *ctx)
+{
+    memcpy(ctx->state, SHA256_IV, sizeof(SHA256_IV));
+    ctx->count = 0;
+}
+
+void SHA256_Update(SHA256_Ctx_t *ctx, const void *data, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t used = (uint32_t)(ctx->count % SHA256_BLOCK_SIZE);
+    uint32_t n;
+
+    ctx->count += len;
+    if (used > 0)
+    {
+        n = SHA256_BLOCK_SIZE - used;
+        if (len < n)
+        {
+            memcpy(&ctx->buf[used], p, len);
+            return;
+        }
+        memcpy(&ctx->buf[used], p, n);
+        SHA256_Block(ctx->state, ctx->buf);
+        p += n;
+        len -= n;
+    }
+    while (len >= SHA256_BLOCK_SIZE)
+    {
+        SHA256_Block(ctx->state, p);
+        p += SHA256_BLOCK_SIZE;
+        len -= SHA256_BLOCK_SIZE;
+    }
+    memcpy(ctx->buf, p, len);
+}
+
+void SHA256_Final(SHA256_Ctx_t *ctx, uint8_t *digest)
+{
+    uint32_t used = (uint32_t)(ctx->count % SHA256_BLOCK_SIZE);
+    uint64_t bits = ctx->count * 8U;
+    uint32_t i;
+
+    // 补一个1位,再补0到56字节,最后8字节是消息长度(位,大端)
+    ctx->buf[used++] = 0x80;
+    if (used > SHA256_BLOCK_SIZE - 8U)
+    {
+        memset(&ctx->buf[used], 0, SHA256_BLOCK_SIZE - used);
+        SHA256_Block(ctx->state, ctx->buf);
+        used = 0;
+    }
+    memset(&ctx->buf[used], 0, SHA256_BLOCK_SIZE - 8U - used);
+    SHA256_Store(&ctx->buf[SHA256_BLOCK_SIZE - 8U], (uint32_t)(bits >> 32));
+    SHA256_Store(&ctx->buf[SHA256_BLOCK_SIZE - 4U], (uint32_t)bits);
+    SHA256_Block(ctx->state, ctx->buf);
+    for (i = 0; i < 8; i++)
+    {
+        SHA256_Store(digest + 4 * i, ctx->state[i]);
+    }
+}
+
+/**
+ * @brief 一次计算整段数据的摘要
+ */
+void SHA256(const void *data, uint32_t len, uint8_t *digest)
+{
+    SHA256_Ctx_t ctx;
+
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, data, len);
+    SHA256_Final(&ctx, digest);
+}
+
+/**
+ * @brief HMAC初始化:压缩内、外层密钥块,保存两个中间状态
+ * @param key 密钥,超过64字节时先取摘要
+ */
+void HMAC_SHA256_Init(HMAC_SHA256_Ctx_t *ctx, const void *key, uint32_t len)
+{
+    uint8_t pad[SHA256_BLOCK_SIZE];
+    uint32_t i;
+
+    memset(pad, 0, sizeof(pad));
+    if (len > SHA256_BLOCK_SIZE)
+    {
+        SHA256(key, len, pad);
+    }
+    else
+    {
+        memcpy(pad, key, len);
+    }
+    for (i = 0; i < SHA256_BLOCK_SIZE; i++)
+    {
+        pad[i] ^= 0x36;
+    }
+    memcpy(ctx->istate, SHA256_IV, sizeof(SHA256_IV));
+    SHA256_Block(ctx->istate, pad);
+    for (i = 0; i < SHA256_BLOCK_SIZE; i++)
+    {
+        pad[i] ^= 0x36 ^ 0x5C;
+    }
+    memcpy(ctx->ostate, SHA256_IV, sizeof(SHA256_IV));
+    SHA256_Block(ctx->ostate, pad);
+    memset(pad, 0, sizeof(pad));
+    HMAC_SHA256_Reset(ctx);
+}
+
+/**
+ * @brief 用同一个密钥计算下一个MAC,从内层中间状态开始,不重新压缩密钥块
+ */
+void HMAC_SHA256_Reset(HMAC_SHA256_Ctx_t *ctx)
+{
+    memcpy(ctx->inner.state, ctx->istate, sizeof(ctx->istate));
+    ctx->inner.count = SHA256_BLOCK_SIZE;
+}
+
+void HMAC_SHA256_Update(HMAC_SHA256_Ctx_t *ctx, const void *data, uint32_t len)
+{
+    SHA256_Update(&ctx->inner, data, len);
+}
+
+void HMAC_SHA256_Final(HMAC_SHA256_Ctx_t *ctx, uint8_t *mac)
+{
+    SHA256_Ctx_t outer;
+
+    SHA256_Final(&ctx->inner, mac);
+    memcpy(outer.state, ctx->ostate, sizeof(ctx->ostate));
+    outer.count = SHA256_BLOCK_SIZE;
+    SHA256_Update(&outer, mac, SHA256_DIGEST_SIZE);
+    SHA256_Final(&outer, mac);
+}
+
+/**
+ * @brief 一次计算整段数据的HMAC
+ */
+void HMAC_SHA256(const void *key, uint32_t key_len, const void *data, uint32_t len, uint8_t *mac)
+{
+    HMAC_SHA256_Ctx_t ctx;
+
+    HMAC_SHA256_Init(&ctx, key, key_len);
+    HMAC_SHA256_Update(&ctx, data, len);
+    HMAC_SHA256_Final(&ctx, mac);
+}
+
+/**
+ * @brief PBKDF2-HMAC-SHA256密钥派生,耗时和iterations成正比(每次迭代两次压缩)
+ * @param pass 口令
+ * @param salt 盐
+ * @param iterations 迭代次数,至少1
+ * @param out 派生的密钥,out_len字节
+ */
+void PBKDF2_SHA256(const void *pass, uint32_t pass_len, const void *salt, uint32_t salt_len,
+                   uint32_t iterations, uint8_t *out, uint32_t out_len)
+{
+    HMAC_SHA256_Ctx_t ctx;
+    uint8_t u[SHA256_DIGEST_SIZE];
+    uint8_t cnt[4];
+    uint32_t t[8], w[16], s[8];
+    uint32_t block, n, i, k;
+
+    HMAC_SHA256_Init(&ctx, pass, pass_len);
+    for (block = 1; out_len > 0; block++)
+    {
+        // U1 = HMAC(P, S | INT(block))
+        SHA256_Store(cnt, block);
+        HMAC_SHA256_Reset(&ctx);
+        HMAC_SHA256_Update(&ctx, salt, salt_len);
+        HMAC_SHA256_Update(&ctx, cnt, sizeof(cnt));
+        HMAC_SHA256_Final(&ctx, u);
+        for (k = 0; k < 8; k++)
+        {
+            t[k] = SHA256_Load(u + 4 * k);
+            s[k] = t[k];
+        }
+        // Uj = HMAC(P, Uj-1):内外层的输入都是中间状态之后的32字节,补位后正好一块
+        for (i = 1; i < iterations; i++)
+        {
+            memcpy(w, s, sizeof(s));
+            w[8] = 0x80000000U;
+            memset(&w[9], 0, 6 * sizeof(uint32_t));
+            w[15] = (SHA256_BLOCK_SIZE + SHA256_DIGEST_SIZE) * 8U;
+            memcpy(s, ctx.istate, sizeof(s));
+            SHA256_Transform(s, w);
+
+            memcpy(w, s, sizeof(s));
+            w[8] = 0x80000000U;
+            memset(&w[9], 0, 6 * sizeof(uint32_t));
+            w[15] = (SHA256_BLOCK_SIZE + SHA256_DIGEST_SIZE) * 8U;
+            memcpy(s, ctx.ostate, sizeof(s));
+            SHA256_Transform(s, w);
+
+            for (k = 0; k < 8; k++)
+            {
+                t[k] ^= s[k];
+            }
+        }
+        n = out_len < SHA256_DIGEST_SIZE ? out_len : SHA256_DIGEST_SIZE;
+        for (k = 0; k < 8; k++)
+        {
+            SHA256_Store(u + 4 * k, t[k]);
+        }
+        memcpy(out, u, n);
+        out += n;
+        out_len -= n;
+    }
+    memset(&ctx, 0, sizeof(ctx));
+    memset(u, 0, sizeof(u));
+}
@@ -0,0 +1,50 @@
+/**
+  ******************************************************************************
+  * @file    sha256.h
+  * @author  cyytx
+  * @brief   SHA-256摘要、HMAC-SHA256和PBKDF2的头文件,
+  *          用于NFC卡密钥分散、密码派生等凭据相关的计算
+  ******************************************************************************
+  */
+
+#ifndef __SHA256_H
+#define __SHA256_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define SHA256_BLOCK_SIZE       64
+#define SHA256_DIGEST_SIZE      32
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t count;                         /* 已输入的字节数 */
+    uint8_t buf[SHA256_BLOCK_SIZE];         /* 不满一块的输入 */
+} SHA256_Ctx_t;
+
+typedef struct {
+    SHA256_Ctx_t inner;                     /* 内层摘要 */
+    uint32_t istate[8];                     /* 压缩密钥^ipad之后的中间状态 */
+    uint32_t ostate[8];                     /* 压缩密钥^opad之后的中间状态 */
+} HMAC_SHA256_Ctx_t;
+
+void SHA256_Init(SHA256_Ctx_t *ctx);
+void SHA256_Update(SHA256_Ctx_t *ctx, const void *data, uint32_t len);
+void SHA256_Final(SHA256_Ctx_t *ctx, uint8_t *digest);
+void SHA256(const void *data, uint32_t len, uint8_t *digest);
+void HMAC_SHA256_Init(HMAC_SHA256_Ctx_t *ctx, const void *key, uint32_t len);
+void HMAC_SHA256_Reset(HMAC_SHA256_Ctx_t *ctx);
+void HMAC_SHA256_Update(HMAC_SHA256_Ctx_t *ctx, const void *data, uint32_t len);
+void HMAC_SHA256_Final(HMAC_SHA256_Ctx_t *ctx, uint8_t *mac);
+void HMAC_SHA256(const void *key, uint32_t key_len, const void *data, uint32_t len, uint8_t *mac);
+void PBKDF2_SHA256(const void *pass, uint32_t pass_len, const void *salt, uint32_t salt_len,
+                   uint32_t iterations, uint8_t *out, uint32_t out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SHA256_H */
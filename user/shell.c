@@ -0,0 +1,1152 @@
+/**
+  ******************************************************************************
+  * @file    shell.c
+  * @author  cyytx
+  * @brief   调试shell的源文件
+  *          1.USART1 RX用DMA2 Stream2 Channel4循环接收,空闲中断/半满/全满时通知shell任务;
+  *          2.shell任务优先级最低(仅高于LED任务),命令不会打断开锁流程;
+  *          3.输出写入日志环形缓冲区(TEXT记录),和日志一起由USART1 TX DMA发出,
+  *            主机端用 tools/log_decode.py --port 查看输出并输入命令。
+  ******************************************************************************
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "shell.h"
+#include "priorities.h"
+#include "log.h"
+#include "fingerprint.h"
+#include "face.h"
+#include "nfc.h"
+#include "key.h"
+#include "sdcard.h"
+#include "lcd.h"
+#include "cred.h"
+#include "fstore.h"
+#include "auth.h"
+#include "bio.h"
+#include "audit.h"
+#include "rtc.h"
+#include "rng.h"
+#include "sha1.h"
+#include "p256.h"
+#include "ble.h"
+#include "sg90.h"
+
+#define LOG_MODULE DEFAULT    /* 日志模块名,等级见log_config.h */
+
+#if SHELL_ENABLE
+
+extern UART_HandleTypeDef huart1;
+static DMA_HandleTypeDef hdma_usart1_rx;        // USART1 RX DMA句柄
+static TaskHandle_t shellTaskHandle = NULL;     // shell任务句柄
+
+static uint8_t shell_rx_buf[SHELL_RX_SIZE];     // DMA循环接收缓冲区
+static uint16_t shell_rx_tail = 0;              // 已处理到的位置
+static char shell_line[SHELL_LINE_MAX + 1];     // 当前输入行
+static uint16_t shell_line_len = 0;
+static char shell_out[128];                     // SHELL_Printf格式化缓冲区,只在shell任务中使用
+
+#define SHELL_PROMPT            "> "
+/* LOG_ENABLE时输出是二进制记录,主机端log_decode.py按行发送命令,不需要回显 */
+#define SHELL_ECHO              (!LOG_ENABLE)
+
+static void SHELL_CmdHelp(int argc, char *argv[]);
+static void SHELL_CmdPs(int argc, char *argv[]);
+static void SHELL_CmdHeap(int argc, char *argv[]);
+static void SHELL_CmdStats(int argc, char *argv[]);
+static void SHELL_CmdBench(int argc, char *argv[]);
+static void SHELL_CmdCapture(int argc, char *argv[]);
+static void SHELL_CmdCred(int argc, char *argv[]);
+static void SHELL_CmdAuth(int argc, char *argv[]);
+static void SHELL_CmdAudit(int argc, char *argv[]);
+static void SHELL_CmdBio(int argc, char *argv[]);
+static void SHELL_CmdNfc(int argc, char *argv[]);
+static void SHELL_CmdServo(int argc, char *argv[]);
+static void SHELL_CmdDate(int argc, char *argv[]);
+static void SHELL_CmdReboot(int argc, char *argv[]);
+
+static const SHELL_Cmd_t shell_cmds[] = {
+    {"help",   "list commands",                                 SHELL_CmdHelp},
+    {"ps",     "task state, priority, stack free, cpu usage",   SHELL_CmdPs},
+    {"heap",   "heap free / min ever free",                     SHELL_CmdHeap},
+    {"stats",  "driver counters (log, uart baud, key scan, nfc poll)", SHELL_CmdStats},
+    {"bench",  "bench lcd | sd [blocks] | nfc [count] | rc522 [count] | totp [secrets] | ecc [count] | servo", SHELL_CmdBench},
+    {"capture", "capture fp|face|ble|all|off (rx frames for replay)", SHELL_CmdCapture},
+    {"cred",   "cred [list|user id [name [flags]]|deluser id|pin user digits|nfc user|totp user|phone user|fp|face id user|migrate fp|face first last [user]|del fp|face|totp|phone id]", SHELL_CmdCred},
+    {"auth",   "auth [reset|clear] (unlock events, latency, attempt limiter per source; clear = lift lockouts)", SHELL_CmdAuth},
+    {"audit",  "audit [flush] (sd audit log counters)",         SHELL_CmdAudit},
+    {"bio",    "bio [reset] (face/fp race wins, wake->match time)", SHELL_CmdBio},
+    {"nfc",    "nfc [idle_ms fast_ms hold_ms [settle_ms]] (card polling policy)", SHELL_CmdNfc},
+    {"servo",  "servo [step|trap|scurve [speed_dps [accel_dps2 [settle_ms]]]] (motion profile, last move, state restored after reset)", SHELL_CmdServo},
+    {"date",   "date [unix seconds] (show / set rtc, utc)",     SHELL_CmdDate},
+    {"reboot", "system reset",                                  SHELL_CmdReboot},
+};
+
+/**
+ * @brief 输出一段文本,日志缓冲区满时等待DMA发送,不丢弃shell输出
+ */
+static void SHELL_Write(const char *text, uint16_t len)
+{
+    uint16_t done;
+    TickType_t start = xTaskGetTickCount();
+
+    while (len > 0U)
+    {
+        if (LOG_GetFree() < (uint16_t)(4U + LOG_TEXT_MAX))
+        {
+            if (xTaskGetTickCount() - start > pdMS_TO_TICKS(SHELL_OUT_TIMEOUT))
+            {
+                return;
+            }
+            vTaskDelay(1);
+            continue;
+        }
+        done = LOG_Text(text, len);
+        text += done;
+        len = (uint16_t)(len - done);
+    }
+}
+
+/**
+ * @brief shell格式化输出,只能在shell任务(命令处理函数)中调用
+ */
+void SHELL_Printf(const char *fmt, ...)
+{
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(shell_out, sizeof(shell_out), fmt, ap);
+    va_end(ap);
+    if (len <= 0)
+    {
+        return;
+    }
+    if (len >= (int)sizeof(shell_out))
+    {
+        len = sizeof(shell_out) - 1;
+    }
+    SHELL_Write(shell_out, (uint16_t)len);
+}
+
+/*************************************** 命令 ***************************************/
+
+static void SHELL_CmdHelp(int argc, char *argv[])
+{
+    uint32_t i;
+
+    for (i = 0; i < sizeof(shell_cmds) / sizeof(shell_cmds[0]); i++)
+    {
+        SHELL_Printf("%-8s %s\r\n", shell_cmds[i].name, shell_cmds[i].help);
+    }
+}
+
+/* 任务列表:状态 优先级 栈剩余(字节) CPU占用(运行时间统计,计数器为微秒时间戳) */
+static void SHELL_CmdPs(int argc, char *argv[])
+{
+    static const char state_char[] = {'X', 'R', 'B', 'S', 'D', '?'};
+    TaskStatus_t *tasks;
+    UBaseType_t num, i;
+    uint32_t total;
+    uint32_t pct;
+
+    num = uxTaskGetNumberOfTasks();
+    tasks = pvPortMalloc(num * sizeof(TaskStatus_t));
+    if (tasks == NULL)
+    {
+        SHELL_Printf("no memory\r\n");
+        return;
+    }
+    num = uxTaskGetSystemState(tasks, num, &total);
+    total /= 1000U; // 结果为千分比
+    SHELL_Printf("%-16s %s %4s %10s %7s\r\n", "name", "st", "prio", "stack free", "cpu");
+    for (i = 0; i < num; i++)
+    {
+        pct = total ? tasks[i].ulRunTimeCounter / total : 0;
+        SHELL_Printf("%-16s %c  %4u %10u %3u.%u%%\r\n",
+                     tasks[i].pcTaskName,
+                     state_char[tasks[i].eCurrentState < 5 ? tasks[i].eCurrentState : 5],
+                     (unsigned)tasks[i].uxCurrentPriority,
+                     (unsigned)(tasks[i].usStackHighWaterMark * sizeof(StackType_t)),
+                     (unsigned)(pct / 10U), (unsigned)(pct % 10U));
+    }
+    vPortFree(tasks);
+    SHELL_Printf("st: X running, R ready, B blocked, S suspended, D deleted\r\n");
+}
+
+static void SHELL_CmdHeap(int argc, char *argv[])
+{
+    SHELL_Printf("heap total:%u free:%u min free:%u\r\n",
+                 (unsigned)configTOTAL_HEAP_SIZE,
+                 (unsigned)xPortGetFreeHeapSize(),
+                 (unsigned)xPortGetMinimumEverFreeHeapSize());
+}
+
+static void SHELL_CmdStats(int argc, char *argv[])
+{
+    LOG_Stats_t log_stats;
+
+    SHELL_Printf("uptime: %u ms\r\n", (unsigned)HAL_GetTick());
+    LOG_GetStats(&log_stats);
+    SHELL_Printf("log: written:%u dropped:%u sent:%u bytes dma:%u max used:%u/%u\r\n",
+                 (unsigned)log_stats.written, (unsigned)log_stats.dropped,
+                 (unsigned)log_stats.bytes_sent, (unsigned)log_stats.dma_started,
+                 (unsigned)log_stats.max_used, (unsigned)LOG_RING_SIZE);
+#if FINGERPRINT_ENABLE
+    SHELL_Printf("fp: baud %u\r\n", (unsigned)FP_GetBaudRate());
+#endif
+#if FACE_ENABLE
+    SHELL_Printf("face: baud %u\r\n", (unsigned)FACE_GetBaudRate());
+#endif
+#if KEY_ENABLE
+    {
+        KEY_Stats_t key;
+
+        KEY_GetStats(&key);
+        SHELL_Printf("key: wakeups:%u scans:%u press:%u release:%u rollover:%u max down:%u\r\n",
+                     (unsigned)key.wakeups, (unsigned)key.scans, (unsigned)key.presses,
+                     (unsigned)key.releases, (unsigned)key.rollovers, (unsigned)key.max_down);
+        SHELL_Printf("key: ghost scans:%u blocked:%u dropped:%u latency last:%uus max:%uus\r\n",
+                     (unsigned)key.ghosts, (unsigned)key.blocked, (unsigned)key.dropped,
+                     (unsigned)key.last_us, (unsigned)key.max_us);
+    }
+#endif
+#if NFC_ENABLE
+    {
+        NFC_PollStats_t nfc;
+
+        NFC_GetPollStats(&nfc);
+        SHELL_Printf("nfc: polls:%u found:%u last:%uus min:%uus max:%uus avg:%uus cpu avg:%uus\r\n",
+                     (unsigned)nfc.polls, (unsigned)nfc.found, (unsigned)nfc.last_us,
+                     (unsigned)(nfc.polls ? nfc.min_us : 0), (unsigned)nfc.max_us,
+                     (unsigned)(nfc.polls ? nfc.total_us / nfc.polls : 0),
+                     (unsigned)(nfc.polls ? nfc.cpu_us / nfc.polls : 0));
+        SHELL_Printf("nfc rf: on:%ums up:%ums duty:%u.%u%%\r\n", (unsigned)nfc.rf_on_ms, (unsigned)nfc.up_ms,
+                     (unsigned)(nfc.up_ms ? (uint64_t)nfc.rf_on_ms * 1000U / nfc.up_ms / 10U : 0),
+                     (unsigned)(nfc.up_ms ? (uint64_t)nfc.rf_on_ms * 1000U / nfc.up_ms % 10U : 0));
+    }
+#endif
+}
+
+#if LCD_ENABLE
+/* 全屏填充,CPU逐像素写和DMA各一次 */
+static void SHELL_BenchLcd(void)
+{
+    uint32_t t0, t_cpu, t_dma;
+    uint32_t bytes = (uint32_t)LCD_W * LCD_H * 2U;
+
+    t0 = LOG_GetTimeUs();
+    LCD_Fill(0, 0, LCD_W, LCD_H, BLACK);
+    t_cpu = LOG_GetTimeUs() - t0;
+
+    t0 = LOG_GetTimeUs();
+    LCD_Fill_DMA(0, 0, LCD_W, LCD_H, WHITE);
+    t_dma = LOG_GetTimeUs() - t0;
+
+    SHELL_Printf("lcd fill %ux%u: cpu %u us (%u KB/s), dma %u us (%u KB/s)\r\n",
+                 (unsigned)LCD_W, (unsigned)LCD_H,
+                 (unsigned)t_cpu, (unsigned)(t_cpu ? (uint64_t)bytes * 1000000U / 1024U / t_cpu : 0),
+                 (unsigned)t_dma, (unsigned)(t_dma ? (uint64_t)bytes * 1000000U / 1024U / t_dma : 0));
+}
+#endif
+
+#if SDCARD_ENABLE
+#define SHELL_SD_CHUNK          8       // 每次读8块(4KB)
+static uint8_t shell_sd_buf[SHELL_SD_CHUNK * 512] __attribute__((aligned(4)));
+
+/* 连续读blocks块,只读不写,不会破坏文件系统 */
+static void SHELL_BenchSd(uint32_t blocks)
+{
+    uint32_t t0, us, done = 0;
+
+    t0 = LOG_GetTimeUs();
+    while (done < blocks)
+    {
+        if (SD_ReadBlocks_DMA(shell_sd_buf, done, SHELL_SD_CHUNK) != HAL_OK)
+        {
+            SHELL_Printf("sd read error at block %u\r\n", (unsigned)done);
+            return;
+        }
+        done += SHELL_SD_CHUNK;
+    }
+    us = LOG_GetTimeUs() - t0;
+    SHELL_Printf("sd read %u blocks (%u KB) in %u us: %u KB/s\r\n",
+                 (unsigned)done, (unsigned)(done / 2U), (unsigned)us,
+                 (unsigned)(us ? (uint64_t)done * 512U * 1000000U / 1024U / us : 0));
+}
+#endif
+
+/* 一次性密码验证的计算量:n个密钥,每个密钥预处理一次、算前后3个时间步的码,和CRED_MatchTotp相同 */
+static void SHELL_BenchTotp(uint32_t n)
+{
+    HMAC_SHA1_Key_t hk;
+    uint8_t secret[CRED_TOTP_SECRET_SIZE];
+    uint32_t i, s, t0, us, acc = 0;
+    uint32_t step = RTC_GetTime() / CRED_TOTP_STEP;
+
+    t0 = LOG_GetTimeUs();
+    for (i = 0; i < n; i++)
+    {
+        memset(secret, (int)i, sizeof(secret));
+        HMAC_SHA1_Init(&hk, secret, sizeof(secret));
+        for (s = step - CRED_TOTP_WINDOW; s <= step + CRED_TOTP_WINDOW; s++)
+        {
+            acc += HOTP_Value(&hk, s) % 1000000U;
+        }
+    }
+    us = LOG_GetTimeUs() - t0;
+    SHELL_Printf("totp x%u secrets: %uus, %uus/secret (acc %u)\r\n", (unsigned)n, (unsigned)us,
+                 (unsigned)(us / n), (unsigned)acc);
+}
+
+/* P-256验签的基准向量(OpenSSL生成),和手机钥匙开锁时CRED_MatchPhone中的计算相同 */
+static const uint8_t shell_ecc_pub[P256_PUB_SIZE] = {
+    0x24, 0x60, 0xB1, 0x79, 0x8E, 0xB6, 0x8A, 0xD0, 0x5E, 0xB6, 0x98, 0xFA, 0xB8, 0xBA, 0xB3, 0x43,
+    0x1C, 0xBF, 0xCD, 0x6D, 0x16, 0xCD, 0x35, 0x75, 0xB3, 0xBD, 0x3C, 0x9B, 0x57, 0x7D, 0x37, 0xF0,
+    0x61, 0x44, 0xFA, 0x4E, 0x6C, 0x03, 0xE1, 0x2F, 0x2D, 0x76, 0xF7, 0x66, 0x5A, 0xC1, 0x99, 0x90,
+    0x2E, 0x08, 0x37, 0x96, 0xA9, 0x40, 0xCB, 0x01, 0x75, 0x39, 0xAF, 0xB8, 0x13, 0x11, 0x20, 0x75,
+};
+static const uint8_t shell_ecc_hash[P256_BYTES] = {
+    0x7E, 0x7D, 0xAE, 0x4C, 0xB9, 0x24, 0xFC, 0xE7, 0x5E, 0x5A, 0x9B, 0x9C, 0x0D, 0x00, 0x1D, 0xEC,
+    0x5B, 0x9A, 0x55, 0x57, 0xEF, 0x97, 0xED, 0xDD, 0x11, 0xBD, 0x2B, 0x18, 0x17, 0x67, 0x22, 0xBB,
+};
+static const uint8_t shell_ecc_sig[P256_SIG_SIZE] = {
+    0x55, 0x03, 0xF5, 0xB6, 0x3E, 0xA5, 0x2D, 0xE9, 0xC8, 0x90, 0x90, 0x77, 0x98, 0x6F, 0xCA, 0xA5,
+    0xDA, 0x53, 0x40, 0xB7, 0xEF, 0xF1, 0x1E, 0xFD, 0x59, 0xD2, 0x9E, 0xA8, 0x43, 0x2D, 0x83, 0xBB,
+    0xD7, 0x24, 0x84, 0xC6, 0x9B, 0x2B, 0x9C, 0x79, 0x07, 0xDF, 0xBC, 0x37, 0xA2, 0x90, 0x19, 0x27,
+    0x70, 0xB6, 0x22, 0x3E, 0xC6, 0x68, 0x67, 0x01, 0xDE, 0x33, 0xAD, 0xB6, 0xB4, 0x19, 0xCA, 0x92,
+};
+
+static void SHELL_BenchEcc(uint32_t n)
+{
+    uint32_t i, t0, us, min = 0xFFFFFFFFU, max = 0, total = 0;
+    int fail = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        t0 = LOG_GetTimeUs();
+        if (P256_Verify(shell_ecc_pub, shell_ecc_hash, shell_ecc_sig) != 0)
+        {
+            fail++;
+        }
+        us = LOG_GetTimeUs() - t0;
+        total += us;
+        min = us < min ? us : min;
+        max = us > max ? us : max;
+    }
+    SHELL_Printf("ecdsa p256 verify x%u: min:%uus max:%uus avg:%uus fail:%d\r\n", (unsigned)n,
+                 (unsigned)min, (unsigned)max, (unsigned)(total / n), fail);
+}
+
+/* 十六进制字符串转字节,必须正好是2*len个字符 */
+static int SHELL_HexDecode(const char *hex, uint8_t *out, uint8_t len)
+{
+    char byte[3] = {0};
+    char *end;
+    uint8_t i;
+
+    if (strlen(hex) != 2U * len)
+    {
+        return -1;
+    }
+    for (i = 0; i < len; i++)
+    {
+        byte[0] = hex[2 * i];
+        byte[1] = hex[2 * i + 1];
+        out[i] = (uint8_t)strtoul(byte, &end, 16);
+        if (*end != '\0')
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* RFC 4648 base32,不补'=',身份验证器App手动输入密钥用 */
+static void SHELL_Base32(const uint8_t *data, uint8_t len, char *out)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+    uint32_t buf = 0;
+    uint8_t bits = 0, i;
+
+    for (i = 0; i < len; i++)
+    {
+        buf = (buf << 8) | data[i];
+        bits += 8;
+        while (bits >= 5)
+        {
+            bits -= 5;
+            *out++ = alphabet[(buf >> bits) & 0x1F];
+        }
+    }
+    if (bits > 0)
+    {
+        *out++ = alphabet[(buf << (5 - bits)) & 0x1F];
+    }
+    *out = '\0';
+}
+
+#if NFC_ENABLE
+/* RC522协议操作的周期数,原来的HAL传输和BSRR快速传输对比,读卡器上要放一张卡 */
+static void SHELL_BenchRc522(uint16_t count)
+{
+    static const char *const modes[RC522_SPI_MODE_NUM] = {"hal", "fast"};
+    static const char *const ops[NFC_OP_NUM] = {"request", "anticoll", "read"};
+    static NFC_OpStats_t r[RC522_SPI_MODE_NUM][NFC_OP_NUM];
+    uint32_t mhz = SystemCoreClock / 1000000U;
+    uint32_t avg;
+    uint8_t m, op;
+
+    if (NFC_BenchOps(count ? count : 1U, r) != 0)
+    {
+        SHELL_Printf("rc522 bench timeout\r\n");
+        return;
+    }
+    SHELL_Printf("%-5s %-9s %5s %5s %9s %9s %8s\r\n", "spi", "op", "runs", "ok", "avg cyc", "max cyc", "avg us");
+    for (m = 0; m < RC522_SPI_MODE_NUM; m++)
+    {
+        for (op = 0; op < NFC_OP_NUM; op++)
+        {
+            avg = r[m][op].runs ? r[m][op].total_cycles / r[m][op].runs : 0;
+            SHELL_Printf("%-5s %-9s %5u %5u %9u %9u %8u\r\n", modes[m], ops[op],
+                         (unsigned)r[m][op].runs, (unsigned)r[m][op].ok, (unsigned)avg,
+                         (unsigned)r[m][op].max_cycles, (unsigned)(avg / mhz));
+        }
+    }
+}
+#endif
+
+#if SG90_ENABLE
+/* 舵机转动一次(保持当前角度)的中断开销,原来的TIM2中断方式和DMA方式对比 */
+static void SHELL_BenchServo(void)
+{
+    static const char *const modes[SG90_PWM_MODE_NUM] = {"isr", "dma"};
+    SG90_BenchStats_t r[SG90_PWM_MODE_NUM];
+    uint32_t mhz = SystemCoreClock / 1000000U;
+    uint8_t m;
+
+    if (SG90_Bench(r) != 0)
+    {
+        SHELL_Printf("servo bench timeout\r\n");
+        return;
+    }
+    SHELL_Printf("%-4s %6s %10s %8s %8s %8s %9s %8s\r\n", "pwm", "irqs", "irq cyc", "irq max", "irq us",
+                 "cpu 0.01%", "task cyc", "move ms");
+    for (m = 0; m < SG90_PWM_MODE_NUM; m++)
+    {
+        SHELL_Printf("%-4s %6u %10u %8u %8u %8u %9u %8u\r\n", modes[m], (unsigned)r[m].irqs,
+                     (unsigned)r[m].irq_cycles, (unsigned)r[m].irq_max, (unsigned)(r[m].irq_cycles / mhz),
+                     (unsigned)(r[m].move_us ? (uint64_t)r[m].irq_cycles * 10000U / ((uint64_t)r[m].move_us * mhz) : 0),
+                     (unsigned)r[m].task_cycles, (unsigned)(r[m].move_us / 1000U));
+    }
+}
+#endif
+
+static void SHELL_CmdBench(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        SHELL_Printf("usage: bench lcd | sd [blocks] | nfc [count] | rc522 [count] | totp [secrets] | ecc [count] | servo\r\n");
+        return;
+    }
+#if LCD_ENABLE
+    if (strcmp(argv[1], "lcd") == 0)
+    {
+        SHELL_BenchLcd();
+        return;
+    }
+#endif
+#if SDCARD_ENABLE
+    if (strcmp(argv[1], "sd") == 0)
+    {
+        uint32_t blocks = (argc > 2) ? strtoul(argv[2], NULL, 0) : 2048U;
+
+        blocks = (blocks + SHELL_SD_CHUNK - 1U) / SHELL_SD_CHUNK * SHELL_SD_CHUNK;
+        SHELL_BenchSd(blocks ? blocks : SHELL_SD_CHUNK);
+        return;
+    }
+#endif
+#if NFC_ENABLE
+    if (strcmp(argv[1], "nfc") == 0)
+    {
+        NFC_PollStats_t r;
+        uint16_t count = (argc > 2) ? (uint16_t)strtoul(argv[2], NULL, 0) : 50U;
+
+        if (NFC_Bench(count, &r) != 0)
+        {
+            SHELL_Printf("nfc bench timeout\r\n");
+            return;
+        }
+        SHELL_Printf("nfc poll x%u: found:%u min:%uus max:%uus avg:%uus cpu avg:%uus\r\n",
+                     (unsigned)r.polls, (unsigned)r.found, (unsigned)r.min_us,
+                     (unsigned)r.max_us, (unsigned)(r.polls ? r.total_us / r.polls : 0),
+                     (unsigned)(r.polls ? r.cpu_us / r.polls : 0));
+        return;
+    }
+    if (strcmp(argv[1], "rc522") == 0)
+    {
+        SHELL_BenchRc522((argc > 2) ? (uint16_t)strtoul(argv[2], NULL, 0) : 20U);
+        return;
+    }
+#endif
+    if (strcmp(argv[1], "totp") == 0)
+    {
+        uint32_t n = (argc > 2) ? strtoul(argv[2], NULL, 0) : 500U;
+
+        SHELL_BenchTotp(n ? n : 1U);
+        return;
+    }
+    if (strcmp(argv[1], "ecc") == 0)
+    {
+        uint32_t n = (argc > 2) ? strtoul(argv[2], NULL, 0) : 10U;
+
+        SHELL_BenchEcc(n ? n : 1U);
+        return;
+    }
+#if SG90_ENABLE
+    if (strcmp(argv[1], "servo") == 0)
+    {
+        SHELL_BenchServo();
+        return;
+    }
+#endif
+    SHELL_Printf("unknown bench: %s\r\n", argv[1]);
+}
+
+/* 抓包:把模块串口收到的帧写入日志(LOG_REC_CAP),log_decode.py --replay 保存成回放文件 */
+static void SHELL_CmdCapture(int argc, char *argv[])
+{
+    static const char *const names[] = {"", "fp", "face", "ble"};
+    uint32_t mask = LOG_GetCapture();
+    int i;
+    uint32_t c;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "off") == 0)
+        {
+            mask = 0;
+            continue;
+        }
+        if (strcmp(argv[i], "all") == 0)
+        {
+            mask = (1UL << LOG_CAP_FP) | (1UL << LOG_CAP_FACE) | (1UL << LOG_CAP_BLE);
+            continue;
+        }
+        for (c = LOG_CAP_FP; c <= LOG_CAP_BLE; c++)
+        {
+            if (strcmp(argv[i], names[c]) == 0)
+            {
+                mask |= 1UL << c;
+                break;
+            }
+        }
+        if (c > LOG_CAP_BLE)
+        {
+            SHELL_Printf("unknown channel: %s\r\n", argv[i]);
+            return;
+        }
+    }
+    LOG_SetCapture(mask);
+    SHELL_Printf("capture:");
+    for (c = LOG_CAP_FP; c <= LOG_CAP_BLE; c++)
+    {
+        if (mask & (1UL << c))
+        {
+            SHELL_Printf(" %s", names[c]);
+        }
+    }
+    SHELL_Printf(mask ? "\r\n" : " off\r\n");
+}
+
+/* 凭据库:查看统计和凭据,登记用户、密码、指纹/人脸ID,修改立即写入Flash */
+static void SHELL_CmdCred(int argc, char *argv[])
+{
+    static const char *const types[CRED_TYPE_NUM] = {"-", "pin", "nfc_uid", "nfc_token", "fp", "face", "totp", "phone"};
+    CRED_Stats_t stats;
+    FSTORE_Stats_t fs;
+    CRED_Entry_t e;
+    CRED_User_t info;
+    CRED_Type_t type = CRED_TYPE_NONE;
+    uint8_t digits[CRED_PIN_MAX];
+    uint8_t secret[CRED_TOTP_SECRET_SIZE];
+    char b32[(CRED_TOTP_SECRET_SIZE * 8 + 4) / 5 + 1];
+    uint16_t k, first, last, user, count;
+    uint8_t n;
+    int ret;
+
+    if (argc == 1)
+    {
+        CRED_GetStats(&stats);
+        SHELL_Printf("users %u, entries %u/%u, index %u slots\r\n",
+                     stats.users, stats.entries, CRED_MAX_ENTRIES, CRED_INDEX_SIZE);
+        for (k = CRED_TYPE_PIN; k < CRED_TYPE_NUM; k++)
+        {
+            SHELL_Printf("  %-10s %u\r\n", types[k], stats.by_type[k]);
+        }
+        SHELL_Printf("probe avg %u.%02u max %u\r\n",
+                     stats.entries ? stats.total_probe / stats.entries : 0,
+                     stats.entries ? stats.total_probe * 100 / stats.entries % 100 : 0, stats.max_probe);
+        SHELL_Printf("pin kdf: %u iterations, last %uus, legacy %u\r\n",
+                     (unsigned)stats.pin_iterations, (unsigned)stats.pin_last_us, stats.pin_legacy);
+        SHELL_Printf("totp: %u secrets, last check %uus\r\n",
+                     stats.by_type[CRED_TYPE_TOTP], (unsigned)stats.totp_last_us);
+        SHELL_Printf("phone: %u keys, last verify %uus\r\n",
+                     stats.by_type[CRED_TYPE_PHONE], (unsigned)stats.phone_last_us);
+        FSTORE_GetStats(&fs);
+        SHELL_Printf("flash: sector %u seq %u used %u live %u keys %u skipped %u\r\n",
+                     fs.active, (unsigned)fs.seq, (unsigned)fs.used, (unsigned)fs.live, fs.keys, (unsigned)fs.skipped);
+        SHELL_Printf("flash: writes %u last %uus max %uus, gc %u last %ums\r\n",
+                     (unsigned)fs.writes, (unsigned)fs.last_write_us, (unsigned)fs.max_write_us,
+                     (unsigned)fs.gcs, (unsigned)fs.last_gc_ms);
+        return;
+    }
+    if (strcmp(argv[1], "list") == 0)
+    {
+        for (k = 0; CRED_Get(k, &e) == 0; k++)
+        {
+            SHELL_Printf("%4u %-10s user %-4u key ", k, types[e.type], e.user);
+            for (n = 0; n < e.key_len; n++)
+            {
+                SHELL_Printf("%02X", e.key[n]);
+            }
+            SHELL_Printf("\r\n");
+        }
+        return;
+    }
+    if (strcmp(argv[1], "user") == 0 && argc >= 3)
+    {
+        ret = CRED_AddUser((uint16_t)atoi(argv[2]), argc >= 4 ? argv[3] : NULL,
+                           argc >= 5 ? (uint8_t)strtoul(argv[4], NULL, 0) : 0);
+    }
+    else if (strcmp(argv[1], "deluser") == 0 && argc >= 3)
+    {
+        ret = CRED_DelUser((uint16_t)atoi(argv[2]));
+    }
+    else if (strcmp(argv[1], "pin") == 0 && argc >= 4)
+    {
+        for (n = 0; argv[3][n] >= '0' && argv[3][n] <= '9' && n < CRED_PIN_MAX; n++)
+        {
+            digits[n] = (uint8_t)(argv[3][n] - '0');
+        }
+        ret = argv[3][n] == '\0' ? CRED_SetPin((uint16_t)atoi(argv[2]), digits, n) : -1;
+    }
+#if NFC_ENABLE
+    else if (strcmp(argv[1], "nfc") == 0 && argc >= 3)
+    {
+        k = (uint16_t)atoi(argv[2]);
+        ret = CRED_GetUser(k, &info);
+        if (ret == 0)
+        {
+            NFC_EnrollCard(k);
+            SHELL_Printf("present the card to enroll\r\n");
+        }
+    }
+#endif
+    else if (strcmp(argv[1], "totp") == 0 && argc >= 3)
+    {
+        // 新密钥只在这里显示一次,录入身份验证器App(SHA1、6位、30秒)
+        k = (uint16_t)atoi(argv[2]);
+        ret = RNG_Read(secret, sizeof(secret));
+        if (ret == 0)
+        {
+            ret = CRED_SetTotp(k, secret);
+        }
+        if (ret == 0)
+        {
+            SHELL_Base32(secret, sizeof(secret), b32);
+            SHELL_Printf("secret %s\r\n", b32);
+            SHELL_Printf("otpauth://totp/smart_lock:user%u?secret=%s&issuer=smart_lock\r\n", k, b32);
+            if (RTC_GetTime() == 0)
+            {
+                SHELL_Printf("rtc not set, totp codes are rejected until date is set\r\n");
+            }
+        }
+        memset(secret, 0, sizeof(secret));
+    }
+#if BLE_ENABLE
+    else if (strcmp(argv[1], "phone") == 0 && argc >= 3)
+    {
+        // 手机连上蓝牙后发ENROLL命令登记公钥,协议见ble.h
+        k = (uint16_t)atoi(argv[2]);
+        ret = CRED_GetUser(k, &info);
+        if (ret == 0)
+        {
+            BLE_EnrollPhone(k);
+            SHELL_Printf("send ENROLL from the phone within %us\r\n", BLE_KEY_ENROLL_MS / 1000U);
+        }
+    }
+#endif
+    else if (strcmp(argv[1], "del") == 0 && argc >= 4 && strcmp(argv[2], "phone") == 0)
+    {
+        // 手机钥匙的键是钥匙ID,cred list中显示
+        ret = SHELL_HexDecode(argv[3], digits, CRED_PHONE_ID_SIZE);
+        if (ret == 0)
+        {
+            ret = CRED_Remove(CRED_TYPE_PHONE, digits, CRED_PHONE_ID_SIZE);
+        }
+    }
+    else if (strcmp(argv[1], "migrate") == 0 && argc >= 5 &&
+             (strcmp(argv[2], "fp") == 0 || strcmp(argv[2], "face") == 0))
+    {
+        // 升级前录入的指纹模板/人脸ID没有登记到用户,识别成功也不开锁;
+        // 这里把一段ID登记到指定用户(默认管理员),已经登记过的ID保持不变
+        type = strcmp(argv[2], "fp") == 0 ? CRED_TYPE_FP : CRED_TYPE_FACE;
+        first = (uint16_t)atoi(argv[3]);
+        last = (uint16_t)atoi(argv[4]);
+        user = argc >= 6 ? (uint16_t)atoi(argv[5]) : CRED_ADMIN_USER;
+        ret = CRED_GetUser(user, &info);
+        for (k = first, count = 0; ret == 0 && k >= first && k <= last; k++)
+        {
+            if (CRED_MatchId(type, k) == CRED_NONE)
+            {
+                ret = CRED_AddId(type, user, k);
+                count += ret == 0;
+            }
+        }
+        SHELL_Printf("%u ids migrated to user %u\r\n", count, user);
+    }
+    else if ((strcmp(argv[1], "fp") == 0 || strcmp(argv[1], "face") == 0) && argc >= 4)
+    {
+        type = strcmp(argv[1], "fp") == 0 ? CRED_TYPE_FP : CRED_TYPE_FACE;
+        ret = CRED_AddId(type, (uint16_t)atoi(argv[3]), (uint16_t)atoi(argv[2]));
+    }
+    else if (strcmp(argv[1], "del") == 0 && argc >= 4 &&
+             (strcmp(argv[2], "fp") == 0 || strcmp(argv[2], "face") == 0 || strcmp(argv[2], "totp") == 0))
+    {
+        // TOTP的键是用户编号
+        k = (uint16_t)atoi(argv[3]);
+        digits[0] = (uint8_t)(k >> 8);
+        digits[1] = (uint8_t)k;
+        type = strcmp(argv[2], "fp") == 0 ? CRED_TYPE_FP : (strcmp(argv[2], "face") == 0 ? CRED_TYPE_FACE : CRED_TYPE_TOTP);
+        ret = CRED_Remove(type, digits, 2);
+    }
+    else
+    {
+        SHELL_Printf("bad cred command, see help\r\n");
+        return;
+    }
+    SHELL_Printf(ret == 0 ? "ok\r\n" : "failed\r\n");
+}
+
+/* 开锁授权:各来源的审计事件计数、出示凭据到舵机转动的延时分布和限流状态 */
+static void SHELL_CmdAuth(int argc, char *argv[])
+{
+    static const char *const sources[AUTH_SRC_NUM] = {"key", "ble", "nfc", "fp", "face", "phone"};
+    AUTH_Stats_t st;
+    AUTH_Limit_t lim;
+    uint8_t src;
+
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0)
+    {
+        AUTH_ResetStats();
+        SHELL_Printf("auth stats cleared\r\n");
+        return;
+    }
+    if (argc >= 2 && strcmp(argv[1], "clear") == 0)
+    {
+        AUTH_ClearLimits();
+        SHELL_Printf("auth lockouts cleared\r\n");
+        return;
+    }
+    SHELL_Printf("%-5s %6s %5s %7s %6s %6s %9s %9s %9s %9s %9s\r\n", "src", "unlock", "fail", "lockout",
+                 "denied", "mfa", "min us", "p50 us", "p90 us", "p99 us", "max us");
+    for (src = 0; src < AUTH_SRC_NUM; src++)
+    {
+        AUTH_GetStats((AUTH_Source_t)src, &st);
+        SHELL_Printf("%-5s %6u %5u %7u %6u %6u %9u %9u %9u %9u %9u\r\n", sources[src],
+                     (unsigned)st.events[AUTH_EV_UNLOCK], (unsigned)st.events[AUTH_EV_FAIL],
+                     (unsigned)st.events[AUTH_EV_LOCKOUT], (unsigned)st.events[AUTH_EV_DENIED],
+                     (unsigned)st.events[AUTH_EV_MFA_PENDING], st.count ? (unsigned)st.min_us : 0,
+                     (unsigned)AUTH_Percentile(&st, 50), (unsigned)AUTH_Percentile(&st, 90),
+                     (unsigned)AUTH_Percentile(&st, 99), (unsigned)st.max_us);
+    }
+    SHELL_Printf("%-5s %5s %5s %10s\r\n", "src", "fails", "level", "locked ms");
+    for (src = 0; src < AUTH_SRC_NUM; src++)
+    {
+        AUTH_GetLimit((AUTH_Source_t)src, &lim);
+        SHELL_Printf("%-5s %5u %5u %10u\r\n", sources[src], (unsigned)lim.fails,
+                     (unsigned)lim.level, (unsigned)lim.remain_ms);
+    }
+}
+
+/* SD卡审计日志:计数和当前写入位置 */
+static void SHELL_CmdAudit(int argc, char *argv[])
+{
+    AUDIT_Stats_t st;
+
+    if (argc >= 2 && strcmp(argv[1], "flush") == 0)
+    {
+        AUDIT_Flush();
+        SHELL_Printf("audit flush requested\r\n");
+        return;
+    }
+    AUDIT_GetStats(&st);
+    SHELL_Printf("appended %u written %u dropped %u errors %u\r\n", (unsigned)st.appended,
+                 (unsigned)st.written, (unsigned)st.dropped, (unsigned)st.errors);
+    SHELL_Printf("flushes %u sectors %u max flush %u us\r\n", (unsigned)st.flushes,
+                 (unsigned)st.sectors, (unsigned)st.max_flush_us);
+    if (st.segment == 0)
+    {
+        SHELL_Printf("sd not available\r\n");
+        return;
+    }
+    SHELL_Printf("segment %u sector %u next seq %u\r\n", (unsigned)st.segment,
+                 (unsigned)st.sector, (unsigned)st.next_seq);
+}
+
+/* 人脸、指纹并行识别:各方式胜出次数和唤醒到匹配的耗时 */
+static void SHELL_CmdBio(int argc, char *argv[])
+{
+    static const char *const names[BIO_NUM] = {"face", "fp"};
+    BIO_Stats_t st;
+    uint8_t m;
+
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0)
+    {
+        BIO_ResetStats();
+        SHELL_Printf("bio stats cleared\r\n");
+        return;
+    }
+    BIO_GetStats(&st);
+    SHELL_Printf("races %u fails %u timeouts %u\r\n", (unsigned)st.races,
+                 (unsigned)st.fails, (unsigned)st.timeouts);
+    SHELL_Printf("%-5s %6s %9s %9s %9s\r\n", "mod", "wins", "min us", "avg us", "max us");
+    for (m = 0; m < BIO_NUM; m++)
+    {
+        SHELL_Printf("%-5s %6u %9u %9u %9u\r\n", names[m], (unsigned)st.wins[m],
+                     st.wins[m] ? (unsigned)st.min_us[m] : 0,
+                     st.wins[m] ? (unsigned)(st.total_us[m] / st.wins[m]) : 0,
+                     (unsigned)st.max_us[m]);
+    }
+    if (st.last_winner >= 0)
+    {
+        SHELL_Printf("last winner %s %u us\r\n", names[st.last_winner], (unsigned)st.last_us);
+    }
+}
+
+/* 查看/设置NFC寻卡调度参数,天线占空比见stats命令 */
+static void SHELL_CmdNfc(int argc, char *argv[])
+{
+#if NFC_ENABLE
+    NFC_PollPolicy_t p;
+
+    NFC_GetPolicy(&p);
+    if (argc >= 4)
+    {
+        p.idle_ms = (uint16_t)strtoul(argv[1], NULL, 0);
+        p.fast_ms = (uint16_t)strtoul(argv[2], NULL, 0);
+        p.hold_ms = (uint16_t)strtoul(argv[3], NULL, 0);
+        if (argc >= 5)
+        {
+            p.settle_ms = (uint8_t)strtoul(argv[4], NULL, 0);
+        }
+        if (NFC_SetPolicy(&p) != 0)
+        {
+            SHELL_Printf("bad policy, need 0 < fast_ms <= idle_ms\r\n");
+            return;
+        }
+    }
+    SHELL_Printf("nfc poll: idle %ums fast %ums hold %ums settle %ums\r\n", (unsigned)p.idle_ms,
+                 (unsigned)p.fast_ms, (unsigned)p.hold_ms, (unsigned)p.settle_ms);
+#else
+    SHELL_Printf("nfc disabled\r\n");
+#endif
+}
+
+/* 查看/设置舵机转动曲线,显示最近一次转动的计划时间和实际时间 */
+static void SHELL_CmdServo(int argc, char *argv[])
+{
+#if SG90_ENABLE
+    static const char *const names[SG90_PROFILE_NUM] = {"step", "trap", "scurve"};
+    static const char *const restore[] = {"unknown", "closed", "open", "expired", "interrupted"};
+    SG90_Motion_t m;
+    SG90_MoveStats_t st;
+    SG90_Restore_t rs;
+    uint8_t i;
+
+    SG90_GetMotion(&m);
+    if (argc >= 2)
+    {
+        for (i = 0; i < SG90_PROFILE_NUM && strcmp(argv[1], names[i]) != 0; i++)
+        {
+        }
+        m.profile = i;
+        if (argc >= 3)
+        {
+            m.speed_dps = (uint16_t)strtoul(argv[2], NULL, 0);
+        }
+        if (argc >= 4)
+        {
+            m.accel_dps2 = (uint16_t)strtoul(argv[3], NULL, 0);
+        }
+        if (argc >= 5)
+        {
+            m.settle_ms = (uint16_t)strtoul(argv[4], NULL, 0);
+        }
+        if (SG90_SetMotion(&m) != 0)
+        {
+            SHELL_Printf("bad motion, need step|trap|scurve, speed 30~1000, accel 100~30000, settle <= 500\r\n");
+            return;
+        }
+    }
+    SHELL_Printf("servo motion: %s speed %u dps accel %u dps2 settle %ums\r\n", names[m.profile],
+                 (unsigned)m.speed_dps, (unsigned)m.accel_dps2, (unsigned)m.settle_ms);
+
+    SG90_GetRestore(&rs);
+    SHELL_Printf("boot: lock %s, last cmd %u, relock %ums, restored at %uus\r\n", restore[rs.result],
+                 (unsigned)rs.last_cmd, (unsigned)rs.remain_ms, (unsigned)rs.restore_us);
+
+    SG90_GetMoveStats(&st);
+    if (st.moves > 0U)
+    {
+        SHELL_Printf("last move: %u -> %u deg %s, %u periods, plan %ums actual %ums (moves %u)\r\n",
+                     (unsigned)st.from, (unsigned)st.to, names[st.profile], (unsigned)st.periods,
+                     (unsigned)st.plan_ms, (unsigned)st.actual_ms, (unsigned)st.moves);
+    }
+#else
+    SHELL_Printf("servo disabled\r\n");
+#endif
+}
+
+/* 查看/设置RTC日历(UTC),审计日志记录用这个时间 */
+static void SHELL_CmdDate(int argc, char *argv[])
+{
+    RTC_DateTime_t dt;
+    uint32_t now;
+
+    if (argc >= 2 && RTC_SetTime((uint32_t)strtoul(argv[1], NULL, 0)) != 0)
+    {
+        SHELL_Printf("set time failed (%u~%u)\r\n", (unsigned)RTC_UNIX_MIN, (unsigned)RTC_UNIX_MAX);
+        return;
+    }
+    now = RTC_GetTime();
+    if (now == 0)
+    {
+        SHELL_Printf("rtc not set, use: date <unix seconds>\r\n");
+        return;
+    }
+    RTC_UnixToDate(now, &dt);
+    SHELL_Printf("%04u-%02u-%02u %02u:%02u:%02u UTC (%u)\r\n", (unsigned)dt.year, (unsigned)dt.month,
+                 (unsigned)dt.day, (unsigned)dt.hour, (unsigned)dt.minute, (unsigned)dt.second, (unsigned)now);
+}
+
+static void SHELL_CmdReboot(int argc, char *argv[])
+{
+    SHELL_Printf("reboot...\r\n");
+    AUDIT_Flush();
+    vTaskDelay(pdMS_TO_TICKS(50)); // 等输出发完,审计日志写入SD卡
+    NVIC_SystemReset();
+}
+
+/*************************************** 命令行 ***************************************/
+
+/* 拆分参数并执行一行命令 */
+static void SHELL_Execute(char *line)
+{
+    char *argv[SHELL_ARGS_MAX];
+    int argc = 0;
+    uint32_t i;
+    char *p = line;
+
+    while (*p != '\0' && argc < SHELL_ARGS_MAX)
+    {
+        while (*p == ' ' || *p == '\t')
+        {
+            *p++ = '\0';
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+        argv[argc++] = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t')
+        {
+            p++;
+        }
+    }
+    if (argc == 0)
+    {
+        return;
+    }
+    for (i = 0; i < sizeof(shell_cmds) / sizeof(shell_cmds[0]); i++)
+    {
+        if (strcmp(argv[0], shell_cmds[i].name) == 0)
+        {
+            shell_cmds[i].func(argc, argv);
+            return;
+        }
+    }
+    SHELL_Printf("unknown command: %s, try help\r\n", argv[0]);
+}
+
+/* 处理一个输入字符 */
+static void SHELL_Input(char ch)
+{
+    static char last = 0;
+
+    if (ch == '\n' && last == '\r')
+    {
+        last = ch;
+        return; // \r\n只算一次回车
+    }
+    last = ch;
+
+    if (ch == '\r' || ch == '\n')
+    {
+        if (SHELL_ECHO)
+        {
+            SHELL_Write("\r\n", 2);
+        }
+        shell_line[shell_line_len] = '\0';
+        SHELL_Execute(shell_line);
+        shell_line_len = 0;
+        SHELL_Write(SHELL_PROMPT, sizeof(SHELL_PROMPT) - 1);
+    }
+    else if (ch == '\b' || ch == 0x7F)
+    {
+        if (shell_line_len > 0)
+        {
+            shell_line_len--;
+            if (SHELL_ECHO)
+            {
+                SHELL_Write("\b \b", 3);
+            }
+        }
+    }
+    else if (ch >= ' ' && ch <= '~' && shell_line_len < SHELL_LINE_MAX)
+    {
+        shell_line[shell_line_len++] = ch;
+        if (SHELL_ECHO)
+        {
+            SHELL_Write(&ch, 1);
+        }
+    }
+}
+
+static void SHELL_Task(void *argument)
+{
+    uint16_t head;
+
+    SHELL_Write(SHELL_PROMPT, sizeof(SHELL_PROMPT) - 1);
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // DMA循环接收,剩余计数换算成写入位置
+        head = (uint16_t)(SHELL_RX_SIZE - __HAL_DMA_GET_COUNTER(&hdma_usart1_rx));
+        if (head >= SHELL_RX_SIZE)
+        {
+            head = 0;
+        }
+        while (shell_rx_tail != head)
+        {
+            SHELL_Input((char)shell_rx_buf[shell_rx_tail]);
+            shell_rx_tail = (uint16_t)((shell_rx_tail + 1U) % SHELL_RX_SIZE);
+        }
+    }
+}
+
+/* 启动DMA循环接收,空闲中断/半满/全满都会产生接收事件 */
+static void SHELL_StartReceive(void)
+{
+    shell_rx_tail = 0;
+    if (HAL_UARTEx_ReceiveToIdle_DMA(&huart1, shell_rx_buf, SHELL_RX_SIZE) != HAL_OK)
+    {
+        LOG_ERR("shell rx start failed\r\n");
+    }
+}
+
+/**
+ * @brief  初始化USART1接收DMA,UART_Init之后调用
+ */
+void SHELL_Init(void)
+{
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    hdma_usart1_rx.Instance = DMA2_Stream2;                     // USART1_RX: DMA2 Stream2
+    hdma_usart1_rx.Init.Channel = DMA_CHANNEL_4;                // 通道4
+    hdma_usart1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;       // 外设到存储器
+    hdma_usart1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_usart1_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_usart1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart1_rx.Init.Mode = DMA_CIRCULAR;                    // 循环接收,不需要重新启动
+    hdma_usart1_rx.Init.Priority = DMA_PRIORITY_LOW;
+    hdma_usart1_rx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if (HAL_DMA_Init(&hdma_usart1_rx) != HAL_OK)
+    {
+        Error_Handler();
+    }
+    __HAL_LINKDMA(&huart1, hdmarx, hdma_usart1_rx);
+
+    HAL_NVIC_SetPriority(DMA2_Stream2_IRQn, SHELL_IRQ_PRIORITY_DMA_USART1_RX, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream2_IRQn);
+    HAL_NVIC_SetPriority(USART1_IRQn, LOG_IRQ_PRIORITY_USART1, 0);
+    HAL_NVIC_EnableIRQ(USART1_IRQn);
+
+    SHELL_StartReceive();
+}
+
+/**
+ * @brief  接收事件回调(中断中),由HAL_UARTEx_RxEventCallback调用
+ */
+void SHELL_RxEventCallback(void)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if (shellTaskHandle != NULL)
+    {
+        vTaskNotifyGiveFromISR(shellTaskHandle, &xHigherPriorityTaskWoken);
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    }
+}
+
+/**
+ * @brief  接收错误回调,DMA接收被错误中止后重新启动,由HAL_UART_ErrorCallback调用
+ */
+void SHELL_RxErrorCallback(void)
+{
+    if (huart1.RxState == HAL_UART_STATE_READY)
+    {
+        SHELL_StartReceive();
+    }
+}
+
+void SHELL_CreateTask(void)
+{
+    if (xTaskCreate(SHELL_Task, "ShellTask", STACK_SIZE_SHELL, NULL, TASK_PRIORITY_SHELL, &shellTaskHandle) != pdPASS)
+    {
+        Error_Handler(); /* 堆不够 */
+    }
+}
+
+// DMA中断服务函数
+void DMA2_Stream2_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdma_usart1_rx);
+}
+
+#else /* !SHELL_ENABLE */
+
+void SHELL_Init(void)
+{
+}
+
+void SHELL_CreateTask(void)
+{
+}
+
+void SHELL_RxEventCallback(void)
+{
+}
+
+void SHELL_RxErrorCallback(void)
+{
+}
+
+#endif /* SHELL_ENABLE */
@@ -0,0 +1,44 @@
+/**
+  ******************************************************************************
+  * @file    shell.h
+  * @author  cyytx
+  * @brief   调试shell的头文件,USART1接收(DMA+空闲中断)命令行,
+  *          查看任务/堆/栈/驱动统计,运行LCD、SD卡、NFC基准测试
+  ******************************************************************************
+  */
+
+#ifndef __SHELL_H
+#define __SHELL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+#include "hard_enable_ctrl.h"
+
+#define SHELL_RX_SIZE           256     /* DMA循环接收缓冲区大小 */
+#define SHELL_LINE_MAX          80      /* 一行命令最大长度 */
+#define SHELL_ARGS_MAX          8       /* 一行命令最多参数个数(含命令名) */
+#define SHELL_OUT_TIMEOUT       500     /* 日志缓冲区满时等待的最长时间(ms) */
+
+/* 命令处理函数,argv[0]为命令名 */
+typedef void (*SHELL_CmdFunc)(int argc, char *argv[]);
+
+typedef struct {
+    const char *name;       /* 命令名 */
+    const char *help;       /* 帮助信息 */
+    SHELL_CmdFunc func;     /* 处理函数 */
+} SHELL_Cmd_t;
+
+void SHELL_Init(void);
+void SHELL_CreateTask(void);
+void SHELL_Printf(const char *fmt, ...);
+void SHELL_RxEventCallback(void);
+void SHELL_RxErrorCallback(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SHELL_H */
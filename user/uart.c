@@ -4,6 +4,9 @@
 #include "uart.h"
 #include "fingerprint.h"
 #include "face.h"
+#include "log.h"
+#include "rtc.h"
+#include "shell.h"
 
 #if (__ARMCC_VERSION >= 6010050)            /* 使用AC6编译器时 */
  __asm(".global __use_no_semihosting\n\t");  /* 声明不使用半主机模式 */
@@ -61,11 +64,10 @@ void _ttywrch(int ch)
 //     }
 //     return ch;
 // }
+// printf输出交给日志模块:LOG_Init之前和异常处理中轮询发送,之后写入环形缓冲区由DMA发送
 int fputc(int ch, FILE *f)
 { 	
-	while((USART1->ISR&0X40)==0);//循环发送,直到发送完毕   
-	USART1->TDR=(uint8_t)ch;      
-	return ch;
+	return LOG_PutChar(ch);
 }
 
 // UART 句柄
@@ -88,7 +90,7 @@ void UART_Init(void)
     huart1.Init.WordLength = UART_WORDLENGTH_8B;
     huart1.Init.StopBits = UART_STOPBITS_1;
     huart1.Init.Parity = UART_PARITY_NONE;
-    huart1.Init.Mode = UART_MODE_TX;
+    huart1.Init.Mode = UART_MODE_TX_RX;     // 接收用于调试shell
     huart1.Init.HwFlowCtl = UART_HWCONTROL_NONE;
     huart1.Init.OverSampling = UART_OVERSAMPLING_16;
     huart1.Init.OneBitSampling = UART_ONE_BIT_SAMPLE_DISABLE;
@@ -145,4 +147,116 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
     }
 }
 
-#endif /* DEBUG_UART_ENABLE */ 
\ No newline at end of file
+/**
+  * @brief  接收事件回调函数(空闲中断或DMA半满/全满)
+  * @param  huart: UART句柄指针
+  * @param  Size: 接收缓冲区中已收到数据的位置
+  * @retval 无
+  */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+    if (huart->Instance == USART1)
+    {
+        /* UART1 DMA接收 - 调试shell */
+        SHELL_RxEventCallback();
+    }
+}
+
+/**
+  * @brief  UART发送完成回调函数
+  * @param  huart: UART句柄指针
+  * @retval 无
+  */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    if (huart->Instance == USART1)
+    {
+        /* UART1 DMA发送完成 - 日志模块继续发送 */
+        LOG_TxCpltCallback();
+    }
+}
+
+/**
+  * @brief  UART错误回调函数
+  * @param  huart: UART句柄指针
+  * @retval 无
+  */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+    if (huart->Instance == USART1)
+    {
+        if (huart->gState == HAL_UART_STATE_READY)
+        {
+            /* UART1 DMA发送被错误中止 - 日志模块重新启动发送 */
+            LOG_TxErrorCallback();
+        }
+        /* UART1 DMA接收被错误中止 - 调试shell重新启动接收 */
+        SHELL_RxErrorCallback();
+    }
+    else if (huart->Instance == UART4)
+    {
+        /* 溢出错误会中止中断接收,指纹模块重新启动接收 */
+        Fingerprint_ErrorCallback();
+    }
+    else if (huart->Instance == UART5)
+    {
+        /* 溢出错误会中止中断接收,人脸模块重新启动接收 */
+        FACE_ErrorCallback();
+    }
+}
+
+// USART1中断服务函数,日志DMA发送完成后由TC中断结束传输
+void USART1_IRQHandler(void)
+{
+    HAL_UART_IRQHandler(&huart1);
+}
+
+#endif /* DEBUG_UART_ENABLE */
+
+/* 以下波特率协商函数给指纹和人脸模块用,不受调试串口开关影响 */
+
+/**
+  * @brief  修改串口波特率,用于和外设模块协商通信速率
+  * @param  huart: UART句柄指针,必须已经初始化过
+  * @param  baud: 新的波特率
+  * @retval HAL_OK: 成功
+  * @note   会中止正在进行的中断接收,调用者需要重新启动接收
+  */
+HAL_StatusTypeDef UART_SetBaudRate(UART_HandleTypeDef *huart, uint32_t baud)
+{
+    HAL_UART_AbortReceive(huart);
+    huart->Init.BaudRate = baud;
+    // gState不是RESET,HAL_UART_Init不会再调用MspInit,只重新配置寄存器
+    return HAL_UART_Init(huart);
+}
+
+/* 备份寄存器中波特率的标志,高8位为标志,低24位为波特率 */
+#define UART_BAUD_BKP_MAGIC     0xBA000000U
+#define UART_BAUD_BKP_MASK      0x00FFFFFFU
+
+/**
+  * @brief  读取上次协商好的波特率
+  * @param  bkp_index: 备份寄存器编号,见rtc.h
+  * @param  default_baud: 没有保存过时返回的波特率
+  * @retval 波特率
+  */
+uint32_t UART_LoadBaudRate(uint32_t bkp_index, uint32_t default_baud)
+{
+    uint32_t value = RTC_BkpRead(bkp_index);
+
+    if ((value & ~UART_BAUD_BKP_MASK) != UART_BAUD_BKP_MAGIC || (value & UART_BAUD_BKP_MASK) == 0)
+    {
+        return default_baud;
+    }
+    return value & UART_BAUD_BKP_MASK;
+}
+
+/**
+  * @brief  保存协商好的波特率,重启后先用这个波特率连接
+  * @param  bkp_index: 备份寄存器编号,见rtc.h
+  * @param  baud: 波特率
+  */
+void UART_SaveBaudRate(uint32_t bkp_index, uint32_t baud)
+{
+    RTC_BkpWrite(bkp_index, UART_BAUD_BKP_MAGIC | (baud & UART_BAUD_BKP_MASK));
+}
@@ -18,6 +18,11 @@ int fputc(int ch, FILE *f);
 void UART_Mutex_Init(void);
 #endif /* DEBUG_UART_ENABLE */
 
+/* 外设模块波特率协商,指纹和人脸模块使用 */
+HAL_StatusTypeDef UART_SetBaudRate(UART_HandleTypeDef *huart, uint32_t baud);
+uint32_t UART_LoadBaudRate(uint32_t bkp_index, uint32_t default_baud);
+void UART_SaveBaudRate(uint32_t bkp_index, uint32_t baud);
+
 #ifdef __cplusplus
 }
 #endif